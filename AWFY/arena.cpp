@@ -0,0 +1,89 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "include/arena.hpp"
+
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+
+namespace awfy {
+
+const size_t QueryArena::chunkSize;
+const size_t QueryArena::maxAlignment;
+bool QueryArena::hugePages=false;
+
+QueryArena::QueryArena() : current(0), used(0), systemAllocations(0) {
+}
+
+QueryArena::~QueryArena() {
+   for(const auto& chunk : chunks) {
+      free(chunk.data);
+   }
+}
+
+QueryArena& QueryArena::local() {
+   static __thread QueryArena* arena=nullptr;
+   if(unlikely(arena==nullptr)) {
+      arena=new QueryArena(); // Lives as long as the thread, the workers are not joined before exit
+   }
+   return *arena;
+}
+
+void QueryArena::useHugePages(bool enable) {
+   hugePages=enable;
+}
+
+void* QueryArena::allocateChunk(size_t size) {
+   void* data;
+   const size_t alignment=hugePages ? chunkSize : maxAlignment;
+   if(posix_memalign(&data, alignment, size)!=0) {
+      throw std::bad_alloc();
+   }
+   #ifdef MADV_HUGEPAGE
+   if(hugePages) {
+      madvise(data, size, MADV_HUGEPAGE);
+   }
+   #endif
+   systemAllocations++;
+   return data;
+}
+
+void* QueryArena::allocateSlow(size_t size) {
+   // The current chunk is full, continue in the first later chunk that fits
+   size_t next=current<chunks.size() ? current+1 : 0;
+   while(next<chunks.size() && chunks[next].size<size) {
+      next++;
+   }
+   if(next==chunks.size()) {
+      const size_t chunk=size<=chunkSize ? chunkSize : (size+chunkSize-1)&~(chunkSize-1);
+      chunks.push_back(Chunk { reinterpret_cast<char*>(allocateChunk(chunk)), chunk });
+   }
+   // Chunks that were skipped stay unused until the arena is rewound before them
+   current=next;
+   used=size;
+   return chunks[current].data;
+}
+
+size_t QueryArena::capacity() const {
+   size_t size=0;
+   for(const auto& chunk : chunks) {
+      size+=chunk.size;
+   }
+   return size;
+}
+
+}
@@ -0,0 +1,169 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include "query1.hpp"
+#include "query2.hpp"
+#include "include/indexes.hpp"
+#include "include/queryfiles.hpp"
+#include "include/concurrent/scheduler.hpp"
+#include "include/concurrent/thread.hpp"
+#include "include/runtime.hpp"
+#include "include/schedulegraph.hpp"
+#include "include/executioncommons.hpp"
+#include "include/util/chrono.hpp"
+#include "include/util/log.hpp"
+
+// Edge checks and latency of the queue BFS and the direction optimizing BFS for the
+// query 1 and query 2 entries of a query file. Both variants answer every query on
+// the same indexes, differing answers are reported as mismatches.
+
+const uint32_t hardwareThreads=std::thread::hardware_concurrency();
+
+/// Parses the queries but keeps the query tasks from running them
+struct ParseBatchesIgnored {
+   queryfiles::QueryBatcher& batches;
+
+   ParseBatchesIgnored(queryfiles::QueryBatcher& batches, bool* /*excludes*/)
+      : batches(batches)
+   { }
+
+   void operator()() {
+      batches.parse();
+      auto queryList=batches.getQueryList();
+      for(auto queryIter=queryList.begin(); queryIter!=queryList.end(); queryIter++) {
+         (*queryIter)->ignore=true;
+      }
+   }
+};
+
+struct BFSStats {
+   uint64_t queries;
+   uint64_t edgeChecks;
+   awfy::chrono::Time duration;
+   uint64_t mismatches;
+
+   BFSStats() : queries(0), edgeChecks(0), duration(0), mismatches(0) {
+   }
+
+   void print(const char* query, const char* bfs) const {
+      std::cout<<query<<","<<bfs<<","<<queries<<","<<edgeChecks<<","<<duration<<","<<(queries>0?duration/queries:0)<<","<<mismatches<<std::endl;
+   }
+};
+
+struct CompareBFS {
+   queryfiles::QueryBatcher& batches;
+   FileIndexes& fileIndexes;
+
+   CompareBFS(queryfiles::QueryBatcher& batches, FileIndexes& fileIndexes)
+      : batches(batches), fileIndexes(fileIndexes)
+   { }
+
+   void operator()() {
+      fileIndexes.hybridBFS=false;
+      Query1::QueryRunner queue1(fileIndexes);
+      Query2::QueryRunner queue2(fileIndexes);
+      fileIndexes.hybridBFS=true;
+      Query1::QueryRunner hybrid1(fileIndexes);
+      Query2::QueryRunner hybrid2(fileIndexes);
+
+      BFSStats stats[2][2]; // [query][hybrid]
+      auto& personMapper=fileIndexes.personMapper;
+      auto queryList=batches.getQueryList();
+      for(auto queryIter=queryList.begin(); queryIter!=queryList.end(); queryIter++) {
+         const auto queryPtr=(*queryIter)->getQuery();
+         const auto queryType=reinterpret_cast<queryfiles::QueryParser::BaseQuery*>(queryPtr)->id;
+
+         if(queryType==queryfiles::QueryParser::Query1::QueryId) {
+            auto query=reinterpret_cast<queryfiles::QueryParser::Query1*>(queryPtr);
+            const PersonId p1=personMapper.map(query->p1);
+            const PersonId p2=personMapper.map(query->p2);
+
+            auto start=awfy::chrono::now();
+            const int queueResult=queue1.query(p1, p2, query->x);
+            stats[0][0].duration+=awfy::chrono::now()-start;
+            start=awfy::chrono::now();
+            const int hybridResult=hybrid1.query(p1, p2, query->x);
+            stats[0][1].duration+=awfy::chrono::now()-start;
+
+            stats[0][0].queries++;
+            stats[0][1].queries++;
+            if(queueResult!=hybridResult) {
+               stats[0][1].mismatches++;
+               LOG_PRINT("[BFSBench] Query1 "<<query->p1<<" "<<query->p2<<" "<<query->x<<": "<<queueResult<<" vs "<<hybridResult);
+            }
+         } else if(queryType==queryfiles::QueryParser::Query2::QueryId) {
+            auto query=reinterpret_cast<queryfiles::QueryParser::Query2*>(queryPtr);
+
+            auto start=awfy::chrono::now();
+            const auto queueResult=queue2.query(query->k, query->year, query->month, query->day);
+            stats[1][0].duration+=awfy::chrono::now()-start;
+            start=awfy::chrono::now();
+            const auto hybridResult=hybrid2.query(query->k, query->year, query->month, query->day);
+            stats[1][1].duration+=awfy::chrono::now()-start;
+
+            stats[1][0].queries++;
+            stats[1][1].queries++;
+            if(queueResult!=hybridResult) {
+               stats[1][1].mismatches++;
+               LOG_PRINT("[BFSBench] Query2 "<<query->k<<" "<<query->year<<"-"<<(unsigned)query->month<<"-"<<(unsigned)query->day<<": "<<queueResult<<" vs "<<hybridResult);
+            }
+         }
+      }
+      stats[0][0].edgeChecks=queue1.getEdgeChecks();
+      stats[0][1].edgeChecks=hybrid1.getEdgeChecks();
+      stats[1][0].edgeChecks=queue2.getEdgeChecks();
+      stats[1][1].edgeChecks=hybrid2.getEdgeChecks();
+
+      std::cout<<"query,bfs,queries,edge_checks,us,us_per_query,mismatches"<<std::endl;
+      stats[0][0].print("q1", "queue");
+      stats[0][1].print("q1", "hybrid");
+      stats[1][0].print("q2", "queue");
+      stats[1][1].print("q2", "hybrid");
+   }
+};
+
+int main(int argc, char** argv) {
+   if(argc != 3) {
+      std::cerr<<"Usage: "<<argv[0]<<" <dataFolder> <queryFile>"<<std::endl;
+      return -1;
+   }
+   const std::string dataPath(argv[1]);
+   io::MmapedFile queryFile(argv[2], O_RDONLY);
+   bool excludes[4] = {false, false, true, true};
+
+   awfy::counters::ProgramCounters counters(hardwareThreads);
+   auto& threadCounts=counters.getThreadCounters();
+   threadCounts.initThread();
+   threadCounts.startTask(TaskGraph::Initialize);
+
+   Scheduler scheduler(counters, SchedulerKinds::GLOBAL_QUEUE, hardwareThreads);
+   ScheduleGraph taskGraph(scheduler);
+   queryfiles::QueryFileParser queries(queryFile);
+   queryfiles::QueryBatcher batches(queries);
+   FileIndexes fileIndexes;
+   runtime::QueryState queryState(taskGraph, scheduler, fileIndexes);
+
+   // The comparison runs once the indexes of query 1 and 2 are complete
+   initScheduleGraph<CompareBFS, ParseBatchesIgnored>(scheduler, taskGraph, fileIndexes, dataPath, batches, queryState, excludes,
+      CompareBFS(batches, fileIndexes));
+   taskGraph.eraseNotUsedEdges();
+
+   executeTaskGraph(hardwareThreads, scheduler, counters, threadCounts);
+   return 0;
+}
@@ -0,0 +1,162 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "include/birthdaycomponents.hpp"
+
+#include <unordered_map>
+
+namespace awfy {
+
+namespace {
+
+/// Union-find over all (person, interest) pairs, a person owns one node per entry of its interest list
+class InterestUnionFind {
+   std::vector<uint32_t> parent;
+   std::vector<uint32_t> size; // Only valid for roots
+
+public:
+   InterestUnionFind(size_t numNodes) : parent(numNodes), size(numNodes, 1) {
+      for(size_t i=0; i<numNodes; i++) {
+         parent[i]=i;
+      }
+   }
+
+   uint32_t find(uint32_t node) {
+      while(parent[node]!=node) {
+         parent[node]=parent[parent[node]];
+         node=parent[node];
+      }
+      return node;
+   }
+
+   /// Returns the size of the merged component
+   uint32_t merge(uint32_t a, uint32_t b) {
+      a=find(a);
+      b=find(b);
+      if(a==b) {
+         return size[a];
+      }
+      if(size[a]<size[b]) {
+         std::swap(a,b);
+      }
+      parent[b]=a;
+      size[a]+=size[b];
+      return size[a];
+   }
+};
+
+}
+
+BirthdayComponentIndex::BirthdayComponentIndex(const PersonGraph& personGraph, const Birthday* birthdays, const HasInterestIndex& interests,
+   const InterestStatistics& interestStats, uint32_t numPersons)
+{
+   // Dense interest numbers in the order of the statistics
+   std::unordered_map<InterestId,uint32_t> interestNumbers;
+   for(uint32_t i=0; i<interestStats.size(); i++) {
+      interestNumbers[interestStats[i].interest]=i;
+   }
+
+   std::vector<uint32_t> firstNode(numPersons+1);
+   for(PersonId person=0; person<numPersons; person++) {
+      const auto list=interests.retrieve(person);
+      firstNode[person+1]=firstNode[person]+(list==nullptr ? 0 : list->size());
+   }
+   InterestUnionFind components(firstNode[numPersons]);
+
+   std::vector<PersonId> order(numPersons);
+   for(PersonId person=0; person<numPersons; person++) {
+      order[person]=person;
+   }
+   std::stable_sort(order.begin(), order.end(), [birthdays](PersonId a, PersonId b) { return birthdays[a]>birthdays[b]; });
+
+   std::vector<std::vector<Step>> interestSteps(interestStats.size());
+   std::vector<uint32_t> maxComponents(interestStats.size(), 0);
+   std::vector<uint32_t> changed; // Interests whose largest component grew in the current birthday
+   std::vector<bool> isChanged(interestStats.size(), false);
+   std::vector<bool> added(numPersons, false);
+
+   auto grow=[&](uint32_t interest, uint32_t componentSize) {
+      if(componentSize>maxComponents[interest]) {
+         if(!isChanged[interest]) {
+            isChanged[interest]=true;
+            changed.push_back(interest);
+         }
+         maxComponents[interest]=componentSize;
+      }
+   };
+
+   // Persons with the same birthday are added together, the steps are taken once all of them are in
+   for(size_t pos=0; pos<numPersons; ) {
+      const Birthday birthday=birthdays[order[pos]];
+      for(; pos<numPersons && birthdays[order[pos]]==birthday; pos++) {
+         const PersonId person=order[pos];
+         added[person]=true;
+         const auto personInterests=interests.retrieve(person);
+         if(personInterests==nullptr || personInterests->size()==0) { continue; }
+         const InterestId* personBegin=personInterests->bounds().first;
+         const InterestId* personEnd=personBegin+personInterests->size();
+
+         for(auto interest=personBegin; interest!=personEnd; interest++) {
+            grow(interestNumbers[*interest], 1);
+         }
+
+         const auto friends=personGraph.retrieve(person);
+         if(friends==nullptr) { continue; }
+         auto friendBounds=friends->bounds();
+         for(; friendBounds.first!=friendBounds.second; friendBounds.first++) {
+            const PersonId friendId=*friendBounds.first;
+            if(!added[friendId] || friendId==person) { continue; }
+            const auto friendInterests=interests.retrieve(friendId);
+            if(friendInterests==nullptr) { continue; }
+            const InterestId* friendBegin=friendInterests->bounds().first;
+            const InterestId* friendEnd=friendBegin+friendInterests->size();
+
+            // Both lists are sorted, merge every shared interest
+            const InterestId* a=personBegin;
+            const InterestId* b=friendBegin;
+            while(a!=personEnd && b!=friendEnd) {
+               if(*a<*b) {
+                  a++;
+               } else if(*b<*a) {
+                  b++;
+               } else {
+                  const uint32_t componentSize=components.merge(firstNode[person]+(a-personBegin), firstNode[friendId]+(b-friendBegin));
+                  grow(interestNumbers[*a], componentSize);
+                  a++;
+                  b++;
+               }
+            }
+         }
+      }
+
+      for(auto interest : changed) {
+         interestSteps[interest].push_back(Step { birthday, maxComponents[interest] });
+         isChanged[interest]=false;
+      }
+      changed.clear();
+   }
+
+   entries.reserve(interestStats.size());
+   for(uint32_t i=0; i<interestStats.size(); i++) {
+      if(interestSteps[i].empty()) { continue; }
+      entries.push_back(Entry { interestStats[i].interest, maxComponents[i], static_cast<uint32_t>(steps.size()),
+         static_cast<uint32_t>(interestSteps[i].size()) });
+      steps.insert(steps.end(), interestSteps[i].begin(), interestSteps[i].end());
+   }
+   std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.maxComponent>b.maxComponent; });
+}
+
+}
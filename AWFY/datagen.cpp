@@ -0,0 +1,711 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include "include/env.hpp"
+
+// Writes a data set in the layout of the contest data, at any number of persons, together with a query file.
+//
+// Persons are grouped into communities of equal size, each community gets a home country and a few favourite
+// tags. Person ids are a random permutation of the community slots, so the file order carries no locality.
+// Friendships follow the Chung-Lu model: every person draws a target degree from a power law and connects
+// to partners chosen in proportion to their target degree, inside the own community or, with the mixing
+// probability, anywhere. Comments are written as reply threads: a person starts a thread and friends answer,
+// picked in proportion to a symmetric friendship strength whose tail grows with the reply skew, so that a few
+// friends of every person collect most mutual replies. All comments of a thread are consecutive, a reply is
+// at most maxThreadLength comments behind its parent like in the contest data.
+//
+// Everything is generated in blocks with their own random generator, so the output depends on the seed but
+// not on the number of threads.
+
+namespace {
+
+struct Config {
+   std::string folder;
+   uint32_t persons;
+   uint64_t seed;
+   double degree; // Mean number of friends
+   double alpha; // Exponent of the degree distribution
+   uint32_t community; // Persons per community
+   double mixing; // Share of friendships across communities
+   double comments; // Mean comments per person
+   double replySkew; // 0 spreads the replies evenly over the friends
+   uint32_t queries;
+   uint32_t mix[4]; // Weights of the query types
+   uint32_t threads;
+};
+
+const uint32_t blockSize=1<<12;
+const uint32_t maxThreadLength=64;
+const double threadReplies=4; // Mean replies per thread
+const uint32_t tagsPerCommunity=8;
+const char* continents[]={ "Africa", "Asia", "Europe", "North_America", "Oceania", "South_America" };
+const uint32_t numContinents=6;
+
+inline uint64_t mix64(uint64_t x) {
+   x+=0x9E3779B97F4A7C15ull;
+   x=(x^(x>>30))*0xBF58476D1CE4E5B9ull;
+   x=(x^(x>>27))*0x94D049BB133111EBull;
+   return x^(x>>31);
+}
+
+/// Generator of one block, salt separates the generators of different files
+std::mt19937_64 blockRandom(const Config& config, uint32_t salt, uint64_t block) {
+   return std::mt19937_64(mix64(config.seed^(static_cast<uint64_t>(salt)<<48)^block));
+}
+
+/// Uniform in [0,1)
+inline double uniform(std::mt19937_64& random) {
+   return (random()>>11)*(1.0/9007199254740992.0);
+}
+
+inline uint64_t uniformInt(std::mt19937_64& random, uint64_t bound) {
+   return static_cast<uint64_t>(uniform(random)*bound);
+}
+
+/// Rounds randomly so that the expected value is kept
+inline uint64_t roundRandom(std::mt19937_64& random, double value) {
+   const double base=std::floor(value);
+   return static_cast<uint64_t>(base)+(uniform(random)<value-base ? 1 : 0);
+}
+
+/// Number of failures before the first success, the mean is given
+inline uint64_t geometric(std::mt19937_64& random, double mean) {
+   if(mean<=0) { return 0; }
+   return static_cast<uint64_t>(std::log(1-uniform(random))/std::log(mean/(1+mean)));
+}
+
+/// Samples ranks 0..n-1 with a probability proportional to 1/(rank+1)^exponent
+class ZipfSampler {
+   std::vector<double> prefix;
+
+public:
+   ZipfSampler(uint32_t n, double exponent) : prefix(n) {
+      double sum=0;
+      for(uint32_t rank=0; rank<n; rank++) {
+         sum+=std::pow(rank+1, -exponent);
+         prefix[rank]=sum;
+      }
+   }
+
+   uint32_t operator()(std::mt19937_64& random) const {
+      const double value=uniform(random)*prefix.back();
+      return std::min<size_t>(std::upper_bound(prefix.begin(), prefix.end(), value)-prefix.begin(), prefix.size()-1);
+   }
+};
+
+/// Calls fn for every item on the given number of threads
+template<class Fn>
+void parallelFor(uint32_t threads, uint64_t count, Fn fn) {
+   std::atomic<uint64_t> next(0);
+   std::vector<std::thread> workers;
+   for(uint32_t t=0; t<threads; t++) {
+      workers.emplace_back([&]() {
+         for(uint64_t item=next.fetch_add(1); item<count; item=next.fetch_add(1)) {
+            fn(item);
+         }
+      });
+   }
+   for(auto& worker : workers) {
+      worker.join();
+   }
+}
+
+inline void append(std::string& out, uint64_t value) {
+   char digits[20];
+   int pos=20;
+   do {
+      digits[--pos]='0'+value%10;
+      value/=10;
+   } while(value>0);
+   out.append(digits+pos, 20-pos);
+}
+
+inline void appendRow(std::string& out, uint64_t a, uint64_t b) {
+   append(out, a);
+   out+='|';
+   append(out, b);
+   out+='\n';
+}
+
+inline void appendRow(std::string& out, uint64_t a, uint64_t b, uint64_t c) {
+   append(out, a);
+   out+='|';
+   append(out, b);
+   out+='|';
+   append(out, c);
+   out+='\n';
+}
+
+/// Writes csv files whose rows are produced per block, blocks are formatted in parallel rounds and written in order
+class BlockWriter {
+   const Config& config;
+   std::vector<FILE*> files;
+   std::vector<std::string> names;
+   uint64_t rows;
+
+public:
+   BlockWriter(const Config& config, std::initializer_list<std::pair<const char*, const char*>> fileHeaders) : config(config), rows(0) {
+      for(auto& fileHeader : fileHeaders) {
+         const std::string path=config.folder+fileHeader.first;
+         FILE* file=fopen(path.c_str(), "w");
+         if(file==nullptr) {
+            std::cerr<<"[DataGen] Could not open "<<path<<std::endl;
+            exit(EXIT_FAILURE);
+         }
+         fputs(fileHeader.second, file);
+         fputc('\n', file);
+         files.push_back(file);
+         names.push_back(fileHeader.first);
+      }
+   }
+
+   ~BlockWriter() {
+      for(auto file : files) {
+         fclose(file);
+      }
+      std::cerr<<"[DataGen] Wrote";
+      for(auto& name : names) {
+         std::cerr<<" "<<name;
+      }
+      std::cerr<<", "<<rows<<" rows"<<std::endl;
+   }
+
+   /// format(block, texts) appends the rows of the block to texts[i] for the i-th file
+   template<class Fn>
+   void write(uint64_t numBlocks, Fn format) {
+      const uint64_t roundSize=config.threads*4;
+      std::vector<std::vector<std::string>> texts(roundSize, std::vector<std::string>(files.size()));
+      for(uint64_t first=0; first<numBlocks; first+=roundSize) {
+         const uint64_t count=std::min(roundSize, numBlocks-first);
+         parallelFor(config.threads, count, [&](uint64_t i) {
+            for(auto& text : texts[i]) {
+               text.clear();
+            }
+            format(first+i, texts[i].data());
+         });
+         for(uint64_t i=0; i<count; i++) {
+            for(size_t f=0; f<files.size(); f++) {
+               fwrite(texts[i][f].data(), 1, texts[i][f].size(), files[f]);
+               rows+=std::count(texts[i][f].begin(), texts[i][f].end(), '\n');
+            }
+         }
+      }
+   }
+};
+
+inline uint64_t numBlocks(uint64_t count) {
+   return (count+blockSize-1)/blockSize;
+}
+
+struct Places {
+   uint32_t countries;
+   uint32_t citiesPerCountry;
+
+   Places(uint32_t persons)
+      : countries(std::max(10u, std::min(111u, persons/200))), citiesPerCountry(std::max(2u, std::min(12u, persons/(countries*100)))) {
+   }
+
+   uint32_t country(uint32_t i) const { return numContinents+i; }
+   uint32_t city(uint32_t i) const { return numContinents+countries+i; }
+   uint32_t cities() const { return countries*citiesPerCountry; }
+   uint32_t count() const { return numContinents+countries+cities(); }
+   /// Universities are located in cities, companies in countries
+   uint32_t universities() const { return cities(); }
+   uint32_t companies() const { return 3*countries; }
+};
+
+/// Friendships and the community of every person
+class SocialGraph {
+public:
+   const Config& config;
+   const uint32_t numCommunities;
+   std::vector<uint32_t> personOf; // Community slot -> person id
+   std::vector<uint32_t> slotOf;
+   std::vector<uint32_t> targetDegree; // By slot
+   std::vector<uint64_t> offsets; // By person id
+   std::vector<uint32_t> sizes;
+   std::vector<uint32_t> friends;
+
+   SocialGraph(const Config& config)
+      : config(config), numCommunities((config.persons+config.community-1)/config.community),
+        personOf(config.persons), slotOf(config.persons), targetDegree(config.persons) {
+      auto random=blockRandom(config, 0, 0);
+      for(uint32_t slot=0; slot<config.persons; slot++) {
+         personOf[slot]=slot;
+      }
+      for(uint32_t slot=config.persons-1; slot>0; slot--) {
+         std::swap(personOf[slot], personOf[uniformInt(random, slot+1)]);
+      }
+      for(uint32_t slot=0; slot<config.persons; slot++) {
+         slotOf[personOf[slot]]=slot;
+      }
+      build();
+   }
+
+   uint32_t communityOf(uint32_t person) const {
+      return slotOf[person]/config.community;
+   }
+
+   std::pair<const uint32_t*, const uint32_t*> friendsOf(uint32_t person) const {
+      const uint32_t* begin=friends.data()+offsets[person];
+      return std::make_pair(begin, begin+sizes[person]);
+   }
+
+   uint64_t numEdges() const {
+      uint64_t edges=0;
+      for(auto size : sizes) {
+         edges+=size;
+      }
+      return edges;
+   }
+
+private:
+   void build() {
+      // Pareto distributed target degrees with the configured mean, capped to keep the hubs plausible
+      const double minDegree=config.degree*(config.alpha-2)/(config.alpha-1);
+      const double maxDegree=std::min<double>(config.persons-1, std::max(10.0, 50*config.degree));
+      std::vector<double> prefix(config.persons+1);
+      parallelFor(config.threads, numBlocks(config.persons), [&](uint64_t block) {
+         auto random=blockRandom(config, 1, block);
+         for(uint64_t slot=block*blockSize; slot<std::min<uint64_t>((block+1)*blockSize, config.persons); slot++) {
+            const double degree=minDegree*std::pow(1-uniform(random), -1/(config.alpha-1));
+            targetDegree[slot]=roundRandom(random, std::min(degree, maxDegree));
+         }
+      });
+      for(uint32_t slot=0; slot<config.persons; slot++) {
+         prefix[slot+1]=prefix[slot]+targetDegree[slot];
+      }
+
+      // Every person opens half of its target degree, partners are weighted by their target degree
+      std::vector<std::vector<std::pair<uint32_t,uint32_t>>> edges(numBlocks(config.persons));
+      parallelFor(config.threads, edges.size(), [&](uint64_t block) {
+         auto random=blockRandom(config, 2, block);
+         auto& blockEdges=edges[block];
+         for(uint64_t slot=block*blockSize; slot<std::min<uint64_t>((block+1)*blockSize, config.persons); slot++) {
+            const uint64_t first=slot/config.community*config.community;
+            const uint64_t last=std::min<uint64_t>(first+config.community, config.persons);
+            const uint64_t stubs=roundRandom(random, targetDegree[slot]/2.0);
+            for(uint64_t stub=0; stub<stubs; stub++) {
+               const bool global=uniform(random)<config.mixing;
+               const uint64_t begin=global ? 0 : first;
+               const uint64_t end=global ? config.persons : last;
+               if(prefix[end]==prefix[begin]) { continue; }
+               const double value=prefix[begin]+uniform(random)*(prefix[end]-prefix[begin]);
+               uint64_t partner=std::upper_bound(prefix.begin()+begin+1, prefix.begin()+end+1, value)-prefix.begin()-1;
+               partner=std::min(partner, end-1);
+               if(partner==slot) { continue; }
+               blockEdges.push_back(std::make_pair(personOf[slot], personOf[partner]));
+            }
+         }
+      });
+
+      // Symmetric adjacency lists sorted by person id, duplicates are dropped
+      offsets.assign(config.persons+1, 0);
+      for(auto& blockEdges : edges) {
+         for(auto& edge : blockEdges) {
+            offsets[edge.first+1]++;
+            offsets[edge.second+1]++;
+         }
+      }
+      for(uint32_t person=0; person<config.persons; person++) {
+         offsets[person+1]+=offsets[person];
+      }
+      friends.resize(offsets[config.persons]);
+      std::vector<uint64_t> fill(offsets.begin(), offsets.end()-1);
+      for(auto& blockEdges : edges) {
+         for(auto& edge : blockEdges) {
+            friends[fill[edge.first]++]=edge.second;
+            friends[fill[edge.second]++]=edge.first;
+         }
+         std::vector<std::pair<uint32_t,uint32_t>>().swap(blockEdges);
+      }
+      sizes.resize(config.persons);
+      parallelFor(config.threads, numBlocks(config.persons), [&](uint64_t block) {
+         for(uint64_t person=block*blockSize; person<std::min<uint64_t>((block+1)*blockSize, config.persons); person++) {
+            const auto begin=friends.begin()+offsets[person];
+            const auto end=friends.begin()+offsets[person+1];
+            std::sort(begin, end);
+            sizes[person]=std::unique(begin, end)-begin;
+         }
+      });
+   }
+};
+
+/// Strength of the friendship of two persons in (0,1]^-skew, the same for both directions
+inline double strength(const Config& config, uint32_t a, uint32_t b) {
+   const uint64_t key=(static_cast<uint64_t>(std::min(a, b))<<32)|std::max(a, b);
+   const double u=((mix64(key^config.seed)>>11)+1)*(1.0/9007199254740992.0);
+   return std::pow(u, -config.replySkew);
+}
+
+inline uint32_t communityTag(const Config& config, uint32_t community, uint32_t i, uint32_t numTags) {
+   return mix64((static_cast<uint64_t>(community)<<8|i)^config.seed)%numTags;
+}
+
+inline uint32_t homeCountry(const Config& config, uint32_t community, const Places& places) {
+   return mix64(community^(config.seed<<1))%places.countries;
+}
+
+void writePersons(const Config& config, const SocialGraph& graph, const Places& places, uint32_t numTags, const ZipfSampler& tagPopularity) {
+   BlockWriter writer(config, {
+      { "person.csv", "id|firstName|lastName|gender|birthday|creationDate|locationIP|browserUsed" },
+      { "person_knows_person.csv", "Person.id|Person.id" },
+      { "person_hasInterest_tag.csv", "Person.id|Tag.id" },
+      { "person_isLocatedIn_place.csv", "Person.id|Place.id" },
+      { "person_studyAt_organisation.csv", "Person.id|Organisation.id|classYear" },
+      { "person_workAt_organisation.csv", "Person.id|Organisation.id|workFrom" } });
+   writer.write(numBlocks(config.persons), [&](uint64_t block, std::string* texts) {
+      auto random=blockRandom(config, 3, block);
+      std::vector<uint32_t> interests;
+      char date[16];
+      for(uint64_t person=block*blockSize; person<std::min<uint64_t>((block+1)*blockSize, config.persons); person++) {
+         const uint32_t community=graph.communityOf(person);
+         std::string& personText=texts[0];
+         append(personText, person);
+         personText+="|Name";
+         append(personText, uniformInt(random, 1000));
+         personText+="|Surname";
+         append(personText, uniformInt(random, 10000));
+         personText+=uniform(random)<0.5 ? "|male|" : "|female|";
+         snprintf(date, sizeof(date), "%04u-%02u-%02u", 1980+static_cast<unsigned>(uniformInt(random, 11)),
+            1+static_cast<unsigned>(uniformInt(random, 12)), 1+static_cast<unsigned>(uniformInt(random, 28)));
+         personText+=date;
+         personText+="|2010-01-01T00:00:00.000+0000|10.0.0.1|Firefox\n";
+
+         const auto personFriends=graph.friendsOf(person);
+         for(auto friendIter=personFriends.first; friendIter!=personFriends.second; friendIter++) {
+            appendRow(texts[1], person, *friendIter);
+         }
+
+         // Half of the interests are favourites of the community
+         interests.clear();
+         const uint64_t numInterests=std::min<uint64_t>(1+geometric(random, 4), numTags);
+         for(uint64_t i=0; i<numInterests; i++) {
+            interests.push_back(uniform(random)<0.5 ? communityTag(config, community, uniformInt(random, tagsPerCommunity), numTags) : tagPopularity(random));
+         }
+         std::sort(interests.begin(), interests.end());
+         interests.erase(std::unique(interests.begin(), interests.end()), interests.end());
+         for(auto tag : interests) {
+            appendRow(texts[2], person, tag);
+         }
+
+         const uint32_t country=uniform(random)<0.8 ? homeCountry(config, community, places) : uniformInt(random, places.countries);
+         const uint32_t city=country*places.citiesPerCountry+uniformInt(random, places.citiesPerCountry);
+         appendRow(texts[3], person, places.city(city));
+         // Universities are numbered like the cities, companies follow them
+         if(uniform(random)<0.6) {
+            appendRow(texts[4], person, 10*city, 2000+uniformInt(random, 14));
+         }
+         if(uniform(random)<0.7) {
+            const uint32_t company=places.universities()+country*3+uniformInt(random, 3);
+            appendRow(texts[5], person, 10*company, 2000+uniformInt(random, 14));
+         }
+      }
+   });
+}
+
+void writePlaces(const Config& config, const Places& places) {
+   BlockWriter writer(config, {
+      { "place.csv", "id|name|url|type" },
+      { "place_isPartOf_place.csv", "Place.id|Place.id" },
+      { "organisation_isLocatedIn_place.csv", "Organisation.id|Place.id" } });
+   writer.write(1, [&](uint64_t, std::string* texts) {
+      for(uint32_t continent=0; continent<numContinents; continent++) {
+         append(texts[0], continent);
+         texts[0]+=std::string("|")+continents[continent]+"|http://dbpedia.org/resource/"+continents[continent]+"|continent\n";
+      }
+      for(uint32_t country=0; country<places.countries; country++) {
+         const std::string name="Country_"+std::to_string(country);
+         append(texts[0], places.country(country));
+         texts[0]+="|"+name+"|http://dbpedia.org/resource/"+name+"|country\n";
+         appendRow(texts[1], places.country(country), country%numContinents);
+      }
+      for(uint32_t city=0; city<places.cities(); city++) {
+         const std::string name="City_"+std::to_string(city);
+         append(texts[0], places.city(city));
+         texts[0]+="|"+name+"|http://dbpedia.org/resource/"+name+"|city\n";
+         appendRow(texts[1], places.city(city), places.country(city/places.citiesPerCountry));
+      }
+      for(uint32_t university=0; university<places.universities(); university++) {
+         appendRow(texts[2], 10*university, places.city(university));
+      }
+      for(uint32_t company=0; company<places.companies(); company++) {
+         appendRow(texts[2], 10*(places.universities()+company), places.country(company/3));
+      }
+   });
+}
+
+void writeTags(const Config& config, uint32_t numTags) {
+   BlockWriter writer(config, { { "tag.csv", "id|name|url" } });
+   writer.write(numBlocks(numTags), [&](uint64_t block, std::string* texts) {
+      for(uint64_t tag=block*blockSize; tag<std::min<uint64_t>((block+1)*blockSize, numTags); tag++) {
+         append(texts[0], tag);
+         texts[0]+="|Tag_";
+         append(texts[0], tag);
+         texts[0]+="|http://dbpedia.org/resource/Tag_";
+         append(texts[0], tag);
+         texts[0]+='\n';
+      }
+   });
+}
+
+/// Forums of a community, most members and tags come from it; the sizes follow a power law
+void writeForums(const Config& config, const SocialGraph& graph, uint32_t numForums, uint32_t numTags, const ZipfSampler& tagPopularity) {
+   BlockWriter writer(config, {
+      { "forum_hasTag_tag.csv", "Forum.id|Tag.id" },
+      { "forum_hasMember_person.csv", "Forum.id|Person.id|joinDate" } });
+   const double maxMembers=std::min<double>(config.persons, 2000);
+   writer.write(numBlocks(numForums), [&](uint64_t block, std::string* texts) {
+      auto random=blockRandom(config, 4, block);
+      std::vector<uint32_t> members;
+      for(uint64_t forum=block*blockSize; forum<std::min<uint64_t>((block+1)*blockSize, numForums); forum++) {
+         const uint32_t community=uniformInt(random, graph.numCommunities);
+         const uint64_t forumId=10*forum;
+         const uint64_t numForumTags=1+uniformInt(random, 3);
+         std::vector<uint32_t> tags;
+         for(uint64_t i=0; i<numForumTags; i++) {
+            tags.push_back(uniform(random)<0.6 ? communityTag(config, community, uniformInt(random, tagsPerCommunity), numTags) : tagPopularity(random));
+         }
+         std::sort(tags.begin(), tags.end());
+         tags.erase(std::unique(tags.begin(), tags.end()), tags.end());
+         for(auto tag : tags) {
+            appendRow(texts[0], forumId, tag);
+         }
+
+         // Pareto with mean 20
+         const uint64_t numMembers=std::min(maxMembers, 10*std::pow(1-uniform(random), -0.5));
+         const uint64_t first=static_cast<uint64_t>(community)*config.community;
+         const uint64_t size=std::min<uint64_t>(config.community, config.persons-first);
+         members.clear();
+         for(uint64_t i=0; i<numMembers; i++) {
+            const uint64_t slot=uniform(random)<0.85 ? first+uniformInt(random, size) : uniformInt(random, config.persons);
+            members.push_back(graph.personOf[slot]);
+         }
+         std::sort(members.begin(), members.end());
+         members.erase(std::unique(members.begin(), members.end()), members.end());
+         for(auto member : members) {
+            append(texts[1], forumId);
+            texts[1]+='|';
+            append(texts[1], member);
+            texts[1]+="|2010-01-01T00:00:00.000+0000\n";
+         }
+      }
+   });
+}
+
+struct CommentRecord {
+   uint32_t creator;
+   int32_t parent; // Index of the parent in the block, -1 if the comment replies to a post
+};
+
+/// Reply threads started by the persons of a block, the comments of a thread are consecutive
+void generateComments(const Config& config, const SocialGraph& graph, uint64_t block, std::vector<CommentRecord>& records) {
+   auto random=blockRandom(config, 5, block);
+   const double averageDegree=static_cast<double>(graph.friends.size())/config.persons;
+   std::vector<double> weights;
+   records.clear();
+   for(uint64_t person=block*blockSize; person<std::min<uint64_t>((block+1)*blockSize, config.persons); person++) {
+      const auto personFriends=graph.friendsOf(person);
+      const uint32_t degree=personFriends.second-personFriends.first;
+      weights.clear();
+      double sum=0;
+      for(auto friendIter=personFriends.first; friendIter!=personFriends.second; friendIter++) {
+         sum+=strength(config, person, *friendIter);
+         weights.push_back(sum);
+      }
+
+      // Persons with more friends write more
+      const double threads=config.comments/(1+threadReplies)*(1+degree)/(1+averageDegree);
+      for(uint64_t thread=roundRandom(random, threads); thread>0; thread--) {
+         const int32_t start=records.size();
+         records.push_back(CommentRecord { static_cast<uint32_t>(person), -1 });
+         if(degree==0) { continue; }
+         int32_t lastByStarter=start;
+         int32_t lastByOther=-1;
+         const uint64_t length=1+std::min<uint64_t>(geometric(random, threadReplies), maxThreadLength-1);
+         for(uint64_t reply=1; reply<length; reply++) {
+            const int32_t index=records.size();
+            if(lastByOther>=0 && uniform(random)<0.5) {
+               // The starter answers the last reply
+               records.push_back(CommentRecord { static_cast<uint32_t>(person), lastByOther });
+               lastByStarter=index;
+            } else {
+               const uint32_t pos=std::min<size_t>(std::upper_bound(weights.begin(), weights.end(), uniform(random)*sum)-weights.begin(), degree-1);
+               const int32_t parent=uniform(random)<0.7 ? lastByStarter : start+uniformInt(random, index-start);
+               records.push_back(CommentRecord { personFriends.first[pos], parent });
+               lastByOther=index;
+            }
+         }
+      }
+   }
+}
+
+void writeComments(const Config& config, const SocialGraph& graph) {
+   // Comment ids continue across blocks, so the blocks are counted before they are written
+   const uint64_t blocks=numBlocks(config.persons);
+   std::vector<uint64_t> firstComment(blocks+1);
+   parallelFor(config.threads, blocks, [&](uint64_t block) {
+      std::vector<CommentRecord> records;
+      generateComments(config, graph, block, records);
+      firstComment[block+1]=records.size();
+   });
+   for(uint64_t block=0; block<blocks; block++) {
+      firstComment[block+1]+=firstComment[block];
+   }
+
+   BlockWriter writer(config, {
+      { "comment_hasCreator_person.csv", "Comment.id|Person.id" },
+      { "comment_replyOf_comment.csv", "Comment.id|Comment.id" } });
+   writer.write(blocks, [&](uint64_t block, std::string* texts) {
+      std::vector<CommentRecord> records;
+      generateComments(config, graph, block, records);
+      const uint64_t base=firstComment[block];
+      for(size_t i=0; i<records.size(); i++) {
+         appendRow(texts[0], 10*(base+i), records[i].creator);
+         if(records[i].parent>=0) {
+            appendRow(texts[1], 10*(base+i), 10*(base+records[i].parent));
+         }
+      }
+   });
+}
+
+/// Query1 pairs are within two hops for half of the queries, Query4 prefers popular tags
+void writeQueries(const Config& config, const SocialGraph& graph, const Places& places, const ZipfSampler& tagPopularity) {
+   const std::string path=config.folder+"queries.txt";
+   FILE* file=fopen(path.c_str(), "w");
+   if(file==nullptr) {
+      std::cerr<<"[DataGen] Could not open "<<path<<std::endl;
+      exit(EXIT_FAILURE);
+   }
+   auto random=blockRandom(config, 6, 0);
+   const uint32_t totalWeight=config.mix[0]+config.mix[1]+config.mix[2]+config.mix[3];
+   uint32_t counts[4]={ 0, 0, 0, 0 };
+   for(uint32_t query=0; query<config.queries && totalWeight>0; query++) {
+      uint32_t type=0;
+      for(uint64_t value=uniformInt(random, totalWeight); value>=config.mix[type]; type++) {
+         value-=config.mix[type];
+      }
+      counts[type]++;
+      const unsigned k=1+uniformInt(random, 7);
+      switch(type) {
+         case 0: {
+            const uint32_t p1=uniformInt(random, config.persons);
+            uint32_t p2=uniformInt(random, config.persons);
+            for(uint32_t hop=0; hop<2 && uniform(random)<0.5; hop++) {
+               const auto friends=graph.friendsOf(hop==0 ? p1 : p2);
+               if(friends.first==friends.second) { break; }
+               p2=friends.first[uniformInt(random, friends.second-friends.first)];
+            }
+            fprintf(file, "query1(%u, %u, %d)\n", p1, p2, static_cast<int>(uniformInt(random, 5))-1);
+            break;
+         }
+         case 1:
+            fprintf(file, "query2(%u, %04u-%02u-%02u)\n", k, 1980+static_cast<unsigned>(uniformInt(random, 11)),
+               1+static_cast<unsigned>(uniformInt(random, 12)), 1+static_cast<unsigned>(uniformInt(random, 28)));
+            break;
+         case 2: {
+            const double kind=uniform(random);
+            std::string place;
+            if(kind<0.1) {
+               place=continents[uniformInt(random, numContinents)];
+            } else if(kind<0.6) {
+               place="Country_"+std::to_string(uniformInt(random, places.countries));
+            } else {
+               place="City_"+std::to_string(uniformInt(random, places.cities()));
+            }
+            fprintf(file, "query3(%u, %u, %s)\n", k, 1+static_cast<unsigned>(uniformInt(random, 4)), place.c_str());
+            break;
+         }
+         case 3:
+            fprintf(file, "query4(%u, Tag_%u)\n", k, tagPopularity(random));
+            break;
+      }
+   }
+   fclose(file);
+   std::cerr<<"[DataGen] Wrote queries.txt, "<<counts[0]<<"/"<<counts[1]<<"/"<<counts[2]<<"/"<<counts[3]<<" queries of type 1/2/3/4"<<std::endl;
+}
+
+double doubleOption(const env::ArgsParser& argsParser, const char* option, double defaultValue) {
+   const char* value=argsParser.getOption(option);
+   return value!=nullptr ? strtod(value, nullptr) : defaultValue;
+}
+
+}
+
+int main(int argc, char** argv) {
+   if(argc<3) {
+      std::cerr<<"Usage [runDataGen] <outputFolder> <numPersons> (-seed N) (-degree <meanFriends>) (-alpha <exponent>) (-community <persons>) (-mixing <share>) (-comments <perPerson>) (-replySkew <exponent>) (-queries N) (-mix q1,q2,q3,q4) (-threads N)"<<std::endl;
+      return -1;
+   }
+
+   env::ArgsParser argsParser(argc, argv);
+   Config config;
+   config.folder=argv[1];
+   if(config.folder.back()!='/') {
+      config.folder+='/';
+   }
+   config.persons=strtoul(argv[2], nullptr, 10);
+   config.seed=argsParser.getOptionAs<uint64_t>("-seed", 1, strtoull);
+   config.degree=doubleOption(argsParser, "-degree", 20);
+   config.alpha=doubleOption(argsParser, "-alpha", 2.5);
+   config.community=argsParser.getOptionAsUint32("-community", 100);
+   config.mixing=doubleOption(argsParser, "-mixing", 0.2);
+   config.comments=doubleOption(argsParser, "-comments", 20);
+   config.replySkew=doubleOption(argsParser, "-replySkew", 0.8);
+   config.queries=argsParser.getOptionAsUint32("-queries", 1000);
+   config.threads=argsParser.getOptionAsUint32("-threads", std::max(1u, std::thread::hardware_concurrency()));
+   std::fill(config.mix, config.mix+4, 1);
+   if(argsParser.getOption("-mix")!=nullptr) {
+      if(sscanf(argsParser.getOption("-mix"), "%u,%u,%u,%u", &config.mix[0], &config.mix[1], &config.mix[2], &config.mix[3])!=4) {
+         std::cerr<<"-mix expects four weights, e.g. 1,1,1,1"<<std::endl;
+         return -1;
+      }
+   }
+   if(config.persons<2 || config.alpha<=2 || config.community<1 || config.mixing<0 || config.mixing>1 || config.degree<=0 || config.threads<1) {
+      std::cerr<<"Expected at least 2 persons, -alpha above 2, -mixing in [0,1] and positive -degree, -community and -threads"<<std::endl;
+      return -1;
+   }
+   mkdir(config.folder.c_str(), 0755);
+
+   const auto start=std::chrono::steady_clock::now();
+   const Places places(config.persons);
+   const uint32_t numTags=std::max(100u, std::min(16000u, config.persons/10));
+   const uint32_t numForums=std::max(1u, config.persons/4);
+   const ZipfSampler tagPopularity(numTags, 1.0);
+
+   const SocialGraph graph(config);
+   std::cerr<<"[DataGen] "<<config.persons<<" persons in "<<graph.numCommunities<<" communities, "<<graph.numEdges()<<" friendships"<<std::endl;
+   writePersons(config, graph, places, numTags, tagPopularity);
+   writePlaces(config, places);
+   writeTags(config, numTags);
+   writeForums(config, graph, numForums, numTags, tagPopularity);
+   writeComments(config, graph);
+   writeQueries(config, graph, places, tagPopularity);
+   std::cerr<<"[DataGen] Done in "<<std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-start).count()<<" ms"<<std::endl;
+   return 0;
+}
@@ -0,0 +1,210 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include "query2.hpp"
+#include "query3.hpp"
+#include "include/indexes.hpp"
+#include "include/compressedgraph.hpp"
+#include "include/queryfiles.hpp"
+#include "include/concurrent/scheduler.hpp"
+#include "include/concurrent/thread.hpp"
+#include "include/runtime.hpp"
+#include "include/schedulegraph.hpp"
+#include "include/executioncommons.hpp"
+#include "include/util/chrono.hpp"
+#include "include/util/log.hpp"
+
+// Memory and throughput of the raw and the compressed person graph. Reports the size of both
+// layouts, the time to scan all friend lists and the latency of the query 2 and query 3 entries
+// of a query file. Query 1 and 4 always read the raw graph. Differing answers are reported as mismatches.
+
+const uint32_t hardwareThreads=std::thread::hardware_concurrency();
+const unsigned scanRepetitions=5;
+
+/// Parses the queries but keeps the query tasks from running them
+struct ParseBatchesIgnored {
+   queryfiles::QueryBatcher& batches;
+
+   ParseBatchesIgnored(queryfiles::QueryBatcher& batches, bool* /*excludes*/)
+      : batches(batches)
+   { }
+
+   void operator()() {
+      batches.parse();
+      auto queryList=batches.getQueryList();
+      for(auto queryIter=queryList.begin(); queryIter!=queryList.end(); queryIter++) {
+         (*queryIter)->ignore=true;
+      }
+   }
+};
+
+struct QueryStats {
+   uint64_t queries;
+   awfy::chrono::Time duration;
+   uint64_t mismatches;
+
+   QueryStats() : queries(0), duration(0), mismatches(0) {
+   }
+
+   void print(const char* query, const char* layout) const {
+      std::cout<<query<<","<<layout<<","<<queries<<","<<duration<<","<<(queries>0?duration/queries:0)<<","<<mismatches<<std::endl;
+   }
+};
+
+/// Reads every friend of every person and returns a checksum so the scan is not optimized away
+template<class Friends>
+uint64_t scanFriends(Friends& friends, uint32_t numPersons) {
+   uint64_t checksum=0;
+   for(PersonId person=0; person<numPersons; person++) {
+      auto bounds=friends.bounds(person);
+      while(bounds.first!=bounds.second) {
+         checksum+=*bounds.first;
+         ++bounds.first;
+      }
+   }
+   return checksum;
+}
+
+template<class Friends>
+void printScan(const char* layout, Friends& friends, uint32_t numPersons, size_t bytes, uint64_t numEdges, awfy::chrono::Time buildTime, uint64_t& checksum) {
+   checksum=0;
+   const auto start=awfy::chrono::now();
+   for(unsigned i=0; i<scanRepetitions; i++) {
+      checksum+=scanFriends(friends, numPersons);
+      // Keeps the compiler from merging the repetitions of the side effect free raw scan
+      asm volatile("" : "+r"(checksum) : : "memory");
+   }
+   const auto scanTime=(awfy::chrono::now()-start)/scanRepetitions;
+   std::cout<<layout<<","<<bytes<<","<<(numEdges>0?double(bytes)/numEdges:0)<<","<<buildTime<<","<<scanTime
+      <<","<<(scanTime>0?double(numEdges)/scanTime:0)<<std::endl;
+}
+
+struct CompareGraphs {
+   queryfiles::QueryBatcher& batches;
+   FileIndexes& fileIndexes;
+
+   CompareGraphs(queryfiles::QueryBatcher& batches, FileIndexes& fileIndexes)
+      : batches(batches), fileIndexes(fileIndexes)
+   { }
+
+   void operator()() {
+      const PersonGraph& personGraph=*fileIndexes.personGraph;
+      const uint32_t numPersons=fileIndexes.personMapper.count();
+
+      auto start=awfy::chrono::now();
+      const awfy::CompressedPersonGraph compressed(personGraph, numPersons);
+      const auto buildTime=awfy::chrono::now()-start;
+
+      // Memory and full scan throughput
+      std::cout<<"layout,bytes,bytes_per_edge,build_us,scan_us,edges_per_us"<<std::endl;
+      awfy::RawFriends rawFriends(personGraph);
+      awfy::CompressedFriends compressedFriends(compressed);
+      uint64_t rawChecksum, compressedChecksum;
+      printScan("raw", rawFriends, numPersons, personGraph.buffer.size+numPersons*sizeof(PersonGraph::Content), compressed.edges(), 0, rawChecksum);
+      printScan("compressed", compressedFriends, numPersons, compressed.memorySize(), compressed.edges(), buildTime, compressedChecksum);
+      if(rawChecksum!=compressedChecksum) {
+         LOG_PRINT("[GraphBench] Scan checksums differ: "<<rawChecksum<<" vs "<<compressedChecksum);
+      }
+
+      fileIndexes.compressedGraph=false;
+      Query2::QueryRunner raw2(fileIndexes);
+      Query3::QueryRunner raw3(fileIndexes);
+      fileIndexes.compressedGraph=true;
+      fileIndexes.compressedPersonGraph=&compressed;
+      Query2::QueryRunner compressed2(fileIndexes);
+      Query3::QueryRunner compressed3(fileIndexes);
+
+      QueryStats stats[2][2]; // [query][compressed]
+      auto queryList=batches.getQueryList();
+      for(auto queryIter=queryList.begin(); queryIter!=queryList.end(); queryIter++) {
+         const auto queryPtr=(*queryIter)->getQuery();
+         const auto queryType=reinterpret_cast<queryfiles::QueryParser::BaseQuery*>(queryPtr)->id;
+
+         if(queryType==queryfiles::QueryParser::Query2::QueryId) {
+            auto query=reinterpret_cast<queryfiles::QueryParser::Query2*>(queryPtr);
+
+            start=awfy::chrono::now();
+            const auto rawResult=raw2.query(query->k, query->year, query->month, query->day);
+            stats[0][0].duration+=awfy::chrono::now()-start;
+            start=awfy::chrono::now();
+            const auto compressedResult=compressed2.query(query->k, query->year, query->month, query->day);
+            stats[0][1].duration+=awfy::chrono::now()-start;
+
+            stats[0][0].queries++;
+            stats[0][1].queries++;
+            if(rawResult!=compressedResult) {
+               stats[0][1].mismatches++;
+               LOG_PRINT("[GraphBench] Query2 "<<query->k<<" "<<query->year<<"-"<<(unsigned)query->month<<"-"<<(unsigned)query->day<<": "<<rawResult<<" vs "<<compressedResult);
+            }
+         } else if(queryType==queryfiles::QueryParser::Query3::QueryId) {
+            auto query=reinterpret_cast<queryfiles::QueryParser::Query3*>(queryPtr);
+
+            start=awfy::chrono::now();
+            const auto rawResult=raw3.query(query->k, query->hops, query->getPlace());
+            stats[1][0].duration+=awfy::chrono::now()-start;
+            start=awfy::chrono::now();
+            const auto compressedResult=compressed3.query(query->k, query->hops, query->getPlace());
+            stats[1][1].duration+=awfy::chrono::now()-start;
+
+            stats[1][0].queries++;
+            stats[1][1].queries++;
+            if(rawResult!=compressedResult) {
+               stats[1][1].mismatches++;
+               LOG_PRINT("[GraphBench] Query3 "<<query->k<<" "<<query->hops<<" "<<query->getPlace()<<": "<<rawResult<<" vs "<<compressedResult);
+            }
+         }
+      }
+
+      std::cout<<"query,layout,queries,us,us_per_query,mismatches"<<std::endl;
+      stats[0][0].print("q2", "raw");
+      stats[0][1].print("q2", "compressed");
+      stats[1][0].print("q3", "raw");
+      stats[1][1].print("q3", "compressed");
+   }
+};
+
+int main(int argc, char** argv) {
+   if(argc != 3) {
+      std::cerr<<"Usage: "<<argv[0]<<" <dataFolder> <queryFile>"<<std::endl;
+      return -1;
+   }
+   const std::string dataPath(argv[1]);
+   io::MmapedFile queryFile(argv[2], O_RDONLY);
+   bool excludes[4] = {true, false, false, true};
+
+   awfy::counters::ProgramCounters counters(hardwareThreads);
+   auto& threadCounts=counters.getThreadCounters();
+   threadCounts.initThread();
+   threadCounts.startTask(TaskGraph::Initialize);
+
+   Scheduler scheduler(counters, SchedulerKinds::GLOBAL_QUEUE, hardwareThreads);
+   ScheduleGraph taskGraph(scheduler);
+   queryfiles::QueryFileParser queries(queryFile);
+   queryfiles::QueryBatcher batches(queries);
+   FileIndexes fileIndexes;
+   runtime::QueryState queryState(taskGraph, scheduler, fileIndexes);
+
+   // The comparison runs once the indexes of query 2 and 3 are complete
+   initScheduleGraph<CompareGraphs, ParseBatchesIgnored>(scheduler, taskGraph, fileIndexes, dataPath, batches, queryState, excludes,
+      CompareGraphs(batches, fileIndexes));
+   taskGraph.eraseNotUsedEdges();
+
+   executeTaskGraph(hardwareThreads, scheduler, counters, threadCounts);
+   return 0;
+}
@@ -0,0 +1,175 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "macros.hpp"
+
+namespace awfy {
+
+/// Bump allocator for the temporary data of the queries of one thread. Chunks are kept when the arena is
+/// rewound, so once the arena has grown to the size a query needs, the query allocates nothing from the
+/// system and freeing its data is a reset of the fill position.
+class QueryArena {
+public:
+   static const size_t chunkSize=2*1024*1024; // One huge page
+   static const size_t maxAlignment=64;
+
+   /// Fill position, rewinding to it frees everything that was allocated afterwards
+   struct Mark {
+      size_t chunk;
+      size_t used;
+   };
+
+private:
+   struct Chunk {
+      char* data;
+      size_t size;
+   };
+
+   std::vector<Chunk> chunks;
+   size_t current; // Chunk that is filled, chunks.size() before the first allocation
+   size_t used; // Bytes of the current chunk
+   uint64_t systemAllocations;
+
+   static bool hugePages;
+
+   void* allocateChunk(size_t size);
+
+public:
+   QueryArena();
+   ~QueryArena();
+
+   QueryArena(const QueryArena&) = delete;
+   QueryArena& operator=(const QueryArena&) = delete;
+
+   /// Arena of the calling thread
+   static QueryArena& local();
+   /// Chunks allocated afterwards are aligned to huge pages and advised to be backed by them
+   static void useHugePages(bool enable);
+
+   inline void* allocate(size_t size, size_t alignment=alignof(std::max_align_t)) {
+      assert(alignment<=maxAlignment && (alignment&(alignment-1))==0);
+      if(likely(current<chunks.size())) {
+         const size_t offset=(used+alignment-1)&~(alignment-1);
+         if(likely(offset+size<=chunks[current].size)) {
+            used=offset+size;
+            return chunks[current].data+offset;
+         }
+      }
+      return allocateSlow(size);
+   }
+
+   /// Continues in the next chunk that fits, chunks are 64 byte aligned
+   void* allocateSlow(size_t size);
+
+   template<typename T>
+   inline T* alloc(size_t count) {
+      return reinterpret_cast<T*>(allocate(count*sizeof(T), alignof(T)));
+   }
+
+   /// Zero terminated copy of the string
+   inline const char* copy(const std::string& str) {
+      char* data=alloc<char>(str.size()+1);
+      memcpy(data, str.data(), str.size());
+      data[str.size()]=0;
+      return data;
+   }
+
+   inline Mark mark() const {
+      return Mark { current, used };
+   }
+
+   inline void rewind(Mark mark) {
+      current=mark.chunk;
+      used=mark.used;
+   }
+
+   /// Frees all data, the chunks are kept for the next queries
+   inline void reset() {
+      current=0;
+      used=0;
+   }
+
+   size_t capacity() const;
+   /// Chunks that were requested from the system
+   uint64_t chunkAllocations() const {
+      return systemAllocations;
+   }
+};
+
+/// Frees everything that was allocated from the arena of the thread during the lifetime of the scope. Scopes
+/// of one thread must end in reverse order.
+class ArenaScope {
+   QueryArena& arena;
+   const QueryArena::Mark start;
+
+public:
+   ArenaScope() : arena(QueryArena::local()), start(arena.mark()) {
+   }
+
+   ~ArenaScope() {
+      arena.rewind(start);
+   }
+
+   ArenaScope(const ArenaScope&) = delete;
+   ArenaScope& operator=(const ArenaScope&) = delete;
+};
+
+/// Standard allocator on the arena of the constructing thread, deallocation is a no-op
+template<typename T>
+class ArenaAllocator {
+   template<typename U> friend class ArenaAllocator;
+   QueryArena* arena;
+
+public:
+   typedef T value_type;
+
+   ArenaAllocator() : arena(&QueryArena::local()) {
+   }
+
+   template<typename U>
+   ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {
+   }
+
+   T* allocate(size_t n) {
+      return arena->alloc<T>(n);
+   }
+
+   void deallocate(T*, size_t) {
+   }
+
+   template<typename U>
+   bool operator==(const ArenaAllocator<U>& other) const {
+      return arena==other.arena;
+   }
+
+   template<typename U>
+   bool operator!=(const ArenaAllocator<U>& other) const {
+      return arena!=other.arena;
+   }
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+}
@@ -0,0 +1,75 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "indexes.hpp"
+
+namespace awfy {
+
+/// Largest connected component of the persons sharing an interest for every birthday bound of Q2.
+/// Built by adding the persons in descending birthday order to one union-find per interest, every
+/// interest keeps the steps at which its largest component grew. A Q2 query looks up the step of its
+/// bound in every interest instead of running a BFS.
+class BirthdayComponentIndex {
+public:
+   struct Step {
+      Birthday birthday; // Smallest birthday that is included
+      uint32_t maxComponent;
+   };
+
+   struct Entry {
+      InterestId interest;
+      uint32_t maxComponent; // Over all persons, upper bound for every birthday
+      uint32_t firstStep;
+      uint32_t numSteps;
+   };
+
+private:
+   std::vector<Entry> entries; // Sorted by descending maxComponent
+   std::vector<Step> steps; // Per entry in descending birthday order
+
+public:
+   BirthdayComponentIndex(const PersonGraph& personGraph, const Birthday* birthdays, const HasInterestIndex& interests,
+      const InterestStatistics& interestStats, uint32_t numPersons);
+
+   BirthdayComponentIndex(const BirthdayComponentIndex&) = delete;
+   BirthdayComponentIndex& operator=(const BirthdayComponentIndex&) = delete;
+
+   const std::vector<Entry>& getEntries() const {
+      return entries;
+   }
+
+   /// Largest component of the persons with the interest of the entry and birthday >= bound
+   uint32_t maxComponent(const Entry& entry, Birthday bound) const {
+      const auto first=steps.begin()+entry.firstStep;
+      const auto last=first+entry.numSteps;
+      const auto step=std::partition_point(first, last, [bound](const Step& s) { return s.birthday>=bound; });
+      return step==first ? 0 : (step-1)->maxComponent;
+   }
+
+   size_t numSteps() const {
+      return steps.size();
+   }
+
+   size_t memorySize() const {
+      return entries.size()*sizeof(Entry)+steps.size()*sizeof(Step);
+   }
+};
+
+}
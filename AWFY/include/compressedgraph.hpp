@@ -0,0 +1,250 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <emmintrin.h>
+#include "indexes.hpp"
+#include "macros.hpp"
+
+namespace awfy {
+
+/// Person graph with sorted, delta encoded friend lists.
+/// Every list starts with its size and first friend as varints. Full blocks of 128 friends follow in the
+/// four lane layout of SIMD-BP128: each friend is stored as the difference to the friend four positions
+/// before it and the block is bit packed with the width of its largest difference, so one SSE register
+/// decodes four friends at once. The remaining friends are varint encoded differences to their predecessor.
+class CompressedPersonGraph {
+public:
+   static const uint32_t blockSize=128;
+
+private:
+   std::vector<uint64_t> offsets; // Start of the list of every person, the last entry is the end of the data
+   std::vector<uint8_t> data;
+   uint32_t maxDegree;
+   uint64_t numEdges;
+
+   static inline void writeVarint(std::vector<uint8_t>& out, uint32_t value) {
+      while(value>=0x80) {
+         out.push_back(static_cast<uint8_t>(value|0x80));
+         value>>=7;
+      }
+      out.push_back(static_cast<uint8_t>(value));
+   }
+
+   static inline uint32_t readVarint(const uint8_t*& in) {
+      // Friends are close to each other after sorting, most differences fit into one byte
+      const uint8_t first=*in++;
+      if(likely(first<0x80)) {
+         return first;
+      }
+      uint32_t value=first&0x7f;
+      unsigned shift=7;
+      uint8_t next;
+      do {
+         next=*in++;
+         value|=static_cast<uint32_t>(next&0x7f)<<shift;
+         shift+=7;
+      } while(next&0x80);
+      return value;
+   }
+
+   static inline uint32_t bitWidth(uint32_t value) {
+      return value==0 ? 0 : 32-__builtin_clz(value);
+   }
+
+   /// Packs 128 friends, prev holds the four friends before the block
+   static void packBlock(std::vector<uint8_t>& out, const PersonId* friends, const PersonId* prev) {
+      uint32_t deltas[blockSize];
+      uint32_t maxDelta=0;
+      for(uint32_t i=0; i<blockSize; i++) {
+         deltas[i]=friends[i]-(i<4 ? prev[i] : friends[i-4]);
+         maxDelta|=deltas[i];
+      }
+      const uint32_t b=bitWidth(maxDelta);
+      out.push_back(static_cast<uint8_t>(b));
+
+      // Lane j of row r is stored at bit r*b of the j-th word sequence
+      const size_t start=out.size();
+      out.resize(start+b*16, 0);
+      uint32_t* words=reinterpret_cast<uint32_t*>(out.data()+start);
+      for(uint32_t r=0; r<blockSize/4; r++) {
+         const uint32_t bit=r*b;
+         const uint32_t word=bit/32;
+         const uint32_t shift=bit%32;
+         for(uint32_t j=0; j<4; j++) {
+            const uint32_t delta=deltas[r*4+j];
+            words[word*4+j]|=delta<<shift;
+            if(shift+b>32) {
+               words[(word+1)*4+j]|=delta>>(32-shift);
+            }
+         }
+      }
+   }
+
+   /// Unpacks a block and adds the deltas to prev, the four friends before the block
+   static inline const uint8_t* __attribute__((hot)) unpackBlock(const uint8_t* in, PersonId* out, __m128i prev) {
+      const uint32_t b=*in++;
+      if(unlikely(b==0)) {
+         for(uint32_t r=0; r<blockSize/4; r++) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out+r*4), prev);
+         }
+         return in;
+      }
+
+      const __m128i* words=reinterpret_cast<const __m128i*>(in);
+      const __m128i mask=_mm_set1_epi32(b==32 ? ~0u : (1u<<b)-1);
+      __m128i word=_mm_loadu_si128(words);
+      uint32_t shift=0;
+      for(uint32_t r=0; r<blockSize/4; r++) {
+         __m128i delta=_mm_srl_epi32(word, _mm_cvtsi32_si128(shift));
+         shift+=b;
+         if(shift>=32) {
+            shift-=32;
+            // The last row ends exactly at the end of the block
+            if(likely(r+1<blockSize/4)) {
+               word=_mm_loadu_si128(++words);
+               if(shift>0) {
+                  delta=_mm_or_si128(delta, _mm_sll_epi32(word, _mm_cvtsi32_si128(b-shift)));
+               }
+            }
+         }
+         prev=_mm_add_epi32(prev, _mm_and_si128(delta, mask));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(out+r*4), prev);
+      }
+      return in+b*16;
+   }
+
+public:
+   CompressedPersonGraph() : maxDegree(0), numEdges(0) {
+   }
+
+   CompressedPersonGraph(const CompressedPersonGraph&) = delete;
+   CompressedPersonGraph& operator=(const CompressedPersonGraph&) = delete;
+
+   /// Encodes the friend lists of the first numPersons persons
+   CompressedPersonGraph(const PersonGraph& graph, uint32_t numPersons) : offsets(numPersons+1), maxDegree(0), numEdges(0) {
+      data.reserve(graph.buffer.size/2);
+      std::vector<PersonId> friends;
+      for(PersonId person=0; person<numPersons; person++) {
+         offsets[person]=data.size();
+         const auto list=graph.retrieve(person);
+         if(list==nullptr || list->size()==0) {
+            writeVarint(data, 0);
+            continue;
+         }
+
+         auto bounds=list->bounds();
+         friends.assign(bounds.first, bounds.second);
+         std::sort(friends.begin(), friends.end());
+         const uint32_t degree=friends.size();
+         maxDegree=std::max(maxDegree, degree);
+         numEdges+=degree;
+
+         writeVarint(data, degree);
+         writeVarint(data, friends[0]);
+         const uint32_t numBlocks=degree/blockSize;
+         const PersonId first[4]={friends[0], friends[0], friends[0], friends[0]};
+         for(uint32_t block=0; block<numBlocks; block++) {
+            const PersonId* blockFriends=friends.data()+block*blockSize;
+            packBlock(data, blockFriends, block==0 ? first : blockFriends-4);
+         }
+         PersonId prev=numBlocks>0 ? friends[numBlocks*blockSize-1] : friends[0];
+         for(uint32_t i=numBlocks*blockSize; i<degree; i++) {
+            writeVarint(data, friends[i]-prev);
+            prev=friends[i];
+         }
+      }
+      offsets[numPersons]=data.size();
+      data.shrink_to_fit();
+   }
+
+   /// Number of friends of the person
+   inline uint32_t degree(PersonId person) const {
+      const uint8_t* in=data.data()+offsets[person];
+      return readVarint(in);
+   }
+
+   /// Decodes the friends of the person in ascending order into buffer, which must hold maxFriends() entries
+   inline pair<const PersonId*,const PersonId*> __attribute__((hot)) decode(PersonId person, PersonId* buffer) const {
+      const uint8_t* in=data.data()+offsets[person];
+      const uint32_t degree=readVarint(in);
+      if(degree==0) {
+         return make_pair(buffer, buffer);
+      }
+
+      const PersonId first=readVarint(in);
+      const uint32_t numBlocks=degree/blockSize;
+      PersonId* out=buffer;
+      for(uint32_t block=0; block<numBlocks; block++) {
+         const __m128i prev=block==0 ? _mm_set1_epi32(first) : _mm_loadu_si128(reinterpret_cast<const __m128i*>(out-4));
+         in=unpackBlock(in, out, prev);
+         out+=blockSize;
+      }
+      PersonId prev=numBlocks>0 ? out[-1] : first;
+      for(uint32_t i=numBlocks*blockSize; i<degree; i++) {
+         prev+=readVarint(in);
+         *out++=prev;
+      }
+      return make_pair(const_cast<const PersonId*>(buffer), const_cast<const PersonId*>(out));
+   }
+
+   inline uint32_t maxFriends() const {
+      return maxDegree;
+   }
+
+   inline uint64_t edges() const {
+      return numEdges;
+   }
+
+   /// Bytes used by the offsets and the encoded lists
+   size_t memorySize() const {
+      return offsets.size()*sizeof(uint64_t)+data.size();
+   }
+};
+
+/// Friend list access of the raw person graph, BFS loops take it or CompressedFriends as template argument
+struct RawFriends {
+   const PersonGraph& graph;
+
+   RawFriends(const PersonGraph& graph) : graph(graph) {
+   }
+
+   inline pair<const PersonId*,const PersonId*> bounds(PersonId person) {
+      const auto friends=graph.retrieve(person);
+      if(unlikely(friends==nullptr)) {
+         return pair<const PersonId*,const PersonId*>(nullptr, nullptr);
+      }
+      return friends->bounds();
+   }
+};
+
+/// Friend list access of the compressed person graph, decodes into a buffer owned by the accessor
+struct CompressedFriends {
+   const CompressedPersonGraph& graph;
+   std::vector<PersonId> buffer;
+
+   CompressedFriends(const CompressedPersonGraph& graph) : graph(graph), buffer(graph.maxFriends()) {
+   }
+
+   inline pair<const PersonId*,const PersonId*> bounds(PersonId person) {
+      return graph.decode(person, buffer.data());
+   }
+};
+
+}
@@ -18,10 +18,12 @@ limitations under the License.
 
 #include <vector>
 #include <queue>
+#include <deque>
 #include <assert.h>
 #include <pthread.h>
 #include "../util/counters.hpp"
 
+#include "atomic.hpp"
 #include "mutex.hpp"
 
 class Task {
@@ -55,6 +57,19 @@ struct Priorities {
    };
 };
 
+struct SchedulerKinds {
+   enum Kind {
+      GLOBAL_QUEUE, // All tasks in one mutex protected queue
+      WORK_STEALING // Per executor queues, idle executors steal from the others
+   };
+   static const unsigned numPriorityLevels=6;
+
+   /// Parses "global" or "stealing", null selects the global queue
+   static Kind parse(const char* name);
+   /// Maps the priority to a dense level, higher levels are more urgent
+   static unsigned priorityLevel(Priorities::Priority priority);
+};
+
 struct TaskOrder {
    Priorities::Priority priority;
    unsigned insertion;
@@ -71,8 +86,22 @@ struct TaskOrderCmp {
    }
 };
 
+// Task queue of one executor for the work stealing scheduler.
+// The owner takes tasks from the front, thieves from the back.
+struct WorkerQueue {
+   awfy::Mutex mutex;
+   std::deque<Task> tasks[SchedulerKinds::numPriorityLevels][2]; // [level][isIO]
+   awfy::atomic<uint32_t> size; // Allows thieves to skip empty queues without locking
+   char padding[64]; // Avoid false sharing between the queues of different executors
+
+   void push(const Task* newTasks, size_t count, unsigned level, bool isIO);
+   bool pop(Task& task, bool preferIO, bool steal);
+   bool empty();
+};
+
 // Priority ordered scheduler
 class Scheduler {
+   // Global queue, also receives tasks of threads that are no executor in the work stealing mode
    std::priority_queue<OrderedTask, std::vector<OrderedTask>, TaskOrderCmp> ioTasks;
    std::priority_queue<OrderedTask, std::vector<OrderedTask>, TaskOrderCmp> workTasks;
    awfy::Mutex taskMutex;
@@ -81,10 +110,27 @@ class Scheduler {
    volatile bool currentlyEmpty;
    volatile unsigned nextTaskId;
 
+   // Work stealing state
+   const SchedulerKinds::Kind kind;
+   std::vector<WorkerQueue*> workerQueues;
+   std::vector<unsigned> workerNodes; // Numa node of every executor, all 0 without numa placement
+   awfy::atomic<uint64_t> numTasks; // Tasks in all queues
+   awfy::atomic<uint64_t> numGlobalTasks;
+   awfy::atomic<unsigned> numSleeping;
+   awfy::Mutex idleMutex;
+   awfy::Condition idleCondition;
+
    awfy::counters::ProgramCounters& counters;
 
+   unsigned currentWorker();
+   void pushTasks(const Task* tasks, size_t count, Priorities::Priority priority, bool isIO);
+   void pushGlobal(const Task* tasks, size_t count, Priorities::Priority priority, bool isIO);
+   void notifyWorkers(size_t count);
+   bool popGlobal(Task& task, bool preferIO);
+   bool getStolenTask(Task& task, bool preferIO);
+
 public:
-   Scheduler(awfy::counters::ProgramCounters& counters);
+   Scheduler(awfy::counters::ProgramCounters& counters, SchedulerKinds::Kind kind=SchedulerKinds::GLOBAL_QUEUE, unsigned numWorkers=1);
    ~Scheduler();
 
    Scheduler(const Scheduler&) = delete;
@@ -92,7 +138,13 @@ public:
 
    void schedule(const std::vector<Task>& funcs, Priorities::Priority priority=Priorities::DEFAULT, bool isIO=true);
    void schedule(const Task& task, Priorities::Priority priority=Priorities::DEFAULT, bool isIO=true);
-   Task* getTask(bool preferIO=true);
+   /// Places the tasks in the queue of an executor on the numa node, same as schedule without work stealing
+   void scheduleOnNode(const std::vector<Task>& funcs, unsigned node, Priorities::Priority priority=Priorities::DEFAULT, bool isIO=true);
+   /// Blocks until a task is available, returns false once the scheduler is closed and empty
+   bool getTask(Task& task, bool preferIO=true);
+   /// Binds the calling thread to the queue of the worker, must be called by every executor
+   void registerWorker(unsigned workerId);
+   void unregisterWorker();
    size_t size();
    void setCloseOnEmpty();
 };
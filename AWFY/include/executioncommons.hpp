@@ -16,8 +16,11 @@ limitations under the License.
 
 #pragma once
 
+#include <algorithm>
+#include <vector>
 #include "queryfiles.hpp"
 #include "runtime.hpp"
+#include "reorder.hpp"
 #include "concurrent/scheduler.hpp"
 
 struct RunBatch {
@@ -30,6 +33,7 @@ struct RunBatch {
    : scheduler(scheduler), taskGraph(taskGraph), taskId(taskId), queryState(queryState), batch(batch)
    { }
    void operator()() {
+      awfy::counters::Trace::setLabel("batch");
       queryState.getBatchRunner()->run(scheduler, taskGraph, taskId, batch);
    }
 };
@@ -51,6 +55,20 @@ void scheduleQueries(TaskGraph::Node taskId, uint32_t queryType, Scheduler& sche
       TaskGroup queryTasks;
       unsigned count=0;
       auto taskBatches=batches.getBatches(queryType);
+      if(queryState.costs.enabled()) {
+         // Longest processing time first, so that no expensive query is left over for the end of the run
+         std::vector<std::pair<uint64_t,queryfiles::QueryBatch*>> costs;
+         costs.reserve(taskBatches.size());
+         for(auto batch : taskBatches) {
+            costs.emplace_back(runtime::estimateCost(queryState.costs, *batch), batch);
+         }
+         std::stable_sort(costs.begin(), costs.end(), [](const std::pair<uint64_t,queryfiles::QueryBatch*>& a, const std::pair<uint64_t,queryfiles::QueryBatch*>& b) {
+            return a.first>b.first;
+         });
+         for(unsigned i=0; i<costs.size(); i++) {
+            taskBatches[i]=costs[i].second;
+         }
+      }
       for(auto batchIter=taskBatches.begin(); batchIter!=taskBatches.end(); batchIter++) {
          queryfiles::QueryBatch* batch = *batchIter;
          assert(batch->queryType==queryType);
@@ -141,6 +159,7 @@ void initScheduleGraph(Scheduler& scheduler, ScheduleGraph& taskGraph, FileIndex
 
       taskGraph.setTaskFn(Priorities::DEFAULT, TaskGraph::Finish, CloseScheduler(scheduler));
 
+      fileIndexes.finishRestoredTasks(taskGraph);
       taskGraph.updateTask(TaskGraph::Initialize, -1);
 
       if(!excludes[0]) {
@@ -165,6 +184,35 @@ void initScheduleGraph(Scheduler& scheduler, ScheduleGraph& taskGraph, FileIndex
       if(!excludes[1]||!excludes[3]) {
          taskGraph.updateTask(TaskGraph::IndexQ2orQ4, -1);
       }
+
+      // A snapshot contains the indexes of all query types
+      if(fileIndexes.snapshotFile==nullptr && !fileIndexes.snapshotPath.empty()) {
+         if(excludes[1]) {
+            taskGraph.updateTask(TaskGraph::IndexQ2, -1);
+         }
+         if(excludes[2]) {
+            taskGraph.updateTask(TaskGraph::IndexQ3, -1);
+         }
+         if(excludes[1]&&excludes[2]) {
+            taskGraph.updateTask(TaskGraph::IndexQ2orQ3, -1);
+         }
+      }
+
+      // Relabeling rewrites all person indexes, so it waits until every one of them is built
+      if(fileIndexes.personOrder!=awfy::reorder::Order::None) {
+         const TaskGraph::Node gates[] = { TaskGraph::IndexQ1, TaskGraph::IndexQ2, TaskGraph::IndexQ3, TaskGraph::IndexQ4 };
+         for(unsigned i=0; i<4; i++) {
+            if(excludes[i]) {
+               taskGraph.updateTask(gates[i], -1);
+            }
+         }
+         if(excludes[1]&&excludes[2]) {
+            taskGraph.updateTask(TaskGraph::IndexQ2orQ3, -1);
+         }
+         if(excludes[1]&&excludes[3]) {
+            taskGraph.updateTask(TaskGraph::IndexQ2orQ4, -1);
+         }
+      }
 }
 
 void executeTaskGraph(const unsigned hardwareThreads, Scheduler& scheduler, awfy::counters::ProgramCounters& counters, awfy::counters::ThreadCounters& threadCounts) {
@@ -0,0 +1,199 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "indexes.hpp"
+#include "macros.hpp"
+
+namespace awfy {
+
+/// Level synchronous BFS over the person graph that switches between top-down and bottom-up levels.
+/// Top-down levels expand the frontier queue. Bottom-up levels let every unvisited person search its
+/// friends for a member of the frontier bitmap and stop at the first hit, which skips most edge checks
+/// once the frontier covers a large part of the graph.
+class HybridBFS {
+public:
+   static const uint32_t alpha=14; // Go bottom-up once the frontier has more than unexploredEdges/alpha edges
+   static const uint32_t beta=24; // Go top-down again once the frontier has less than numCandidates/beta persons
+
+private:
+   const uint32_t numPersons;
+   const size_t numWords;
+   std::vector<uint64_t> visited;
+   std::vector<uint64_t> frontierBits;
+   std::vector<uint64_t> nextBits;
+   std::vector<PersonId> frontier;
+   std::vector<PersonId> next;
+
+public:
+   // Statistics, accumulated over all searches
+   uint64_t edgeChecks;
+   uint64_t topDownLevels;
+   uint64_t bottomUpLevels;
+
+   HybridBFS(uint32_t numPersons)
+      : numPersons(numPersons), numWords((numPersons+63)/64), visited(numWords), frontierBits(numWords), nextBits(numWords),
+        edgeChecks(0), topDownLevels(0), bottomUpLevels(0) {
+      frontier.reserve(1024);
+      next.reserve(1024);
+      clear();
+   }
+
+   /// Marks all persons as unvisited
+   void clear() {
+      std::fill(visited.begin(), visited.end(), 0);
+      // Bits behind the last person are never visited
+      if(numPersons%64!=0) {
+         visited[numWords-1]=~0UL<<(numPersons%64);
+      }
+   }
+
+   inline void markVisited(PersonId person) {
+      assert(person<numPersons);
+      visited[person/64]|=1UL<<(person%64);
+   }
+
+   inline bool isVisited(PersonId person) const {
+      assert(person<numPersons);
+      return visited[person/64]&(1UL<<(person%64));
+   }
+
+   /// Visits the persons reachable from the source that were not visited before, level by level.
+   /// filter(person, friends, i) decides whether the i-th friend edge of the person may be used,
+   /// it must be symmetric. levelDone(distance, numDiscovered) is called after every level and stops
+   /// the search if it returns false. unexploredEdges and numCandidates estimate the edges and persons
+   /// that can still be discovered, the edges of discovered persons are subtracted from unexploredEdges.
+   /// Returns the number of discovered persons without the source.
+   template<class Filter, class LevelDone>
+   uint32_t run(const PersonGraph& graph, PersonId source, uint64_t& unexploredEdges, uint32_t numCandidates, Filter filter, LevelDone levelDone) {
+      frontier.clear();
+      frontier.push_back(source);
+      markVisited(source);
+
+      bool bottomUp=false;
+      uint64_t frontierEdges=degree(graph, source);
+      unexploredEdges-=std::min(unexploredEdges, frontierEdges);
+      uint32_t frontierSize=1;
+      uint32_t distance=0;
+      uint32_t numDiscovered=0;
+      while(frontierSize>0) {
+         // Pick the direction of the next level, bottom-up levels scan the whole bitmap which small frontiers do not pay off
+         if(!bottomUp && frontierEdges>unexploredEdges/alpha && frontierEdges>numWords) {
+            std::fill(frontierBits.begin(), frontierBits.end(), 0);
+            for(auto personIter=frontier.cbegin(); personIter!=frontier.cend(); personIter++) {
+               frontierBits[*personIter/64]|=1UL<<(*personIter%64);
+            }
+            bottomUp=true;
+         } else if(bottomUp && frontierSize<numCandidates/beta) {
+            frontier.clear();
+            for(size_t w=0; w<numWords; w++) {
+               uint64_t bits=frontierBits[w];
+               while(bits!=0) {
+                  frontier.push_back(w*64+__builtin_ctzl(bits));
+                  bits&=bits-1;
+               }
+            }
+            bottomUp=false;
+         }
+
+         uint64_t nextEdges=0;
+         if(bottomUp) {
+            frontierSize=bottomUpLevel(graph, filter, nextEdges);
+            bottomUpLevels++;
+         } else {
+            frontierSize=topDownLevel(graph, filter, nextEdges);
+            topDownLevels++;
+         }
+         distance++;
+         numDiscovered+=frontierSize;
+         unexploredEdges-=std::min(unexploredEdges, nextEdges);
+         frontierEdges=nextEdges;
+
+         if(!levelDone(distance, frontierSize)) {
+            break;
+         }
+      }
+      return numDiscovered;
+   }
+
+private:
+   static inline uint32_t degree(const PersonGraph& graph, PersonId person) {
+      const auto friends=graph.retrieve(person);
+      return friends!=nullptr ? friends->size() : 0;
+   }
+
+   template<class Filter>
+   uint32_t __attribute__((hot)) topDownLevel(const PersonGraph& graph, Filter& filter, uint64_t& nextEdges) {
+      next.clear();
+      for(auto personIter=frontier.cbegin(); personIter!=frontier.cend(); personIter++) {
+         const PersonId person=*personIter;
+         const auto friends=graph.retrieve(person);
+         if(unlikely(friends==nullptr)) { continue; }
+
+         const uint32_t numFriends=friends->size();
+         edgeChecks+=numFriends;
+         for(uint32_t i=0; i<numFriends; i++) {
+            const PersonId curFriend=*friends->getPtr(i);
+            if(likely(isVisited(curFriend))) { continue; }
+            if(!filter(person, friends, i)) { continue; }
+
+            markVisited(curFriend);
+            next.push_back(curFriend);
+            nextEdges+=degree(graph, curFriend);
+         }
+      }
+      frontier.swap(next);
+      return frontier.size();
+   }
+
+   template<class Filter>
+   uint32_t __attribute__((hot)) bottomUpLevel(const PersonGraph& graph, Filter& filter, uint64_t& nextEdges) {
+      std::fill(nextBits.begin(), nextBits.end(), 0);
+      uint32_t numNext=0;
+      for(size_t w=0; w<numWords; w++) {
+         uint64_t unvisited=~visited[w];
+         while(unvisited!=0) {
+            const PersonId person=w*64+__builtin_ctzl(unvisited);
+            unvisited&=unvisited-1;
+
+            const auto friends=graph.retrieve(person);
+            if(unlikely(friends==nullptr)) { continue; }
+
+            // Stop at the first friend in the frontier
+            const uint32_t numFriends=friends->size();
+            for(uint32_t i=0; i<numFriends; i++) {
+               edgeChecks++;
+               const PersonId curFriend=*friends->getPtr(i);
+               if(!(frontierBits[curFriend/64]&(1UL<<(curFriend%64)))) { continue; }
+               if(!filter(person, friends, i)) { continue; }
+
+               nextBits[w]|=1UL<<(person%64);
+               markVisited(person);
+               numNext++;
+               nextEdges+=numFriends;
+               break;
+            }
+         }
+      }
+      frontierBits.swap(nextBits);
+      return numNext;
+   }
+};
+
+}
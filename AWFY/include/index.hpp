@@ -448,6 +448,65 @@ public:
    }
 };
 
+/// Identity mapper that can be switched to a relabeling once all indexes are built.
+/// The relabeling must be installed before any query maps or inverts ids.
+template<class Id>
+class RelabelingMapper {
+   Id _count;
+   const Id* toInternal; // Indexed by original id, null while ids map to themselves
+   const Id* toOriginal; // Indexed by internal id
+
+public:
+   #ifdef DEBUG
+   bool closed;
+   #endif
+
+   RelabelingMapper()
+      : _count(numeric_limits<Id>::max()), toInternal(nullptr), toOriginal(nullptr)
+      #ifdef DEBUG
+      ,closed(0)
+      #endif
+   {
+   }
+   RelabelingMapper(size_t numIds)
+      : _count(numIds), toInternal(nullptr), toOriginal(nullptr)
+      #ifdef DEBUG
+      ,closed(0)
+      #endif
+   { }
+
+   inline Id map(Id original) const __attribute__ ((pure)) {
+      assert(_count<numeric_limits<Id>::max()); //Initialized using correct constructor
+      return likely(toInternal==nullptr) ? original : toInternal[original];
+   }
+
+   inline Id invert(Id internal) const __attribute__ ((pure)) {
+      assert(_count<numeric_limits<Id>::max()); //Initialized using correct constructor
+      return likely(toOriginal==nullptr) ? internal : toOriginal[internal];
+   }
+
+   Id count() const __attribute__ ((pure)) {
+      assert(_count<numeric_limits<Id>::max()); //Initialized using correct constructor
+      return _count;
+   }
+
+   inline bool relabeled() const {
+      return toInternal!=nullptr;
+   }
+
+   /// Installs the relabeling, both arrays hold count() ids and stay owned by the caller
+   void relabel(const Id* newToInternal, const Id* newToOriginal) {
+      toInternal=newToInternal;
+      toOriginal=newToOriginal;
+   }
+
+   /// Adds the ids up to numIds, a relabeled mapper has to be relabeled with arrays of the new size
+   void grow(Id numIds) {
+      assert(numIds>=_count);
+      _count=numIds;
+   }
+};
+
 template<class Id>
 class CommentIdMapper {
 public:
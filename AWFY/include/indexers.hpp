@@ -19,6 +19,7 @@ limitations under the License.
 #include "indexes.hpp"
 #include "metrics.hpp"
 #include "schedulegraph.hpp"
+#include "util/counters.hpp"
 #include <thread>
 #include <vector>
 
@@ -87,7 +88,8 @@ struct UniqueMappingIndex_ReadChunk {
 
    void operator()() {
       typedef typename TargetIndex::Id Id;
-      
+      awfy::counters::Trace::setLabel("chunk");
+
       tokenize::Tokenizer innerTokenizer=chunks->getTokenizer(i);
       while(!innerTokenizer.finished()) {
         auto res=innerTokenizer.consumeLongLongDistinctDelimiter('|','\n');
@@ -495,6 +497,7 @@ struct GroupingIndex_BuildParallel {
    void operator()() {
       typedef typename std::remove_pointer<typename TargetIndex::Content>::type TargetIndexContent;
       typedef typename TargetIndexContent::Entry ValueType;
+      awfy::counters::Trace::setLabel("chunk");
 
       //Get existing chunk data or create new
       GroupingIndex_ParallelChunkData<TargetIndex>* chunkData;
@@ -818,10 +821,12 @@ TaskGroup scheduleTagInForumsIndex(const HashIndex<InterestId,LinkedSizedList<ui
 
 TaskGroup scheduleHasMemberIndex(const HasMemberIndex** targetPtr,const string& dataDir, PersonMapper& mapper, const unordered_set<ForumId>& usedForums);
 
-TagIndex* buildTagIndex(const string& dataPath, const unordered_set<awfy::StringRef>& usedTags);
+TagIndex* buildTagIndex(const string& dataPath, const unordered_set<awfy::StringRef>& usedTags, const bool allTags);
 
 PlaceBoundsIndex buildPlaceBoundsIndex(const string& dataDir);
 
+vector<PlaceId> buildOrganizationPlaceIndex(const string& dataDir);
+
 PersonPlaceIndex buildPersonPlacesIndex(const string& dataDir, PersonMapper& personMapper, const PlaceBoundsIndex& boundsIndex);
 
 NamePlaceIndex buildNamePlaceIndex(const string& dataDir);
@@ -26,13 +26,20 @@ limitations under the License.
 #include "schedulegraph.hpp"
 
 /// ID Mappers
-typedef FastIdentityMapper<PersonId> PersonMapper;
+typedef RelabelingMapper<PersonId> PersonMapper;
 typedef CommentIdMapper<uint32_t> CommentMapper;
 
 /// Indexes
 typedef DirectIndex<PersonId,SizedList<uint32_t,PersonId>*> PersonGraph;
 typedef DirectIndex<CommentId,PersonId> CommentCreatorMap;
 typedef const void* PersonCommentedGraph;
+namespace awfy { class CompressedPersonGraph; }
+namespace awfy { class BirthdayComponentIndex; }
+namespace awfy { class ReplyComponentLabels; }
+namespace awfy { class ReplySortedGraph; }
+namespace awfy { class LandmarkLabels; }
+namespace awfy { namespace reorder { enum class Order; } }
+namespace awfy { namespace strategy { enum class Query3Mode; } }
 
 inline Birthday encodeBirthday(uint32_t birthYear,uint32_t birthMonth,uint32_t birthDay) {
    return (birthYear<<16)+(birthMonth<<8)+birthDay;
@@ -158,7 +165,11 @@ struct FileIndexes {
    CommentMapper commentMapper;
 
    const PersonGraph* personGraph; //q1,q2,q3,q4
+   const awfy::CompressedPersonGraph* compressedPersonGraph; //q2,q3, only built if compressedGraph is set
    PersonCommentedGraph personCommentedGraph; //q1
+   const awfy::ReplyComponentLabels* replyLabels; //q1, only built if replyLabelMaxNum is at least -1
+   const awfy::ReplySortedGraph* replyGraph; //q1, only built if replySortedGraph is set
+   const awfy::LandmarkLabels* landmarkLabels; //q1, only built if landmarkLabelBytes is set and the labels fit
    CommentCreatorMap* creatorMap; //q1, but only as an intermediate. Deleted afterwards
    const Birthday* birthdayIndex; //q2
    const HasInterestIndex* hasInterestIndex; //q2,q3
@@ -169,9 +180,40 @@ struct FileIndexes {
    TagInForums tagInForumsIndex; //q4
    const HasMemberIndex* hasMemberIndex; //q4
    const InterestStatistics* interestStatistics;
+   const awfy::BirthdayComponentIndex* birthdayComponents; //q2, only built if birthdaySweep is set
+
+   // Numa node local copies of the person graph, empty unless the replicate numa mode is active
+   vector<const PersonGraph*> personGraphReplicas;
+   vector<PersonCommentedGraph> personCommentedReplicas;
+
+   // Set if the persons were relabeled, the person mapper points into them
+   vector<PersonId> relabeledPersonIds; // Indexed by original id
+   vector<PersonId> originalPersonIds; // Indexed by relabeled id
+
+   io::MmapedFile* snapshotFile; // Set if the indexes were restored from a snapshot
+   string snapshotPath; // Snapshot to write once all indexes are built
+   bool indexAllTags; // Treat every tag as used by Q4, required if the queries are not known upfront
+   bool hybridBFS; // Q1 and Q2 use the direction optimizing BFS instead of the queue BFS
+   bool compressedGraph; // Q2 and Q3 read the compressed person graph instead of the raw lists
+   bool birthdaySweep; // Q2 looks up the largest components in the birthday component index instead of running BFSs
+   awfy::strategy::Query3Mode query3Mode; // Q3 runs a BFS per person, enumerates pairs from per interest lists or picks per query
+   int32_t replyLabelMaxNum; // Q1 checks connectivity labels before searching for comment bounds up to this
+   bool replySortedGraph; // Q1 reads friend lists sorted by mutual replies instead of checking the counts of the raw lists
+   uint64_t landmarkLabelBytes; // Q1 without comment bound looks up distances in landmark labels of at most this size, 0 disables them
+   uint64_t query4CacheBytes; // Q4 keeps the subgraphs and closeness values of recent tags up to this size, 0 disables the cache
+   awfy::reorder::Order personOrder; // Relabeling applied to all person indexes before the queries start
+   uint64_t generation; // Incremented whenever updates replaced indexes, query runners are recreated afterwards
 
    FileIndexes();
 
    TaskGroup prepareMappers(Scheduler& scheduler, const string& dataPath, const bool query1, const bool query2, const bool query3, const bool query4);
    void setupIndexTasks(Scheduler& scheduler, ScheduleGraph& taskGraph, const string& dataPath, const boost::unordered_set<awfy::StringRef>& usedTags);
+   /// Marks the nodes of restored indexes as done, must be called after all edges were added
+   void finishRestoredTasks(ScheduleGraph& taskGraph);
+
+   /// Person graph replica of the numa node of the calling thread
+   const PersonGraph& localPersonGraph() const;
+   PersonCommentedGraph localPersonCommentedGraph() const;
+   /// Rebuilds the compressed graph, the derived Q1 and Q2 indexes and the numa placement after the person indexes were replaced
+   void refreshGraphCopies();
 };
@@ -0,0 +1,142 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <limits>
+#include <vector>
+#include <emmintrin.h>
+#include "indexes.hpp"
+#include "macros.hpp"
+
+namespace awfy {
+
+/// Pruned landmark labeling of the person graph, a 2-hop cover that answers Q1 distances without comment bound.
+/// Persons are ranked by descending degree and every person stores the ranks of its hubs with their distances.
+/// The distance of two persons is the minimum over their common hubs, found by merging both sorted rank lists.
+///
+/// The labels are built by a pruned BFS from every person in rank order. The first roots run one after another,
+/// later roots run in batches whose searches only prune with the labels of earlier batches, so the searches of
+/// one batch can run concurrently. This keeps the cover exact, a batch may only add redundant hubs.
+class LandmarkLabels {
+public:
+   typedef uint8_t Distance;
+   static const uint32_t noRank=std::numeric_limits<uint32_t>::max(); // Pads the rank lists, larger than every rank
+   static const Distance noDistance=std::numeric_limits<Distance>::max();
+   static const uint32_t sequentialRoots=256; // Roots labeled one after another before batching starts
+   static const uint32_t batchRoots=256;
+
+private:
+   struct Entry {
+      uint32_t rank;
+      Distance distance;
+   };
+
+   /// Search state of one thread, all entries are reset after every root
+   struct Workspace {
+      std::vector<Distance> rootDistances; // Indexed by hub rank
+      std::vector<Distance> distances; // Indexed by person
+      std::vector<PersonId> queue;
+   };
+
+   const PersonGraph* personGraph; // Only set while building
+   const uint32_t numPersons;
+   const uint64_t maxBytes;
+   std::vector<PersonId> order; // Person of every rank
+   std::vector<uint32_t> ranks; // Rank of every person
+   std::vector<std::vector<Entry>> buildLabels; // Labels of the committed roots, only kept while building
+   std::vector<std::vector<std::pair<PersonId,Distance>>> batchLabels; // Labels found by the roots of the running batch
+   std::atomic<uint64_t> numEntries;
+   std::atomic<bool> failed; // Set if the labels exceed the memory limit or a distance does not fit
+
+   // Final labels, every rank list ends with noRank and is padded to a multiple of 4 so that it is read in SSE blocks
+   std::vector<uint64_t> offsets;
+   std::vector<uint32_t> labelRanks;
+   std::vector<Distance> labelDistances;
+
+   static Workspace& localWorkspace(uint32_t numPersons);
+   void labelRoot(uint32_t rank, Workspace& workspace, std::vector<std::pair<PersonId,Distance>>& found);
+   void commit(uint32_t rank, const std::vector<std::pair<PersonId,Distance>>& found);
+
+public:
+   /// Ranks the persons, the labels are built by labelBatch and finish
+   LandmarkLabels(const PersonGraph& personGraph, uint32_t numPersons, uint64_t maxBytes);
+
+   LandmarkLabels(const LandmarkLabels&) = delete;
+   LandmarkLabels& operator=(const LandmarkLabels&) = delete;
+
+   uint32_t numBatches() const;
+   /// First root rank of the batch, batch numBatches() ends the last batch
+   uint32_t batchBegin(uint32_t batch) const;
+
+   /// Runs the searches of a part of a batch, parts of the same batch can run concurrently. Batch 0 must
+   /// be run as a whole.
+   void labelBatch(uint32_t batch, uint32_t beginRank, uint32_t endRank);
+   /// Adds the labels of a batch once all its searches finished, batches must be committed in order
+   void commitBatch(uint32_t batch);
+   /// Builds all batches on the calling thread
+   void buildAll();
+   /// Packs the labels for querying, returns false if the build exceeded the memory limit
+   bool finish();
+
+   /// Number of friendships on a shortest path between both persons, -1 if there is no path
+   inline int distance(PersonId a, PersonId b) const {
+      const uint32_t* ranksA=labelRanks.data()+offsets[a];
+      const uint32_t* ranksB=labelRanks.data()+offsets[b];
+      const Distance* distancesA=labelDistances.data()+offsets[a];
+      const Distance* distancesB=labelDistances.data()+offsets[b];
+      unsigned best=std::numeric_limits<unsigned>::max();
+
+      // Compares blocks of 4 ranks against each other, the block with the smaller last rank is replaced next
+      while(true) {
+         const __m128i blockA=_mm_loadu_si128(reinterpret_cast<const __m128i*>(ranksA));
+         __m128i blockB=_mm_loadu_si128(reinterpret_cast<const __m128i*>(ranksB));
+         for(unsigned rotation=0; rotation<4; rotation++) {
+            unsigned matches=_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(blockA, blockB)));
+            while(unlikely(matches!=0)) {
+               const unsigned lane=__builtin_ctz(matches);
+               matches&=matches-1;
+               if(ranksA[lane]!=noRank) {
+                  const unsigned dist=distancesA[lane]+distancesB[(lane+rotation)&3];
+                  best=dist<best ? dist : best;
+               }
+            }
+            blockB=_mm_shuffle_epi32(blockB, _MM_SHUFFLE(0,3,2,1));
+         }
+         const uint32_t lastA=ranksA[3];
+         const uint32_t lastB=ranksB[3];
+         if(lastA<=lastB) {
+            if(lastA==noRank) { break; }
+            ranksA+=4; distancesA+=4;
+         }
+         if(lastB<=lastA) {
+            ranksB+=4; distancesB+=4;
+         }
+      }
+      return best==std::numeric_limits<unsigned>::max() ? -1 : static_cast<int>(best);
+   }
+
+   uint64_t entries() const {
+      return numEntries;
+   }
+
+   size_t memorySize() const {
+      return offsets.size()*sizeof(uint64_t)+labelRanks.size()*sizeof(uint32_t)+labelDistances.size()*sizeof(Distance);
+   }
+};
+
+}
@@ -0,0 +1,79 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "indexes.hpp"
+#include "util/chrono.hpp"
+
+namespace awfy {
+
+/// Predicts the work of a query from the sizes of the index entries it reads, so that the most expensive
+/// batches can be scheduled first. The units differ per query type and only order queries of the same type:
+///  Q1: friends of both persons
+///  Q2: constant, every query scans the same interests
+///  Q3: persons at the place times the persons they can reach within the hops
+///  Q4: squared number of forum memberships of the tag, one pruned BFS per member over the subgraph
+/// Predicted and measured costs are recorded per query and compared at the end of the run.
+class QueryCostModel {
+public:
+   struct Sample {
+      uint32_t queryType;
+      uint64_t predicted;
+      awfy::chrono::Time actual; // Microseconds from the start of the query until its result is written
+   };
+
+private:
+   const FileIndexes& indexes;
+   bool active;
+   std::string samplesPath;
+
+   std::mutex mutex;
+   std::vector<PlaceBound> personPlaces; // Lower bounds of all person places, sorted; built on the first Q3 estimate
+   double averageFriends;
+   uint64_t placesGeneration;
+   std::vector<Sample> samples;
+
+   uint64_t placePopulation(const char* place);
+
+public:
+   QueryCostModel(const FileIndexes& indexes);
+
+   QueryCostModel(const QueryCostModel&) = delete;
+   QueryCostModel& operator=(const QueryCostModel&) = delete;
+
+   /// Orders the batches longest first and records the samples, they are written to samplesPath if it is not empty
+   void enable(const std::string& samplesPath);
+   bool enabled() const {
+      return active;
+   }
+
+   /// Persons are given with their ids in the query file
+   uint64_t estimateQuery1(PersonId p1, PersonId p2);
+   uint64_t estimateQuery3(uint32_t hops, const char* place);
+   uint64_t estimateQuery4(const char* tag);
+
+   void record(uint32_t queryType, uint64_t predicted, awfy::chrono::Time actual);
+   /// Rank correlation of predicted and measured cost per query type
+   void print(std::ostream& out);
+};
+
+}
@@ -87,6 +87,8 @@ namespace queryfiles {
    public:
 
       QueryFileParser(io::MmapedFile& file);
+      /// Parses queries from a newline terminated buffer that stays readable 16 bytes past its end
+      QueryFileParser(const char* data, size_t size);
       QueryFileParser(const QueryParser&) = delete;
       QueryFileParser(QueryParser&&) = delete;
 
@@ -230,6 +232,11 @@ namespace queryfiles {
       madvise(file.mapping,file.size,MADV_SEQUENTIAL|MADV_WILLNEED);
    }
 
+   QueryFileParser::QueryFileParser(const char* data, size_t size) : tokenizer(data, size) {
+      // -1 because assumes ending with newline
+      tokenizer.limit=tokenizer.limit-1;
+   }
+
    AnswerParser::AnswerParser(io::MmapedFile& file) : tokenizer(file) {
       // -1 because assumes ending with newline
       tokenizer.limit=tokenizer.limit-1;
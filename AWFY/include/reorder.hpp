@@ -0,0 +1,40 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+#include "indexes.hpp"
+
+/// Relabeling of the persons so that friends get close ids. Indexes that are addressed by person id
+/// then keep the persons a BFS touches together in the same cache lines and pages.
+namespace awfy {
+   namespace reorder {
+      enum class Order {
+         None,
+         Degree, // Descending number of friends, the hubs share the first cache lines
+         RCM, // Reverse Cuthill-McKee, BFS order from low degree persons with neighbours sorted by degree
+         Community // Label propagation communities, persons of one community are numbered consecutively
+      };
+
+      /// Parses "none", "degree", "rcm" or "community", null keeps the file order
+      Order parseOrder(const char* name);
+      const char* orderName(Order order);
+
+      /// Returns the persons in their new order, entry i is the current id of the person that gets id i
+      std::vector<PersonId> computeOrder(const PersonGraph& graph, uint32_t numPersons, Order order);
+   }
+}
@@ -0,0 +1,76 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "indexes.hpp"
+#include "macros.hpp"
+
+namespace awfy {
+
+/// Person graph for Q1 with every friend list sorted by the number of mutual replies, the smaller count
+/// of both directions, in descending order. The friends that qualify for a comment bound are a prefix of
+/// the list, so a search with a bound reads only qualifying friends and needs no lookup in the list of
+/// the friend. The prefix lengths of the small bounds are stored per person, larger bounds search the
+/// reply counts.
+class ReplySortedGraph {
+public:
+   static const uint32_t numBounds=8; // Prefix lengths are stored for the bounds 0 to 7
+
+private:
+   std::vector<uint64_t> offsets; // Start of the list of every person, the last entry is the end of the data
+   std::vector<PersonId> friends;
+   std::vector<uint32_t> replies; // Mutual replies of every friend entry
+   std::vector<uint32_t> prefixes; // numBounds entries per person, friends with more replies than the bound
+
+public:
+   ReplySortedGraph(const PersonGraph& personGraph, PersonCommentedGraph commentedGraph, uint32_t numPersons);
+
+   ReplySortedGraph(const ReplySortedGraph&) = delete;
+   ReplySortedGraph& operator=(const ReplySortedGraph&) = delete;
+
+   /// Friends of the person that replied more than num times to each other, all friends if num is negative
+   inline std::pair<const PersonId*,const PersonId*> bounds(PersonId person, int32_t num) const {
+      const uint64_t begin=offsets[person];
+      const uint64_t end=offsets[person+1];
+      if(num<0) {
+         return std::make_pair(friends.data()+begin, friends.data()+end);
+      }
+      uint64_t prefixEnd;
+      if(likely(static_cast<uint32_t>(num)<numBounds)) {
+         prefixEnd=begin+prefixes[static_cast<size_t>(person)*numBounds+num];
+      } else {
+         const uint32_t bound=num;
+         prefixEnd=std::partition_point(replies.begin()+begin, replies.begin()+end,
+            [bound](uint32_t count) { return count>bound; })-replies.begin();
+      }
+      return std::make_pair(friends.data()+begin, friends.data()+prefixEnd);
+   }
+
+   uint64_t edges() const {
+      return friends.size();
+   }
+
+   size_t memorySize() const {
+      return offsets.size()*sizeof(uint64_t)+friends.size()*sizeof(PersonId)+replies.size()*sizeof(uint32_t)
+         +prefixes.size()*sizeof(uint32_t);
+   }
+};
+
+}
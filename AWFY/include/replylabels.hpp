@@ -0,0 +1,71 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+#include "indexes.hpp"
+
+namespace awfy {
+
+/// Connected components of the Q1 graph for every comment bound from -1 to maxNum. Level num contains the
+/// friendships in which both persons replied more than num times to each other, the component label of
+/// every person is stored per level. Q1 answers -1 right away if source and target have different labels.
+class ReplyComponentLabels {
+   struct Edge {
+      PersonId a;
+      PersonId b;
+      uint32_t replies; // Minimum of both directions
+   };
+
+   const int32_t maxNum;
+   const uint32_t numPersons;
+   std::vector<PersonId> labels; // One block of numPersons labels per level, level 0 is num=-1
+   std::vector<Edge> edges; // Only kept until all levels are built
+
+public:
+   /// Collects the friendships with their reply counts, the levels are built by buildLevel
+   ReplyComponentLabels(const PersonGraph& personGraph, PersonCommentedGraph commentedGraph, uint32_t numPersons, int32_t maxNum);
+
+   ReplyComponentLabels(const ReplyComponentLabels&) = delete;
+   ReplyComponentLabels& operator=(const ReplyComponentLabels&) = delete;
+
+   uint32_t numLevels() const {
+      return maxNum+2;
+   }
+
+   /// Labels the components of one level, different levels can be built concurrently
+   void buildLevel(uint32_t level);
+   /// Releases the collected friendships once all levels are built
+   void finish();
+
+   bool covers(int32_t num) const {
+      return num<=maxNum;
+   }
+
+   /// Whether a path may exist between both persons for the comment bound, num must be covered.
+   /// Every negative bound means that the reply counts are not checked.
+   bool connected(PersonId a, PersonId b, int32_t num) const {
+      const PersonId* level=labels.data()+static_cast<size_t>(num<0 ? 0 : num+1)*numPersons;
+      return level[a]==level[b];
+   }
+
+   size_t memorySize() const {
+      return labels.size()*sizeof(PersonId);
+   }
+};
+
+}
@@ -17,10 +17,12 @@ limitations under the License.
 #pragma once
 
 #include <string>
+#include "arena.hpp"
 #include "concurrent/atomic.hpp"
 #include "indexes.hpp"
 #include "queryfiles.hpp"
 #include "metrics.hpp"
+#include "querycost.hpp"
 #include "../query1.hpp"
 #include "../query2.hpp"
 #include "../query3.hpp"
@@ -42,6 +44,8 @@ namespace runtime {
       const metrics::BlockStats<>::LogSensor sensor;
       uint64_t queryCount;
       uint64_t batchCount;
+      /// Result strings of the queries of this thread, they are read after all batches finished
+      awfy::QueryArena results;
 
    public:
       BatchRunner(QueryState& state);
@@ -57,9 +61,10 @@ namespace runtime {
       ScheduleGraph& taskGraph;
       Scheduler& scheduler;
       FileIndexes& indexes;
+      awfy::QueryCostModel costs;
 
       QueryState(ScheduleGraph& taskGraph, Scheduler& scheduler, FileIndexes& indexes) :
-         taskGraph(taskGraph), scheduler(scheduler), indexes(indexes) {
+         taskGraph(taskGraph), scheduler(scheduler), indexes(indexes), costs(indexes) {
       }
 
       BatchRunner* getBatchRunner() {
@@ -72,7 +77,11 @@ namespace runtime {
 
       Query1::QueryRunner* getQuery1Runner() {
          static __thread Query1::QueryRunner* queryRunner;
-         if(queryRunner==nullptr) {
+         static __thread uint64_t generation;
+         if(queryRunner==nullptr || generation!=indexes.generation) {
+            // Runners keep references into the indexes, updates replace them
+            delete queryRunner;
+            generation=indexes.generation;
             assert(indexes.personGraph!=nullptr);
             queryRunner = new Query1::QueryRunner(indexes);
          }
@@ -81,7 +90,10 @@ namespace runtime {
 
       Query2::QueryRunner* getQuery2Runner() {
          static __thread Query2::QueryRunner* queryRunner;
-         if(queryRunner==nullptr) {
+         static __thread uint64_t generation;
+         if(queryRunner==nullptr || generation!=indexes.generation) {
+            delete queryRunner;
+            generation=indexes.generation;
             queryRunner=new Query2::QueryRunner(indexes);
          }
          return queryRunner;
@@ -89,7 +101,10 @@ namespace runtime {
 
       Query3::QueryRunner* getQuery3Runner() {
          static __thread Query3::QueryRunner* queryRunner;
-         if(queryRunner==nullptr) {
+         static __thread uint64_t generation;
+         if(queryRunner==nullptr || generation!=indexes.generation) {
+            delete queryRunner;
+            generation=indexes.generation;
             queryRunner = new Query3::QueryRunner(indexes);
          }
          return queryRunner;
@@ -97,20 +112,59 @@ namespace runtime {
 
       Query4::QueryRunner* getQuery4Runner() {
          static __thread Query4::QueryRunner* queryRunner;
-         if(queryRunner==nullptr) {
+         static __thread uint64_t generation;
+         if(queryRunner==nullptr || generation!=indexes.generation) {
+            delete queryRunner;
+            generation=indexes.generation;
             queryRunner = new Query4::QueryRunner(taskGraph, scheduler, indexes);
          }
          return queryRunner;
       }
    };
 
+   /// Cost of a query whose parameters are not mapped yet, see awfy::QueryCostModel
+   uint64_t estimateCost(awfy::QueryCostModel& costs, uint32_t queryType, void* queryPtr) {
+      switch(queryType) {
+         case 0: {
+            const auto query=reinterpret_cast<queryfiles::QueryParser::Query1*>(queryPtr);
+            return costs.estimateQuery1(query->p1, query->p2);
+         }
+         case 1:
+            return 1;
+         case 2: {
+            const auto query=reinterpret_cast<queryfiles::QueryParser::Query3*>(queryPtr);
+            return costs.estimateQuery3(query->hops, query->getPlace());
+         }
+         case 3: {
+            const auto query=reinterpret_cast<queryfiles::QueryParser::Query4*>(queryPtr);
+            return costs.estimateQuery4(query->getTag());
+         }
+      }
+      FATAL_ERROR("Invalid query type "<<queryType);
+   }
+
+   uint64_t estimateCost(awfy::QueryCostModel& costs, queryfiles::QueryBatch& batch) {
+      uint64_t cost=0;
+      for(auto entry=batch.entries; entry!=batch.end; entry=entry->getNextEntry()) {
+         cost+=estimateCost(costs, batch.queryType, entry->getQuery());
+      }
+      return cost;
+   }
+
    struct BatchUpdateTask {
    ScheduleGraph& taskGraph;
    const TaskGraph::Node task;
-   BatchUpdateTask(ScheduleGraph& taskGraph, TaskGraph::Node task)
-      : taskGraph(taskGraph), task(task)
+   const uint32_t queryType;
+   awfy::QueryCostModel* costs;
+   const uint64_t predicted;
+   const awfy::chrono::Time start;
+   BatchUpdateTask(ScheduleGraph& taskGraph, TaskGraph::Node task, uint32_t queryType, awfy::QueryCostModel* costs=nullptr, uint64_t predicted=0, awfy::chrono::Time start=0)
+      : taskGraph(taskGraph), task(task), queryType(queryType), costs(costs), predicted(predicted), start(start)
    { }
    void operator()() {
+      if(costs!=nullptr) {
+         costs->record(queryType, predicted, awfy::chrono::now()-start);
+      }
       taskGraph.updateTask(task, -1);
    }
    };
@@ -136,10 +190,9 @@ namespace runtime {
       const auto baseQuery=reinterpret_cast<queryfiles::QueryParser::BaseQuery*>(baseQueryPtr);
       const auto queryType=baseQuery->id;
 
-      const char* dummyResultStr=(new string(""))->c_str();
-
       // Execute logic for the corresponding query type
       auto& personMapper = state.indexes.personMapper;
+      auto& costs = state.costs;
       if(queryType == queryfiles::QueryParser::Query1::QueryId) {
          auto query1Runner=state.getQuery1Runner();
          while(currentEntry!=currentBatch->end) {
@@ -149,11 +202,16 @@ namespace runtime {
 
             assert(currentEntry->result==nullptr);
             queryfiles::QueryParser::Query1* query = reinterpret_cast<queryfiles::QueryParser::Query1*>(queryPtr);
+            const uint64_t predicted=costs.enabled() ? estimateCost(costs, 0, queryPtr) : 0;
+            const auto start=costs.enabled() ? awfy::chrono::now() : 0;
             query->p1 = personMapper.map(query->p1);
             query->p2 = personMapper.map(query->p2);
             long long int result = query1Runner->query(query->p1,query->p2,query->x);
-            currentEntry->result=((new string(move(to_string(result))))->c_str());
+            currentEntry->result=results.copy(to_string(result));
             assert(currentEntry->result!=nullptr);
+            if(costs.enabled()) {
+               costs.record(0, predicted, awfy::chrono::now()-start);
+            }
 
             queryCount++;
             currentEntry=currentEntry->getNextEntry();
@@ -167,9 +225,14 @@ namespace runtime {
 
             assert(currentEntry->result==nullptr);
             queryfiles::QueryParser::Query2* query = reinterpret_cast<queryfiles::QueryParser::Query2*>(queryPtr);
+            const uint64_t predicted=costs.enabled() ? estimateCost(costs, 1, queryPtr) : 0;
+            const auto start=costs.enabled() ? awfy::chrono::now() : 0;
             auto result = query2Runner->query(query->k,query->year, query->month, query->day);
-            currentEntry->result=(new string(result))->c_str();
+            currentEntry->result=results.copy(result);
             assert(currentEntry->result!=nullptr);
+            if(costs.enabled()) {
+               costs.record(1, predicted, awfy::chrono::now()-start);
+            }
 
             queryCount++;
             currentEntry=currentEntry->getNextEntry();
@@ -183,9 +246,16 @@ namespace runtime {
 
             assert(currentEntry->result==nullptr);
             queryfiles::QueryParser::Query3* query = reinterpret_cast<queryfiles::QueryParser::Query3*>(queryPtr);
-            auto result = query3Runner->query(query->k, query->hops, query->getPlace());
-            currentEntry->result=(new string(result))->c_str();
-            assert(currentEntry->result!=nullptr);
+            currentEntry->result = "";
+            const uint64_t predicted=costs.enabled() ? estimateCost(costs, 2, queryPtr) : 0;
+            const auto start=costs.enabled() ? awfy::chrono::now() : 0;
+
+            // Large places are searched by morsels, small ones are answered before the tasks are returned
+            auto tasks=query3Runner->query(query->k, query->hops, query->getPlace(), currentEntry->result);
+            tasks.join(LambdaRunner::createLambdaTask(BatchUpdateTask(taskGraph,TaskGraph::Query3,2,
+               costs.enabled() ? &costs : nullptr, predicted, start),TaskGraph::Query3));
+            taskGraph.updateTask(TaskGraph::Query3, 1);
+            scheduler.schedule(tasks.close(), Priorities::LOW, false);
 
             queryCount++;
             currentEntry=currentEntry->getNextEntry();
@@ -199,11 +269,14 @@ namespace runtime {
 
             assert(currentEntry->result==nullptr);
             queryfiles::QueryParser::Query4* query = reinterpret_cast<queryfiles::QueryParser::Query4*>(queryPtr);
-            currentEntry->result = dummyResultStr;
+            currentEntry->result = "";
+            const uint64_t predicted=costs.enabled() ? estimateCost(costs, 3, queryPtr) : 0;
+            const auto start=costs.enabled() ? awfy::chrono::now() : 0;
 
             auto tasks=query4Runner->query(query->k, query->getTag(), currentEntry->result);
-            // Finish this query only after subtypes have finished
-            tasks.join(LambdaRunner::createLambdaTask(BatchUpdateTask(taskGraph,TaskGraph::Query4),TaskGraph::Query4));
+            // Finish this query only after subtypes have finished, its cost is the time until then
+            tasks.join(LambdaRunner::createLambdaTask(BatchUpdateTask(taskGraph,TaskGraph::Query4,3,
+               costs.enabled() ? &costs : nullptr, predicted, start),TaskGraph::Query4));
             // Only allow to continue after join has finished
             taskGraph.updateTask(TaskGraph::Query4, 1);
             scheduler.schedule(tasks.close(), Priorities::LOW, false);
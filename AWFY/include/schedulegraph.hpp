@@ -52,6 +52,15 @@ struct TaskGraph {
       PersonPlace,
       HasForum,
       InterestStatistics,
+      Snapshot,
+      NumaPersonGraph,
+      NumaCommentedGraph,
+      CompressedPersonGraph,
+      PersonReorder,
+      BirthdayComponents,
+      ReplyLabels,
+      ReplySortedGraph,
+      LandmarkLabels,
 
       // Query related entries
       Query1,
@@ -89,6 +98,16 @@ struct TaskGraph {
          case Birthday : return "Birthday";
          case PersonPlace : return "PersonPlace";
          case HasForum : return "HasForum";
+         case InterestStatistics : return "InterestStatistics";
+         case Snapshot : return "Snapshot";
+         case NumaPersonGraph : return "NumaPersonGraph";
+         case NumaCommentedGraph : return "NumaCommentedGraph";
+         case CompressedPersonGraph : return "CompressedPersonGraph";
+         case PersonReorder : return "PersonReorder";
+         case BirthdayComponents : return "BirthdayComponents";
+         case ReplyLabels : return "ReplyLabels";
+         case ReplySortedGraph : return "ReplySortedGraph";
+         case LandmarkLabels : return "LandmarkLabels";
          case Query1 : return "Query1";
          case Query2 : return "Query2";
          case Query3 : return "Query3";
@@ -0,0 +1,522 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <list>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "queryfiles.hpp"
+#include "runtime.hpp"
+#include "schedulegraph.hpp"
+#include "updates.hpp"
+#include "util/chrono.hpp"
+#include "util/log.hpp"
+#include "concurrent/mutex.hpp"
+#include "concurrent/scheduler.hpp"
+#include "concurrent/thread.hpp"
+
+/// Long running query server. The indexes are built once, afterwards query lines
+/// are read from stdin or a unix domain socket and answered as soon as they complete.
+/// Every answer line has the form "<seq>\t<result>", seq counts the non empty query
+/// lines of a connection starting from 0.
+namespace server {
+
+   const std::string shutdownCommand = "shutdown";
+   const std::string updateCommand = "update";
+
+   /// The server does not know the queries upfront
+   class EmptyQueryParser : public queryfiles::QueryParser {
+   public:
+      int64_t readNext(void* /*resultPtr*/) override {
+         return -1;
+      }
+   };
+
+   /// Checks the line against the query file grammar and parses it into the query buffer
+   bool parseQuery(const std::string& line, std::vector<uint8_t>& query) {
+      typedef queryfiles::QueryParser QueryParser;
+      if(line.size()<8 || line.compare(0,5,"query")!=0 || line[6]!='(' || line.back()!=')') {
+         return false;
+      }
+      if(line.size()+sizeof(QueryParser::Query3)+1>QueryParser::maxQuerySize()) {
+         return false;
+      }
+      // The file parser does not validate, make sure that all delimiters exist
+      const auto numDelimiters=std::count(line.begin(), line.end(), ',');
+      switch(line[5]) {
+         case QueryParser::Query1::QueryId:
+         case QueryParser::Query3::QueryId:
+            if(numDelimiters<2) { return false; }
+            break;
+         case QueryParser::Query2::QueryId:
+         case QueryParser::Query4::QueryId:
+            if(numDelimiters<1) { return false; }
+            break;
+         default:
+            return false;
+      }
+
+      // The tokenizer reads up to 16 bytes past the line
+      std::vector<char> buffer(line.size()+1+16, 0);
+      std::copy(line.begin(), line.end(), buffer.begin());
+      buffer[line.size()]='\n';
+      query.resize(QueryParser::maxQuerySize());
+      queryfiles::QueryFileParser parser(buffer.data(), line.size()+1);
+      return parser.readNext(query.data())>=0;
+   }
+
+   class QueryServer;
+
+   /// Query stream of one client
+   class Connection {
+      QueryServer& server;
+      const int inFd;
+      const int outFd;
+      const bool ownsFd;
+      std::vector<char> readBuffer;
+      size_t readPos;
+      size_t readEnd;
+
+      awfy::Mutex mutex; // Protects the output and the fields below
+      awfy::Condition drained;
+      uint64_t pending;
+      bool open;
+      bool finished;
+
+      bool readLine(std::string& line) {
+         line.clear();
+         while(true) {
+            while(readPos<readEnd) {
+               const char c=readBuffer[readPos++];
+               if(c=='\n') {
+                  return true;
+               }
+               if(c!='\r') {
+                  line.push_back(c);
+               }
+            }
+            const auto bytes=read(inFd, readBuffer.data(), readBuffer.size());
+            if(bytes<0 && errno==EINTR) {
+               continue;
+            }
+            if(bytes<=0) {
+               return !line.empty();
+            }
+            readPos=0;
+            readEnd=bytes;
+         }
+      }
+
+      /// Has to be called while holding the mutex
+      void write(const std::string& output) {
+         size_t written=0;
+         while(written<output.size()) {
+            const auto bytes=::write(outFd, output.data()+written, output.size()-written);
+            if(bytes<0 && errno==EINTR) {
+               continue;
+            }
+            if(bytes<=0) {
+               return; // Client is gone, drop the answer
+            }
+            written+=bytes;
+         }
+      }
+
+   public:
+      Connection(QueryServer& server, int inFd, int outFd, bool ownsFd)
+         : server(server), inFd(inFd), outFd(outFd), ownsFd(ownsFd), readBuffer(64*1024), readPos(0), readEnd(0),
+           pending(0), open(true), finished(false)
+      { }
+
+      Connection(const Connection&) = delete;
+      Connection(Connection&&) = delete;
+
+      void respond(uint64_t seq, const std::string& answer) {
+         awfy::lock_guard<awfy::Mutex> lock(mutex);
+         write(std::to_string(static_cast<unsigned long long>(seq))+'\t'+answer+'\n');
+      }
+
+      void startQuery() {
+         awfy::lock_guard<awfy::Mutex> lock(mutex);
+         pending++;
+      }
+
+      /// Writes the answer of a scheduled query
+      void finishQuery(uint64_t seq, const std::string& answer);
+
+      /// Lets the next read return end of stream
+      void stopReading() {
+         awfy::lock_guard<awfy::Mutex> lock(mutex);
+         if(open) {
+            shutdown(inFd, SHUT_RD);
+         }
+      }
+
+      bool isFinished() {
+         awfy::lock_guard<awfy::Mutex> lock(mutex);
+         return finished;
+      }
+
+      void serve();
+
+      static void* start(void* argument) {
+         static_cast<Connection*>(argument)->serve();
+         return nullptr;
+      }
+   };
+
+   struct Request {
+      Connection& connection;
+      const uint64_t seq;
+      std::vector<uint8_t> query;
+      const char* result;
+
+      Request(Connection& connection, uint64_t seq)
+         : connection(connection), seq(seq), result(nullptr)
+      { }
+   };
+
+   /// Sends the result of a query that finished in sub tasks
+   struct AnswerAsyncQuery {
+      Request* request;
+      AnswerAsyncQuery(Request* request) : request(request)
+      { }
+      void operator()() {
+         auto& connection=request->connection;
+         const auto seq=request->seq;
+         const std::string answer(request->result);
+         delete request;
+         connection.finishQuery(seq, answer);
+      }
+   };
+
+   /// Executes one query with the thread local query runners
+   struct RunQuery {
+      Scheduler& scheduler;
+      runtime::QueryState& queryState;
+      Request* request;
+      RunQuery(Scheduler& scheduler, runtime::QueryState& queryState, Request* request)
+         : scheduler(scheduler), queryState(queryState), request(request)
+      { }
+
+      void operator()() {
+         typedef queryfiles::QueryParser QueryParser;
+         const auto baseQuery=reinterpret_cast<QueryParser::BaseQuery*>(request->query.data());
+         std::string answer;
+         switch(baseQuery->id) {
+            case QueryParser::Query1::QueryId: {
+               auto query=reinterpret_cast<QueryParser::Query1*>(baseQuery);
+               auto& personMapper=queryState.indexes.personMapper;
+               const auto result=queryState.getQuery1Runner()->query(personMapper.map(query->p1), personMapper.map(query->p2), query->x);
+               answer=std::to_string(static_cast<long long>(result));
+               break;
+            }
+            case QueryParser::Query2::QueryId: {
+               auto query=reinterpret_cast<QueryParser::Query2*>(baseQuery);
+               answer=queryState.getQuery2Runner()->query(query->k, query->year, query->month, query->day);
+               break;
+            }
+            case QueryParser::Query3::QueryId: {
+               // Answered by the finish task once all sub tasks are done
+               auto query=reinterpret_cast<QueryParser::Query3*>(baseQuery);
+               auto finishTask=new Task(LambdaRunner::createLambdaTask(AnswerAsyncQuery(request), TaskGraph::QueryExec));
+               auto tasks=queryState.getQuery3Runner()->query(query->k, query->hops, query->getPlace(), request->result, finishTask);
+               scheduler.schedule(tasks.close(), Priorities::NORMAL, false);
+               return;
+            }
+            case QueryParser::Query4::QueryId: {
+               // Answered by the finish task once all sub tasks are done
+               auto query=reinterpret_cast<QueryParser::Query4*>(baseQuery);
+               auto finishTask=new Task(LambdaRunner::createLambdaTask(AnswerAsyncQuery(request), TaskGraph::QueryExec));
+               auto tasks=queryState.getQuery4Runner()->query(query->k, query->getTag(), request->result, finishTask);
+               scheduler.schedule(tasks.close(), Priorities::NORMAL, false);
+               return;
+            }
+            default:
+               FATAL_ERROR("Invalid query id "<<(unsigned) baseQuery->id);
+         }
+         auto& connection=request->connection;
+         const auto seq=request->seq;
+         delete request;
+         connection.finishQuery(seq, answer);
+      }
+   };
+
+   class QueryServer {
+      Scheduler& scheduler;
+      ScheduleGraph& taskGraph;
+      runtime::QueryState& queryState;
+      const std::string socketPath;
+
+      const std::string dataPath;
+
+      awfy::Mutex mutex; // Protects the fields below
+      awfy::Condition readyCondition;
+      bool ready;
+      bool stopping;
+      int listenFd;
+      awfy::Condition idleCondition;
+      uint64_t runningQueries;
+      bool updating; // Queries are held back until the update is applied
+      awfy::updates::IndexUpdater* updater; // Created by the first update
+
+      struct ConnectionThread {
+         Connection* connection;
+         awfy::Thread<Connection> thread;
+         ConnectionThread(Connection* connection)
+            : connection(connection), thread(&Connection::start, connection)
+         { }
+      };
+      std::list<ConnectionThread> connections;
+
+      void waitUntilReady() {
+         awfy::lock_guard<awfy::Mutex> lock(mutex);
+         while(!ready) {
+            readyCondition.wait(mutex.get());
+         }
+      }
+
+      /// Has to be called while holding the mutex, afterwards the connection list is not modified anymore
+      void stopConnections() {
+         if(stopping) {
+            return;
+         }
+         stopping=true;
+         if(listenFd>=0) {
+            shutdown(listenFd, SHUT_RDWR);
+         }
+         for(auto iter=connections.begin(); iter!=connections.end(); iter++) {
+            iter->connection->stopReading();
+         }
+      }
+
+      /// Joins the threads of closed connections
+      void reapConnections() {
+         for(auto iter=connections.begin(); iter!=connections.end(); ) {
+            if(iter->connection->isFinished()) {
+               iter->thread.join();
+               iter=connections.erase(iter);
+            } else {
+               iter++;
+            }
+         }
+      }
+
+      void serveSocket() {
+         listenFd=socket(AF_UNIX, SOCK_STREAM, 0);
+         sockaddr_un address;
+         memset(&address, 0, sizeof(address));
+         address.sun_family=AF_UNIX;
+         if(listenFd<0 || socketPath.size()>=sizeof(address.sun_path)) {
+            FATAL_ERROR("Could not create socket "<<socketPath);
+         }
+         socketPath.copy(address.sun_path, socketPath.size());
+         unlink(socketPath.c_str());
+         if(bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address))!=0 || listen(listenFd, SOMAXCONN)!=0) {
+            FATAL_ERROR("Could not bind socket "<<socketPath<<": "<<strerror(errno));
+         }
+         std::cerr<<"[Server] Listening on "<<socketPath<<std::endl;
+
+         while(true) {
+            const int fd=accept(listenFd, nullptr, nullptr);
+            if(fd<0 && errno==EINTR) {
+               continue;
+            }
+            awfy::lock_guard<awfy::Mutex> lock(mutex);
+            if(fd<0 || stopping) {
+               if(fd>=0) { close(fd); }
+               stopConnections();
+               break;
+            }
+            reapConnections();
+            connections.emplace_back(new Connection(*this, fd, fd, true));
+         }
+
+         for(auto iter=connections.begin(); iter!=connections.end(); iter++) {
+            iter->thread.join();
+         }
+         connections.clear();
+         close(listenFd);
+         unlink(socketPath.c_str());
+      }
+
+   public:
+      QueryServer(Scheduler& scheduler, ScheduleGraph& taskGraph, runtime::QueryState& queryState, const std::string& socketPath, const std::string& dataPath)
+         : scheduler(scheduler), taskGraph(taskGraph), queryState(queryState), socketPath(socketPath), dataPath(dataPath), ready(false), stopping(false),
+           listenFd(-1), runningQueries(0), updating(false), updater(nullptr)
+      { }
+
+      ~QueryServer() {
+         delete updater;
+      }
+
+      QueryServer(const QueryServer&) = delete;
+      QueryServer(QueryServer&&) = delete;
+
+      /// Called once all indexes are built
+      void setReady() {
+         awfy::lock_guard<awfy::Mutex> lock(mutex);
+         ready=true;
+         readyCondition.broadcast();
+      }
+
+      void schedule(Request* request) {
+         {
+            awfy::lock_guard<awfy::Mutex> lock(mutex);
+            while(updating) {
+               idleCondition.wait(mutex.get());
+            }
+            runningQueries++;
+         }
+         request->connection.startQuery();
+         scheduler.schedule(LambdaRunner::createLambdaTask(RunQuery(scheduler, queryState, request), TaskGraph::QueryExec), Priorities::NORMAL, false);
+      }
+
+      void queryFinished() {
+         awfy::lock_guard<awfy::Mutex> lock(mutex);
+         runningQueries--;
+         if(runningQueries==0) {
+            idleCondition.broadcast();
+         }
+      }
+
+      /// Waits until all scheduled queries are answered and applies the update batch while new queries wait
+      std::string update(const std::string& batchPath) {
+         struct stat batchStat;
+         if(stat(batchPath.c_str(), &batchStat)!=0 || !S_ISDIR(batchStat.st_mode)) {
+            return "ERROR unknown batch folder";
+         }
+         {
+            awfy::lock_guard<awfy::Mutex> lock(mutex);
+            while(updating) {
+               idleCondition.wait(mutex.get());
+            }
+            updating=true;
+            while(runningQueries>0) {
+               idleCondition.wait(mutex.get());
+            }
+         }
+
+         if(updater==nullptr) {
+            updater=new awfy::updates::IndexUpdater(queryState.indexes, dataPath);
+         }
+         const auto stats=updater->apply(batchPath);
+         std::cerr<<"[Server] Applied update "<<batchPath<<": "<<stats.toString()<<std::endl;
+
+         awfy::lock_guard<awfy::Mutex> lock(mutex);
+         updating=false;
+         idleCondition.broadcast();
+         return "OK "+stats.toString();
+      }
+
+      /// Stops accepting connections and ends all query streams
+      void stop() {
+         awfy::lock_guard<awfy::Mutex> lock(mutex);
+         stopConnections();
+      }
+
+      void run() {
+         // Clients may disconnect before their answers are written
+         signal(SIGPIPE, SIG_IGN);
+         waitUntilReady();
+         if(socketPath.empty()) {
+            Connection connection(*this, STDIN_FILENO, STDOUT_FILENO, false);
+            connection.serve();
+         } else {
+            serveSocket();
+         }
+         // Allows the scheduler to close
+         taskGraph.updateTask(TaskGraph::QueryExec, -1);
+      }
+
+      static void* start(void* argument) {
+         static_cast<QueryServer*>(argument)->run();
+         return nullptr;
+      }
+   };
+
+   void Connection::finishQuery(uint64_t seq, const std::string& answer) {
+      // The indexes are not read anymore, updates may start
+      server.queryFinished();
+
+      awfy::lock_guard<awfy::Mutex> lock(mutex);
+      write(std::to_string(static_cast<unsigned long long>(seq))+'\t'+answer+'\n');
+      pending--;
+      if(pending==0) {
+         drained.broadcast();
+      }
+   }
+
+   void Connection::serve() {
+      std::string line;
+      uint64_t seq=0;
+      while(readLine(line)) {
+         if(line.empty()) {
+            continue;
+         }
+         if(line==shutdownCommand) {
+            server.stop();
+            break;
+         }
+         if(line.compare(0, updateCommand.size()+1, updateCommand+' ')==0) {
+            // Queries of this connection that were read before are answered first
+            respond(seq, server.update(line.substr(updateCommand.size()+1)));
+            seq++;
+            continue;
+         }
+         Request* request=new Request(*this, seq++);
+         if(!parseQuery(line, request->query)) {
+            respond(request->seq, "ERROR invalid query");
+            delete request;
+            continue;
+         }
+         server.schedule(request);
+      }
+
+      // Answer all outstanding queries before closing
+      awfy::lock_guard<awfy::Mutex> lock(mutex);
+      while(pending>0) {
+         drained.wait(mutex.get());
+      }
+      if(ownsFd) {
+         close(inFd);
+      }
+      open=false;
+      finished=true;
+   }
+
+   /// Replaces the answer validation, the server starts once all indexes are ready
+   struct ServerReady {
+      QueryServer& server;
+      awfy::chrono::Time start;
+      ServerReady(QueryServer& server, awfy::chrono::Time start)
+         : server(server), start(start)
+      { }
+      void operator()() {
+         std::cerr<<"[Server] Indexes ready after "<<(awfy::chrono::now()-start)/1000<<" ms"<<std::endl;
+         server.setReady();
+      }
+   };
+}
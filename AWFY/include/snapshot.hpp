@@ -0,0 +1,97 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include "indexes.hpp"
+#include "io.hpp"
+
+/// Binary snapshot of the person related file indexes.
+/// All sections are addressed by offsets relative to the file start, so the
+/// file can be mapped at any address and used without parsing.
+namespace snapshot {
+   const uint64_t magic=0x50414e5359465741ull; // "AWFYSNAP"
+   const uint32_t formatVersion=1;
+   const size_t sectionAlignment=64;
+
+   enum class Section : uint32_t {
+      PersonGraph=0,
+      PersonCommented,
+      Birthday,
+      HasInterest,
+      InterestStatistics,
+      Tags,
+      NamePlaces,
+      PlaceBounds,
+      PersonPlaces,
+      Count
+   };
+   const size_t numSections=static_cast<size_t>(Section::Count);
+
+   /// Data files whose size is recorded to detect stale snapshots
+   const char* const sourceFiles[] = {
+      "person.csv",
+      "person_knows_person.csv",
+      "comment_hasCreator_person.csv",
+      "comment_replyOf_comment.csv",
+      "person_hasInterest_tag.csv",
+      "person_isLocatedIn_place.csv",
+      "person_studyAt_organisation.csv",
+      "person_workAt_organisation.csv",
+      "organisation_isLocatedIn_place.csv",
+      "place_isPartOf_place.csv",
+      "place.csv",
+      "tag.csv"
+   };
+   const size_t numSourceFiles=sizeof(sourceFiles)/sizeof(sourceFiles[0]);
+
+   struct SectionEntry {
+      uint64_t offset;
+      uint64_t size;
+   };
+
+   struct Header {
+      uint64_t magic;
+      uint32_t version;
+      uint32_t layout;
+      uint64_t numPersons;
+      uint64_t sourceSizes[numSourceFiles];
+      SectionEntry sections[numSections];
+   };
+
+   /// Task graph nodes whose results are fully contained in a snapshot
+   const TaskGraph::Node restoredNodes[] = {
+      TaskGraph::PersonMapping,
+      TaskGraph::PersonGraph,
+      TaskGraph::CommentCreatorMap,
+      TaskGraph::HasInterest,
+      TaskGraph::Birthday,
+      TaskGraph::PersonPlace,
+      TaskGraph::NamePlace,
+      TaskGraph::InterestStatistics
+   };
+
+   /// Maps the snapshot and restores all contained indexes. Returns false if the
+   /// snapshot is missing, was written by an incompatible version or is stale.
+   bool load(const std::string& snapshotPath, const std::string& dataPath, FileIndexes& indexes);
+
+   /// Writes all indexes of the restored nodes to the snapshot file
+   void write(const std::string& snapshotPath, const std::string& dataPath, const FileIndexes& indexes);
+
+   /// Builds the tag index from a mapped snapshot
+   TagIndex* buildTagIndex(const io::MmapedFile& file, const unordered_set<awfy::StringRef>& usedTags, const bool allTags);
+}
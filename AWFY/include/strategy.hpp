@@ -0,0 +1,63 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+struct FileIndexes;
+namespace io { class MmapedFile; }
+
+/// Choice between the alternative algorithms of a query type. Strategies that are not set explicitly
+/// are selected from the number of queries of each type and the size of the data set before loading.
+namespace awfy {
+   namespace strategy {
+      /// How Query3 finds the pairs of persons at the place
+      enum class Query3Mode {
+         Bfs, // BFS from every person at the place
+         Inverted, // Pairs from per interest lists of the place persons, distances only of top k candidates
+         Auto // Cheaper of both by an estimate per query
+      };
+
+      /// Parses "bfs", "inverted" or "auto"
+      Query3Mode parseQuery3Mode(const char* name);
+      const char* query3ModeName(Query3Mode mode);
+
+      const uint64_t unknownCount = UINT64_MAX;
+
+      /// Size of the query batch and the data set, known before the indexes are loaded
+      struct Workload {
+         uint64_t queries[4]; // Queries per type, unknownCount if they are not known upfront
+         uint64_t persons; // Estimated from the size of person.csv
+
+         Workload();
+
+         /// Counts the queries of the types that are not excluded
+         void countQueries(const io::MmapedFile& queryFile, const bool* excludes);
+         void estimatePersons(const std::string& dataPath);
+      };
+
+      /// Strategies that were set explicitly and are kept
+      struct Fixed {
+         bool query2;
+         bool query3;
+      };
+
+      /// Selects the strategies that are not fixed and prints the choices
+      void select(const Workload& workload, const Fixed& fixed, FileIndexes& indexes);
+   }
+}
@@ -123,6 +123,10 @@ public:
       assert(id<mapFrom.size());
       return mapFrom[id];
    }
+
+   size_t memorySize() const {
+      return (mapTo.size()+mapFrom.size())*sizeof(PersonId)+numSubgraphPersons*sizeof(PersonGraph::Content)+subgraph.buffer.size;
+   }
 #else //Q4_BUILD_SUBGRAPH
 private:
    uint32_t numPersons;
@@ -152,5 +156,9 @@ public:
    inline PersonId mapFromSubgraph(PersonId id) const __attribute__((always_inline)) {
       return id;
    }
+
+   size_t memorySize() const {
+      return 0;
+   }
 #endif
 };
\ No newline at end of file
@@ -16,6 +16,7 @@ limitations under the License.
 
 #pragma once
 
+#include <memory>
 #include <vector>
 #include <utility>
 #include <cassert>
@@ -36,15 +37,16 @@ namespace awfy {
 
 
    /// Class managing a list of top k values
-   template<class Key, class Value>
+   template<class Key, class Value, class Alloc=std::allocator<std::pair<Key, Value>>>
    class TopKList {
    public:
       typedef std::pair<Key, Value> EntryPair;
-      typedef typename std::vector<EntryPair>::iterator EntryIter;
+      typedef std::vector<EntryPair, Alloc> EntryVector;
+      typedef typename EntryVector::iterator EntryIter;
 
    private:
       const EntryPair initialBound;
-      std::vector<EntryPair> topMatches;
+      EntryVector topMatches;
       size_t k;
 
       // Find insert position of element
@@ -76,7 +78,7 @@ namespace awfy {
       /// Try to insert a value into top k list, will not update if value is too small
       /// Returns the new bound
       void insert(const Key& key, const Value& value) {
-         EntryPair pair = make_pair(key, value);
+         EntryPair pair = std::make_pair(key, value);
          assert(compare(pair, initialBound)); //Everything we insert must be smaller than the initial bound
          // Insert entries in order until list is full
          if (topMatches.size() < k){
@@ -95,7 +97,7 @@ namespace awfy {
          return topMatches.back();
       }
 
-      const std::vector<EntryPair>& getEntries() {
+      const EntryVector& getEntries() {
          //Remove dummy element if necesary
          if(topMatches.size()>0 && topMatches.back() == initialBound) {
             topMatches.pop_back();
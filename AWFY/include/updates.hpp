@@ -0,0 +1,115 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "indexes.hpp"
+#include "io.hpp"
+#include "util/chrono.hpp"
+
+/// Append only updates of the indexes of a running instance. An update batch is a folder with csv
+/// files in the format of the data folder, only containing the new rows:
+///  person.csv, person_knows_person.csv, comment_hasCreator_person.csv, comment_replyOf_comment.csv,
+///  person_hasInterest_tag.csv, person_isLocatedIn_place.csv, person_studyAt_organisation.csv,
+///  person_workAt_organisation.csv and forum_hasMember_person.csv.
+/// Missing files are skipped. Tags, places, organisations and forum tags are static, rows that refer
+/// to unknown ones are ignored.
+namespace awfy {
+   namespace updates {
+      struct UpdateStats {
+         uint64_t persons;
+         uint64_t knows; // Undirected edges
+         uint64_t replies; // Replies that were added to the counts of friends
+         uint64_t interests;
+         uint64_t places;
+         uint64_t members;
+         uint64_t skipped; // Duplicates and rows that refer to unknown entities
+         uint64_t compactions;
+         awfy::chrono::Time duration;
+
+         UpdateStats();
+         std::string toString() const;
+      };
+
+      /// Takes over the person indexes of a FileIndexes instance and patches them in place.
+      /// The person graph and the commented graph are copied into a layout with free slots behind
+      /// every adjacency list, lists that run full move to a delta segment at the end of the buffer.
+      /// Once that is exhausted the graph is compacted with fresh slots for every list.
+      ///
+      /// Queries must not run while a batch is applied, afterwards the generation of the indexes is
+      /// incremented so that the query runners pick up the new state. Memory of the patched indexes
+      /// is owned by the updater, it has to outlive all queries on them.
+      ///
+      /// Replies are only counted once both persons know each other. Replies of a batch between persons
+      /// that are not friends yet are kept until the friendship arrives, replies of the base data are not.
+      class IndexUpdater {
+         typedef std::remove_pointer<PersonGraph::Content>::type FriendList;
+
+         FileIndexes& indexes;
+         const std::string dataPath;
+
+         // Person graph and commented graph share the offsets of their lists
+         PersonGraph* graph;
+         uint8_t* graphBuffer;
+         uint8_t* commentedBuffer;
+         size_t bufferSize;
+         size_t bufferUsed; // End of the delta segment
+         std::vector<uint32_t> capacities; // Entries that fit into the list of every person
+         size_t personCapacity; // Persons that fit into the graph index
+
+         std::vector<Birthday> birthdays;
+         HasInterestIndex* interests;
+         std::unordered_map<PersonId,std::vector<uint32_t>> interestLists; // Lists of the interest index that were changed
+         InterestStatistics* interestStats;
+         PersonPlaceIndex* places;
+         std::unordered_map<PersonId,std::vector<PlaceBounds>> placeLists; // Lists of the place index that were changed
+         std::vector<PlaceId> organizationPlaces;
+         std::vector<uint8_t*> memberBlocks;
+
+         std::unordered_map<uint64_t,PersonId> commentCreators; // Comments of the update batches by original id
+         io::MmapedFile* baseCreators; // Comment creators of the base data, sorted by comment id
+         std::unordered_map<uint64_t,uint32_t> pendingReplies; // Directed (parent creator, replier) pairs of non friends
+
+         void rebuildGraph(size_t newPersonCapacity);
+         FriendList* allocateList(PersonId person, uint32_t capacity);
+         bool addFriend(PersonId person, PersonId friendId, UpdateStats& stats);
+         void growPersons(PersonId numPersons, UpdateStats& stats);
+         PersonId creatorOf(uint64_t comment);
+
+         void applyPersons(const std::string& batchPath, UpdateStats& stats);
+         void applyPlaces(const std::string& batchPath, UpdateStats& stats);
+         void applyInterests(const std::string& batchPath, UpdateStats& stats);
+         void applyKnows(const std::string& batchPath, UpdateStats& stats);
+         void applyComments(const std::string& batchPath, UpdateStats& stats);
+         void applyMembers(const std::string& batchPath, UpdateStats& stats);
+
+      public:
+         IndexUpdater(FileIndexes& indexes, const std::string& dataPath);
+         ~IndexUpdater();
+
+         IndexUpdater(const IndexUpdater&) = delete;
+         IndexUpdater& operator=(const IndexUpdater&) = delete;
+
+         /// Applies all files of the batch folder
+         UpdateStats apply(const std::string& batchPath);
+         /// Rewrites the person graph with fresh free slots for every list
+         void compact();
+      };
+   }
+}
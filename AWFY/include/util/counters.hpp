@@ -16,9 +16,14 @@ limitations under the License.
 
 #pragma once
 
+#include <memory>
+#include <ostream>
+#include <string>
 #include <vector>
 #include "../metrics.hpp"
+#include "../concurrent/atomic.hpp"
 #include "chrono.hpp"
+#include "perfevents.hpp"
 
 namespace awfy {
    namespace counters {
@@ -40,22 +45,65 @@ namespace awfy {
          void end();
       };
 
+      /// Tasks are recorded for the trace in all build types once it is enabled, see ProgramCounters::writeTrace
+      struct Trace {
+         static bool enabled;
+         static __thread const char* label;
+
+         /// Names the kind of the running task in the trace, e.g. "chunk" or "morsel"
+         static void setLabel(const char* label) {
+            Trace::label=label;
+         }
+      };
+
+      struct TraceEvent {
+         awfy::chrono::Time start;
+         awfy::chrono::Time end;
+         unsigned groupId;
+         const char* label;
+         size_t numAllocations;
+         size_t allocatedMemory;
+      };
+
+      /// Hardware events counted per task with perf_event_open once enabled, see ProgramCounters::printHardwareStats
+      struct HardwareCounters {
+         static const unsigned numEvents=5;
+         static bool enabled;
+         static const char* names[numEvents];
+      };
+
+      struct HardwareStats {
+         uint64_t numTasks;
+         uint64_t events[HardwareCounters::numEvents];
+      };
+
       class ThreadCounters {
       public:
          unsigned threadId;
          std::vector<TaskCounters*> taskCounters;
          std::vector<awfy::chrono::TimeFrame> stallTimes;
+         std::vector<TraceEvent> traceEvents;
+         /// Opened by the thread itself in initThread, perf events count the thread that opens them
+         std::unique_ptr<awfy::perf::CounterGroup> hardwareEvents;
+         std::vector<HardwareStats> hardwareStats; // Indexed by group id
+         uint64_t hardwareStart[HardwareCounters::numEvents];
+         unsigned currentGroupId;
 
          ThreadCounters(const unsigned threadId);
          ~ThreadCounters();
 
          ThreadCounters(ThreadCounters&& other)
-            : threadId(other.threadId), taskCounters(move(other.taskCounters)), stallTimes(move(other.stallTimes))
+            : threadId(other.threadId), taskCounters(move(other.taskCounters)), stallTimes(move(other.stallTimes)), traceEvents(move(other.traceEvents)),
+              hardwareEvents(move(other.hardwareEvents)), hardwareStats(move(other.hardwareStats)), currentGroupId(other.currentGroupId)
          { }
          ThreadCounters& operator=(ThreadCounters&& other) {
             this->threadId=other.threadId;
             this->taskCounters=move(other.taskCounters);
             this->stallTimes=move(other.stallTimes);
+            this->traceEvents=move(other.traceEvents);
+            this->hardwareEvents=move(other.hardwareEvents);
+            this->hardwareStats=move(other.hardwareStats);
+            this->currentGroupId=other.currentGroupId;
             return *this;
          }
 
@@ -85,6 +133,31 @@ namespace awfy {
          ThreadCounters& getThreadCounters();
          AllocationStats getAllocationStats();
          void printStats();
+         /// Writes the recorded tasks of all threads in the Chrome trace event format, it can be opened in
+         /// chrome://tracing or Perfetto. Must be called after the executors finished.
+         void writeTrace(const std::string& path);
+         /// Hardware events per task graph node summed over all threads, must be called after the executors finished
+         void printHardwareStats(std::ostream& out);
+      };
+
+      /// Numa placement statistics. Task locality is counted in software, remote
+      /// memory accesses are taken from the numastat page counters of the kernel.
+      class NumaCounters {
+         static const unsigned maxNodes=64;
+         static awfy::atomic<uint64_t> localTasks[maxNodes];
+         static awfy::atomic<uint64_t> remoteTasks[maxNodes];
+         static awfy::atomic<uint64_t> placedBytes[maxNodes];
+         static awfy::atomic<uint64_t> placementTime[maxNodes];
+         static std::vector<std::pair<uint64_t,uint64_t>> startPages; // local_node and other_node pages per node
+
+      public:
+         /// Snapshots the numastat counters, the report covers the time since this call
+         static void start();
+         /// Counts a task that ran on the executor node but was scheduled for the home node
+         static void countTask(unsigned executorNode, unsigned homeNode);
+         /// Counts the bytes that were copied or migrated to the node
+         static void countPlacement(unsigned node, uint64_t bytes, awfy::chrono::Time duration);
+         static void print(std::ostream& out);
       };
 
       struct CurrentThread {
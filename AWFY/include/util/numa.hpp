@@ -0,0 +1,66 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/// NUMA placement of executors and read only indexes. The topology is read from
+/// sysfs, machines without NUMA information are treated as a single node.
+namespace awfy {
+   namespace numa {
+      enum class Mode {
+         Off,
+         Replicate, // Pin executors and copy the person graph to every node
+         Interleave // Pin executors and interleave the person graph pages over all nodes
+      };
+
+      /// Parses "off", "replicate" or "interleave", null disables numa placement
+      Mode parseMode(const char* name);
+      void setMode(Mode mode);
+      Mode mode();
+      inline bool enabled() {
+         return mode()!=Mode::Off;
+      }
+
+      struct Topology {
+         std::vector<unsigned> nodeIds; // Operating system ids of the nodes
+         std::vector<std::vector<unsigned>> nodeCpus;
+
+         static const Topology& get();
+         unsigned numNodes() const {
+            return nodeCpus.size();
+         }
+      };
+
+      /// Executors are spread round robin over the nodes
+      unsigned executorNode(unsigned executorId);
+      unsigned executorCpu(unsigned executorId);
+
+      /// Binds the calling thread to the cpu of the executor
+      void pinExecutor(unsigned executorId);
+      /// Node of the calling thread, 0 if it is not pinned
+      unsigned currentNode();
+
+      /// Runs the function once per node in parallel, each call on a thread bound to its node.
+      /// Memory that is touched first by the function is allocated on that node.
+      void runOnNodes(const std::function<void(unsigned node)>& fn);
+      /// Spreads the pages of the memory range over all nodes, returns false if the kernel refused
+      bool interleave(const void* data, size_t size);
+   }
+}
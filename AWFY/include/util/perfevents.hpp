@@ -0,0 +1,162 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/// Hardware counters of the calling thread via perf_event_open. Counters that the kernel or
+/// the perf_event_paranoid setting refuses stay invalid and read as zero.
+namespace awfy {
+   namespace perf {
+      class Counter {
+         int fd;
+
+      public:
+         /// Counts user space events of the calling thread, the counter starts disabled
+         Counter(uint32_t type, uint64_t config) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size=sizeof(attr);
+            attr.type=type;
+            attr.config=config;
+            attr.disabled=1;
+            attr.exclude_kernel=1;
+            attr.exclude_hv=1;
+            fd=syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+         }
+
+         ~Counter() {
+            if(fd>=0) {
+               close(fd);
+            }
+         }
+
+         Counter(const Counter&) = delete;
+         Counter& operator=(const Counter&) = delete;
+
+         inline bool valid() const {
+            return fd>=0;
+         }
+
+         inline void start() {
+            if(fd>=0) {
+               ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+               ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+         }
+
+         inline void stop() {
+            if(fd>=0) {
+               ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+         }
+
+         inline uint64_t read() const {
+            uint64_t value=0;
+            if(fd<0 || ::read(fd, &value, sizeof(value))!=sizeof(value)) {
+               return 0;
+            }
+            return value;
+         }
+      };
+
+      /// Events of the calling thread that are scheduled onto the PMU together and read with a single
+      /// syscall. The group runs from the first add on, callers take differences of read.
+      class CounterGroup {
+      public:
+         static const unsigned maxEvents=8;
+
+      private:
+         int leader;
+         int fds[maxEvents];
+         int slots[maxEvents]; // Position of an event in the group read, -1 if it could not be opened
+         unsigned numEvents;
+         unsigned numOpened;
+
+      public:
+         CounterGroup() : leader(-1), numEvents(0), numOpened(0) {
+         }
+
+         ~CounterGroup() {
+            for(unsigned i=0; i<numEvents; i++) {
+               if(fds[i]>=0) {
+                  close(fds[i]);
+               }
+            }
+         }
+
+         CounterGroup(const CounterGroup&) = delete;
+         CounterGroup& operator=(const CounterGroup&) = delete;
+
+         /// Returns false if the event is not supported or not permitted, it then reads as zero
+         bool add(uint32_t type, uint64_t config) {
+            if(numEvents==maxEvents) {
+               return false;
+            }
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size=sizeof(attr);
+            attr.type=type;
+            attr.config=config;
+            attr.exclude_kernel=1;
+            attr.exclude_hv=1;
+            attr.read_format=PERF_FORMAT_GROUP|PERF_FORMAT_TOTAL_TIME_ENABLED|PERF_FORMAT_TOTAL_TIME_RUNNING;
+            const int fd=syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+            fds[numEvents]=fd;
+            slots[numEvents]=fd>=0 ? numOpened++ : -1;
+            if(fd>=0 && leader<0) {
+               leader=fd;
+            }
+            numEvents++;
+            return fd>=0;
+         }
+
+         inline bool valid() const {
+            return numOpened>0;
+         }
+
+         inline bool valid(unsigned event) const {
+            return event<numEvents && slots[event]>=0;
+         }
+
+         /// Writes the count of every added event, scaled up if the kernel had to multiplex the group
+         void read(uint64_t* values) const {
+            uint64_t buffer[3+maxEvents];
+            const ssize_t expected=(3+numOpened)*sizeof(uint64_t);
+            if(leader<0 || ::read(leader, buffer, sizeof(buffer))!=expected) {
+               memset(values, 0, numEvents*sizeof(uint64_t));
+               return;
+            }
+            const uint64_t enabled=buffer[1], running=buffer[2];
+            for(unsigned i=0; i<numEvents; i++) {
+               if(slots[i]<0) {
+                  values[i]=0;
+               } else if(running==0 || running==enabled) {
+                  values[i]=buffer[3+slots[i]];
+               } else {
+                  values[i]=static_cast<uint64_t>(static_cast<double>(buffer[3+slots[i]])*enabled/running);
+               }
+            }
+         }
+      };
+   }
+}
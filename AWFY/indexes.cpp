@@ -22,6 +22,15 @@ limitations under the License.
 #include "include/indexers.hpp"
 #include "include/alloc.hpp"
 #include "include/metrics.hpp"
+#include "include/snapshot.hpp"
+#include "include/util/numa.hpp"
+#include "include/compressedgraph.hpp"
+#include "include/birthdaycomponents.hpp"
+#include "include/replylabels.hpp"
+#include "include/replygraph.hpp"
+#include "include/landmarklabels.hpp"
+#include "include/reorder.hpp"
+#include "include/strategy.hpp"
 
 static const unsigned unroll=32;
 
@@ -44,7 +53,7 @@ TaskGroup scheduleHasMemberIndex(const HasMemberIndex** targetPtr, const string&
    return unsortedGroupingIndex<HasMemberIndex, IdentityMapper<ForumId>, PersonMapper,false, true, true, false /*keys out*/, true /*filter*/>(TaskGraph::HasForum, targetPtr, dataDir+"forum_hasMember_person.csv", *mapper, usedForums.size(), personMapper, memberDummy, usedForums);
 }
 
-TagIndex* buildTagIndex(const string& dataDir, const unordered_set<awfy::StringRef>& usedTags)
+TagIndex* buildTagIndex(const string& dataDir, const unordered_set<awfy::StringRef>& usedTags, const bool allTags)
 {
    awfy::AllocatorRef allocator = awfy::Allocator::get();
 
@@ -69,7 +78,7 @@ TagIndex* buildTagIndex(const string& dataDir, const unordered_set<awfy::StringR
 
       //If this tag is used in a Q4, add its id to used tags
       awfy::StringRef tagStr(strPtr,tagLength);
-      if(usedTags.find(tagStr)!=usedTags.end()) {
+      if(allTags || usedTags.find(tagStr)!=usedTags.end()) {
          index->usedTags.insert(id);
       }
 
@@ -368,6 +377,7 @@ struct BuildOrSchedulePersonCommentedIndex_ProcessChunk {
    { }
 
    void operator()() {
+      awfy::counters::Trace::setLabel("chunk");
       tokenize::Tokenizer innerTokenizer=chunks->getTokenizer(i);
 
       // run madvise after every MADVISEAFTER chunks
@@ -545,6 +555,7 @@ struct BuildPersonCommentedIndex_Streaming_ProcessChunk {
    }
 
    void operator()() {
+      awfy::counters::Trace::setLabel("chunk");
       tokenize::Tokenizer replyOfFileTokenizer=replyOfCommentChunks->getTokenizer(i);
       const auto chunkStart = replyOfFileTokenizer.getPositionPtr();
       const auto chunkSize = replyOfCommentChunks->chunkSize;
@@ -745,7 +756,36 @@ struct TagBuilder {
 
    static void* build(TagBuilder* builder) {
       metrics::BlockStats<>::LogSensor sensor("tag");
-      builder->indexes->tagIndex=buildTagIndex(builder->dataPath, builder->usedTags);
+      builder->indexes->tagIndex=buildTagIndex(builder->dataPath, builder->usedTags, builder->indexes->indexAllTags);
+      delete builder;
+      return nullptr;
+   }
+};
+
+struct SnapshotTagBuilder {
+   FileIndexes* indexes;
+   const unordered_set<awfy::StringRef>& usedTags;
+
+   SnapshotTagBuilder(FileIndexes* indexes, const unordered_set<awfy::StringRef>& usedTags) : indexes(indexes), usedTags(usedTags) {
+   }
+
+   static void* build(SnapshotTagBuilder* builder) {
+      metrics::BlockStats<>::LogSensor sensor("tag");
+      builder->indexes->tagIndex=snapshot::buildTagIndex(*(builder->indexes->snapshotFile), builder->usedTags, builder->indexes->indexAllTags);
+      delete builder;
+      return nullptr;
+   }
+};
+
+struct SnapshotBuilder {
+   const string& dataPath;
+   FileIndexes* indexes;
+
+   SnapshotBuilder(const string& dataPath, FileIndexes* indexes) : dataPath(dataPath), indexes(indexes) {
+   }
+
+   static void* build(SnapshotBuilder* builder) {
+      snapshot::write(builder->indexes->snapshotPath, builder->dataPath, *(builder->indexes));
       delete builder;
       return nullptr;
    }
@@ -1013,64 +1053,493 @@ struct PersonMappingBuilder {
    }
 };
 
-FileIndexes::FileIndexes() : personGraph(nullptr), personCommentedGraph(nullptr), birthdayIndex(nullptr),
+/// Copies the buffer into memory that is first touched by the calling thread
+static void* copyBuffer(const void* data, size_t size) {
+   void* copy;
+   auto ret=posix_memalign(&copy,64,size);
+   if(unlikely(ret!=0)) {
+      throw -1;
+   }
+   memcpy(copy,data,size);
+   return copy;
+}
+
+static void interleaveBuffer(const void* data, size_t size) {
+   const auto start=awfy::chrono::now();
+   if(!awfy::numa::interleave(data, size)) {
+      LOG_PRINT("[NUMA] Could not interleave "<<size<<" bytes");
+      return;
+   }
+   const auto numNodes=awfy::numa::Topology::get().numNodes();
+   const auto duration=awfy::chrono::now()-start;
+   for(unsigned node=0; node<numNodes; node++) {
+      awfy::counters::NumaCounters::countPlacement(node, size/numNodes, duration);
+   }
+}
+
+/// Places the person graph on the numa nodes, either as one replica per node or interleaved
+struct NumaPersonGraphBuilder {
+   FileIndexes* indexes;
+
+   NumaPersonGraphBuilder(FileIndexes* indexes) : indexes(indexes) {
+   }
+
+   static const PersonGraph* replicate(const PersonGraph& personGraph, size_t numPersons) {
+      PersonGraph* replica=new PersonGraph(numPersons);
+      uint8_t* buffer=reinterpret_cast<uint8_t*>(copyBuffer(personGraph.buffer.data, personGraph.buffer.size));
+      replica->buffer.data=buffer;
+      replica->buffer.size=personGraph.buffer.size;
+
+      // Lists keep their offset in the buffer, so the commented graph offsets stay valid
+      const uint8_t* base=reinterpret_cast<const uint8_t*>(personGraph.buffer.data);
+      for(PersonId person=0; person<=personGraph.maxKey(); person++) {
+         const auto list=personGraph.retrieve(person);
+         if(list!=nullptr) {
+            replica->insert(person, reinterpret_cast<PersonGraph::Content>(buffer+(reinterpret_cast<const uint8_t*>(list)-base)));
+         }
+      }
+      return replica;
+   }
+
+   static void place(FileIndexes& indexes) {
+      const PersonGraph& personGraph=*indexes.personGraph;
+      const size_t numPersons=indexes.personMapper.count();
+      const auto numNodes=awfy::numa::Topology::get().numNodes();
+
+      if(awfy::numa::mode()==awfy::numa::Mode::Interleave) {
+         interleaveBuffer(personGraph.data, numPersons*sizeof(PersonGraph::Content));
+         interleaveBuffer(personGraph.buffer.data, personGraph.buffer.size);
+      } else if(numNodes>1) {
+         indexes.personGraphReplicas.resize(numNodes);
+         awfy::numa::runOnNodes([&](unsigned node) {
+            const auto start=awfy::chrono::now();
+            indexes.personGraphReplicas[node]=replicate(personGraph, numPersons);
+            awfy::counters::NumaCounters::countPlacement(node, personGraph.buffer.size+numPersons*sizeof(PersonGraph::Content),
+               awfy::chrono::now()-start);
+         });
+      }
+   }
+
+   static void* build(NumaPersonGraphBuilder* builder) {
+      metrics::BlockStats<>::LogSensor sensor("numaPersonGraph");
+      place(*builder->indexes);
+
+      delete builder;
+      return nullptr;
+   }
+};
+
+/// Places the commented graph like the person graph, it shares the buffer layout of the person graph
+struct NumaCommentedGraphBuilder {
+   FileIndexes* indexes;
+
+   NumaCommentedGraphBuilder(FileIndexes* indexes) : indexes(indexes) {
+   }
+
+   static void place(FileIndexes& indexes) {
+      const size_t size=indexes.personGraph->buffer.size;
+      const auto numNodes=awfy::numa::Topology::get().numNodes();
+
+      if(awfy::numa::mode()==awfy::numa::Mode::Interleave) {
+         interleaveBuffer(indexes.personCommentedGraph, size);
+      } else if(numNodes>1) {
+         indexes.personCommentedReplicas.resize(numNodes);
+         awfy::numa::runOnNodes([&](unsigned node) {
+            const auto start=awfy::chrono::now();
+            indexes.personCommentedReplicas[node]=copyBuffer(indexes.personCommentedGraph, size);
+            awfy::counters::NumaCounters::countPlacement(node, size, awfy::chrono::now()-start);
+         });
+      }
+   }
+
+   static void* build(NumaCommentedGraphBuilder* builder) {
+      metrics::BlockStats<>::LogSensor sensor("numaCommentedGraph");
+      place(*builder->indexes);
+
+      delete builder;
+      return nullptr;
+   }
+};
+
+/// Relabels the persons for locality and rewrites every index that is addressed by or contains person ids.
+/// Runs once all person indexes are built and before any query, the person mapper translates the query
+/// parameters and results afterwards.
+struct PersonReorderBuilder {
+   FileIndexes* indexes;
+
+   PersonReorderBuilder(FileIndexes* indexes) : indexes(indexes) {
+   }
+
+   template<class T>
+   static T* allocBuffer(size_t size) {
+      T* buffer;
+      auto ret=posix_memalign(reinterpret_cast<void**>(&buffer),64,size);
+      if(unlikely(ret!=0)) {
+         throw -1;
+      }
+      return buffer;
+   }
+
+   /// Rebuilds the person graph and the commented graph in the new order, lists are sorted by the new ids.
+   /// Both graphs keep sharing the offsets of their lists.
+   static void relabelPersonGraph(FileIndexes& indexes, const vector<PersonId>& newToOld, const vector<PersonId>& oldToNew) {
+      typedef typename std::remove_pointer<PersonGraph::Content>::type List;
+      const PersonGraph& oldGraph=*indexes.personGraph;
+      const uint8_t* oldBase=reinterpret_cast<const uint8_t*>(oldGraph.buffer.data);
+      const uint8_t* oldCommented=reinterpret_cast<const uint8_t*>(indexes.personCommentedGraph);
+      const size_t numPersons=newToOld.size();
+
+      size_t dataSize=0;
+      for(PersonId person=0; person<numPersons; person++) {
+         const auto friends=oldGraph.retrieve(person);
+         if(friends!=nullptr) {
+            dataSize+=sizeof(List::Size)+friends->size()*sizeof(PersonId);
+         }
+      }
+      uint8_t* base=allocBuffer<uint8_t>(dataSize);
+      uint8_t* commented=oldCommented!=nullptr ? allocBuffer<uint8_t>(dataSize) : nullptr;
+
+      PersonGraph* graph=new PersonGraph(numPersons);
+      graph->buffer.data=base;
+      graph->buffer.size=dataSize;
+      vector<pair<PersonId,PersonGraph::Id>> entries;
+      size_t offset=0;
+      for(PersonId person=0; person<numPersons; person++) {
+         const auto friends=oldGraph.retrieve(newToOld[person]);
+         if(friends==nullptr) { continue; }
+
+         const size_t oldOffset=reinterpret_cast<const uint8_t*>(friends)-oldBase;
+         const List* oldCounts=reinterpret_cast<const List*>(oldCommented+oldOffset);
+         entries.resize(friends->size());
+         for(uint32_t i=0; i<friends->size(); i++) {
+            entries[i]=make_pair(oldToNew[*friends->getPtr(i)], oldCommented!=nullptr ? *oldCounts->getPtr(i) : 0);
+         }
+         sort(entries.begin(), entries.end());
+
+         List* list=reinterpret_cast<List*>(base+offset);
+         list->setSize(entries.size());
+         for(uint32_t i=0; i<entries.size(); i++) {
+            *list->getPtr(i)=entries[i].first;
+         }
+         if(commented!=nullptr) {
+            List* counts=reinterpret_cast<List*>(commented+offset);
+            counts->setSize(entries.size());
+            for(uint32_t i=0; i<entries.size(); i++) {
+               *counts->getPtr(i)=entries[i].second;
+            }
+         }
+         graph->insert(person, list);
+         offset+=sizeof(List::Size)+entries.size()*sizeof(PersonId);
+      }
+      assert(offset==dataSize);
+
+      // The old buffers stay allocated, they may be owned by the indexer allocations
+      indexes.personGraph=graph;
+      if(commented!=nullptr) {
+         indexes.personCommentedGraph=commented;
+      }
+   }
+
+   static void* build(PersonReorderBuilder* builder) {
+      metrics::BlockStats<>::LogSensor sensor("personReorder");
+      FileIndexes& indexes=*builder->indexes;
+      const uint32_t numPersons=indexes.personMapper.count();
+
+      vector<PersonId> newToOld=awfy::reorder::computeOrder(*indexes.personGraph, numPersons, indexes.personOrder);
+      assert(newToOld.size()==numPersons);
+      vector<PersonId> oldToNew(numPersons);
+      for(PersonId person=0; person<numPersons; person++) {
+         oldToNew[newToOld[person]]=person;
+      }
+
+      relabelPersonGraph(indexes, newToOld, oldToNew);
+
+      if(indexes.birthdayIndex!=nullptr) {
+         Birthday* birthdays=allocBuffer<Birthday>(numPersons*sizeof(Birthday));
+         for(PersonId person=0; person<numPersons; person++) {
+            birthdays[person]=indexes.birthdayIndex[newToOld[person]];
+         }
+         indexes.birthdayIndex=birthdays;
+      }
+
+      if(indexes.hasInterestIndex!=nullptr) {
+         HasInterestIndex* interests=const_cast<HasInterestIndex*>(indexes.hasInterestIndex);
+         vector<HasInterestIndex::Content> oldInterests(numPersons);
+         for(PersonId person=0; person<numPersons; person++) {
+            oldInterests[person]=interests->retrieve(person);
+         }
+         for(PersonId person=0; person<numPersons; person++) {
+            interests->insert(person, oldInterests[newToOld[person]]);
+         }
+      }
+
+      if(indexes.personPlaceIndex!=nullptr) {
+         PersonPlaceIndex* places=const_cast<PersonPlaceIndex*>(indexes.personPlaceIndex);
+         // Persons without any place may be missing at the end, they get the empty list
+         vector<const PlaceBounds*> oldPlaces(move(places->places));
+         oldPlaces.resize(numPersons, &placeSeparator);
+         places->places.resize(numPersons);
+         for(PersonId person=0; person<numPersons; person++) {
+            places->places[person]=oldPlaces[newToOld[person]];
+         }
+      }
+
+      // Member lists are only built for the forums of used tags
+      if(indexes.hasMemberIndex!=nullptr) {
+         const HasMemberIndex& members=*indexes.hasMemberIndex;
+         const auto& forums=indexes.tagInForumsIndex.forums;
+         for(auto forumIter=forums.cbegin(); forumIter!=forums.cend(); forumIter++) {
+            auto forumMembers=const_cast<HasMemberIndex::Content>(members.retrieve(*forumIter));
+            if(forumMembers==members.end()) { continue; }
+            auto memberList=forumMembers->firstList();
+            do {
+               for(uint32_t i=0; i<memberList->size(); i++) {
+                  PersonId* member=const_cast<PersonId*>(memberList->getPtr(i));
+                  *member=oldToNew[*member];
+               }
+            } while((memberList=forumMembers->nextList(memberList))!=nullptr);
+         }
+      }
+
+      indexes.originalPersonIds=move(newToOld);
+      indexes.relabeledPersonIds=move(oldToNew);
+      indexes.personMapper.relabel(indexes.relabeledPersonIds.data(), indexes.originalPersonIds.data());
+      LOG_PRINT("[Reorder] Relabeled "<<numPersons<<" persons in "<<awfy::reorder::orderName(indexes.personOrder)<<" order");
+
+      delete builder;
+      return nullptr;
+   }
+};
+
+/// Encodes the person graph for the BFS loops of Q2 and Q3, the raw graph stays for Q1 and Q4
+struct CompressedPersonGraphBuilder {
+   FileIndexes* indexes;
+
+   CompressedPersonGraphBuilder(FileIndexes* indexes) : indexes(indexes) {
+   }
+
+   static void* build(CompressedPersonGraphBuilder* builder) {
+      metrics::BlockStats<>::LogSensor sensor("compressedPersonGraph");
+      FileIndexes& indexes=*builder->indexes;
+      const PersonGraph& personGraph=*indexes.personGraph;
+      const size_t numPersons=indexes.personMapper.count();
+
+      auto compressed=new awfy::CompressedPersonGraph(personGraph, numPersons);
+      LOG_PRINT("[CompressedPersonGraph] "<<compressed->edges()<<" edges in "<<compressed->memorySize()/1024<<" kb compared to "
+         <<(personGraph.buffer.size+numPersons*sizeof(PersonGraph::Content))/1024<<" kb");
+      indexes.compressedPersonGraph=compressed;
+
+      delete builder;
+      return nullptr;
+   }
+};
+
+/// Sweeps the persons by birthday so that Q2 is answered without BFS
+struct BirthdayComponentsBuilder {
+   FileIndexes* indexes;
+
+   BirthdayComponentsBuilder(FileIndexes* indexes) : indexes(indexes) {
+   }
+
+   static void* build(BirthdayComponentsBuilder* builder) {
+      metrics::BlockStats<>::LogSensor sensor("birthdayComponents");
+      FileIndexes& indexes=*builder->indexes;
+
+      auto components=new awfy::BirthdayComponentIndex(*indexes.personGraph, indexes.birthdayIndex, *indexes.hasInterestIndex,
+         *indexes.interestStatistics, indexes.personMapper.count());
+      LOG_PRINT("[BirthdayComponents] "<<components->getEntries().size()<<" interests with "<<components->numSteps()<<" steps in "
+         <<components->memorySize()/1024<<" kb");
+      indexes.birthdayComponents=components;
+
+      delete builder;
+      return nullptr;
+   }
+};
+
+/// Labels the components of the Q1 graph for every comment bound, one task per bound
+struct ReplyLabelsBuilder {
+   ScheduleGraph& taskGraph;
+   Scheduler& scheduler;
+   FileIndexes* indexes;
+
+   ReplyLabelsBuilder(ScheduleGraph& taskGraph, Scheduler& scheduler, FileIndexes* indexes)
+      : taskGraph(taskGraph), scheduler(scheduler), indexes(indexes) {
+   }
+
+   static void* build(ReplyLabelsBuilder* builder) {
+      FileIndexes& indexes=*builder->indexes;
+      auto labels=new awfy::ReplyComponentLabels(*indexes.personGraph, indexes.personCommentedGraph, indexes.personMapper.count(),
+         indexes.replyLabelMaxNum);
+
+      TaskGroup tasks;
+      for(uint32_t level=0; level<labels->numLevels(); level++) {
+         tasks.schedule(LambdaRunner::createLambdaTask([labels, level]() { labels->buildLevel(level); }, TaskGraph::ReplyLabels));
+      }
+      ScheduleGraph& taskGraph=builder->taskGraph;
+      tasks.join(LambdaRunner::createLambdaTask([&taskGraph, &indexes, labels]() {
+         labels->finish();
+         LOG_PRINT("[ReplyLabels] "<<labels->numLevels()<<" levels in "<<labels->memorySize()/1024<<" kb");
+         indexes.replyLabels=labels;
+         taskGraph.updateTask(TaskGraph::ReplyLabels, -1);
+      }, TaskGraph::ReplyLabels));
+
+      // Only allow to continue after join has finished
+      taskGraph.updateTask(TaskGraph::ReplyLabels, 1);
+      builder->scheduler.schedule(tasks.close(), Priorities::CRITICAL);
+      delete builder;
+      return nullptr;
+   }
+};
+
+/// Sorts the friend lists by mutual replies for the Q1 search, the raw graph stays for the other queries
+struct ReplySortedGraphBuilder {
+   FileIndexes* indexes;
+
+   ReplySortedGraphBuilder(FileIndexes* indexes) : indexes(indexes) {
+   }
+
+   static void* build(ReplySortedGraphBuilder* builder) {
+      metrics::BlockStats<>::LogSensor sensor("replySortedGraph");
+      FileIndexes& indexes=*builder->indexes;
+
+      auto graph=new awfy::ReplySortedGraph(*indexes.personGraph, indexes.personCommentedGraph, indexes.personMapper.count());
+      LOG_PRINT("[ReplySortedGraph] "<<graph->edges()<<" edges in "<<graph->memorySize()/1024<<" kb");
+      indexes.replyGraph=graph;
+
+      delete builder;
+      return nullptr;
+   }
+};
+
+/// Labels the person graph for distance lookups, the batches of roots run one after another with
+/// one task per group of roots
+struct LandmarkLabelsBuilder {
+   static const uint32_t rootsPerTask=16;
+
+   ScheduleGraph& taskGraph;
+   Scheduler& scheduler;
+   FileIndexes* indexes;
+
+   LandmarkLabelsBuilder(ScheduleGraph& taskGraph, Scheduler& scheduler, FileIndexes* indexes)
+      : taskGraph(taskGraph), scheduler(scheduler), indexes(indexes) {
+   }
+
+   static void scheduleBatch(ScheduleGraph& taskGraph, Scheduler& scheduler, FileIndexes& indexes, awfy::LandmarkLabels* labels, uint32_t batch) {
+      const uint32_t begin=labels->batchBegin(batch);
+      const uint32_t end=labels->batchBegin(batch+1);
+
+      TaskGroup tasks;
+      if(batch==0) {
+         // The first roots depend on each other and run in one task
+         tasks.schedule(LambdaRunner::createLambdaTask([labels, begin, end]() {
+            labels->labelBatch(0, begin, end);
+         }, TaskGraph::LandmarkLabels));
+      } else {
+         for(uint32_t rank=begin; rank<end; rank+=rootsPerTask) {
+            const uint32_t partEnd=std::min(end, rank+rootsPerTask);
+            tasks.schedule(LambdaRunner::createLambdaTask([labels, batch, rank, partEnd]() {
+               labels->labelBatch(batch, rank, partEnd);
+            }, TaskGraph::LandmarkLabels));
+         }
+      }
+      tasks.join(LambdaRunner::createLambdaTask([&taskGraph, &scheduler, &indexes, labels, batch]() {
+         labels->commitBatch(batch);
+         if(batch+1<labels->numBatches()) {
+            scheduleBatch(taskGraph, scheduler, indexes, labels, batch+1);
+            return;
+         }
+         if(labels->finish()) {
+            LOG_PRINT("[LandmarkLabels] "<<labels->entries()<<" labels in "<<labels->memorySize()/1024<<" kb");
+            indexes.landmarkLabels=labels;
+         } else {
+            LOG_PRINT("[LandmarkLabels] Exceeded "<<indexes.landmarkLabelBytes/1024<<" kb, query 1 keeps searching");
+            delete labels;
+         }
+         taskGraph.updateTask(TaskGraph::LandmarkLabels, -1);
+      }, TaskGraph::LandmarkLabels));
+      scheduler.schedule(tasks.close(), Priorities::CRITICAL);
+   }
+
+   static void* build(LandmarkLabelsBuilder* builder) {
+      FileIndexes& indexes=*builder->indexes;
+      auto labels=new awfy::LandmarkLabels(*indexes.personGraph, indexes.personMapper.count(), indexes.landmarkLabelBytes);
+
+      // Only allow to continue after the last batch has finished
+      builder->taskGraph.updateTask(TaskGraph::LandmarkLabels, 1);
+      scheduleBatch(builder->taskGraph, builder->scheduler, indexes, labels, 0);
+      delete builder;
+      return nullptr;
+   }
+};
+
+FileIndexes::FileIndexes() : personGraph(nullptr), compressedPersonGraph(nullptr), personCommentedGraph(nullptr), replyLabels(nullptr), replyGraph(nullptr), landmarkLabels(nullptr), birthdayIndex(nullptr),
    hasInterestIndex(nullptr), tagIndex(nullptr), placeBoundsIndex(nullptr), personPlaceIndex(nullptr),
-   namePlaceIndex(nullptr), hasMemberIndex(nullptr) {
+   namePlaceIndex(nullptr), hasMemberIndex(nullptr), birthdayComponents(nullptr), snapshotFile(nullptr), indexAllTags(false),
+   hybridBFS(false), compressedGraph(false), birthdaySweep(false), query3Mode(awfy::strategy::Query3Mode::Bfs), replyLabelMaxNum(-2), replySortedGraph(false), landmarkLabelBytes(0), query4CacheBytes(0), personOrder(awfy::reorder::Order::None), generation(0) {
 
 }
 void FileIndexes::setupIndexTasks(Scheduler& scheduler, ScheduleGraph& taskGraph, const string& dataPath, const unordered_set<awfy::StringRef>& usedTags) {
-   taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::PersonMapping,
-      builderTask(new PersonMappingBuilder(dataPath, this), TaskGraph::PersonMapping));
+   const bool restored=snapshotFile!=nullptr;
+   if(!restored) {
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::PersonMapping,
+         builderTask(new PersonMappingBuilder(dataPath, this), TaskGraph::PersonMapping));
 
-   taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::PersonGraph,
-      builderTask(new PersonGraphBuilder(taskGraph, scheduler, dataPath, this), TaskGraph::PersonGraph));
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::PersonGraph,
+         builderTask(new PersonGraphBuilder(taskGraph, scheduler, dataPath, this), TaskGraph::PersonGraph));
 
-   taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::CommentCreatorMap,
-      builderTask(new CommentCreatorMapBuilder(taskGraph, scheduler, dataPath, this), TaskGraph::CommentCreatorMap));
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::CommentCreatorMap,
+         builderTask(new CommentCreatorMapBuilder(taskGraph, scheduler, dataPath, this), TaskGraph::CommentCreatorMap));
 
-   taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::HasInterest,
-      builderTask(new HasInterestBuilder(taskGraph, scheduler, dataPath, this), TaskGraph::HasInterest));
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::HasInterest,
+         builderTask(new HasInterestBuilder(taskGraph, scheduler, dataPath, this), TaskGraph::HasInterest));
 
-   taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::Birthday, 
-      builderTask(new BirthdayBuilder(dataPath, this), TaskGraph::Birthday));
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::Birthday, 
+         builderTask(new BirthdayBuilder(dataPath, this), TaskGraph::Birthday));
 
-   taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::PersonPlace, 
-      builderTask(new PersonPlaceBuilder(dataPath, this), TaskGraph::PersonPlace));
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::PersonPlace, 
+         builderTask(new PersonPlaceBuilder(dataPath, this), TaskGraph::PersonPlace));
 
-   taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::HasForum, 
-      builderTask(new HasForumBuilder(taskGraph, scheduler, dataPath, this), TaskGraph::HasForum));
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::NamePlace, 
+         builderTask(new NamePlaceBuilder(dataPath, this), TaskGraph::NamePlace));
 
-   taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::Tag,
-      builderTask(new TagBuilder(dataPath, this, usedTags), TaskGraph::Tag));
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::InterestStatistics,
+         builderTask(new InterestStatisticsBuilder(this),  TaskGraph::InterestStatistics));
 
-   taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::NamePlace, 
-      builderTask(new NamePlaceBuilder(dataPath, this), TaskGraph::NamePlace));
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::Tag,
+         builderTask(new TagBuilder(dataPath, this, usedTags), TaskGraph::Tag));
+   } else {
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::Tag,
+         builderTask(new SnapshotTagBuilder(this, usedTags), TaskGraph::Tag));
+   }
+
+   taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::HasForum, 
+      builderTask(new HasForumBuilder(taskGraph, scheduler, dataPath, this), TaskGraph::HasForum));
 
    taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::TagInForums,
       builderTask(new TagInForumsBuilder(taskGraph, scheduler, dataPath, this),  TaskGraph::TagInForums));
 
-   taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::InterestStatistics,
-      builderTask(new InterestStatisticsBuilder(this),  TaskGraph::InterestStatistics));
-
    // Add indexing dependencies
-   taskGraph.addEdge(TaskGraph::Initialize, TaskGraph::PersonMapping);
-   taskGraph.addEdge(TaskGraph::PersonMapping, TaskGraph::PersonGraph);
-   taskGraph.addEdge(TaskGraph::PersonMapping, TaskGraph::HasInterest);
-   taskGraph.addEdge(TaskGraph::PersonMapping, TaskGraph::Birthday);
-   taskGraph.addEdge(TaskGraph::PersonMapping, TaskGraph::PersonPlace);
-   taskGraph.addEdge(TaskGraph::PersonGraph, TaskGraph::CommentCreatorMap);
-   taskGraph.addEdge(TaskGraph::IndexQ2orQ3, TaskGraph::HasInterest);
-   taskGraph.addEdge(TaskGraph::IndexQ2, TaskGraph::Birthday);
-   taskGraph.addEdge(TaskGraph::IndexQ3, TaskGraph::PersonPlace);
+   if(!restored) {
+      taskGraph.addEdge(TaskGraph::Initialize, TaskGraph::PersonMapping);
+      taskGraph.addEdge(TaskGraph::PersonMapping, TaskGraph::PersonGraph);
+      taskGraph.addEdge(TaskGraph::PersonMapping, TaskGraph::HasInterest);
+      taskGraph.addEdge(TaskGraph::PersonMapping, TaskGraph::Birthday);
+      taskGraph.addEdge(TaskGraph::PersonMapping, TaskGraph::PersonPlace);
+      taskGraph.addEdge(TaskGraph::PersonMapping, TaskGraph::HasForum); // Member index maps person ids
+      taskGraph.addEdge(TaskGraph::PersonGraph, TaskGraph::CommentCreatorMap);
+      taskGraph.addEdge(TaskGraph::IndexQ2orQ3, TaskGraph::HasInterest);
+      taskGraph.addEdge(TaskGraph::IndexQ2, TaskGraph::Birthday);
+      taskGraph.addEdge(TaskGraph::IndexQ3, TaskGraph::PersonPlace);
+      taskGraph.addEdge(TaskGraph::IndexQ3, TaskGraph::NamePlace);
+      taskGraph.addEdge(TaskGraph::HasInterest, TaskGraph::InterestStatistics);
+      taskGraph.addEdge(TaskGraph::Birthday, TaskGraph::InterestStatistics);
+   }
    taskGraph.addEdge(TaskGraph::IndexQ4, TaskGraph::HasForum);
    taskGraph.addEdge(TaskGraph::IndexQ2orQ4, TaskGraph::Tag);
-   taskGraph.addEdge(TaskGraph::IndexQ3, TaskGraph::NamePlace);
    taskGraph.addEdge(TaskGraph::QueryLoading, TaskGraph::Tag);
    taskGraph.addEdge(TaskGraph::Tag, TaskGraph::TagInForums);
    taskGraph.addEdge(TaskGraph::TagInForums, TaskGraph::HasForum);
    taskGraph.addEdge(TaskGraph::IndexQ4, TaskGraph::TagInForums);
-   taskGraph.addEdge(TaskGraph::HasInterest, TaskGraph::InterestStatistics);
-   taskGraph.addEdge(TaskGraph::Birthday, TaskGraph::InterestStatistics);
 
    // Add query dependencies
    taskGraph.addEdge(TaskGraph::PersonGraph, TaskGraph::Query4);
@@ -1088,4 +1557,195 @@ void FileIndexes::setupIndexTasks(Scheduler& scheduler, ScheduleGraph& taskGraph
    taskGraph.addEdge(TaskGraph::HasForum, TaskGraph::Query4);
    taskGraph.addEdge(TaskGraph::Tag, TaskGraph::Query4);
    taskGraph.addEdge(TaskGraph::TagInForums, TaskGraph::Query4);
+
+   // Relabeling needs all person indexes, the derived graphs below are built from the relabeled ones
+   const bool reorder=personOrder!=awfy::reorder::Order::None;
+   if(reorder) {
+      assert(!restored);
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::PersonReorder,
+         builderTask(new PersonReorderBuilder(this), TaskGraph::PersonReorder));
+
+      const TaskGraph::Node personIndexes[] = { TaskGraph::PersonGraph, TaskGraph::CommentCreatorMap, TaskGraph::HasInterest,
+         TaskGraph::Birthday, TaskGraph::PersonPlace, TaskGraph::HasForum, TaskGraph::InterestStatistics };
+      for(auto node : personIndexes) {
+         taskGraph.addEdge(node, TaskGraph::PersonReorder);
+      }
+      taskGraph.addEdge(TaskGraph::PersonReorder, TaskGraph::Query1);
+      taskGraph.addEdge(TaskGraph::PersonReorder, TaskGraph::Query2);
+      taskGraph.addEdge(TaskGraph::PersonReorder, TaskGraph::Query3);
+      taskGraph.addEdge(TaskGraph::PersonReorder, TaskGraph::Query4);
+   }
+
+   // Replicas are placed once the graphs are complete, queries start afterwards
+   if(awfy::numa::enabled()) {
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::NumaPersonGraph,
+         builderTask(new NumaPersonGraphBuilder(this), TaskGraph::NumaPersonGraph));
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::NumaCommentedGraph,
+         builderTask(new NumaCommentedGraphBuilder(this), TaskGraph::NumaCommentedGraph));
+
+      taskGraph.addEdge(TaskGraph::PersonGraph, TaskGraph::NumaPersonGraph);
+      taskGraph.addEdge(TaskGraph::CommentCreatorMap, TaskGraph::NumaCommentedGraph);
+      taskGraph.addEdge(TaskGraph::NumaPersonGraph, TaskGraph::Query1);
+      taskGraph.addEdge(TaskGraph::NumaCommentedGraph, TaskGraph::Query1);
+      taskGraph.addEdge(TaskGraph::NumaPersonGraph, TaskGraph::Query2);
+      taskGraph.addEdge(TaskGraph::NumaPersonGraph, TaskGraph::Query3);
+      taskGraph.addEdge(TaskGraph::NumaPersonGraph, TaskGraph::Query4);
+      if(reorder) {
+         taskGraph.addEdge(TaskGraph::PersonReorder, TaskGraph::NumaPersonGraph);
+         taskGraph.addEdge(TaskGraph::PersonReorder, TaskGraph::NumaCommentedGraph);
+      }
+   }
+
+   // Derived from the person graph, so it is rebuilt after restoring a snapshot
+   if(compressedGraph) {
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::CompressedPersonGraph,
+         builderTask(new CompressedPersonGraphBuilder(this), TaskGraph::CompressedPersonGraph));
+
+      taskGraph.addEdge(TaskGraph::PersonGraph, TaskGraph::CompressedPersonGraph);
+      taskGraph.addEdge(TaskGraph::CompressedPersonGraph, TaskGraph::Query2);
+      taskGraph.addEdge(TaskGraph::CompressedPersonGraph, TaskGraph::Query3);
+      if(reorder) {
+         taskGraph.addEdge(TaskGraph::PersonReorder, TaskGraph::CompressedPersonGraph);
+      }
+   }
+
+   // Derived from the person indexes, so it is rebuilt after restoring a snapshot
+   if(birthdaySweep) {
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::BirthdayComponents,
+         builderTask(new BirthdayComponentsBuilder(this), TaskGraph::BirthdayComponents));
+
+      taskGraph.addEdge(TaskGraph::PersonGraph, TaskGraph::BirthdayComponents);
+      taskGraph.addEdge(TaskGraph::HasInterest, TaskGraph::BirthdayComponents);
+      taskGraph.addEdge(TaskGraph::Birthday, TaskGraph::BirthdayComponents);
+      taskGraph.addEdge(TaskGraph::InterestStatistics, TaskGraph::BirthdayComponents);
+      taskGraph.addEdge(TaskGraph::BirthdayComponents, TaskGraph::Query2);
+      if(reorder) {
+         taskGraph.addEdge(TaskGraph::PersonReorder, TaskGraph::BirthdayComponents);
+      }
+   }
+
+   // Derived from the person graph and the reply counts, so it is rebuilt after restoring a snapshot
+   if(replyLabelMaxNum>=-1) {
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::ReplyLabels,
+         builderTask(new ReplyLabelsBuilder(taskGraph, scheduler, this), TaskGraph::ReplyLabels));
+
+      taskGraph.addEdge(TaskGraph::PersonGraph, TaskGraph::ReplyLabels);
+      taskGraph.addEdge(TaskGraph::CommentCreatorMap, TaskGraph::ReplyLabels);
+      taskGraph.addEdge(TaskGraph::ReplyLabels, TaskGraph::Query1);
+      if(reorder) {
+         taskGraph.addEdge(TaskGraph::PersonReorder, TaskGraph::ReplyLabels);
+      }
+   }
+
+   // Derived from the person graph and the reply counts, so it is rebuilt after restoring a snapshot
+   if(replySortedGraph) {
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::ReplySortedGraph,
+         builderTask(new ReplySortedGraphBuilder(this), TaskGraph::ReplySortedGraph));
+
+      taskGraph.addEdge(TaskGraph::PersonGraph, TaskGraph::ReplySortedGraph);
+      taskGraph.addEdge(TaskGraph::CommentCreatorMap, TaskGraph::ReplySortedGraph);
+      taskGraph.addEdge(TaskGraph::ReplySortedGraph, TaskGraph::Query1);
+      if(reorder) {
+         taskGraph.addEdge(TaskGraph::PersonReorder, TaskGraph::ReplySortedGraph);
+      }
+   }
+
+   // Derived from the person graph only, rebuilt after restoring a snapshot like the other Q1 indexes
+   if(landmarkLabelBytes>0) {
+      taskGraph.setTaskFn(Priorities::CRITICAL, TaskGraph::LandmarkLabels,
+         builderTask(new LandmarkLabelsBuilder(taskGraph, scheduler, this), TaskGraph::LandmarkLabels));
+
+      taskGraph.addEdge(TaskGraph::PersonGraph, TaskGraph::LandmarkLabels);
+      taskGraph.addEdge(TaskGraph::LandmarkLabels, TaskGraph::Query1);
+      if(reorder) {
+         taskGraph.addEdge(TaskGraph::PersonReorder, TaskGraph::LandmarkLabels);
+      }
+   }
+
+   if(!restored && !snapshotPath.empty()) {
+      // Persist the indexes once all of them are built
+      taskGraph.setTaskFn(Priorities::LOW, TaskGraph::Snapshot,
+         builderTask(new SnapshotBuilder(dataPath, this), TaskGraph::Snapshot));
+      for(auto node : snapshot::restoredNodes) {
+         taskGraph.addEdge(node, TaskGraph::Snapshot);
+      }
+      taskGraph.addEdge(TaskGraph::Snapshot, TaskGraph::Finish);
+   }
+}
+
+void FileIndexes::finishRestoredTasks(ScheduleGraph& taskGraph) {
+   if(snapshotFile!=nullptr) {
+      for(auto node : snapshot::restoredNodes) {
+         taskGraph.updateTask(node, -1);
+      }
+   }
+}
+
+const PersonGraph& FileIndexes::localPersonGraph() const {
+   if(personGraphReplicas.empty()) {
+      return *personGraph;
+   }
+   assert(awfy::numa::currentNode()<personGraphReplicas.size());
+   return *personGraphReplicas[awfy::numa::currentNode()];
+}
+
+PersonCommentedGraph FileIndexes::localPersonCommentedGraph() const {
+   if(personCommentedReplicas.empty()) {
+      return personCommentedGraph;
+   }
+   assert(awfy::numa::currentNode()<personCommentedReplicas.size());
+   return personCommentedReplicas[awfy::numa::currentNode()];
+}
+
+void FileIndexes::refreshGraphCopies() {
+   if(compressedGraph) {
+      delete compressedPersonGraph;
+      compressedPersonGraph=new awfy::CompressedPersonGraph(*personGraph, personMapper.count());
+   }
+   if(replyGraph!=nullptr) {
+      delete replyGraph;
+      replyGraph=new awfy::ReplySortedGraph(*personGraph, personCommentedGraph, personMapper.count());
+   }
+   if(landmarkLabels!=nullptr) {
+      delete landmarkLabels;
+      landmarkLabels=nullptr;
+      auto labels=new awfy::LandmarkLabels(*personGraph, personMapper.count(), landmarkLabelBytes);
+      labels->buildAll();
+      if(labels->finish()) {
+         landmarkLabels=labels;
+      } else {
+         LOG_PRINT("[LandmarkLabels] Exceeded "<<landmarkLabelBytes/1024<<" kb after the update, query 1 keeps searching");
+         delete labels;
+      }
+   }
+   if(replyLabels!=nullptr) {
+      delete replyLabels;
+      auto labels=new awfy::ReplyComponentLabels(*personGraph, personCommentedGraph, personMapper.count(), replyLabelMaxNum);
+      for(uint32_t level=0; level<labels->numLevels(); level++) {
+         labels->buildLevel(level);
+      }
+      labels->finish();
+      replyLabels=labels;
+   }
+   if(birthdayComponents!=nullptr) {
+      delete birthdayComponents;
+      birthdayComponents=new awfy::BirthdayComponentIndex(*personGraph, birthdayIndex, *hasInterestIndex, *interestStatistics,
+         personMapper.count());
+   }
+   if(awfy::numa::enabled()) {
+      for(auto replica : personGraphReplicas) {
+         free(replica->buffer.data);
+         delete replica;
+      }
+      personGraphReplicas.clear();
+      for(auto replica : personCommentedReplicas) {
+         free(const_cast<void*>(replica));
+      }
+      personCommentedReplicas.clear();
+
+      NumaPersonGraphBuilder::place(*this);
+      if(personCommentedGraph!=nullptr) {
+         NumaCommentedGraphBuilder::place(*this);
+      }
+   }
 }
@@ -0,0 +1,589 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "query3.hpp"
+#include "include/alloc.hpp"
+#include "include/hybridbfs.hpp"
+#include "include/index.hpp"
+#include "include/indexes.hpp"
+#include "include/tokenize.hpp"
+#include "include/topklist.hpp"
+#include "boost/unordered_map.hpp"
+
+// Latency of the hot kernels of the engine next to a plain scalar or standard library variant of
+// the same operation. Every kernel runs on synthetic inputs and, if a data folder is given, on
+// inputs taken from its csv files. Results are written as csv, one row per kernel, variant and input:
+//  ns_per_op  minimum over the timed runs of the run duration divided by ops
+//  checksum   folded results of the kernel, variants of the same row group must agree
+
+typedef std::pair<uint32_t, uint64_t> ScoreEntry;
+namespace awfy {
+template<>
+class TopKComparer<ScoreEntry> {
+public:
+   // Returns true if first param is larger or equal
+   static bool compare(const ScoreEntry& a, const ScoreEntry& b) {
+      return (a.second>b.second || (a.second==b.second && a.first<b.first));
+   }
+};
+}
+
+namespace {
+
+const uint64_t minRunNs=100*1000*1000;
+const uint32_t minRuns=3;
+/// Bytes behind every text buffer, the SSE tokenizer loads 16 bytes past the field start
+const size_t textPadding=32;
+
+std::string cpuName;
+
+std::string readCpuName() {
+   std::ifstream cpuinfo("/proc/cpuinfo");
+   std::string line;
+   while(std::getline(cpuinfo, line)) {
+      if(line.compare(0, 10, "model name")!=0) { continue; }
+      auto value=line.substr(line.find(':')+1);
+      value.erase(0, value.find_first_not_of(' '));
+      value.erase(std::remove(value.begin(), value.end(), ','), value.end());
+      return value;
+   }
+   return "unknown";
+}
+
+/// Runs fn until minRuns runs and minRunNs nanoseconds are done and prints the fastest run
+template<class Fn>
+void measure(const char* kernel, const char* variant, const std::string& input, uint64_t size, uint64_t ops, Fn fn) {
+   uint64_t best=UINT64_MAX;
+   uint64_t total=0;
+   uint64_t checksum=0;
+   for(uint32_t run=0; run<minRuns || total<minRunNs; run++) {
+      const auto start=std::chrono::steady_clock::now();
+      checksum=fn();
+      const uint64_t ns=std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count();
+      best=std::min(best, ns);
+      total+=ns;
+   }
+   std::cout<<cpuName<<","<<kernel<<","<<variant<<","<<input<<","<<size<<","<<ops<<","
+      <<static_cast<double>(best)/std::max<uint64_t>(ops, 1)<<","<<checksum<<std::endl;
+}
+
+/// Lines of a csv file without its header line
+std::vector<std::string> readLines(const std::string& path) {
+   std::vector<std::string> lines;
+   std::ifstream file(path);
+   std::string line;
+   std::getline(file, line);
+   while(std::getline(file, line)) {
+      if(!line.empty()) {
+         lines.push_back(line);
+      }
+   }
+   return lines;
+}
+
+/// Text of '|' terminated integer fields followed by the padding
+struct FieldText {
+   std::string text;
+   uint64_t fields;
+};
+
+FieldText syntheticIntegers(uint64_t count, std::mt19937_64& random) {
+   FieldText result { std::string(), count };
+   for(uint64_t i=0; i<count; i++) {
+      // Ids of the data sets have up to 12 digits
+      result.text+=std::to_string(random()%1000000000000ull);
+      result.text+='|';
+   }
+   result.text.append(textPadding, '|');
+   return result;
+}
+
+/// Both ids of person_knows_person.csv with the line ends replaced by the field separator
+FieldText knowsIntegers(const std::string& dataFolder) {
+   FieldText result { std::string(), 0 };
+   for(auto& line : readLines(dataFolder+"person_knows_person.csv")) {
+      result.text+=line;
+      result.text+='|';
+      result.fields+=2;
+   }
+   result.text.append(textPadding, '|');
+   return result;
+}
+
+void benchParseLong(const std::string& input, const FieldText& fields) {
+   const char* begin=fields.text.data();
+   const char* end=begin+fields.text.size()-textPadding;
+   measure("parse_long", "sse", input, fields.fields, fields.fields, [=]() {
+      const __m128i separator=_mm_set1_epi8('|');
+      uint64_t sum=0;
+      for(const char* iter=begin; iter<end;) {
+         const auto result=tokenize::searchCastLong(iter, end, &separator);
+         sum+=result.second;
+         iter+=result.first+1;
+      }
+      return sum;
+   });
+   measure("parse_long", "strtoll", input, fields.fields, fields.fields, [=]() {
+      uint64_t sum=0;
+      for(const char* iter=begin; iter<end;) {
+         char* fieldEnd;
+         sum+=strtoll(iter, &fieldEnd, 10);
+         iter=fieldEnd+1;
+      }
+      return sum;
+   });
+}
+
+/// Dates in the YYYY-MM-DD form, every date is followed by a separator
+FieldText syntheticDates(uint64_t count, std::mt19937_64& random) {
+   FieldText result { std::string(), count };
+   char date[16];
+   for(uint64_t i=0; i<count; i++) {
+      snprintf(date, sizeof(date), "%04u-%02u-%02u|", 1980+static_cast<unsigned>(random()%30), 1+static_cast<unsigned>(random()%12), 1+static_cast<unsigned>(random()%28));
+      result.text+=date;
+   }
+   result.text.append(textPadding, '|');
+   return result;
+}
+
+/// Birthdays of person.csv, the fifth field of every line
+FieldText personDates(const std::string& dataFolder) {
+   FieldText result { std::string(), 0 };
+   for(auto& line : readLines(dataFolder+"person.csv")) {
+      size_t pos=0;
+      for(uint32_t field=0; field<4 && pos!=std::string::npos; field++) {
+         pos=line.find('|', pos);
+         pos=pos==std::string::npos ? pos : pos+1;
+      }
+      if(pos==std::string::npos || line.size()<pos+10) { continue; }
+      result.text.append(line, pos, 10);
+      result.text+='|';
+      result.fields++;
+   }
+   result.text.append(textPadding, '|');
+   return result;
+}
+
+void benchBirthday(const std::string& input, const FieldText& dates) {
+   const char* begin=dates.text.data();
+   const char* end=begin+dates.fields*11;
+   measure("cast_birthday", "sse", input, dates.fields, dates.fields, [=]() {
+      uint64_t sum=0;
+      for(const char* iter=begin; iter<end; iter+=11) {
+         sum+=tokenize::castBirthday(iter, end);
+      }
+      return sum;
+   });
+   measure("cast_birthday", "scalar", input, dates.fields, dates.fields, [=]() {
+      uint64_t sum=0;
+      for(const char* iter=begin; iter<end; iter+=11) {
+         uint32_t birthday=(iter[0]-'0')*1000+(iter[1]-'0')*100+(iter[2]-'0')*10+(iter[3]-'0');
+         birthday=(birthday<<8)+(iter[5]-'0')*10+(iter[6]-'0');
+         birthday=(birthday<<8)+(iter[8]-'0')*10+(iter[9]-'0');
+         sum+=birthday;
+      }
+      return sum;
+   });
+}
+
+/// Person graph in the layout of the indexes, [count][friends] per person in one block
+struct BenchGraph {
+   std::vector<uint32_t> lists;
+   PersonGraph graph;
+   uint32_t numPersons;
+   uint64_t numEdges;
+
+   BenchGraph(const std::vector<std::vector<PersonId>>& friends)
+      : graph(std::max<size_t>(friends.size(), 1)), numPersons(friends.size()), numEdges(0) {
+      for(auto& personFriends : friends) {
+         numEdges+=personFriends.size();
+      }
+      lists.reserve(friends.size()+numEdges);
+      std::vector<size_t> offsets;
+      for(auto& personFriends : friends) {
+         offsets.push_back(lists.size());
+         lists.push_back(personFriends.size());
+         lists.insert(lists.end(), personFriends.begin(), personFriends.end());
+      }
+      for(PersonId person=0; person<numPersons; person++) {
+         graph.insert(person, reinterpret_cast<SizedList<uint32_t,PersonId>*>(&lists[offsets[person]]));
+      }
+   }
+
+   const SizedList<uint32_t,PersonId>* friendsOf(PersonId person) const {
+      return graph.retrieve(person);
+   }
+};
+
+std::vector<std::vector<PersonId>> syntheticFriends(uint32_t numPersons, uint32_t degree, std::mt19937_64& random) {
+   std::vector<std::vector<PersonId>> friends(numPersons);
+   for(PersonId person=0; person<numPersons; person++) {
+      for(uint32_t i=0; i<degree/2; i++) {
+         const PersonId other=random()%numPersons;
+         if(other==person) { continue; }
+         friends[person].push_back(other);
+         friends[other].push_back(person);
+      }
+   }
+   for(auto& personFriends : friends) {
+      std::sort(personFriends.begin(), personFriends.end());
+      personFriends.erase(std::unique(personFriends.begin(), personFriends.end()), personFriends.end());
+   }
+   return friends;
+}
+
+/// Friend lists of person_knows_person.csv with the persons numbered in order of appearance
+std::vector<std::vector<PersonId>> knowsFriends(const FieldText& knows) {
+   std::unordered_map<uint64_t, PersonId> mapping;
+   std::vector<std::vector<PersonId>> friends;
+   auto map=[&](uint64_t original) {
+      auto inserted=mapping.insert(std::make_pair(original, static_cast<PersonId>(mapping.size())));
+      if(inserted.second) {
+         friends.emplace_back();
+      }
+      return inserted.first->second;
+   };
+   const char* iter=knows.text.data();
+   for(uint64_t i=0; i+1<knows.fields; i+=2) {
+      char* fieldEnd;
+      const PersonId a=map(strtoull(iter, &fieldEnd, 10));
+      const PersonId b=map(strtoull(fieldEnd+1, &fieldEnd, 10));
+      iter=fieldEnd+1;
+      friends[a].push_back(b);
+   }
+   return friends;
+}
+
+/// Looks up every needle in the list of its person, every second needle is usually not contained
+void benchListFind(const std::string& input, const BenchGraph& graph, const std::vector<std::pair<PersonId,PersonId>>& needles) {
+   measure("list_find", "sse", input, graph.numEdges, needles.size(), [&]() {
+      uint64_t found=0;
+      for(auto& needle : needles) {
+         const auto result=graph.friendsOf(needle.first)->find(needle.second);
+         found+=result!=nullptr ? result-graph.friendsOf(needle.first)->getPtr(0)+1 : 0;
+      }
+      return found;
+   });
+   measure("list_find", "std_find", input, graph.numEdges, needles.size(), [&]() {
+      uint64_t found=0;
+      for(auto& needle : needles) {
+         const auto bounds=graph.friendsOf(needle.first)->bounds();
+         const auto result=std::find(bounds.first, bounds.second, needle.second);
+         found+=result!=bounds.second ? result-bounds.first+1 : 0;
+      }
+      return found;
+   });
+}
+
+std::vector<std::pair<PersonId,PersonId>> listNeedles(const BenchGraph& graph, std::mt19937_64& random) {
+   std::vector<std::pair<PersonId,PersonId>> needles;
+   for(PersonId person=0; person<graph.numPersons; person++) {
+      const auto friends=graph.friendsOf(person);
+      if(friends->size()==0) { continue; }
+      needles.push_back(std::make_pair(person, *friends->getPtr(random()%friends->size())));
+      needles.push_back(std::make_pair(person, graph.numPersons+static_cast<PersonId>(random()%graph.numPersons)));
+   }
+   std::shuffle(needles.begin(), needles.end(), random);
+   return needles;
+}
+
+void benchListFindSynthetic(std::mt19937_64& random) {
+   for(uint32_t length : { 4, 16, 64, 256 }) {
+      std::vector<std::vector<PersonId>> friends(std::max<uint32_t>((1<<16)/length, 64));
+      for(auto& personFriends : friends) {
+         while(personFriends.size()<length) {
+            personFriends.push_back(random()%(1<<20));
+         }
+      }
+      const BenchGraph graph(friends);
+      benchListFind("synthetic_"+std::to_string(length), graph, listNeedles(graph, random));
+   }
+}
+
+/// Erases all entries of lists with the given length in random order, the lists are refilled before every pass
+void benchFixedListErase(std::mt19937_64& random) {
+   for(uint32_t length : { 4, 16, 64, 256 }) {
+      const uint32_t numLists=std::max<uint32_t>((1<<16)/length, 16);
+      std::vector<std::vector<uint32_t>> contents(numLists), eraseOrders(numLists);
+      for(uint32_t list=0; list<numLists; list++) {
+         for(uint32_t i=0; i<length; i++) {
+            contents[list].push_back(random()%(1<<20));
+         }
+         eraseOrders[list]=contents[list];
+         std::shuffle(eraseOrders[list].begin(), eraseOrders[list].end(), random);
+      }
+      const std::string input="synthetic_"+std::to_string(length);
+      const uint64_t ops=static_cast<uint64_t>(numLists)*length;
+
+      awfy::BulkFreeAllocator<> allocator;
+      std::vector<FixedSizeList<uint32_t>*> lists;
+      for(uint32_t list=0; list<numLists; list++) {
+         lists.push_back(FixedSizeList<uint32_t>::create(length, allocator));
+      }
+      measure("fixed_list_erase", "sse", input, length, ops, [&]() {
+         uint64_t remaining=0;
+         for(uint32_t list=0; list<numLists; list++) {
+            std::copy(contents[list].begin(), contents[list].end(), lists[list]->begin());
+            for(auto entry : eraseOrders[list]) {
+               remaining+=lists[list]->erase(entry).second;
+            }
+         }
+         return remaining;
+      });
+
+      std::vector<std::vector<uint32_t>> vectors(numLists);
+      measure("fixed_list_erase", "vector", input, length, ops, [&]() {
+         uint64_t remaining=0;
+         for(uint32_t list=0; list<numLists; list++) {
+            auto& vector=vectors[list];
+            vector.assign(contents[list].begin(), contents[list].end());
+            for(auto entry : eraseOrders[list]) {
+               vector.erase(std::find(vector.begin(), vector.end(), entry));
+               remaining+=!vector.empty();
+            }
+         }
+         return remaining;
+      });
+   }
+}
+
+/// Inserts all keys into an empty map and looks up every key and a missing key per inserted one
+template<class Map, class Insert, class Find>
+void benchHashMap(const char* variant, const std::string& input, const std::vector<uint64_t>& keys, Insert insert, Find find) {
+   measure("hash_insert", variant, input, keys.size(), keys.size(), [&]() {
+      Map map(keys.size());
+      for(uint32_t i=0; i<keys.size(); i++) {
+         insert(map, keys[i], i);
+      }
+      return static_cast<uint64_t>(map.size());
+   });
+   Map map(keys.size());
+   for(uint32_t i=0; i<keys.size(); i++) {
+      insert(map, keys[i], i);
+   }
+   measure("hash_find", variant, input, keys.size(), 2*keys.size(), [&]() {
+      uint64_t sum=0;
+      for(auto key : keys) {
+         sum+=find(map, key)+find(map, ~key);
+      }
+      return sum;
+   });
+}
+
+void benchHashMaps(std::mt19937_64& random) {
+   for(uint32_t size : { 1<<10, 1<<16, 1<<20 }) {
+      std::vector<uint64_t> keys;
+      for(uint32_t i=0; i<size; i++) {
+         keys.push_back(random()%1000000000000ull);
+      }
+      const std::string input="synthetic_"+std::to_string(size);
+      typedef campers::HashMap<uint64_t,uint32_t> CampersMap;
+      benchHashMap<CampersMap>("campers", input, keys,
+         [](CampersMap& map, uint64_t key, uint32_t value) { *map.tryInsert(key)=value; },
+         [](CampersMap& map, uint64_t key) -> uint64_t { auto value=map.find(key); return value!=nullptr ? *value+1 : 0; });
+      typedef boost::unordered_map<uint64_t,uint32_t> BoostMap;
+      benchHashMap<BoostMap>("boost", input, keys,
+         [](BoostMap& map, uint64_t key, uint32_t value) { map[key]=value; },
+         [](BoostMap& map, uint64_t key) -> uint64_t { auto value=map.find(key); return value!=map.end() ? value->second+1 : 0; });
+      typedef std::unordered_map<uint64_t,uint32_t> StdMap;
+      benchHashMap<StdMap>("std", input, keys,
+         [](StdMap& map, uint64_t key, uint32_t value) { map[key]=value; },
+         [](StdMap& map, uint64_t key) -> uint64_t { auto value=map.find(key); return value!=map.end() ? value->second+1 : 0; });
+   }
+}
+
+/// Inserts a stream of scores into top k lists of several sizes, the scores are skewed like reply counts
+void benchTopK(std::mt19937_64& random) {
+   const uint32_t numScores=1<<16;
+   std::vector<ScoreEntry> scores;
+   std::geometric_distribution<uint64_t> skewed(0.01);
+   for(uint32_t i=0; i<numScores; i++) {
+      scores.push_back(ScoreEntry(i, skewed(random)));
+   }
+   std::shuffle(scores.begin(), scores.end(), random);
+
+   for(uint32_t k : { 3, 10, 100 }) {
+      const std::string input="k_"+std::to_string(k);
+      measure("topk_insert", "topk_list", input, numScores, numScores, [&]() {
+         awfy::TopKList<uint32_t,uint64_t> topK(ScoreEntry(UINT32_MAX, 0));
+         topK.init(k);
+         for(auto& score : scores) {
+            topK.insert(score.first, score.second);
+         }
+         uint64_t sum=0;
+         for(auto& entry : topK.getEntries()) {
+            sum=sum*31+entry.first;
+         }
+         return sum;
+      });
+      measure("topk_insert", "heap", input, numScores, numScores, [&]() {
+         // Min heap of the k best scores, the smallest of them on top
+         auto better=[](const ScoreEntry& a, const ScoreEntry& b) { return awfy::compare(a, b); };
+         std::priority_queue<ScoreEntry, std::vector<ScoreEntry>, decltype(better)> heap(better);
+         for(auto& score : scores) {
+            if(heap.size()<k) {
+               heap.push(score);
+            } else if(better(score, heap.top())) {
+               heap.pop();
+               heap.push(score);
+            }
+         }
+         std::vector<ScoreEntry> entries;
+         for(; !heap.empty(); heap.pop()) {
+            entries.push_back(heap.top());
+         }
+         uint64_t sum=0;
+         for(auto entry=entries.rbegin(); entry!=entries.rend(); entry++) {
+            sum=sum*31+entry->first;
+         }
+         return sum;
+      });
+   }
+}
+
+/// Intersects pairs of sorted interest lists, the rare list is the shorter one
+void benchIntersection(std::mt19937_64& random) {
+   const uint32_t numPairs=1024;
+   for(auto lengths : { std::make_pair(4u, 16u), std::make_pair(16u, 64u), std::make_pair(64u, 256u), std::make_pair(16u, 1024u) }) {
+      std::vector<std::vector<uint32_t>> rare(numPairs), freq(numPairs);
+      for(uint32_t pair=0; pair<numPairs; pair++) {
+         const uint32_t range=4*lengths.second;
+         for(uint32_t i=0; i<lengths.first; i++) {
+            rare[pair].push_back(random()%range);
+         }
+         for(uint32_t i=0; i<lengths.second; i++) {
+            freq[pair].push_back(random()%range);
+         }
+         for(auto list : { &rare[pair], &freq[pair] }) {
+            std::sort(list->begin(), list->end());
+            list->erase(std::unique(list->begin(), list->end()), list->end());
+         }
+      }
+      const std::string input="synthetic_"+std::to_string(lengths.first)+"x"+std::to_string(lengths.second);
+      measure("intersect", "sse", input, lengths.first+lengths.second, numPairs, [&]() {
+         uint64_t common=0;
+         for(uint32_t pair=0; pair<numPairs; pair++) {
+            common+=Query3::v1(rare[pair].data(), rare[pair].size(), freq[pair].data(), freq[pair].size());
+         }
+         return common;
+      });
+      measure("intersect", "scalar", input, lengths.first+lengths.second, numPairs, [&]() {
+         uint64_t common=0;
+         for(uint32_t pair=0; pair<numPairs; pair++) {
+            common+=Query3::match_scalar(rare[pair].data(), rare[pair].size(), freq[pair].data(), freq[pair].size());
+         }
+         return common;
+      });
+   }
+}
+
+/// Full searches from a fixed set of sources, ops are searches
+void benchBFS(const std::string& input, const BenchGraph& graph, std::mt19937_64& random) {
+   std::vector<PersonId> sources;
+   for(uint32_t i=0; i<16 && graph.numPersons>0; i++) {
+      sources.push_back(random()%graph.numPersons);
+   }
+
+   awfy::HybridBFS hybrid(graph.numPersons);
+   measure("bfs", "hybrid", input, graph.numEdges, sources.size(), [&]() {
+      uint64_t discovered=0;
+      for(auto source : sources) {
+         hybrid.clear();
+         uint64_t unexploredEdges=graph.numEdges;
+         discovered+=hybrid.run(graph.graph, source, unexploredEdges, graph.numPersons,
+            [](PersonId, const SizedList<uint32_t,PersonId>*, uint32_t) { return true; },
+            [](uint32_t, uint32_t) { return true; });
+      }
+      return discovered;
+   });
+
+   std::vector<uint8_t> visited(graph.numPersons);
+   std::vector<PersonId> queue;
+   queue.reserve(graph.numPersons);
+   measure("bfs", "queue", input, graph.numEdges, sources.size(), [&]() {
+      uint64_t discovered=0;
+      for(auto source : sources) {
+         std::fill(visited.begin(), visited.end(), 0);
+         queue.clear();
+         queue.push_back(source);
+         visited[source]=1;
+         for(size_t head=0; head<queue.size(); head++) {
+            const auto bounds=graph.friendsOf(queue[head])->bounds();
+            for(auto friendIter=bounds.first; friendIter!=bounds.second; friendIter++) {
+               if(!visited[*friendIter]) {
+                  visited[*friendIter]=1;
+                  queue.push_back(*friendIter);
+               }
+            }
+         }
+         discovered+=queue.size()-1;
+      }
+      return discovered;
+   });
+}
+
+}
+
+int main(int argc, char** argv) {
+   if(argc>2) {
+      std::cerr<<"Usage: runKernelBench [<dataFolder>]"<<std::endl;
+      exit(EXIT_FAILURE);
+   }
+   std::string dataFolder=argc==2 ? argv[1] : "";
+   if(!dataFolder.empty() && dataFolder.back()!='/') {
+      dataFolder+='/';
+   }
+
+   cpuName=readCpuName();
+   std::mt19937_64 random(42);
+   std::cout<<std::fixed<<std::setprecision(3);
+   std::cout<<"cpu,kernel,variant,input,size,ops,ns_per_op,checksum"<<std::endl;
+
+   benchParseLong("synthetic", syntheticIntegers(1<<20, random));
+   benchBirthday("synthetic", syntheticDates(1<<20, random));
+   benchListFindSynthetic(random);
+   benchFixedListErase(random);
+   benchHashMaps(random);
+   benchTopK(random);
+   benchIntersection(random);
+   {
+      const BenchGraph graph(syntheticFriends(1<<16, 32, random));
+      benchBFS("synthetic", graph, random);
+   }
+
+   if(!dataFolder.empty()) {
+      const auto knows=knowsIntegers(dataFolder);
+      benchParseLong("person_knows_person", knows);
+      benchBirthday("person", personDates(dataFolder));
+      const BenchGraph graph(knowsFriends(knows));
+      benchListFind("person_knows_person", graph, listNeedles(graph, random));
+      benchBFS("person_knows_person", graph, random);
+   }
+
+   return 0;
+}
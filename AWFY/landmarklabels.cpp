@@ -0,0 +1,203 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "include/landmarklabels.hpp"
+
+#include <algorithm>
+
+namespace awfy {
+
+const uint32_t LandmarkLabels::noRank;
+const LandmarkLabels::Distance LandmarkLabels::noDistance;
+
+LandmarkLabels::LandmarkLabels(const PersonGraph& personGraph, uint32_t numPersons, uint64_t maxBytes)
+   : personGraph(&personGraph), numPersons(numPersons), maxBytes(maxBytes), order(numPersons), ranks(numPersons),
+     buildLabels(numPersons), batchLabels(batchRoots), numEntries(0), failed(false)
+{
+   std::vector<uint32_t> degrees(numPersons);
+   for(PersonId person=0; person<numPersons; person++) {
+      const auto friends=personGraph.retrieve(person);
+      degrees[person]=friends==nullptr ? 0 : friends->size();
+      order[person]=person;
+   }
+   // Persons with many friends cover most shortest paths, so they become the first hubs
+   std::sort(order.begin(), order.end(), [&degrees](PersonId a, PersonId b) {
+      return degrees[a]>degrees[b] || (degrees[a]==degrees[b] && a<b);
+   });
+   for(uint32_t rank=0; rank<numPersons; rank++) {
+      ranks[order[rank]]=rank;
+   }
+}
+
+LandmarkLabels::Workspace& LandmarkLabels::localWorkspace(uint32_t numPersons) {
+   static thread_local Workspace workspace;
+   if(workspace.distances.size()<numPersons) {
+      workspace.rootDistances.resize(numPersons, noDistance);
+      workspace.distances.resize(numPersons, noDistance);
+   }
+   return workspace;
+}
+
+uint32_t LandmarkLabels::numBatches() const {
+   if(numPersons<=sequentialRoots) {
+      return 1;
+   }
+   return 1+(numPersons-sequentialRoots+batchRoots-1)/batchRoots;
+}
+
+uint32_t LandmarkLabels::batchBegin(uint32_t batch) const {
+   if(batch==0) {
+      return 0;
+   }
+   return std::min(numPersons, sequentialRoots+(batch-1)*batchRoots);
+}
+
+void LandmarkLabels::labelRoot(uint32_t rank, Workspace& workspace, std::vector<std::pair<PersonId,Distance>>& found) {
+   found.clear();
+   if(failed) { return; }
+
+   const PersonId root=order[rank];
+   const auto& rootLabels=buildLabels[root];
+   for(const auto& entry : rootLabels) {
+      workspace.rootDistances[entry.rank]=entry.distance;
+   }
+
+   auto& distances=workspace.distances;
+   auto& queue=workspace.queue;
+   queue.clear();
+   queue.push_back(root);
+   distances[root]=0;
+   for(size_t head=0; head<queue.size(); head++) {
+      const PersonId person=queue[head];
+      const unsigned distance=distances[person];
+
+      // Skip the person if an earlier hub already covers a path of this length
+      bool covered=false;
+      for(const auto& entry : buildLabels[person]) {
+         const Distance hubDistance=workspace.rootDistances[entry.rank];
+         if(hubDistance!=noDistance && static_cast<unsigned>(hubDistance)+entry.distance<=distance) {
+            covered=true;
+            break;
+         }
+      }
+      if(covered) { continue; }
+      found.push_back(std::make_pair(person, static_cast<Distance>(distance)));
+
+      if(unlikely(distance+1>=noDistance)) {
+         failed=true;
+         break;
+      }
+      const auto friends=personGraph->retrieve(person);
+      if(friends==nullptr) { continue; }
+      for(uint32_t i=0; i<friends->size(); i++) {
+         const PersonId friendId=*friends->getPtr(i);
+         // Paths over higher ranked persons are covered by their own labels
+         if(ranks[friendId]>rank && distances[friendId]==noDistance) {
+            distances[friendId]=distance+1;
+            queue.push_back(friendId);
+         }
+      }
+   }
+
+   for(const PersonId person : queue) {
+      distances[person]=noDistance;
+   }
+   for(const auto& entry : rootLabels) {
+      workspace.rootDistances[entry.rank]=noDistance;
+   }
+
+   const uint64_t totalEntries=numEntries.fetch_add(found.size())+found.size();
+   if(totalEntries*(sizeof(uint32_t)+sizeof(Distance))>maxBytes) {
+      failed=true;
+   }
+}
+
+void LandmarkLabels::commit(uint32_t rank, const std::vector<std::pair<PersonId,Distance>>& found) {
+   for(const auto& label : found) {
+      buildLabels[label.first].push_back(Entry { rank, label.second });
+   }
+}
+
+void LandmarkLabels::labelBatch(uint32_t batch, uint32_t beginRank, uint32_t endRank) {
+   Workspace& workspace=localWorkspace(numPersons);
+   if(batch==0) {
+      // The first roots prune with the labels of all roots before them
+      std::vector<std::pair<PersonId,Distance>> found;
+      for(uint32_t rank=beginRank; rank<endRank; rank++) {
+         labelRoot(rank, workspace, found);
+         commit(rank, found);
+      }
+   } else {
+      const uint32_t begin=batchBegin(batch);
+      for(uint32_t rank=beginRank; rank<endRank; rank++) {
+         labelRoot(rank, workspace, batchLabels[rank-begin]);
+      }
+   }
+}
+
+void LandmarkLabels::commitBatch(uint32_t batch) {
+   if(batch==0) { return; }
+   const uint32_t begin=batchBegin(batch);
+   const uint32_t end=batchBegin(batch+1);
+   for(uint32_t rank=begin; rank<end; rank++) {
+      auto& found=batchLabels[rank-begin];
+      commit(rank, found);
+      found.clear();
+   }
+}
+
+void LandmarkLabels::buildAll() {
+   for(uint32_t batch=0; batch<numBatches(); batch++) {
+      labelBatch(batch, batchBegin(batch), batchBegin(batch+1));
+      commitBatch(batch);
+   }
+}
+
+bool LandmarkLabels::finish() {
+   personGraph=nullptr;
+   std::vector<std::vector<std::pair<PersonId,Distance>>>().swap(batchLabels);
+   std::vector<PersonId>().swap(order);
+   std::vector<uint32_t>().swap(ranks);
+   if(failed) {
+      std::vector<std::vector<Entry>>().swap(buildLabels);
+      return false;
+   }
+
+   offsets.resize(numPersons+1);
+   uint64_t size=0;
+   for(PersonId person=0; person<numPersons; person++) {
+      offsets[person]=size;
+      // At least one noRank ends every list
+      size+=(buildLabels[person].size()+4)&~static_cast<uint64_t>(3);
+   }
+   offsets[numPersons]=size;
+
+   labelRanks.resize(size, noRank);
+   labelDistances.resize(size, noDistance);
+   for(PersonId person=0; person<numPersons; person++) {
+      uint64_t pos=offsets[person];
+      for(const auto& entry : buildLabels[person]) {
+         labelRanks[pos]=entry.rank;
+         labelDistances[pos]=entry.distance;
+         pos++;
+      }
+      std::vector<Entry>().swap(buildLabels[person]);
+   }
+   std::vector<std::vector<Entry>>().swap(buildLabels);
+   return true;
+}
+
+}
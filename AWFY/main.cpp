@@ -24,7 +24,11 @@ limitations under the License.
 #include "query2.hpp"
 #include "query3.hpp"
 #include "query4.hpp"
+#include "include/arena.hpp"
 #include "include/indexes.hpp"
+#include "include/snapshot.hpp"
+#include "include/reorder.hpp"
+#include "include/strategy.hpp"
 #include "include/env.hpp"
 #include "include/metrics.hpp"
 #include "include/queryfiles.hpp"
@@ -32,8 +36,10 @@ limitations under the License.
 #include "include/concurrent/scheduler.hpp"
 #include "include/concurrent/thread.hpp"
 #include "include/executioncommons.hpp"
+#include "include/server.hpp"
 #include "include/util/measurement.hpp"
 #include "include/util/memoryhooks.hpp"
+#include "include/util/numa.hpp"
 
 const uint32_t hardwareThreads=std::thread::hardware_concurrency(); // Intel Xeon E5430 has 4 cores and no HT (2 sockets = 8 cores)
 
@@ -41,13 +47,23 @@ size_t globalQueryId{0U};
 
 struct ParseAllBatches {
    queryfiles::QueryBatcher& batches;
+   bool* excludes;
 
-   ParseAllBatches(queryfiles::QueryBatcher& batches, bool* /*unused*/)
-      : batches(batches)
+   ParseAllBatches(queryfiles::QueryBatcher& batches, bool* excludes)
+      : batches(batches), excludes(excludes)
    { }
 
    void operator()() {
       batches.parse();
+
+      // Queries of excluded types are neither run nor printed
+      auto queryList=batches.getQueryList();
+      for(auto queryIter=queryList.begin(); queryIter!=queryList.end(); queryIter++) {
+         auto& query = *queryIter;
+         if(excludes[reinterpret_cast<queryfiles::QueryParser::BaseQuery*>(query->getQuery())->id-'1']) {
+            query->ignore=true;
+         }
+      }
    }
 };
 
@@ -207,7 +223,7 @@ struct PrintResults {
       #endif
       // Print results
       for(auto queryIter=queryList.cbegin(); queryIter!=queryList.cend(); queryIter++) {
-         // Compare results
+         if((*queryIter)->ignore) { continue; }
          auto result = string((*queryIter)->result);
          cout<<result<<endl;
       }
@@ -223,13 +239,43 @@ struct PrintResults {
 
 const static std::string FILE_FLAG = "FILE";
 const static std::string PARAM_FLAG = "PARAM";
+const static std::string SERVE_FLAG = "SERVE";
+const static char* SNAPSHOT_ENV = "AWFY_SNAPSHOT";
+const static char* SCHEDULER_ENV = "AWFY_SCHEDULER";
+const static char* NUMA_ENV = "AWFY_NUMA";
+const static char* BFS_ENV = "AWFY_BFS";
+const static char* GRAPH_ENV = "AWFY_GRAPH";
+const static char* Q2_ENV = "AWFY_Q2";
+const static char* Q3_ENV = "AWFY_Q3";
+const static char* STRATEGY_ENV = "AWFY_STRATEGY";
+const static char* Q1_LABELS_ENV = "AWFY_Q1_LABELS";
+const static char* Q1_GRAPH_ENV = "AWFY_Q1_GRAPH";
+const static char* Q1_PLL_ENV = "AWFY_Q1_PLL";
+const static char* Q4_CACHE_ENV = "AWFY_Q4_CACHE";
+const static char* REORDER_ENV = "AWFY_REORDER";
+const static char* ARENA_ENV = "AWFY_ARENA";
+const static char* ADMISSION_ENV = "AWFY_ADMISSION";
+const static char* ADMISSION_LOG_ENV = "AWFY_ADMISSION_LOG";
+const static char* TRACE_ENV = "AWFY_TRACE";
+const static char* PERF_ENV = "AWFY_PERF";
 
 int main(int argc, char **argv) {
 
-   if(argc < 4) {
+   if(argc < 4 && !(argc == 3 && argv[2] == SERVE_FLAG)) {
       cerr<<"Usage with query file: " << argv[0] << " <dataFolder> " << FILE_FLAG << " <queryFile>"<<endl;
 		cerr<<"Usage with query file and query id: " << argv[0] << " <dataFolder> " << FILE_FLAG << " <queryFile>" << " <queryId>"<<endl;
       cerr<<"Usage with query params: " << argv[0] << " <dataFolder> " << PARAM_FLAG << " <queryNumber> <param1> <param2> ..."<<endl;
+      cerr<<"Usage as query server: " << argv[0] << " <dataFolder> " << SERVE_FLAG << " [<socketPath>]"<<endl;
+      cerr<<"Set " << SNAPSHOT_ENV << "=<snapshotFile> to restore the indexes from a snapshot, it is written if missing or stale."<<endl;
+      cerr<<"Set " << SCHEDULER_ENV << "=stealing to use per thread work stealing queues instead of the global task queue."<<endl;
+      cerr<<"Set " << NUMA_ENV << "=replicate|interleave to pin the executors to numa nodes and replicate or interleave the person graph."<<endl;
+      cerr<<"Set " << BFS_ENV << "=hybrid to use the direction optimizing BFS for query 1 and 2."<<endl;
+      cerr<<"Set " << GRAPH_ENV << "=compressed to let query 2 and 3 read a compressed copy of the person graph."<<endl;
+      cerr<<"Set " << Q2_ENV << "=bfs|sweep and " << Q3_ENV << "=bfs|inverted|auto to fix the strategy of query 2 and 3, " << STRATEGY_ENV << "=fixed to keep the defaults instead of selecting them by batch and graph size."<<endl;
+      cerr<<"Set " << REORDER_ENV << "=degree|rcm|community to relabel the persons for locality once the indexes are loaded."<<endl;
+      cerr<<"Set " << ADMISSION_ENV << "=lpt to schedule the most expensive queries first, " << ADMISSION_LOG_ENV << "=<csvFile> to write the predicted and measured costs."<<endl;
+      cerr<<"Set " << TRACE_ENV << "=<traceFile> to write a timeline of all tasks per executor in the Chrome trace event format."<<endl;
+      cerr<<"Set " << PERF_ENV << "=1 to count cycles, instructions, cache, TLB and branch misses per task graph node with perf_event_open."<<endl;
       return -1;
    }
 
@@ -237,12 +283,19 @@ int main(int argc, char **argv) {
    bool excludes[4] = {false, false, false, false};
 
    const auto start = awfy::chrono::now();
+   awfy::numa::setMode(awfy::numa::parseMode(getenv(NUMA_ENV)));
+   awfy::QueryArena::useHugePages(getenv(ARENA_ENV) != nullptr && string(getenv(ARENA_ENV)) == "huge");
+   if (awfy::numa::enabled()) {
+      awfy::counters::NumaCounters::start();
+   }
+   awfy::counters::Trace::enabled = getenv(TRACE_ENV) != nullptr;
+   awfy::counters::HardwareCounters::enabled = getenv(PERF_ENV) != nullptr && string(getenv(PERF_ENV)) != "0";
    awfy::counters::ProgramCounters counters(hardwareThreads);
    auto& threadCounts=counters.getThreadCounters();
    threadCounts.initThread();
    threadCounts.startTask(TaskGraph::Initialize);
 
-   Scheduler scheduler(counters);
+   Scheduler scheduler(counters, SchedulerKinds::parse(getenv(SCHEDULER_ENV)), hardwareThreads);
    ScheduleGraph taskGraph(scheduler);
    const string dataPath(argv[1]);
 
@@ -281,19 +334,101 @@ int main(int argc, char **argv) {
       auto queryIndex = queryfiles::QueryParser::getQueryIndex(paramParser->query->id);
       updateExcludes(queryIndex);
       queries = paramParser;
+   } else if (argv[2] == SERVE_FLAG) {
+      queries = new server::EmptyQueryParser();
    }
 
    queryfiles::QueryBatcher batches(*queries);
    
    FileIndexes fileIndexes;
+   fileIndexes.indexAllTags = argv[2] == SERVE_FLAG;
+   fileIndexes.hybridBFS = getenv(BFS_ENV) != nullptr && string(getenv(BFS_ENV)) == "hybrid";
+   fileIndexes.compressedGraph = getenv(GRAPH_ENV) != nullptr && string(getenv(GRAPH_ENV)) == "compressed";
+   fileIndexes.birthdaySweep = getenv(Q2_ENV) != nullptr && string(getenv(Q2_ENV)) == "sweep";
+   if (getenv(Q3_ENV) != nullptr) {
+      fileIndexes.query3Mode = awfy::strategy::parseQuery3Mode(getenv(Q3_ENV));
+   }
+   fileIndexes.replySortedGraph = getenv(Q1_GRAPH_ENV) != nullptr && string(getenv(Q1_GRAPH_ENV)) == "sorted";
+   if (getenv(Q1_LABELS_ENV) != nullptr) {
+      fileIndexes.replyLabelMaxNum = std::stoi(getenv(Q1_LABELS_ENV));
+   }
+   if (getenv(Q1_PLL_ENV) != nullptr) {
+      fileIndexes.landmarkLabelBytes = std::stoull(getenv(Q1_PLL_ENV))<<20;
+   }
+   if (getenv(Q4_CACHE_ENV) != nullptr) {
+      fileIndexes.query4CacheBytes = std::stoull(getenv(Q4_CACHE_ENV))<<20;
+   }
+   fileIndexes.personOrder = awfy::reorder::parseOrder(getenv(REORDER_ENV));
+   // Strategies that were not set explicitly are selected by the number of queries and the number of persons
+   if (getenv(STRATEGY_ENV) == nullptr || string(getenv(STRATEGY_ENV)) != "fixed") {
+      awfy::strategy::Workload workload;
+      if (queryFile != nullptr) {
+         workload.countQueries(*queryFile, excludes);
+      } else if (argv[2] == PARAM_FLAG) {
+         for (auto index = 0u; index < 4; ++index) {
+            workload.queries[index] = excludes[index] ? 0 : 1;
+         }
+      }
+      workload.estimatePersons(dataPath);
+      awfy::strategy::Fixed fixed;
+      fixed.query2 = getenv(Q2_ENV) != nullptr;
+      fixed.query3 = getenv(Q3_ENV) != nullptr;
+      awfy::strategy::select(workload, fixed, fileIndexes);
+   }
+   // Restore indexes from the snapshot or write it if it is missing or stale
+   const char* snapshotPath = getenv(SNAPSHOT_ENV);
+   if (snapshotPath != nullptr && fileIndexes.personOrder != awfy::reorder::Order::None) {
+      LOG_PRINT("[Snapshot] Ignoring " << snapshotPath << ", snapshots hold the file order of the persons");
+      snapshotPath = nullptr;
+   }
+   if (snapshotPath != nullptr && !snapshot::load(snapshotPath, dataPath, fileIndexes)) {
+      fileIndexes.snapshotPath = snapshotPath;
+   }
    runtime::QueryState queryState(taskGraph, scheduler, fileIndexes);
+   if (getenv(ADMISSION_ENV) != nullptr && string(getenv(ADMISSION_ENV)) == "lpt") {
+      queryState.costs.enable(getenv(ADMISSION_LOG_ENV) != nullptr ? getenv(ADMISSION_LOG_ENV) : "");
+   }
+
+   if (argv[2] == SERVE_FLAG) {
+      auto queryServer = new server::QueryServer(scheduler, taskGraph, queryState, argc > 3 ? argv[3] : "", dataPath);
+      // Keep the executors alive until the server has shut down
+      taskGraph.addEdge(TaskGraph::QueryExec, TaskGraph::Finish);
+      initScheduleGraph<server::ServerReady, ParseAllBatches>(scheduler, taskGraph, fileIndexes, dataPath, batches, queryState, excludes,
+         server::ServerReady(*queryServer, start));
+      if (!fileIndexes.snapshotPath.empty()) {
+         // Updates replace the indexes that the snapshot writer reads
+         taskGraph.addEdge(TaskGraph::Snapshot, TaskGraph::ValidateAnswers);
+      }
+
+      taskGraph.eraseNotUsedEdges();
+
+      awfy::Thread<server::QueryServer> serverThread(&server::QueryServer::start, queryServer);
+      executeTaskGraph(hardwareThreads, scheduler, counters, threadCounts);
+      serverThread.join();
+   } else {
+      initScheduleGraph<PrintResults, ParseAllBatches>(scheduler, taskGraph, fileIndexes, dataPath, batches, queryState, excludes,
+         PrintResults(counters, taskGraph, batches, fileIndexes, dataPath, start, *queries));
 
-   initScheduleGraph<PrintResults, ParseAllBatches>(scheduler, taskGraph, fileIndexes, dataPath, batches, queryState, excludes,
-      PrintResults(counters, taskGraph, batches, fileIndexes, dataPath, start, *queries));
+      taskGraph.eraseNotUsedEdges();
 
-   taskGraph.eraseNotUsedEdges();
+      executeTaskGraph(hardwareThreads, scheduler, counters, threadCounts);
+   }
 
-   executeTaskGraph(hardwareThreads, scheduler, counters, threadCounts);
+   if (awfy::counters::Trace::enabled) {
+      counters.writeTrace(getenv(TRACE_ENV));
+   }
+   if (awfy::counters::HardwareCounters::enabled) {
+      counters.printHardwareStats(std::cerr);
+   }
+   if (awfy::numa::enabled()) {
+      awfy::counters::NumaCounters::print(std::cerr);
+   }
+   if (Query4::TagCache::get().enabled()) {
+      Query4::TagCache::get().print(std::cerr);
+   }
+   if (queryState.costs.enabled()) {
+      queryState.costs.print(std::cerr);
+   }
 
    delete queries;
    delete queryFile;
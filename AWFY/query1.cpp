@@ -33,11 +33,63 @@ namespace Query1 {
    }
 
    QueryRunner::QueryRunner(const FileIndexes& indexes) 
-      : personGraph(*(indexes.personGraph)), commentedGraph(indexes.personCommentedGraph) {
+      : personGraph(indexes.localPersonGraph()), commentedGraph(indexes.localPersonCommentedGraph()),
+        numPersons(indexes.personMapper.count()), hybridBFS(indexes.hybridBFS), replyLabels(indexes.replyLabels),
+        replyGraph(indexes.replySortedGraph ? indexes.replyGraph : nullptr), landmarkLabels(indexes.landmarkLabels), numEdges(0),
+        hybridSearch(hybridBFS ? numPersons : 0), edgeChecks(0) {
+      if(hybridBFS) {
+         for(PersonId person=0; person<numPersons; person++) {
+            const auto friends=personGraph.retrieve(person);
+            if(friends!=nullptr) {
+               numEdges+=friends->size();
+            }
+         }
+      }
+   }
+
+   // Checks whether both persons commented more than num times on each other
+   inline bool commentedEnough(const PersonGraph& personGraph, const uint8_t* basePersonPtr, const uint8_t* baseCommentedPtr,
+         PersonId person, const PersonGraph::Content friends, uint32_t friendIx, uint32_t num) {
+      typedef typename std::remove_pointer<typename PersonGraph::Content>::type Content;
+      const auto friendsOffset = reinterpret_cast<const uint8_t*>(friends)-basePersonPtr;
+      const auto commentedCounts = reinterpret_cast<const Content*>(baseCommentedPtr+friendsOffset);
+      if(likely(*commentedCounts->getPtr(friendIx)<=num)) {
+         return false;
+      }
+      // Check if reverse is also true
+      auto otherNeighbours= personGraph.retrieve(*friends->getPtr(friendIx));
+      assert(otherNeighbours!=nullptr);
+      auto otherNeighbourOffset = otherNeighbours->find(person);
+      assert(otherNeighbourOffset!=nullptr);
+      auto commentedOffset = reinterpret_cast<const uint8_t*>(otherNeighbourOffset)-basePersonPtr;
+      return *reinterpret_cast<const PersonGraph::Id*>(baseCommentedPtr+commentedOffset)>num;
    }
 
    template<bool checkCommented>
-   int shortestPath(BidirectSearchState& searchState, const PersonGraph& personGraph, const void* commentedGraph, PersonId p1, PersonId p2, uint32_t num) {
+   int QueryRunner::hybridShortestPath(PersonId p1, PersonId p2, uint32_t num) {
+      const auto basePersonPtr = reinterpret_cast<const uint8_t*>(personGraph.buffer.data);
+      const auto baseCommentedPtr = reinterpret_cast<const uint8_t*>(commentedGraph);
+      const PersonGraph& graph = personGraph;
+
+      int resultDist=-1;
+      uint64_t unexploredEdges=numEdges;
+      hybridSearch.clear();
+      hybridSearch.run(personGraph, p1, unexploredEdges, numPersons,
+         [&](PersonId person, const PersonGraph::Content friends, uint32_t friendIx) {
+            return !checkCommented || commentedEnough(graph, basePersonPtr, baseCommentedPtr, person, friends, friendIx, num);
+         },
+         [&](uint32_t distance, uint32_t /*numDiscovered*/) {
+            if(hybridSearch.isVisited(p2)) {
+               resultDist=distance;
+               return false;
+            }
+            return true;
+         });
+      return resultDist;
+   }
+
+   template<bool checkCommented>
+   int shortestPath(BidirectSearchState& searchState, const PersonGraph& personGraph, const void* commentedGraph, PersonId p1, PersonId p2, uint32_t num, uint64_t& edgeChecks) {
       // Prepare access to index data structures
       typedef typename std::remove_pointer<typename PersonGraph::Content>::type Content;
       auto basePersonPtr = reinterpret_cast<uint8_t*>(personGraph.buffer.data);
@@ -77,6 +129,7 @@ namespace Query1 {
             continue;
          }
          auto neighbourCount = neighbours->size();
+         edgeChecks += neighbourCount;
          const auto neighboursOffset = reinterpret_cast<const uint8_t*>(neighbours)-basePersonPtr;
          const auto commentedCounts = reinterpret_cast<const Content*>(baseCommentedPtr+neighboursOffset);
 
@@ -130,17 +183,102 @@ namespace Query1 {
       return -1;
    }
 
+   // Same search as shortestPath, but only the qualifying prefix of every friend list is read
+   int shortestPathSorted(BidirectSearchState& searchState, const awfy::ReplySortedGraph& replyGraph, PersonId p1, PersonId p2, int32_t num, uint64_t& edgeChecks) {
+      // Reset data structures and initialize for this search
+      assert(searchState.states.size()==2);
+      auto& bidiStates=searchState.states;
+      bidiStates[0].init(p1, p2);
+      bidiStates[1].init(p2, p1);
+
+      // Run bidirectional search
+      int8_t dir = 0;
+      bool bidiJoined[2]={false,false};
+      unsigned resultDist=std::numeric_limits<unsigned>::max();
+      while (!bidiStates[0].fringe.empty() && !bidiStates[1].fringe.empty()){
+         dir=1-dir;
+
+         auto& dirFringe=bidiStates[dir].fringe;
+         auto& dirSeen=bidiStates[dir].seen;
+         auto& dirTarget=bidiStates[dir].target;
+         auto& otherDirSeen=bidiStates[1-dir].seen;
+
+         // Fetch next person from queue
+         PersonId curPerson = dirFringe.front().first;
+         uint32_t curDepth = dirFringe.front().second;
+         dirFringe.pop_front();
+
+         // Check whether both bidirectional search met and thus finished
+         if (unlikely(bidiJoined[1-dir]&&otherDirSeen.count(curPerson))) {
+            return resultDist;
+         }
+
+         // Continue search over the friends that commented enough
+         auto neighbours = replyGraph.bounds(curPerson, num);
+         edgeChecks += neighbours.second-neighbours.first;
+         for (; neighbours.first!=neighbours.second; ++neighbours.first) {
+            auto neighbourId = *neighbours.first;
+            // Skip already seen neighbors
+            if(dirSeen.count(neighbourId)) {
+               continue;
+            }
+
+            auto neighbourDist=curDepth+1;
+
+            // Return if we found the target
+            if(unlikely(neighbourId==dirTarget)) {
+               return neighbourDist;
+            }
+            // Insert neighbor distance information
+            dirSeen.tryInsert(neighbourId)[0]=neighbourDist;
+            dirFringe.push_back(make_pair(neighbourId, neighbourDist));
+
+            // Check whether the bidirectional searches meet
+            auto otherSeenNeighbour=otherDirSeen.find(neighbourId);
+            if (unlikely(otherSeenNeighbour!=nullptr)) {
+               auto joinedDist=neighbourDist+*otherSeenNeighbour;
+               if(unlikely(resultDist>joinedDist)) {
+                  resultDist=joinedDist; bidiJoined[dir]=true;
+               }
+            }
+         }
+      }
+      return -1;
+   }
+
    int QueryRunner::query(PersonId p1, PersonId p2, int32_t num) {
       // Shortcut when source == target
       if(unlikely(p1==p2)) {
          return 0;
       }
+      // Exact distance from the labels when the comments are not checked
+      if(num<0 && landmarkLabels!=nullptr) {
+         return landmarkLabels->distance(p1,p2);
+      }
+      // Shortcut when both persons are in different components for this comment bound
+      if(replyLabels!=nullptr && replyLabels->covers(num) && !replyLabels->connected(p1,p2,num)) {
+         return -1;
+      }
 
       // Calculate shortest path from source to target
+      if(hybridBFS) {
+         if(unlikely(num>=0)) {
+            return hybridShortestPath<true>(p1,p2,num);
+         } else {
+            return hybridShortestPath<false>(p1,p2,num);
+         }
+      }
+      if(replyGraph!=nullptr) {
+         return shortestPathSorted(searchState,*replyGraph,p1,p2,num,edgeChecks);
+      }
       if(unlikely(num>=0)) {
-         return shortestPath<true>(searchState,personGraph,commentedGraph,p1,p2,num);
+         return shortestPath<true>(searchState,personGraph,commentedGraph,p1,p2,num,edgeChecks);
       } else {
-         return shortestPath<false>(searchState,personGraph,commentedGraph,p1,p2,num);
+         return shortestPath<false>(searchState,personGraph,commentedGraph,p1,p2,num,edgeChecks);
       }
    }
+
+   uint64_t QueryRunner::getEdgeChecks() const {
+      return edgeChecks+hybridSearch.edgeChecks;
+   }
 }
@@ -22,6 +22,10 @@ limitations under the License.
 #include "include/indexes.hpp"
 #include "include/campers/hashtable.hpp"
 #include "include/queue.hpp"
+#include "include/hybridbfs.hpp"
+#include "include/replylabels.hpp"
+#include "include/replygraph.hpp"
+#include "include/landmarklabels.hpp"
 
 namespace Query1 {
 
@@ -41,11 +45,24 @@ namespace Query1 {
    class QueryRunner {
       const PersonGraph& personGraph;
       const void* commentedGraph;
+      const uint32_t numPersons;
+      const bool hybridBFS;
+      const awfy::ReplyComponentLabels* replyLabels; // Set if unreachable targets are detected by the component labels
+      const awfy::ReplySortedGraph* replyGraph; // Set if the bidirectional search reads the reply sorted friend lists
+      const awfy::LandmarkLabels* landmarkLabels; // Set if distances without comment bound are looked up in the labels
+      uint64_t numEdges;
       BidirectSearchState searchState;
+      awfy::HybridBFS hybridSearch;
+      uint64_t edgeChecks; // Of the bidirectional search
+
+      template<bool checkCommented>
+      int hybridShortestPath(PersonId p1, PersonId p2, uint32_t num);
 
    public:
       QueryRunner(const FileIndexes& indexes);
       int query(PersonId p1, PersonId p2, int32_t num);
+      /// Friend entries that were inspected by all queries of this runner
+      uint64_t getEdgeChecks() const;
    };
 
 }
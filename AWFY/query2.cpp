@@ -30,13 +30,38 @@ public:
 
 namespace Query2 {
    typedef awfy::TopKComparer<InterestEntry> Q2Comp;
+   typedef awfy::TopKList<awfy::StringRef,uint32_t,awfy::ArenaAllocator<pair<awfy::StringRef,uint32_t>>> Q2TopK;
+
+   // Space separated tag names of the top k list
+   static string formatResult(Q2TopK& topResults, uint32_t k) {
+      auto& topEntries=topResults.getEntries();
+      assert(topEntries.size()<=k);
+      const uint32_t resNum = min(k, (uint32_t)topEntries.size());
+      size_t length=0;
+      for (uint32_t i=0; i<resNum; i++) {
+         length+=topEntries[i].first.strLen+1;
+      }
+
+      string output;
+      output.reserve(length);
+      for (uint32_t i=0; i<resNum; i++) {
+         if(i>0) {
+            output+=' ';
+         }
+         output.append(topEntries[i].first.str, topEntries[i].first.strLen);
+      }
+      return output;
+   }
 
    QueryRunner::QueryRunner(const FileIndexes& indexes) : 
-      knowsIndex(*(indexes.personGraph)), birthdayIndex(indexes.birthdayIndex),
+      knowsIndex(indexes.localPersonGraph()), birthdayIndex(indexes.birthdayIndex),
       hasInterestIndex(*(indexes.hasInterestIndex)), tagIndex(*(indexes.tagIndex)),
       personMapper(indexes.personMapper),
       interestStats(*indexes.interestStatistics),
-      toVisit(personMapper.count())
+      toVisit(personMapper.count()), hybridBFS(indexes.hybridBFS),
+      hybridSearch(hybridBFS ? personMapper.count() : 0), rawFriends(knowsIndex),
+      compressedFriends(indexes.compressedGraph ? new awfy::CompressedFriends(*indexes.compressedPersonGraph) : nullptr),
+      birthdayComponents(indexes.birthdayComponents), edgeChecks(0)
    {
       {
          auto ret=posix_memalign(reinterpret_cast<void**>(&visited),64,personMapper.count()*sizeof(bool));
@@ -53,6 +78,7 @@ namespace Query2 {
    }
 
    QueryRunner::~QueryRunner() {
+      delete compressedFriends;
    }
 
    void QueryRunner::reset() {
@@ -60,6 +86,10 @@ namespace Query2 {
 
    string QueryRunner::query(uint32_t num, uint32_t year, uint16_t month, uint16_t day) {
       reset();
+      awfy::ArenaScope scope; // Frees the top k list
+      if(birthdayComponents!=nullptr) {
+         return connectedComponents_Sweep(num, encodeBirthday(year,month,day));
+      }
       return connectedComponents_Simple(num, encodeBirthday(year,month,day));
    }
 
@@ -74,8 +104,9 @@ namespace Query2 {
       }
    }
 
-   uint32_t __attribute__((hot)) __attribute__((optimize("align-loops"))) getConnectedComponent(const PersonId person, const PersonGraph& knowsIndex, bool* __restrict__ visited, BFSQueue& toVisit, 
-         const uint32_t numPersons, const uint32_t remainingPersons) {
+   template<class Friends>
+   uint32_t __attribute__((hot)) __attribute__((optimize("align-loops"))) getConnectedComponent(const PersonId person, Friends& friends, bool* __restrict__ visited, BFSQueue& toVisit, 
+         const uint32_t numPersons, const uint32_t remainingPersons, uint64_t& edgeChecks) {
       // This person is now a starting point for a connected component
       toVisit.reset(numPersons);
       {
@@ -88,10 +119,8 @@ namespace Query2 {
          const PersonId curPerson = toVisit.front();
          toVisit.pop_front();
 
-         const auto curFriends=knowsIndex.retrieve(curPerson);
-         if(unlikely(curFriends==nullptr)) { continue; }
-
-         auto friendsBounds = curFriends->bounds();
+         auto friendsBounds = friends.bounds(curPerson);
+         edgeChecks+=friendsBounds.second-friendsBounds.first;
          while(friendsBounds.first != friendsBounds.second) {
             const PersonId curFriend=*friendsBounds.first;
             ++friendsBounds.first;
@@ -118,7 +147,7 @@ namespace Query2 {
 
       // Initialize top k list
       std::string worst("ZZZZZZZZZZZZZ");
-      awfy::TopKList<awfy::StringRef,uint32_t> topResults(make_pair(awfy::StringRef(worst.c_str(), worst.size()), 0));
+      Q2TopK topResults(make_pair(awfy::StringRef(worst.c_str(), worst.size()), 0));
       topResults.init(k);
 
       // Iterate over all interests
@@ -136,6 +165,14 @@ namespace Query2 {
          // Skip interests which have no persons
          if(unlikely(interest.numPersons==0)) { continue; }
 
+         if(hybridBFS) {
+            const uint32_t maxComponentSize=maxComponent_Hybrid(interest.interest, topResults.getBound().second);
+            if(maxComponentSize>0) {
+               topResults.insert(tag, maxComponentSize);
+            }
+            continue;
+         }
+
          // Reset seen list
          memset(visited,0,numPersons);
 
@@ -159,7 +196,9 @@ namespace Query2 {
             // Less persons remaining than needed for making the bound
             if(remainingPersons<topResults.getBound().second) { break; }
 
-            uint32_t componentSize=getConnectedComponent(person, knowsIndex, visited, toVisit, numPersons, remainingPersons);
+            uint32_t componentSize=likely(compressedFriends==nullptr)
+               ? getConnectedComponent(person, rawFriends, visited, toVisit, numPersons, remainingPersons, edgeChecks)
+               : getConnectedComponent(person, *compressedFriends, visited, toVisit, numPersons, remainingPersons, edgeChecks);
             remainingPersons-=componentSize;
 
             if(componentSize>maxComponentSize) {
@@ -173,19 +212,74 @@ namespace Query2 {
          }
       }
 
-      // Create result string
-      ostringstream output;
-      auto& topEntries=topResults.getEntries();
-      assert(topEntries.size()<=k);
-      const uint32_t resNum = min(k, (uint32_t)topEntries.size());
-      for (uint32_t i=0; i<resNum; i++) {
-         if(i>0) {
-            output<<" ";
+      return formatResult(topResults, k);
+   }
+
+   string QueryRunner::connectedComponents_Sweep(uint32_t k, const Birthday birthday) {
+      std::string worst("ZZZZZZZZZZZZZ");
+      Q2TopK topResults(make_pair(awfy::StringRef(worst.c_str(), worst.size()), 0));
+      topResults.init(k);
+
+      // Entries are sorted by their largest component over all birthdays, which bounds every lookup
+      for(const auto& entry : birthdayComponents->getEntries()) {
+         if(entry.maxComponent<topResults.getBound().second) { break; }
+         const uint32_t maxComponentSize=birthdayComponents->maxComponent(entry, birthday);
+         if(maxComponentSize==0 || maxComponentSize<topResults.getBound().second) { continue; }
+
+         const awfy::StringRef& tag = tagIndex.idToStr.retrieve(entry.interest);
+         assert(tag.str!=nullptr);
+         topResults.insert(tag, maxComponentSize);
+      }
+
+      return formatResult(topResults, k);
+   }
+
+   uint32_t QueryRunner::maxComponent_Hybrid(const InterestId interest, const uint32_t bound) {
+      const uint32_t numPersons=personMapper.count();
+
+      // Mark all people with bad birthdays or bad interests as visited
+      hybridSearch.clear();
+      uint32_t matchingPersons=0;
+      uint64_t matchingEdges=0;
+      for(PersonId person=0; person<numPersons; person++) {
+         if(unlikely(correctBirthday[person] && !ignorePerson(person, interest, hasInterestIndex))) {
+            matchingPersons++;
+            const auto friends=knowsIndex.retrieve(person);
+            if(friends!=nullptr) {
+               matchingEdges+=friends->size();
+            }
+         } else {
+            hybridSearch.markVisited(person);
+         }
+      }
+
+      uint32_t maxComponentSize=0;
+      uint32_t remainingPersons=matchingPersons;
+      for(PersonId person=0; person<numPersons; person++) {
+         // Skip filtered persons (or were seen in a connected component)
+         if(likely(hybridSearch.isVisited(person))) { continue; }
+
+         // Less persons remaining than needed for making the bound
+         if(remainingPersons<bound) { break; }
+
+         uint32_t componentSize=1;
+         hybridSearch.run(knowsIndex, person, matchingEdges, remainingPersons,
+            [](PersonId, const PersonGraph::Content, uint32_t) { return true; },
+            [&](uint32_t /*distance*/, uint32_t numDiscovered) {
+               componentSize+=numDiscovered;
+               return componentSize<remainingPersons;
+            });
+         remainingPersons-=componentSize;
+
+         if(componentSize>maxComponentSize) {
+            maxComponentSize=componentSize;
          }
-         output<<string(topEntries[i].first.str, topEntries[i].first.strLen);
       }
+      return maxComponentSize;
+   }
 
-      return output.str();
+   uint64_t QueryRunner::getEdgeChecks() const {
+      return edgeChecks+hybridSearch.edgeChecks;
    }
 
 }
@@ -20,11 +20,15 @@ limitations under the License.
 #include <string>
 #include <deque>
 #include "include/indexes.hpp"
+#include "include/compressedgraph.hpp"
+#include "include/birthdaycomponents.hpp"
 #include "include/alloc.hpp"
+#include "include/arena.hpp"
 #include "include/campers/hashtable.hpp"
 #include "include/MurmurHash2.h"
 #include "include/topklist.hpp"
 #include "include/queue.hpp"
+#include "include/hybridbfs.hpp"
 
 using namespace std;
 
@@ -44,14 +48,25 @@ namespace Query2 {
       bool* correctBirthday;
       bool* visited;
       BFSQueue toVisit;
+      const bool hybridBFS;
+      awfy::HybridBFS hybridSearch;
+      awfy::RawFriends rawFriends;
+      awfy::CompressedFriends* compressedFriends; // Set if the queue BFS reads the compressed person graph
+      const awfy::BirthdayComponentIndex* birthdayComponents; // Set if queries are answered from the birthday sweep
+      uint64_t edgeChecks; // Of the queue BFS
 
       void reset();
       string connectedComponents_Simple(uint32_t num, const Birthday birthday);
+      string connectedComponents_Sweep(uint32_t num, const Birthday birthday);
+      /// Size of the largest component of persons with matching birthday and interest, 0 if it cannot reach the bound
+      uint32_t maxComponent_Hybrid(const InterestId interest, const uint32_t bound);
 
    public:
       QueryRunner(const FileIndexes& indexes);
       ~QueryRunner();
       string query(uint32_t num, uint32_t year, uint16_t month, uint16_t day);
+      /// Friend entries that were inspected by all queries of this runner
+      uint64_t getEdgeChecks() const;
    };
 
 }
@@ -17,8 +17,12 @@ limitations under the License.
 #include <stack>
 #include <functional>
 #include <sstream>
+#include <cmath>
+#include <mutex>
 #include "query3.hpp"
 #include "include/indexers.hpp"
+#include "include/concurrent/atomic.hpp"
+#include "include/concurrent/scheduler.hpp"
 
 using namespace std;
 
@@ -42,22 +46,65 @@ public:
 
 namespace Query3 {
 
+/// Friends a BFS reads per list pair before the Auto mode enumerates the lists, a pair costs a merge of two
+/// interest lists and possibly a distance check
+static const double invertedPairCost=2;
+/// Place persons per morsel of the parallel BFS search
+static const uint32_t morselSize=64;
+static const uint32_t maxMorselTasks=256;
+/// Places with fewer persons are searched by the calling thread
+static const uint32_t parallelMinPersons=2*morselSize;
+
+/// Sorts below every pair, entries equal to it are removed from the final list
+inline TopKPairs::EntryPair noMatch() {
+   return make_pair(PersonPair(numeric_limits<PersonId>::max(),numeric_limits<PersonId>::max()), 0);
+}
+
+PairSearch::PairSearch(const FileIndexes& fileIndexes)
+   : personMapper(fileIndexes.personMapper),
+     hasInterestIndex(*(fileIndexes.hasInterestIndex)),
+     seen(nullptr),
+     toVisit(personMapper.count()/2), // sufficient for test_1k
+     rawFriends(fileIndexes.localPersonGraph()),
+     compressedFriends(fileIndexes.compressedGraph ? new awfy::CompressedFriends(*fileIndexes.compressedPersonGraph) : nullptr)
+{
+   bfsResults.reserve(512); // maximum number for 1k is 116
+   auto ret = posix_memalign(reinterpret_cast<void**>(&seen), 64, personMapper.count() * sizeof(bool));
+   if(unlikely(ret!=0)) {
+      throw -1;
+   }
+}
+
+PairSearch::~PairSearch()
+{
+   free(seen);
+   delete compressedFriends;
+}
+
 QueryRunner::QueryRunner(const FileIndexes& fileIndexes)
-   : knowsIndex(*(fileIndexes.personGraph)),
+   : indexes(fileIndexes),
+     knowsIndex(fileIndexes.localPersonGraph()),
      personMapper(fileIndexes.personMapper),
      hasInterestIndex(*(fileIndexes.hasInterestIndex)),
      placeBoundsIndex(*(fileIndexes.placeBoundsIndex)),
      personPlaceIndex(*(fileIndexes.personPlaceIndex)),
      namePlaceIndex(*(fileIndexes.namePlaceIndex)),
-     toVisit(personMapper.count()/2), // sufficient for test_1k
-     topMatches(make_pair(PersonPair(numeric_limits<PersonId>::max(),numeric_limits<PersonId>::max()), 0)),
-     seen(nullptr)
+     topMatches(noMatch()),
+     search(fileIndexes),
+     mode(fileIndexes.query3Mode),
+     averageFriends(0),
+     meetRound(0)
 {
-   bfsResults.reserve(512); // maximum number for 1k is 116
    personFilter.resize(personMapper.count());
-   auto ret = posix_memalign(reinterpret_cast<void**>(&seen), 64, personMapper.count() * sizeof(bool));
-   if(unlikely(ret!=0)) {
-      throw -1;
+   if(mode!=awfy::strategy::Query3Mode::Bfs) {
+      meetMarks.resize(personMapper.count());
+   }
+   if(mode==awfy::strategy::Query3Mode::Auto && personMapper.count()>0) {
+      uint64_t numFriends=0;
+      for(PersonId person=0; person<personMapper.count(); person++) {
+         numFriends+=knowsIndex.retrieve(person)->size();
+      }
+      averageFriends=double(numFriends)/personMapper.count();
    }
 }
 
@@ -147,12 +194,15 @@ void checkInOrder(const T interests) {
 }
 #endif
 
-void __attribute__((hot)) __attribute__((optimize("align-loops"))) QueryRunner::runBFS(PersonId start, uint32_t hops) {
+template<class Friends>
+void __attribute__((hot)) __attribute__((optimize("align-loops"))) PairSearch::runBFS(PersonId start, uint32_t hops, const awfy::vector<char>& personFilter, Friends& friends) {
    assert(toVisit.empty()); //Data structures are in a sane state
    memset(seen, 0, personMapper.count() * sizeof(bool));
 
    seen[start] = true;
    bfsResults.clear();
+   // Pairs are only reported from the person with the smaller original id
+   const PersonId originalStart = personMapper.invert(start);
 
    {
       auto& p = toVisit.push_back_pos();
@@ -169,19 +219,14 @@ void __attribute__((hot)) __attribute__((optimize("align-loops"))) QueryRunner::
          return;
       }
 
-      const auto curFriends = knowsIndex.retrieve(curPerson);
-      if (unlikely(curFriends==nullptr)) {
-         continue;
-      }
-
-      auto friendsBounds = curFriends->bounds();
+      auto friendsBounds = friends.bounds(curPerson);
       while (friendsBounds.first != friendsBounds.second) {
          const PersonId curFriend = *friendsBounds.first;
          ++friendsBounds.first;
          if (seen[curFriend]) {
             continue;
          }
-         if (curFriend > start && personFilter[curFriend]) {
+         if (personFilter[curFriend] && personMapper.invert(curFriend) > originalStart) {
             bfsResults.push_back(curFriend);
          }
          seen[curFriend] = true;
@@ -192,6 +237,14 @@ void __attribute__((hot)) __attribute__((optimize("align-loops"))) QueryRunner::
    } while (!toVisit.empty());
 }
 
+void PairSearch::runBFS(PersonId start, uint32_t hops, const awfy::vector<char>& personFilter) {
+   if(likely(compressedFriends==nullptr)) {
+      runBFS(start, hops, personFilter, rawFriends);
+   } else {
+      runBFS(start, hops, personFilter, *compressedFriends);
+   }
+}
+
 #ifdef SSE_INTEREST_COUNT
 /**
  * SSE_INTEREST_COUNT:
@@ -424,88 +477,478 @@ void QueryRunner::buildPersonFilter(const awfy::vector<PlaceBounds>& place)
    }
    #ifdef Q3_SORT_BY_INTEREST
    sort(persons.begin(), persons.end(), PersonNumInterestSorter());
+   #else
+   // Ties in the top k are broken by original ids, so the persons are visited in that order
+   if (personMapper.relabeled()) {
+      const PersonMapper& mapper = personMapper;
+      sort(persons.begin(), persons.end(), [&mapper](PersonId a, PersonId b) {
+         return mapper.invert(a) < mapper.invert(b);
+      });
+   }
    #endif
 }
 
-string QueryRunner::queryPlaces(const uint32_t k, uint32_t hops, const awfy::vector<PlaceBounds>& place) {
-   topMatches.init(k);
-   
-   // collect all persons
-   buildPersonFilter(place); //Maximum id of a person considered in the query
+/// Orders pairs by their common interests and then descending by the first person, a pair whose key is smaller than
+/// that of the k-th entry is behind it
+inline uint64_t boundKey(uint32_t commonInterests, PersonId invertedPersonId) {
+   return (static_cast<uint64_t>(commonInterests)<<32) | (numeric_limits<PersonId>::max()-invertedPersonId);
+}
+
+/// Key of the k-th entry, 0 until the list is full
+inline uint64_t boundKey(TopKPairs& matches) {
+   const auto& bound=matches.getBound();
+   return bound.first.first==numeric_limits<PersonId>::max() ? 0 : boundKey(bound.second, bound.first.first);
+}
+
+/// Top k of a search by the calling thread
+struct LocalMatches {
+   TopKPairs& matches;
+
+   LocalMatches(TopKPairs& matches) : matches(matches)
+   { }
+
+   uint64_t bound() {
+      return boundKey(matches);
+   }
+
+   /// Returns the new bound
+   uint64_t insert(const PersonPair& pair, uint32_t commonInterests) {
+      matches.insert(pair, commonInterests);
+      return boundKey(matches);
+   }
+};
+
+/// Top k that all morsels of a query insert into, the bound is read without the lock
+struct SharedMatches {
+   mutex matchesMutex;
+   TopKPairs matches; // Guarded by matchesMutex
+   awfy::atomic<uint64_t> boundKey;
 
-   for(auto personIter=persons.cbegin(); personIter!=persons.cend(); personIter++) {
+   SharedMatches(uint32_t k) : matches(noMatch()), boundKey(0) {
+      matches.init(k);
+   }
+
+   uint64_t bound() {
+      return boundKey.load();
+   }
+
+   uint64_t insert(const PersonPair& pair, uint32_t commonInterests) {
+      lock_guard<mutex> lock(matchesMutex);
+      matches.insert(pair, commonInterests);
+      const uint64_t key=Query3::boundKey(matches);
+      boundKey.store(key);
+      return key;
+   }
+};
+
+template<class Matches>
+void PairSearch::searchPairs(const PlacePerson* begin, const PlacePerson* end, uint32_t hops, const awfy::vector<char>& personFilter, Matches& matches) {
+   for(auto personIter=begin; personIter!=end; personIter++) {
+      // Bounds found by other morsels are read once per person
+      uint64_t bound=matches.bound();
       #ifdef Q3_SORT_BY_INTEREST
       const auto personId = personIter->first;
       const auto personInterestCount = personIter->second;
+      const PersonId invertedPersonId = personMapper.invert(personId);
       // Skip persons that have too few interests to make the top k bound
-      if(personInterestCount<topMatches.getBound().second
-         || (personInterestCount==topMatches.getBound().second 
-             && compareLexicographic(topMatches.getBound().first, PersonPair(personId,numeric_limits<PersonId>::max())))) {
+      if(boundKey(personInterestCount, invertedPersonId)<bound) {
          continue;
       }
       #else
       const auto personId = *personIter;
+      const PersonId invertedPersonId = personMapper.invert(personId);
       const auto ownInterests = hasInterestIndex.retrieve(personId);
-      if(ownInterests->size()<topMatches.getBound().second
-         || (ownInterests->size()==topMatches.getBound().second 
-             && compareLexicographic(topMatches.getBound().first, PersonPair(personId,numeric_limits<PersonId>::max())))) {
+      if(boundKey(ownInterests->size(), invertedPersonId)<bound) {
          continue;
       }
       #endif
 
-      runBFS(personId, hops);
+      runBFS(personId, hops, personFilter);
 
       #ifdef Q3_SORT_BY_INTEREST
       auto const ownInterests = hasInterestIndex.retrieve(personId);
       #endif
 
       // Iterate over all persons within "hops" distance && place bounds and calculate common interests
-      uint64_t invertedPersonId=personMapper.invert(personId);
       for(auto friendIter=bfsResults.cbegin(); friendIter!=bfsResults.cend(); friendIter++) {
          const auto friendId = *friendIter;
-         assert(friendId >= personId);
+         const PersonId invertedFriendId = personMapper.invert(friendId);
+         assert(invertedFriendId > invertedPersonId);
 
          const auto friendsInterests = hasInterestIndex.retrieve(friendId);
          // Skip reachable person if it has too few interests to make top k bound
-         if(friendsInterests->size()<topMatches.getBound().second
-            || (friendsInterests->size()==topMatches.getBound().second 
-             && compareLexicographic(topMatches.getBound().first, PersonPair(personId,friendId)))) {
+         if(boundKey(friendsInterests->size(), invertedPersonId)<bound) {
             continue;
          }
 
          // Calculate common interests and update top k list
          const auto commonInterests = getCommonInterestCount(ownInterests, friendsInterests);
-         topMatches.insert(
-            make_pair(invertedPersonId, personMapper.invert(friendId)),
-            commonInterests);
+         if(boundKey(commonInterests, invertedPersonId)>=bound) {
+            bound=matches.insert(PersonPair(invertedPersonId, invertedFriendId), commonInterests);
+         }
       } 
    }
+}
 
-   ostringstream output;
-   auto matches = topMatches.getEntries();
+string formatMatches(TopKPairs& topMatches, const uint32_t k) {
+   string output;
+   const auto& matches = topMatches.getEntries();
    const uint32_t resNum = min(k, (uint32_t)matches.size());
+   output.reserve(resNum*24);
    for (uint32_t i=0; i<resNum; i++){
       if(i>0) {
-         output<<" ";
+         output+=' ';
       }
       const auto& resultPair = matches[i].first;
-      output<<resultPair.first<<"|"<<resultPair.second;
+      output.append(to_string(resultPair.first));
+      output+='|';
+      output.append(to_string(resultPair.second));
    }
 
-   return output.str();
+   return output;
 }
 
-string QueryRunner::query(const uint32_t k, const uint32_t hops, const char* place) {
+template<class Friends>
+bool QueryRunner::withinHops(PersonId a, PersonId b, uint32_t hops, Friends& friends) {
+   // Marks of older rounds read as unvisited, so the array is only cleared when the rounds wrap
+   if(unlikely(meetRound>=numeric_limits<uint32_t>::max()/2-1)) {
+      fill(meetMarks.begin(), meetMarks.end(), 0);
+      meetRound=0;
+   }
+   meetRound++;
+   const uint32_t marks[2] = { meetRound*2, meetRound*2+1 };
+   frontiers[0].clear();
+   frontiers[1].clear();
+   frontiers[0].push_back(a);
+   frontiers[1].push_back(b);
+   meetMarks[a]=marks[0];
+   meetMarks[b]=marks[1];
+
+   for(uint32_t dist=0; dist<hops; dist++) {
+      // Expand the smaller frontier by one level, a person reached from the other side closes the path
+      const unsigned side = frontiers[0].size()<=frontiers[1].size() ? 0 : 1;
+      auto& frontier=frontiers[side];
+      if(frontier.empty()) {
+         return false;
+      }
+      nextFrontier.clear();
+      for(auto personIter=frontier.cbegin(); personIter!=frontier.cend(); personIter++) {
+         auto friendsBounds = friends.bounds(*personIter);
+         while (friendsBounds.first != friendsBounds.second) {
+            const PersonId curFriend = *friendsBounds.first;
+            ++friendsBounds.first;
+            const uint32_t mark=meetMarks[curFriend];
+            if(mark==marks[side]) {
+               continue;
+            }
+            if(mark==marks[1-side]) {
+               return true;
+            }
+            meetMarks[curFriend]=marks[side];
+            nextFrontier.push_back(curFriend);
+         }
+      }
+      frontier.swap(nextFrontier);
+   }
+   return false;
+}
+
+#ifndef Q3_SORT_BY_INTEREST
+uint64_t QueryRunner::buildInvertedLists() {
+   // Persons are in original id order, so the order of two positions is the order of the result pair
+   const uint32_t numPlacePersons=persons.size();
+   interestPositions.clear();
+   for(uint32_t pos=0; pos<numPlacePersons; pos++) {
+      auto interestBounds=hasInterestIndex.retrieve(persons[pos])->bounds();
+      for(; interestBounds.first!=interestBounds.second; ++interestBounds.first) {
+         interestPositions.push_back(make_pair(*interestBounds.first, pos));
+      }
+   }
+   sort(interestPositions.begin(), interestPositions.end());
+   listInterests.clear();
+   listOffsets.clear();
+   listPositions.resize(interestPositions.size());
+   for(size_t i=0; i<interestPositions.size(); i++) {
+      if(listInterests.empty() || listInterests.back()!=interestPositions[i].first) {
+         listInterests.push_back(interestPositions[i].first);
+         listOffsets.push_back(i);
+      }
+      listPositions[i]=interestPositions[i].second;
+   }
+   listOffsets.push_back(interestPositions.size());
+
+   uint64_t numPairs=0;
+   for(size_t list=0; list+1<listOffsets.size(); list++) {
+      const uint64_t length=listOffsets[list+1]-listOffsets[list];
+      numPairs+=length*(length-1)/2;
+   }
+   return numPairs;
+}
+
+void QueryRunner::enumeratePairs(uint32_t hops) {
+   const uint32_t numPlacePersons=persons.size();
+   candidateCounts.clear();
+   candidateCounts.resize(numPlacePersons);
+   for(uint32_t pos=0; pos<numPlacePersons; pos++) {
+      const PersonId personId=persons[pos];
+      const PersonId invertedPersonId=personMapper.invert(personId);
+      const auto ownInterests=hasInterestIndex.retrieve(personId);
+      const uint32_t numInterests=ownInterests->size();
+      if(numInterests==0 || numInterests<topMatches.getBound().second
+         || (numInterests==topMatches.getBound().second
+             && compareLexicographic(topMatches.getBound().first, PersonPair(invertedPersonId,numeric_limits<PersonId>::max())))) {
+         continue;
+      }
+
+      // Own lists restricted to the persons after this one, shortest first
+      ownLists.clear();
+      auto interestBounds=ownInterests->bounds();
+      for(; interestBounds.first!=interestBounds.second; ++interestBounds.first) {
+         const size_t list=lower_bound(listInterests.cbegin(), listInterests.cend(), *interestBounds.first)-listInterests.cbegin();
+         assert(list<listInterests.size() && listInterests[list]==*interestBounds.first);
+         const uint32_t* listBegin=listPositions.data()+listOffsets[list];
+         const uint32_t* listEnd=listPositions.data()+listOffsets[list+1];
+         const uint32_t* listStart=upper_bound(listBegin, listEnd, pos);
+         if(listStart!=listEnd) {
+            ownLists.push_back(make_pair(listStart, listEnd));
+         }
+      }
+      sort(ownLists.begin(), ownLists.end(), [](const pair<const uint32_t*,const uint32_t*>& a, const pair<const uint32_t*,const uint32_t*>& b) {
+         return a.second-a.first < b.second-b.first;
+      });
+
+      // A pair with at least bound common interests is in one of the first numInterests-bound+1 lists
+      const uint32_t bound=topMatches.getBound().second;
+      const size_t prefix=bound==0 ? ownLists.size() : min(ownLists.size(), (size_t)(numInterests-bound+1));
+      candidates.clear();
+      for(size_t list=0; list<prefix; list++) {
+         for(auto posIter=ownLists[list].first; posIter!=ownLists[list].second; posIter++) {
+            if(candidateCounts[*posIter]++==0) {
+               candidates.push_back(*posIter);
+            }
+         }
+      }
+      // Counts over a prefix are partial, those of candidates that could still make the bound are completed
+      size_t numCandidates=0;
+      for(auto candIter=candidates.cbegin(); candIter!=candidates.cend(); candIter++) {
+         const uint32_t candidate=*candIter;
+         uint32_t count=candidateCounts[candidate];
+         candidateCounts[candidate]=0;
+         if(prefix<ownLists.size()) {
+            const auto friendsInterests=hasInterestIndex.retrieve(persons[candidate]);
+            if(friendsInterests->size()<bound) {
+               continue;
+            }
+            count=getCommonInterestCount(ownInterests, friendsInterests);
+         }
+         if(count<bound) {
+            continue;
+         }
+         candidates[numCandidates++]=candidate;
+         candidateCounts[candidate]=count;
+      }
+      candidates.resize(numCandidates);
+      sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+         return candidateCounts[a]>candidateCounts[b] || (candidateCounts[a]==candidateCounts[b] && a<b);
+      });
+
+      // Best pairs first, the first pair that does not beat the bound ends the person
+      for(auto candIter=candidates.cbegin(); candIter!=candidates.cend(); candIter++) {
+         const uint32_t candidate=*candIter;
+         const auto entry=make_pair(PersonPair(invertedPersonId, personMapper.invert(persons[candidate])), candidateCounts[candidate]);
+         if(awfy::compare(topMatches.getBound(), entry)) {
+            break;
+         }
+         const bool reachable = likely(search.compressedFriends==nullptr)
+            ? withinHops(personId, persons[candidate], hops, search.rawFriends)
+            : withinHops(personId, persons[candidate], hops, *search.compressedFriends);
+         if(reachable) {
+            topMatches.insert(entry.first, entry.second);
+         }
+      }
+      for(auto candIter=candidates.cbegin(); candIter!=candidates.cend(); candIter++) {
+         candidateCounts[*candIter]=0;
+      }
+   }
+
+   // Fewer than k reachable pairs share an interest, the rest is filled with pairs in id order that share none
+   if(topMatches.getBound().second==0) {
+      for(auto personIter=persons.cbegin(); personIter!=persons.cend(); personIter++) {
+         const PersonId personId=*personIter;
+         const PersonId invertedPersonId=personMapper.invert(personId);
+         search.runBFS(personId, hops, personFilter);
+         const auto ownInterests=hasInterestIndex.retrieve(personId);
+         for(auto friendIter=search.bfsResults.cbegin(); friendIter!=search.bfsResults.cend(); friendIter++) {
+            if(getCommonInterestCount(ownInterests, hasInterestIndex.retrieve(*friendIter))==0) {
+               topMatches.insert(make_pair(invertedPersonId, personMapper.invert(*friendIter)), 0);
+            }
+         }
+         // Pairs of later persons come after all pairs in the list once it is full
+         if(topMatches.getBound().first.first!=numeric_limits<PersonId>::max()) {
+            break;
+         }
+      }
+   }
+}
+#endif
+
+bool QueryRunner::preparePlace(const uint32_t k, const char* place) {
    reset();
    
-   awfy::vector<PlaceBounds> placeBounds = getPlaceBounds(place);
-   if(unlikely(placeBounds.size()==0)) {
+   // Refers to the member, its capacity is kept for the next query
+   const awfy::vector<PlaceBounds>& bounds = getPlaceBounds(place);
+   if(unlikely(bounds.size()==0)) {
       //Handle case that an invalid place is queried
-      ostringstream output;
-      return output.str();
+      return false;
+   }
+
+   topMatches.init(k);
+   buildPersonFilter(bounds);
+   return true;
+}
+
+bool QueryRunner::useInvertedLists(uint32_t hops) {
+   #ifndef Q3_SORT_BY_INTEREST
+   if(mode!=awfy::strategy::Query3Mode::Bfs) {
+      const uint64_t listPairs=buildInvertedLists();
+      // The BFS from every person reads the friends of the persons within hops-1, the lists hold the pairs
+      // the enumeration reads at most
+      const double bfsFriends=persons.size()*min(averageFriends*personMapper.count(), pow(averageFriends, hops));
+      return mode==awfy::strategy::Query3Mode::Inverted || bfsFriends>=listPairs*invertedPairCost;
    }
+   #else
+   (void)hops;
+   #endif
+   return false;
+}
+
+string QueryRunner::findMatches(const uint32_t k, const uint32_t hops, bool inverted) {
+   #ifndef Q3_SORT_BY_INTEREST
+   if(inverted) {
+      enumeratePairs(hops);
+      return formatMatches(topMatches, k);
+   }
+   #else
+   assert(!inverted);
+   #endif
+   LocalMatches matches(topMatches);
+   search.searchPairs(persons.data(), persons.data()+persons.size(), hops, personFilter, matches);
+   return formatMatches(topMatches, k);
+}
+
+string QueryRunner::query(const uint32_t k, const uint32_t hops, const char* place) {
+   if(!preparePlace(k, place)) {
+      return string();
+   }
+   return findMatches(k, hops, useInvertedLists(hops));
+}
+
+/// Query whose BFS searches run as morsels, owns the place persons while they run
+struct SearchState {
+   const FileIndexes& indexes;
+   const uint32_t k;
+   const uint32_t hops;
+   const awfy::vector<PlacePerson> persons;
+   const awfy::vector<char> personFilter;
+   SharedMatches matches;
+   Task* finishTask; // Executed once the result was written, may be null
+
+   SearchState(const FileIndexes& indexes, uint32_t k, uint32_t hops, awfy::vector<PlacePerson>&& persons, awfy::vector<char>&& personFilter, Task* finishTask)
+      : indexes(indexes), k(k), hops(hops), persons(move(persons)), personFilter(move(personFilter)), matches(k), finishTask(finishTask)
+   { }
+};
+
+/// BFS buffers of the calling thread, replaced after updates like the query runners
+PairSearch& getThreadLocalSearch(const FileIndexes& indexes) {
+   static __thread PairSearch* searchPtr=nullptr;
+   static __thread uint64_t generation=0;
+   if(searchPtr==nullptr || generation!=indexes.generation) {
+      delete searchPtr;
+      generation=indexes.generation;
+      searchPtr=new PairSearch(indexes);
+   }
+   return *searchPtr;
+}
+
+struct MorselTask {
+   SearchState& state;
+   const uint32_t rangeStart;
+   const uint32_t rangeEnd;
+
+   MorselTask(SearchState& state, uint32_t rangeStart, uint32_t rangeEnd)
+      : state(state), rangeStart(rangeStart), rangeEnd(rangeEnd)
+   { }
 
-   return queryPlaces(k,hops,placeBounds);
+   void operator()() {
+      awfy::counters::Trace::setLabel("morsel");
+      assert(rangeStart<rangeEnd);
+      getThreadLocalSearch(state.indexes).searchPairs(state.persons.data()+rangeStart, state.persons.data()+rangeEnd, state.hops,
+         state.personFilter, state.matches);
+   }
+};
+
+/// The order of pairs is total, so the top k does not depend on the order in which the morsels inserted
+struct ResultWriter {
+   SearchState* state;
+   const char*& resultOut;
+
+   ResultWriter(SearchState* state, const char*& resultOut)
+      : state(state), resultOut(resultOut)
+   { }
+
+   void operator()() {
+      Query4::writeResult(formatMatches(state->matches.matches, state->k), resultOut, state->finishTask);
+      delete state;
+   }
+};
+
+TaskGroup QueryRunner::query(const uint32_t k, const uint32_t hops, const char* place, const char*& resultOut, Task* finishTask) {
+   if(!preparePlace(k, place)) {
+      Query4::writeResult(string(), resultOut, finishTask);
+      return TaskGroup();
+   }
+   const bool inverted=useInvertedLists(hops);
+   if(inverted || persons.size()<parallelMinPersons) {
+      Query4::writeResult(findMatches(k, hops, inverted), resultOut, finishTask);
+      return TaskGroup();
+   }
+
+   // Process first persons to initialize the top k, the morsels start with its bound
+   const uint32_t numPersons=persons.size();
+   const PlacePerson* personsBegin=persons.data();
+   LocalMatches localMatches(topMatches);
+   uint32_t numSequential=0;
+   do {
+      const uint32_t sequentialEnd=min(numPersons, numSequential+morselSize);
+      search.searchPairs(personsBegin+numSequential, personsBegin+sequentialEnd, hops, personFilter, localMatches);
+      numSequential=sequentialEnd;
+   } while(localMatches.bound()==0 && numSequential<numPersons/4);
+   const uint32_t numRemaining=numPersons-numSequential;
+   if(numRemaining<parallelMinPersons) {
+      search.searchPairs(personsBegin+numSequential, personsBegin+numPersons, hops, personFilter, localMatches);
+      Query4::writeResult(formatMatches(topMatches, k), resultOut, finishTask);
+      return TaskGroup();
+   }
+
+   // The next query of this runner rebuilds the persons and the filter
+   SearchState* state=new SearchState(indexes, k, hops, move(persons), move(personFilter), finishTask);
+   const auto& entries=topMatches.getEntries();
+   for(auto entryIter=entries.cbegin(); entryIter!=entries.cend(); entryIter++) {
+      state->matches.insert(entryIter->first, entryIter->second);
+   }
+   uint32_t personsPerTask=morselSize;
+   if(numRemaining/personsPerTask>maxMorselTasks) {
+      personsPerTask=numRemaining/maxMorselTasks;
+   }
+   const uint32_t numTasks=numRemaining/personsPerTask;
+   TaskGroup taskGroup;
+   for(uint32_t task=0; task<numTasks; task++) {
+      const uint32_t rangeStart=numSequential+personsPerTask*task;
+      const uint32_t rangeEnd=task!=numTasks-1 ? rangeStart+personsPerTask : numPersons;
+      taskGroup.schedule(LambdaRunner::createLambdaTask(MorselTask(*state, rangeStart, rangeEnd),TaskGraph::Query3));
+   }
+   taskGroup.join(LambdaRunner::createLambdaTask(ResultWriter(state, resultOut),TaskGraph::Query3));
+   return taskGroup;
 }
 
 }
@@ -19,8 +19,10 @@ limitations under the License.
 #include <string>
 #include "include/topklist.hpp"
 #include "include/indexes.hpp"
+#include "include/compressedgraph.hpp"
 #include "include/alloc.hpp"
 #include "include/queue.hpp"
+#include "include/strategy.hpp"
 #include "query4.hpp"
 
 #define SSE_INTEREST_COUNT
@@ -31,8 +33,47 @@ namespace Query3 {
 
 typedef std::pair<PersonId, PersonId> PersonPair;
 
+#ifdef SSE_INTEREST_COUNT
+/// Number of common entries of two sorted lists, v1 compares blocks with SSE and expects lenRare<=lenFreq
+size_t match_scalar(const uint32_t* A, const size_t lenA, const uint32_t* B, const size_t lenB);
+size_t v1(const uint32_t* rare, size_t lenRare, const uint32_t* freq, size_t lenFreq);
+#endif
+
+typedef awfy::TopKList<PersonPair, uint32_t> TopKPairs;
+
+#ifdef Q3_SORT_BY_INTEREST
+typedef pair<PersonId,uint32_t> PlacePerson; // Person and its number of interests
+#else
+typedef PersonId PlacePerson;
+#endif
+
+/// BFS buffers and friend list access of one thread
+struct PairSearch {
+   const PersonMapper& personMapper;
+   const HasInterestIndex& hasInterestIndex;
+   bool* seen;
+   awfy::Queue<std::pair<PersonId, uint32_t>> toVisit;
+   awfy::vector<PersonId> bfsResults;
+   awfy::RawFriends rawFriends;
+   awfy::CompressedFriends* compressedFriends; // Set if the BFS reads the compressed person graph
+
+   PairSearch(const FileIndexes& indexes);
+   ~PairSearch();
+   PairSearch(const PairSearch&) = delete;
+   PairSearch& operator=(const PairSearch&) = delete;
+
+   /// Collects the persons in the filter within hops of start that have a larger original id in bfsResults
+   template<class Friends>
+   void runBFS(PersonId start, uint32_t hops, const awfy::vector<char>& personFilter, Friends& friends);
+   void runBFS(PersonId start, uint32_t hops, const awfy::vector<char>& personFilter);
+   /// Inserts the pairs of the persons in [begin,end) into a LocalMatches or SharedMatches list
+   template<class Matches>
+   void searchPairs(const PlacePerson* begin, const PlacePerson* end, uint32_t hops, const awfy::vector<char>& personFilter, Matches& matches);
+};
+
 class QueryRunner {
    //Indexes
+   const FileIndexes& indexes;
    const PersonGraph& knowsIndex;
    const PersonMapper& personMapper;
    const HasInterestIndex& hasInterestIndex;
@@ -40,32 +81,54 @@ class QueryRunner {
    const PersonPlaceIndex& personPlaceIndex;
    const NamePlaceIndex& namePlaceIndex;
 
-   typedef awfy::TopKList<PersonPair, uint32_t> TopKPairs;
-
    //Runtime data
    awfy::vector<PlaceBounds> placeBounds;
-   #ifdef Q3_SORT_BY_INTEREST
-   awfy::vector<pair<PersonId,uint32_t>> persons;
-   #else
-   awfy::vector<PersonId> persons;
-   #endif
+   awfy::vector<PlacePerson> persons;
    awfy::vector<char> personFilter;
-   awfy::Queue<std::pair<PersonId, uint32_t>> toVisit;
-   awfy::vector<PersonId> bfsResults;
    TopKPairs topMatches;
-   bool* seen;
+   PairSearch search;
+
+   //Inverted list strategy, only used if query3Mode is not Bfs
+   const awfy::strategy::Query3Mode mode;
+   double averageFriends; // Friends per person, only computed for the Auto mode
+   awfy::vector<pair<InterestId,uint32_t>> interestPositions; // Interest and position in persons of every place person
+   awfy::vector<InterestId> listInterests; // Distinct interests of the place persons, sorted
+   awfy::vector<uint32_t> listOffsets; // Start of the positions of every interest in listPositions
+   awfy::vector<uint32_t> listPositions; // Positions of the persons with an interest, ascending per interest
+   awfy::vector<pair<const uint32_t*,const uint32_t*>> ownLists;
+   awfy::vector<uint32_t> candidateCounts; // Indexed by position
+   awfy::vector<uint32_t> candidates;
+   awfy::vector<uint32_t> meetMarks; // Side and round that reached a person in withinHops
+   uint32_t meetRound;
+   awfy::vector<PersonId> frontiers[2];
+   awfy::vector<PersonId> nextFrontier;
 
    void reset();
 
-   void runBFS(PersonId start, uint32_t hops);
+   /// Bidirectional BFS that stops once both persons are known to be more than hops apart
+   template<class Friends>
+   bool withinHops(PersonId a, PersonId b, uint32_t hops, Friends& friends);
    awfy::vector<PlaceBounds>&& getPlaceBounds(const char* place);
 
    /// Builds person filter and returns max. person id in the filter
    void buildPersonFilter(const awfy::vector<PlaceBounds>& place);
-   string queryPlaces(const uint32_t k, uint32_t hops, const awfy::vector<PlaceBounds>& place);
+   /// Finds the place persons and initializes the top k, returns false if the place does not exist
+   bool preparePlace(const uint32_t k, const char* place);
+   /// Decides between the BFS from every place person and the inverted lists, builds the lists if needed
+   bool useInvertedLists(uint32_t hops);
+   /// Builds the lists of place persons per interest, returns the number of pairs they hold
+   uint64_t buildInvertedLists();
+   /// Enumerates the pairs with common interests from the lists, most common interests first, and checks the
+   /// distance only of pairs that enter the top k
+   void enumeratePairs(uint32_t hops);
+   /// Searches the prepared place with the calling thread
+   string findMatches(const uint32_t k, const uint32_t hops, bool inverted);
 
 public:
    QueryRunner(const FileIndexes& indexes);
    string query(const uint32_t k, const uint32_t hops, const char* place);
+   /// Splits the BFS search of large places into morsels of place persons. The optional finishTask is
+   /// executed and deleted as soon as resultOut was written.
+   TaskGroup query(const uint32_t k, const uint32_t hops, const char* place, const char*& resultOut, Task* finishTask=nullptr);
 };
 }
@@ -18,6 +18,7 @@ limitations under the License.
 #include <sstream>
 #include <cmath>
 #include <random>
+#include <algorithm>
 #include "query4.hpp"
 #include "include/alloc.hpp"
 
@@ -55,20 +56,146 @@ inline CentralityResult* getInitialBound() {
    return makeHeapBound(CentralityResult(boundId, 0, 0, MIN_CENTRALITY));
 }
 
+size_t TagData::memorySize() const {
+   return subgraph.memorySize()
+      +(componentStats->personComponents.size()+componentStats->componentSizes.size())*sizeof(uint32_t)
+      +estimates.orderedPersons.size()*sizeof(PersonId)+estimates.personEstimates.size()*sizeof(PersonEstimates)
+      +closeness.capacity()*sizeof(CentralityResult);
+}
+
+TagCache::TagCache() : budget(0), generation(0), usedBytes(0), answered(0), resumed(0), misses(0), evictions(0) {
+}
+
+TagCache& TagCache::get() {
+   static TagCache cache;
+   return cache;
+}
+
+void TagCache::configure(uint64_t budget) {
+   lock_guard<mutex> lock(cacheMutex);
+   this->budget=budget;
+   evict();
+}
+
+void TagCache::evict() {
+   while(usedBytes>budget && !lru.empty()) {
+      auto entry=entries.find(lru.back());
+      usedBytes-=entry->second.bytes;
+      entries.erase(entry);
+      lru.pop_back();
+      evictions++;
+   }
+}
+
+shared_ptr<TagData> TagCache::find(InterestId tag, uint64_t generation) {
+   lock_guard<mutex> lock(cacheMutex);
+   if(generation>this->generation) {
+      // Updates replaced the person indexes, all subgraphs are stale
+      entries.clear();
+      lru.clear();
+      usedBytes=0;
+      this->generation=generation;
+   }
+   auto entry=entries.find(tag);
+   if(entry==entries.end() || generation!=this->generation) {
+      misses++;
+      return nullptr;
+   }
+   lru.splice(lru.begin(), lru, entry->second.lruPos);
+   return entry->second.data;
+}
+
+void TagCache::insert(const shared_ptr<TagData>& data, uint64_t generation) {
+   lock_guard<mutex> lock(cacheMutex);
+   if(generation!=this->generation || entries.count(data->tag)>0) {
+      return;
+   }
+   const uint64_t bytes=data->memorySize();
+   if(bytes>budget) {
+      return;
+   }
+   lru.push_front(data->tag);
+   entries.emplace(data->tag, Entry { data, lru.begin(), bytes });
+   usedBytes+=bytes;
+   evict();
+}
+
+bool TagCache::answer(const TagData& data, uint32_t k, string& result) {
+   lock_guard<mutex> lock(cacheMutex);
+   if(data.answeredK<k) {
+      resumed++;
+      return false;
+   }
+   answered++;
+   // Every query computed its top k exactly, so the best known values start with the top answeredK
+   ostringstream output;
+   const uint32_t resNum=min(k, (uint32_t)data.closeness.size());
+   for(uint32_t i=0; i<resNum; i++) {
+      if(i>0) {
+         output<<" ";
+      }
+      output<<data.closeness[i].person;
+   }
+   result=output.str();
+   return true;
+}
+
+CentralityResult* TagCache::initialBound(const TagData& data, uint32_t k) {
+   lock_guard<mutex> lock(cacheMutex);
+   if(k>0 && data.closeness.size()>=k) {
+      // The k-th result is at least as central as the k-th known value. The bound takes the next person id so
+      // that the known person itself still qualifies.
+      const CentralityResult& kth=data.closeness[k-1];
+      return makeHeapBound(CentralityResult(kth.person+1, kth.distances, kth.numReachable, kth.centrality));
+   }
+   return getInitialBound();
+}
+
+void TagCache::addResults(TagData& data, uint32_t k, vector<CentralityResult>& completed) {
+   lock_guard<mutex> lock(cacheMutex);
+   auto& closeness=data.closeness;
+   closeness.insert(closeness.end(), completed.begin(), completed.end());
+   sort(closeness.begin(), closeness.end(), [](const CentralityResult& a, const CentralityResult& b) {
+      return CentralityCmp::compare(make_pair(a.person, a), make_pair(b.person, b));
+   });
+   // Persons searched by several queries have the same value
+   closeness.erase(unique(closeness.begin(), closeness.end(), [](const CentralityResult& a, const CentralityResult& b) {
+      return a.person==b.person;
+   }), closeness.end());
+   data.answeredK=max(data.answeredK, k);
+
+   auto entry=entries.find(data.tag);
+   if(entry!=entries.end() && entry->second.data.get()==&data) {
+      const uint64_t bytes=data.memorySize();
+      usedBytes=usedBytes-entry->second.bytes+bytes;
+      entry->second.bytes=bytes;
+      evict();
+   }
+}
+
+void TagCache::print(std::ostream& out) {
+   lock_guard<mutex> lock(cacheMutex);
+   out<<"[Q4Cache] answered: "<<answered<<", resumed: "<<resumed<<", missed: "<<misses<<", evicted: "<<evictions
+      <<", cached: "<<entries.size()<<" tags in "<<usedBytes/1024<<" kb"<<std::endl;
+}
+
 static const uint32_t morselSize = 128;
 static const uint32_t maxMorselTasks = 128;
 static const float boundsStablePercentage = 0.002; // Number of consecutive BFSs that must be prunable so that the state is considered stable
 static const uint32_t minBoundRounds = 20;
+static const uint32_t maxBatchSize = 256; // Sources that share the traversals of one multi source BFS
 
 typedef uint8_t Level;
 
 QueryRunner::QueryRunner(ScheduleGraph& taskGraph, Scheduler& scheduler, FileIndexes& fileIndexes)
-   : taskGraph(taskGraph), scheduler(scheduler), knowsIndex(*(fileIndexes.personGraph)),
+   : taskGraph(taskGraph), scheduler(scheduler), knowsIndex(fileIndexes.localPersonGraph()),
      personMapper(fileIndexes.personMapper),
      tagIndex(*(fileIndexes.tagIndex)),
      tagInForumsIndex(*(fileIndexes.tagInForumsIndex.index)),
-     hasMemberIndex(*(fileIndexes.hasMemberIndex))
+     hasMemberIndex(*(fileIndexes.hasMemberIndex)),
+     generation(fileIndexes.generation)
 {
+   TagCache::get().configure(fileIndexes.query4CacheBytes);
    assert(fileIndexes.personGraph != nullptr);
    assert(fileIndexes.tagIndex != nullptr);
    assert(fileIndexes.tagInForumsIndex.index != nullptr);
@@ -189,7 +316,16 @@ uint8_t decideBFSVariant(QueryState& /*state*/, bool /*unstableBounds*/, const P
    return 0;
 }
 
-std::vector<PersonId> shortestPath(BidirectSearchState& searchState, const PersonSubgraph& forumSubgraph, PersonId p1, PersonId p2) {
+BidirectSearchState& getThreadLocalSearchState() {
+   static __thread BidirectSearchState* searchStatePtr=nullptr;
+   if(searchStatePtr==nullptr) {
+      searchStatePtr=new BidirectSearchState();
+   }
+   return *searchStatePtr;
+}
+
+/// Appends the persons on a shortest path between both persons to path, nothing if they are not connected
+void shortestPath(BidirectSearchState& searchState, const PersonSubgraph& forumSubgraph, PersonId p1, PersonId p2, awfy::ArenaVector<PersonId>& path) {
    // Reset data structures and initialize for this search
    assert(searchState.states.size()==2);
    auto& bidiStates=searchState.states;
@@ -219,7 +355,7 @@ std::vector<PersonId> shortestPath(BidirectSearchState& searchState, const Perso
          assert(resultPerson!=std::numeric_limits<unsigned>::max());
          // Trace path back
          const PersonId otherTarget=bidiStates[1-dir].target;
-         std::vector<PersonId> path;
+         const size_t pathStart=path.size();
          PersonId tracePerson=resultPerson;
          path.push_back(tracePerson);
          while(tracePerson!=otherTarget) {
@@ -232,8 +368,9 @@ std::vector<PersonId> shortestPath(BidirectSearchState& searchState, const Perso
             path.push_back(tracePerson);
          }
 
-         assert(path.size()==resultDist+1);
-         return path;
+         assert(path.size()-pathStart==resultDist+1);
+         (void)pathStart;
+         return;
       }
 
       // Load neighbours and comment information
@@ -255,7 +392,7 @@ std::vector<PersonId> shortestPath(BidirectSearchState& searchState, const Perso
          if(neighbourId==dirTarget) {
             // Trace path back
             const PersonId otherTarget=bidiStates[1-dir].target;
-            std::vector<PersonId> path;
+            const size_t pathStart=path.size();
             PersonId tracePerson=curPerson;
             path.push_back(neighbourId);
             path.push_back(curPerson);
@@ -263,8 +400,9 @@ std::vector<PersonId> shortestPath(BidirectSearchState& searchState, const Perso
                tracePerson=dirSeen.find(tracePerson)->person;
                path.push_back(tracePerson);
             }
-            assert(path.size()==neighbourDist+1);
-            return path;
+            assert(path.size()-pathStart==neighbourDist+1);
+            (void)pathStart;
+            return;
          }
 
          // Insert neighbour distance information
@@ -284,7 +422,6 @@ std::vector<PersonId> shortestPath(BidirectSearchState& searchState, const Perso
          friendsBounds.first++;
       }
    }
-   return std::vector<PersonId>();
 }
 
 struct BoundManager {
@@ -380,6 +517,65 @@ struct BatchBFSdata {
    }
 };
 
+/// Bitmask with one bit per source of a multi source BFS batch, aligned so that it fits a SIMD register
+template<unsigned width>
+struct alignas(width/8) BatchMask {
+   static_assert(width%64==0, "Batch width must be a multiple of 64");
+   static const unsigned numWords=width/64;
+   uint64_t words[numWords];
+
+   inline void clear() {
+      for(unsigned w=0; w<numWords; w++) {
+         words[w]=0;
+      }
+   }
+
+   inline void set(uint32_t bit) {
+      words[bit/64]|=1UL<<(bit%64);
+   }
+
+   inline void reset(uint32_t bit) {
+      words[bit/64]&=~(1UL<<(bit%64));
+   }
+
+   inline bool test(uint32_t bit) const {
+      return words[bit/64]&(1UL<<(bit%64));
+   }
+
+   inline bool empty() const {
+      uint64_t any=0;
+      for(unsigned w=0; w<numWords; w++) {
+         any|=words[w];
+      }
+      return any==0;
+   }
+};
+
+/// Returns a 64 byte aligned buffer of the calling thread, the content is undefined
+void* getThreadLocalBatchBuffer(size_t size) {
+   static __thread void* buffer=nullptr;
+   static __thread size_t bufferSize=0;
+   if(bufferSize<size) {
+      free(buffer);
+      const int allocResult=posix_memalign(&buffer,64,size);
+      if(unlikely(allocResult!=0)) {
+         FATAL_ERROR("Could not allocate "<<size<<" bytes for the batch BFS");
+      }
+      bufferSize=size;
+   }
+   return buffer;
+}
+
+Level* getThreadLocalLevels(size_t size) {
+   static __thread vector<Level>* levelsPtr=nullptr;
+   if(levelsPtr==nullptr) {
+      levelsPtr=new vector<Level>(size);
+   } else if(levelsPtr->size()<size) {
+      levelsPtr->resize(size);
+   }
+   return levelsPtr->data();
+}
+
 struct BFSRunner {
    struct BFSState {
       const uint64_t localBound;
@@ -406,7 +602,8 @@ struct BFSRunner {
       assert(toVisit.empty()); //Data structures are in a sane state
 
       // Initialize BFS
-      Level* seen = new Level[subgraph.size()]();
+      Level* seen = getThreadLocalLevels(subgraph.size());
+      memset(seen, 0, sizeof(Level)*subgraph.size());
       seen[start] = 1; // Level = distance + 1, Level 0 = not seen
       {
          auto& p = toVisit.push_back_pos();
@@ -441,7 +638,6 @@ struct BFSRunner {
          }
       } while(true);
 
-      delete[] seen;
       return state.result;
    }
 
@@ -480,169 +676,157 @@ struct BFSRunner {
       return numUnseen-numRemainingUnseen;
    }
 
-
-   struct BatchToVisitInfo {
-      uint64_t queries;
-      PersonId person;
-      BatchToVisitInfo() : queries(0)
-      { }
-      BatchToVisitInfo(uint64_t queries, PersonId person)
-         : queries(queries), person(person)
-      { }
-   };
-   struct BatchToVisitInfoComparer {
-      bool operator()(const BatchToVisitInfo& t1, const BatchToVisitInfo& t2) {
-         return t1.person>t2.person;
-      }
-   };
-
 public:
-   static void runBatch(vector<BatchBFSdata>& bfsData, const PersonSubgraph& subgraph) {
+   /// Runs one BFS per entry of the batch with a single traversal of the subgraph per level.
+   /// Every person stores which sources have seen it and which sources visit it in the current
+   /// and in the next level as bitmasks of the batch width.
+   template<unsigned width>
+   static void runBatch(awfy::ArenaVector<BatchBFSdata>& bfsData, const PersonSubgraph& subgraph) {
+      typedef BatchMask<width> Mask;
       const auto subgraphSize = subgraph.size();
-
-      array<uint64_t*,2> toVisitLists;
-      toVisitLists[0] = new uint64_t[subgraphSize];
-      memset(toVisitLists[0],0,sizeof(uint64_t)*subgraphSize);
-      toVisitLists[1] = new uint64_t[subgraphSize];
-      memset(toVisitLists[1],0,sizeof(uint64_t)*subgraphSize);
-
       const uint32_t numQueries = bfsData.size();
-      assert(numQueries>0 && numQueries<=64);
+      assert(numQueries>0 && numQueries<=width);
+
+      // Seen, toVisit and nextToVisit masks share one thread local buffer
+      Mask* masks = reinterpret_cast<Mask*>(getThreadLocalBatchBuffer(3*sizeof(Mask)*subgraphSize));
+      memset(masks, 0, 3*sizeof(Mask)*subgraphSize);
+      Mask* seen = masks;
+      array<Mask*,2> toVisitLists;
+      toVisitLists[0] = masks+subgraphSize;
+      toVisitLists[1] = masks+2*subgraphSize;
 
       PersonId minPerson = numeric_limits<PersonId>::max();
-      uint64_t* seen = new uint64_t[subgraphSize];
-      memset(seen, 0, sizeof(uint64_t)*subgraphSize);
-      for(size_t a=0; a<numQueries; a++) {
-         const uint64_t personMask = 1UL<<a;
-         assert(seen[bfsData[a].person]==0);
-         seen[bfsData[a].person] = personMask;
-         (toVisitLists[0])[bfsData[a].person] = personMask;
-         minPerson = min(minPerson, bfsData[a].person);
+      PersonId maxPerson = 0;
+      for(uint32_t a=0; a<numQueries; a++) {
+         const PersonId person = bfsData[a].person;
+         assert(seen[person].empty());
+         seen[person].set(a);
+         toVisitLists[0][person].set(a);
+         minPerson = min(minPerson, person);
+         maxPerson = max(maxPerson, person);
       }
 
-      runBatchRound(bfsData, subgraph, minPerson, toVisitLists, seen);
-
-      delete[] seen;
-      delete[] toVisitLists[0];
-      delete[] toVisitLists[1];
+      runBatchRounds<width>(bfsData, subgraph, minPerson, maxPerson, toVisitLists, seen);
    }
 
-   static void __attribute__((hot)) runBatchRound(vector<BatchBFSdata>& bfsData, const PersonSubgraph& subgraph, PersonId minPerson, array<uint64_t*,2>& toVisitLists, uint64_t* __restrict__ seen) {
-      const auto subgraphSize = subgraph.size();
+private:
+   template<unsigned width>
+   static void __attribute__((hot)) runBatchRounds(awfy::ArenaVector<BatchBFSdata>& bfsData, const PersonSubgraph& subgraph, PersonId minPerson, PersonId maxPerson, array<BatchMask<width>*,2>& toVisitLists, BatchMask<width>* __restrict__ seen) {
+      typedef BatchMask<width> Mask;
       const uint32_t numQueries = bfsData.size();
 
-      uint64_t processQuery = (~0UL);
+      Mask processQuery;
+      processQuery.clear();
+      for(uint32_t a=0; a<numQueries; a++) {
+         processQuery.set(a);
+      }
       uint32_t queriesToProcess=numQueries;
 
-      uint32_t numDistDiscovered[64] __attribute__((aligned(16)));  
+      uint32_t numDistDiscovered[width] __attribute__((aligned(16)));
       memset(numDistDiscovered,0,sizeof(uint32_t)*numQueries);
 
       uint8_t curToVisitQueue = 0;
       uint32_t nextDistance = 1;
+      // Range of persons that are visited in the next level, limits the scan of the next round
+      PersonId nextMinPerson = numeric_limits<PersonId>::max();
+      PersonId nextMaxPerson = 0;
 
-      PersonId curPerson=minPerson;
-      bool nextToVisitEmpty = true;
       do {
-         const uint64_t* const toVisit = toVisitLists[curToVisitQueue];
-         uint64_t* const nextToVisit = toVisitLists[1-curToVisitQueue];
-
-         for(; curPerson<subgraphSize && toVisit[curPerson]==0; curPerson++) { }
-         if(likely(curPerson<subgraphSize)) {
-            const uint64_t toVisitEntry = toVisit[curPerson];
+         const Mask* const toVisit = toVisitLists[curToVisitQueue];
+         Mask* const nextToVisit = toVisitLists[1-curToVisitQueue];
+
+         for(PersonId curPerson=minPerson; curPerson<=maxPerson; curPerson++) {
+            // Sources that visit the person and have not finished yet
+            Mask visitEntry;
+            uint64_t anyVisit=0;
+            for(unsigned w=0; w<Mask::numWords; w++) {
+               visitEntry.words[w] = toVisit[curPerson].words[w] & processQuery.words[w];
+               anyVisit |= visitEntry.words[w];
+            }
+            if(anyVisit==0) {
+               continue;
+            }
 
             const auto& curFriends=*subgraph.graph().retrieve(curPerson);
             assert(subgraph.graph().retrieve(curPerson)!=nullptr);
 
-            const auto firstQueryId = __builtin_ctzl(toVisitEntry);
-            if((toVisitEntry>>(firstQueryId+1)) == 0) {
-               //Only single person in this entry
-
-               auto friendsBounds = curFriends.bounds();
-               while(friendsBounds.first != friendsBounds.second) {
-                  if(toVisitEntry & processQuery & (~seen[*friendsBounds.first])) {
-                     seen[*friendsBounds.first] |= toVisitEntry;
-                     nextToVisit[*friendsBounds.first] |= toVisitEntry;
-                     nextToVisitEmpty = false;
-                     numDistDiscovered[firstQueryId]++;
-                  }
-                  ++friendsBounds.first;
+            auto friendsBounds = curFriends.bounds();
+            while(friendsBounds.first != friendsBounds.second) {
+               const PersonId friendId = *friendsBounds.first;
+               ++friendsBounds.first;
+
+               Mask newToVisit; //!seen & toVisit
+               uint64_t anyNew=0;
+               for(unsigned w=0; w<Mask::numWords; w++) {
+                  newToVisit.words[w] = visitEntry.words[w] & ~seen[friendId].words[w];
+                  anyNew |= newToVisit.words[w];
+               }
+               if(anyNew==0) {
+                  continue;
                }
-            } else {
-               auto friendsBounds = curFriends.bounds();
-               while(friendsBounds.first != friendsBounds.second) {
 
-                  uint64_t newToVisit = toVisitEntry & processQuery & (~seen[*friendsBounds.first]); //!seen & toVisit
-                  if(newToVisit == 0) {
-                     ++friendsBounds.first;
-                     continue;
+               for(unsigned w=0; w<Mask::numWords; w++) {
+                  seen[friendId].words[w] |= newToVisit.words[w];
+                  nextToVisit[friendId].words[w] |= newToVisit.words[w];
+               }
+               nextMinPerson = min(nextMinPerson, friendId);
+               nextMaxPerson = max(nextMaxPerson, friendId);
+
+               for(unsigned w=0; w<Mask::numWords; w++) {
+                  uint64_t bits = newToVisit.words[w];
+                  while(bits!=0) {
+                     numDistDiscovered[w*64+__builtin_ctzl(bits)]++;
+                     bits &= bits-1;
                   }
-
-                  seen[*friendsBounds.first] |= toVisitEntry;
-                  nextToVisit[*friendsBounds.first] |= newToVisit;
-                  
-                  nextToVisitEmpty = false;
-
-                   uint32_t pos=0;
-                   do {
-                      const auto numTZ = __builtin_ctzl(newToVisit);
-                      numDistDiscovered[pos+numTZ]++;
-                      if(unlikely(numTZ==63)) {
-                         break;
-                      }
-                      pos += numTZ+1;
-                      newToVisit = newToVisit>>(numTZ+1);
-                   } while(newToVisit>0);
-
-                  ++friendsBounds.first;
                }
             }
+         }
 
-            //Go to next person
-            curPerson++;
-         } else {
-            //Swap queues
-            for(uint32_t a=0; a<numQueries; a++) {
-               if(likely(processQuery & (1UL<<a))) {
-                  bfsData[a].totalReachable += numDistDiscovered[a];
-                  bfsData[a].totalDistances += numDistDiscovered[a]*nextDistance;
-
-                  bfsData[a].bfsBound.updateDistEstimate(bfsData[a].totalReachable, nextDistance);
-                  assert(bfsData[a].bfsBound.distances==bfsData[a].totalDistances);
-
-                  if(unlikely((bfsData[a].componentSize-1)==bfsData[a].totalReachable)) {
-                     if(queriesToProcess==1) {
-                        return;
-                     }
-                     processQuery &= ~(1UL<<a);
-                     queriesToProcess--;
-                     continue;
+         // Level finished, update the bounds of all sources
+         for(uint32_t a=0; a<numQueries; a++) {
+            if(likely(processQuery.test(a))) {
+               bfsData[a].totalReachable += numDistDiscovered[a];
+               bfsData[a].totalDistances += numDistDiscovered[a]*nextDistance;
+
+               bfsData[a].bfsBound.updateDistEstimate(bfsData[a].totalReachable, nextDistance);
+               assert(bfsData[a].bfsBound.distances==bfsData[a].totalDistances);
+
+               if(unlikely((bfsData[a].componentSize-1)==bfsData[a].totalReachable)) {
+                  if(queriesToProcess==1) {
+                     return;
                   }
+                  processQuery.reset(a);
+                  queriesToProcess--;
+                  continue;
+               }
+
+               // Update estimate
+               if(bfsData[a].accurateDistanceBound.first && bfsData[a].bfsBound.getLowerDistanceBound()>bfsData[a].accurateDistanceBound.second) {
+                  bfsData[a].bfsBound.earlyExit(nextDistance+1);
+                  bfsData[a].earlyExit=true;
 
-                  // Update estimate
-                  if(bfsData[a].accurateDistanceBound.first && bfsData[a].bfsBound.getLowerDistanceBound()>bfsData[a].accurateDistanceBound.second) {
-                     bfsData[a].bfsBound.earlyExit(nextDistance+1);
-                     bfsData[a].earlyExit=true;
-                     
-                     if(unlikely(queriesToProcess==1)) {
-                        return;
-                     }
-                     processQuery &= ~(1UL<<a);
-                     queriesToProcess--;
+                  if(unlikely(queriesToProcess==1)) {
+                     return;
                   }
+                  processQuery.reset(a);
+                  queriesToProcess--;
                }
             }
-            if(unlikely(nextToVisitEmpty)) {
-               return;
-            }
+         }
+         if(unlikely(nextMinPerson>nextMaxPerson)) {
+            return;
+         }
 
-            memset(toVisitLists[curToVisitQueue],0,sizeof(uint64_t)*subgraphSize);
-            memset(numDistDiscovered,0,sizeof(uint32_t)*numQueries);
-            nextToVisitEmpty = true;
+         // Only the scanned range of the current level can contain entries
+         memset(toVisitLists[curToVisitQueue]+minPerson,0,sizeof(Mask)*(maxPerson-minPerson+1));
+         memset(numDistDiscovered,0,sizeof(uint32_t)*numQueries);
 
-            curPerson = 0;
-            nextDistance++;
-            curToVisitQueue = 1-curToVisitQueue;
-         }
+         minPerson = nextMinPerson;
+         maxPerson = nextMaxPerson;
+         nextMinPerson = numeric_limits<PersonId>::max();
+         nextMaxPerson = 0;
+         nextDistance++;
+         curToVisitQueue = 1-curToVisitQueue;
       } while(true);
    }
 };
@@ -799,6 +983,7 @@ private:
    const bool abortOnceStable;
    uint32_t _lastOffset;
    ConnectedComponentStats& componentStats;
+   vector<CentralityResult> completed; // Exact results for the tag cache, added to the state once the morsel is done
 
 public:
    MorselTask(QueryState& state, uint32_t rangeStart, uint32_t rangeEnd, PruningStats& pruningStats, bool abortOnceStable /* Aborts processing once a first stable estimate state is reached */, ConnectedComponentStats& componentStats)
@@ -837,13 +1022,16 @@ public:
       const auto bfsResult=BFSRunner::run(subgraphPersonId, state.subgraph, accurateDistanceBound, bfsBound, componentReachable);
       estimate.validate(componentReachable, "after BFS");
       const auto closeness = getCloseness(state.numPersonsInForums, bfsResult.totalDistances, bfsResult.totalReachable);
-      const PersonId externalPersonId = state.subgraph.mapFromSubgraph(subgraphPersonId);
+      const PersonId externalPersonId = state.personMapper.invert(state.subgraph.mapFromSubgraph(subgraphPersonId));
       CentralityResult resultCentrality(externalPersonId, bfsResult.totalDistances, bfsResult.totalReachable, closeness);
       pruningStats.numReachedPerson.fetch_add(bfsResult.totalReachable);
 
       // Check if person qualifies as new top k value
       bool boundUpdated=false;
       if(!bfsResult.earlyExit) {
+         if(state.cacheResults) {
+            completed.push_back(resultCentrality);
+         }
          if(CentralityCmp::compare(make_pair(resultCentrality.person, resultCentrality), make_pair(centralityBound.person, centralityBound))) {
             // Add improved value to top k list
             lock_guard<mutex> lock(state.topResultsMutex);
@@ -867,11 +1055,12 @@ public:
    pair<uint32_t,bool> processPersonBatch(const vector<PersonId>& persons, uint32_t begin, uint32_t end) {
       const CentralityResult centralityBound=*state.globalCentralityBound.load();
 
-      //Build batch of up to 64 persons
-      vector<BatchBFSdata> batchData;
-      batchData.reserve(64);
+      //Build batch of up to maxBatchSize persons
+      awfy::ArenaScope scope;
+      awfy::ArenaVector<BatchBFSdata> batchData;
+      batchData.reserve(maxBatchSize);
       uint32_t p=begin;
-      for(; batchData.size()<64 && p<end; p++) {
+      for(; batchData.size()<maxBatchSize && p<end; p++) {
          const PersonId subgraphPersonId = persons[p];
          assert(!state.personChecked[subgraphPersonId]);
          assert(state.subgraph.personInSubgraph(subgraphPersonId));
@@ -901,20 +1090,29 @@ public:
 
       bool boundUpdated=false;
       if(batchData.size()>0) {
-         //Run BFS
-         BFSRunner::runBatch(batchData, state.subgraph);
+         //Run BFS with the narrowest mask that fits the batch
+         if(batchData.size()<=64) {
+            BFSRunner::runBatch<64>(batchData, state.subgraph);
+         } else if(batchData.size()<=128) {
+            BFSRunner::runBatch<128>(batchData, state.subgraph);
+         } else {
+            BFSRunner::runBatch<256>(batchData, state.subgraph);
+         }
 
          for(auto bIter=batchData.begin(); bIter!=batchData.end(); bIter++) {
             PersonEstimates& estimate = state.estimates.personEstimates[bIter->person];
             estimate.validate(bIter->componentSize, "after BFS");
 
             const auto closeness = getCloseness(state.numPersonsInForums, bIter->totalDistances, bIter->totalReachable);
-            const PersonId externalPersonId = state.subgraph.mapFromSubgraph(bIter->person);
+            const PersonId externalPersonId = state.personMapper.invert(state.subgraph.mapFromSubgraph(bIter->person));
             CentralityResult resultCentrality(externalPersonId, bIter->totalDistances, bIter->totalReachable, closeness);
             pruningStats.numReachedPerson.fetch_add(bIter->totalReachable); 
 
             // Check if person qualifies as new top k value
             if(unlikely(!bIter->earlyExit)) {
+               if(state.cacheResults) {
+                  completed.push_back(resultCentrality);
+               }
                if(CentralityCmp::compare(make_pair(resultCentrality.person, resultCentrality), make_pair(centralityBound.person, centralityBound))) {
                   // Add improved value to top k list
                   lock_guard<mutex> lock(state.topResultsMutex);
@@ -938,6 +1136,7 @@ public:
    }
 
    void operator()() {
+      awfy::counters::Trace::setLabel("morsel");
       #ifdef DEBUG
       auto startTime=awfy::chrono::now();
       #endif
@@ -945,6 +1144,9 @@ public:
          LOG_PRINT("[MorselTask] Fail! Invalid task range: "<<rangeStart<<"-"<<rangeEnd);
       }
       assert(rangeStart<=rangeEnd);
+      if(awfy::numa::enabled()) {
+         awfy::counters::NumaCounters::countTask(awfy::numa::currentNode(), state.homeNode);
+      }
 
       uint32_t numConsecutivePrunedBFSs=0;
       uint32_t boundsStableThreshold=static_cast<uint32_t>((rangeEnd-rangeStart)*boundsStablePercentage);
@@ -984,6 +1186,12 @@ public:
       }
 
       _lastOffset = rangeOffset-1;
+
+      if(!completed.empty()) {
+         lock_guard<mutex> lock(state.topResultsMutex);
+         state.completedResults.insert(state.completedResults.end(), completed.begin(), completed.end());
+         completed.clear();
+      }
    }
 
    uint32_t lastProcessedOffset() const {
@@ -991,6 +1199,18 @@ public:
    }
 };
 
+/// Copies the result into the result buffer, then executes and deletes the optional finish task
+void writeResult(const string& result, const char*& resultOut, Task* finishTask) {
+   auto resultBuffer = awfy::Allocator::get().alloc<char>(result.size()+1);
+   result.copy(resultBuffer, result.size());
+   resultBuffer[result.size()]=0;
+   resultOut = resultBuffer;
+   if(finishTask!=nullptr) {
+      finishTask->execute();
+      delete finishTask;
+   }
+}
+
 struct ResultConcatenator {
    ScheduleGraph& taskGraph;
    QueryState* state;
@@ -1032,11 +1252,10 @@ struct ResultConcatenator {
       }
       #endif
       #endif
-      const auto& outStr = output.str();
-      auto resultBuffer = awfy::Allocator::get().alloc<char>(outStr.size()+1);
-      outStr.copy(resultBuffer, outStr.size());
-      resultBuffer[outStr.size()]=0;
-      resultOut = resultBuffer;
+      if(state->cacheResults) {
+         TagCache::get().addResults(*state->tagData, state->k, state->completedResults);
+      }
+      writeResult(output.str(), resultOut, state->finishTask);
       taskGraph.updateTask(TaskGraph::Query4, -1);
       delete &pruningStats;
       delete state;
@@ -1111,7 +1330,8 @@ std::vector<PersonId> generateInterestingPersons(QueryState& state, ConnectedCom
    const uint32_t numPairs=numPersons*2;
    uint32_t discoveredPair=0;
    uint32_t attempts=0;
-   std::vector<pair<PersonId,PersonId>> pairs;
+   awfy::ArenaScope scope; // Frees the sampled pairs and paths
+   awfy::ArenaVector<pair<PersonId,PersonId>> pairs;
    while(discoveredPair<numPairs && attempts<numPairs*3) {
       attempts++;
 
@@ -1136,18 +1356,15 @@ std::vector<PersonId> generateInterestingPersons(QueryState& state, ConnectedCom
    }
 
    // Collect path nodes
-   BidirectSearchState searchState;
-   std::vector<PersonId> interestingPersons;
+   BidirectSearchState& searchState=getThreadLocalSearchState();
+   awfy::ArenaVector<PersonId> interestingPersons;
    for(uint32_t i=0; i<pairs.size(); i++) {
-      auto path=shortestPath(searchState, state.subgraph, pairs[i].first, pairs[i].second);
-      for(uint32_t j=0; j<path.size(); j++) {
-         interestingPersons.push_back(path[j]);
-      }
+      shortestPath(searchState, state.subgraph, pairs[i].first, pairs[i].second, interestingPersons);
    }
 
    sort(interestingPersons.begin(), interestingPersons.end());
 
-   std::vector<pair<uint32_t, PersonId>> countingPersons;
+   awfy::ArenaVector<pair<uint32_t, PersonId>> countingPersons;
    PersonId lastPerson=std::numeric_limits<PersonId>::max();
    for(uint32_t i=0; i<interestingPersons.size(); i++) {
       if(likely(interestingPersons[i]!=lastPerson)) {
@@ -1284,7 +1501,7 @@ struct SearchSpaceChunker {
          }
 
          taskGroup.join(LambdaRunner::createLambdaTask(SearchSpaceChunker(taskGraph, scheduler, state, resultOut, pruningStats, componentStats, lastChangePos, searchEndOffset, numPersonsInForums, searchRound+1),TaskGraph::Query4));
-         scheduler.schedule(taskGroup.close());
+         scheduler.scheduleOnNode(taskGroup.close(), state.homeNode);
       } else {
          // Update estimates
          for(uint32_t i=lastOffset; i<state.estimates.orderedPersons.size(); i++) {
@@ -1323,38 +1540,61 @@ struct SearchSpaceChunker {
          }
 
          taskGroup.join(LambdaRunner::createLambdaTask(SearchSpaceChunker(taskGraph, scheduler, state, resultOut, pruningStats, componentStats, lastChangePos, windowEnd, numPersonsInForums, searchRound+1),TaskGraph::Query4));
-         scheduler.schedule(taskGroup.close());
+         scheduler.scheduleOnNode(taskGroup.close(), state.homeNode);
       }
    }
 };
 
-TaskGroup QueryRunner::query(const uint32_t k, const char* tag, const char*& resultOut) {
+TaskGroup QueryRunner::query(const uint32_t k, const char* tag, const char*& resultOut, Task* finishTask) {
    reset();
 
    //Get interest tag
    InterestId tagId = tagIndex.strToId.retrieve(awfy::StringRef(tag,strlen(tag)));
    if(tagId == tagIndex.strToId.end()) {
       //Tag not found
-      auto resultBuffer = awfy::Allocator::get().alloc<char>(1);
-      resultBuffer[0]=0;
-      resultOut = resultBuffer;
+      writeResult(string(), resultOut, finishTask);
       return TaskGroup();
    }
 
-   //Build person filter
-   const auto personFilterInfos = buildPersonFilter(tagId);
-   const uint32_t numPersonsInForums = personFilterInfos.second.first;
-   const uint64_t numFriendsInForums = personFilterInfos.second.second;
+   auto& tagCache = TagCache::get();
+   const bool cacheResults = tagCache.enabled();
+   shared_ptr<TagData> tagData;
+   if(cacheResults) {
+      tagData = tagCache.find(tagId, generation);
+      string result;
+      if(tagData != nullptr && tagCache.answer(*tagData, k, result)) {
+         writeResult(result, resultOut, finishTask);
+         return TaskGroup();
+      }
+   }
 
-   //Build query subgraph
-   PersonSubgraph subgraph(personFilterInfos.first, numPersonsInForums, numFriendsInForums, knowsIndex);
-   auto componentStats = calculateConnectedComponents(subgraph);
+   if(tagData == nullptr) {
+      //Build person filter
+      const auto personFilterInfos = buildPersonFilter(tagId);
+      const uint32_t numPersonsInForums = personFilterInfos.second.first;
+      const uint64_t numFriendsInForums = personFilterInfos.second.second;
 
-   // Caculate estimates
-   const PersonEstimatesData personEstimatesData = PersonEstimatesData::create(subgraph, *componentStats);
+      //Build query subgraph
+      PersonSubgraph subgraph(personFilterInfos.first, numPersonsInForums, numFriendsInForums, knowsIndex);
+      auto componentStats = calculateConnectedComponents(subgraph);
+
+      // Caculate estimates
+      PersonEstimatesData personEstimatesData = PersonEstimatesData::create(subgraph, *componentStats);
+
+      tagData = make_shared<TagData>(tagId, numPersonsInForums, move(subgraph), componentStats, move(personEstimatesData));
+      if(cacheResults) {
+         tagCache.insert(tagData, generation);
+      }
+   }
+   const uint32_t numPersonsInForums = tagData->numPersonsInForums;
+   ConnectedComponentStats* componentStats = tagData->componentStats.get();
+   // A resumed tag starts with the k-th known closeness, its bound is stable from the first person on
+   CentralityResult* initialBound = cacheResults ? tagCache.initialBound(*tagData, k) : getInitialBound();
+   const bool seededBound = initialBound->centrality > MIN_CENTRALITY;
 
-   QueryState* queryState = new QueryState(*this, k, numPersonsInForums, move(personEstimatesData), move(subgraph), getInitialBound());
+   QueryState* queryState = new QueryState(*this, personMapper, k, move(tagData), cacheResults, initialBound);
    queryState->topResults.init(k);
+   queryState->finishTask = finishTask;
    PruningStats* pruningStats = new PruningStats();
 
    //Process first persons to initialize top results
@@ -1364,7 +1604,7 @@ TaskGroup QueryRunner::query(const uint32_t k, const char* tag, const char*& res
       sequentialInitialization();
       numSequential = sequentialInitialization.lastProcessedOffset()+1;
       LOG_PRINT("[Query4] Sequential Loop "<<numSequential<<", last bound update:"<<queryState->lastBoundUpdate);
-   } while(queryState->lastBoundUpdate==0 && numSequential<numPersonsInForums);
+   } while(queryState->lastBoundUpdate==0 && !seededBound && numSequential<numPersonsInForums);
    LOG_PRINT("[Query4] Processed "<<numSequential<<" persons of "<<numPersonsInForums<<" sequentially");
    // Reoder after sequential part?
 
@@ -1383,7 +1623,15 @@ TaskGroup QueryRunner::query(const uint32_t k, const char* tag, const char*& res
       sort(queryState->estimates.orderedPersons.begin()+numSequential, queryState->estimates.orderedPersons.end(), EstimateComparer(queryState->estimates.personEstimates));
    }
 
-   #ifndef EXPBACKOFF
+   #ifdef EXPBACKOFF
+   // The search space chunker stops once the bound no longer improves, a seeded bound is final from the start
+   if(!seededBound) {
+      SearchSpaceChunker chunker(taskGraph, scheduler,*queryState, resultOut, pruningStats, componentStats, queryState->lastBoundUpdate, numSequential, numPersonsInForums, 0);
+      chunker();
+      return taskGroup;
+   }
+   #endif
+
    if(numSequential < numPersonsInForums) {
       const uint32_t numRemaining = numPersonsInForums-numSequential;
       // Limit number of tasks
@@ -1396,14 +1644,7 @@ TaskGroup QueryRunner::query(const uint32_t k, const char* tag, const char*& res
          taskGroup.schedule(LambdaRunner::createLambdaTask(MorselTask(*queryState, rangeStart, rangeEnd, *pruningStats, false, *componentStats),TaskGraph::Query4));
       }
    }
-   #else
-   SearchSpaceChunker chunker(taskGraph, scheduler,*queryState, resultOut, pruningStats, componentStats, queryState->lastBoundUpdate, numSequential, numPersonsInForums, 0);
-   chunker();
-   #endif
-
-   #ifndef EXPBACKOFF
    taskGroup.join(LambdaRunner::createLambdaTask(ResultConcatenator(taskGraph, queryState, resultOut, *pruningStats),TaskGraph::Query4));
-   #endif
 
    return taskGroup;
 }
@@ -18,11 +18,17 @@ limitations under the License.
 
 #define Q4_BUILD_SUBGRAPH
 
+#include <atomic>
+#include <list>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include "include/arena.hpp"
 #include "include/indexes.hpp"
 #include "include/queue.hpp"
 #include "include/subgraph.hpp"
 #include "include/topklist.hpp"
+#include "include/util/numa.hpp"
 
 using namespace std;
 
@@ -109,7 +115,7 @@ struct PersonEstimates {
    }
 
    #ifdef DEBUG
-   void validate(uint32_t max, const std::string& loc) const {
+   void validate(uint32_t max, const char* loc) const {
 
       for(unsigned i=1; i<reachable.size(); i++) {
          if((i==1&&reachable[0]==0) ||
@@ -122,7 +128,7 @@ struct PersonEstimates {
       }
    }
    #else
-   void validate(uint32_t /*max*/, const std::string& /*loc*/) const {
+   void validate(uint32_t /*max*/, const char* /*loc*/) const {
    }
    #endif
 
@@ -203,25 +209,100 @@ struct PersonEstimatesData {
    static PersonEstimatesData create(const PersonSubgraph& subgraph, const ConnectedComponentStats& componentStats);
 };
 
+/// Tag dependent part of a query, shared by all queries for the tag while it is cached
+struct TagData {
+   const InterestId tag;
+   const uint32_t numPersonsInForums;
+   const PersonSubgraph subgraph;
+   const unique_ptr<ConnectedComponentStats> componentStats;
+   PersonEstimatesData estimates; // Before any BFS refined them, cached queries work on a copy
+
+   // Guarded by the tag cache
+   vector<CentralityResult> closeness; // Exact closeness of the persons whose BFS completed, best first
+   uint32_t answeredK; // The first answeredK entries of closeness are the top results of the tag
+
+   TagData(InterestId tag, uint32_t numPersonsInForums, PersonSubgraph subgraph, ConnectedComponentStats* componentStats, PersonEstimatesData estimates)
+      : tag(tag), numPersonsInForums(numPersonsInForums), subgraph(move(subgraph)), componentStats(componentStats), estimates(move(estimates)), answeredK(0)
+   { }
+
+   size_t memorySize() const;
+};
+
+/// Process wide cache of the tag data of Q4. Queries for a cached tag skip building the subgraph and its estimates,
+/// are answered from the closeness values of earlier queries if those covered k, and otherwise start with the k-th
+/// known closeness as bound. Evicts the least recently used tags once the memory budget is exceeded.
+class TagCache {
+   struct Entry {
+      shared_ptr<TagData> data;
+      list<InterestId>::iterator lruPos;
+      uint64_t bytes; // Size when it was last accounted
+   };
+
+   mutex cacheMutex;
+   std::atomic<uint64_t> budget; // Bytes, 0 disables the cache, read without the lock
+   uint64_t generation; // Index generation of the cached tags
+   uint64_t usedBytes;
+   list<InterestId> lru; // Most recently used first
+   unordered_map<InterestId, Entry> entries;
+
+   uint64_t answered;
+   uint64_t resumed;
+   uint64_t misses;
+   uint64_t evictions;
+
+   TagCache();
+   void evict();
+
+public:
+   static TagCache& get();
+
+   /// Sets the memory budget, is called by every query runner
+   void configure(uint64_t budget);
+   bool enabled() const {
+      return budget>0;
+   }
+
+   /// Cached data of the tag, drops all tags that were built for an older index generation
+   shared_ptr<TagData> find(InterestId tag, uint64_t generation);
+   void insert(const shared_ptr<TagData>& data, uint64_t generation);
+   /// Writes the top k persons if they are known from earlier queries
+   bool answer(const TagData& data, uint32_t k, string& result);
+   /// Bound to start a query with, the k-th best known closeness if there are enough
+   CentralityResult* initialBound(const TagData& data, uint32_t k);
+   /// Merges the closeness values of a finished query that computed the top k
+   void addResults(TagData& data, uint32_t k, vector<CentralityResult>& completed);
+
+   void print(std::ostream& out);
+};
+
 class QueryState {
 public:
    QueryRunner& runner;
+   const PersonMapper& personMapper; // Results carry original person ids
 
    // These are constant in the multithreaded part
    const uint32_t k;
    const uint32_t numPersonsInForums;
+   const shared_ptr<TagData> tagData;
+   const PersonSubgraph& subgraph;
    PersonEstimatesData estimates;
    vector<uint8_t> personChecked; // Is used concurrently!!
-   const PersonSubgraph subgraph;
+   const bool cacheResults; // Collects the closeness of all completed BFSs for the tag cache
 
    mutex topResultsMutex;
    awfy::TopKList<PersonId, CentralityResult> topResults;
    awfy::atomic<CentralityResult*> globalCentralityBound;
    uint32_t lastBoundUpdate;
-
-   QueryState(QueryRunner& runner, uint32_t k, uint32_t numPersonsInForums, PersonEstimatesData estimates, PersonSubgraph subgraph, CentralityResult* globalCentralityBound)
-      : runner(runner), k(k), numPersonsInForums(numPersonsInForums), estimates(move(estimates)), personChecked(subgraph.size()), subgraph(move(subgraph)),
-         topResults(make_pair(globalCentralityBound->person,*globalCentralityBound)), globalCentralityBound(globalCentralityBound), lastBoundUpdate(0)
+   vector<CentralityResult> completedResults; // Guarded by topResultsMutex
+   Task* finishTask; // Executed once the result was written, may be null
+   const unsigned homeNode; // Numa node that allocated the subgraph, morsels are routed there
+
+   QueryState(QueryRunner& runner, const PersonMapper& personMapper, uint32_t k, shared_ptr<TagData> tagData, bool cacheResults, CentralityResult* globalCentralityBound)
+      : runner(runner), personMapper(personMapper), k(k), numPersonsInForums(tagData->numPersonsInForums), tagData(move(tagData)), subgraph(this->tagData->subgraph),
+         estimates(cacheResults ? PersonEstimatesData(this->tagData->estimates) : move(this->tagData->estimates)),
+         personChecked(subgraph.size()), cacheResults(cacheResults),
+         topResults(make_pair(globalCentralityBound->person,*globalCentralityBound)), globalCentralityBound(globalCentralityBound), lastBoundUpdate(0), finishTask(nullptr),
+         homeNode(awfy::numa::currentNode())
    {}
 };
 
@@ -234,6 +315,7 @@ private:
 	const TagIndex& tagIndex;
 	const TagInForumsIndex& tagInForumsIndex;
 	const HasMemberIndex& hasMemberIndex;
+	const uint64_t generation;
 
 	uint32_t getDegree(PersonId person) const;
 
@@ -243,7 +325,11 @@ private:
 
 public:
 	QueryRunner(ScheduleGraph& taskGraph, Scheduler& scheduler, FileIndexes& fileIndexes);
-	TaskGroup query(const uint32_t k, const char* tag, const char*& resultOut); 
+	/// The optional finishTask is executed and deleted as soon as resultOut was written
+	TaskGroup query(const uint32_t k, const char* tag, const char*& resultOut, Task* finishTask=nullptr);
 };
 
+/// Copies the result into the result buffer, then executes and deletes the optional finish task
+void writeResult(const string& result, const char*& resultOut, Task* finishTask);
+
 }
@@ -0,0 +1,188 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "include/querycost.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include "include/util/log.hpp"
+
+namespace awfy {
+
+namespace {
+   const char* queryNames[4] = { "Query1", "Query2", "Query3", "Query4" };
+
+   /// Ranks of the values, ties get the mean of their ranks
+   std::vector<double> ranks(const std::vector<double>& values) {
+      std::vector<uint32_t> order(values.size());
+      for(uint32_t i=0; i<order.size(); i++) {
+         order[i]=i;
+      }
+      std::sort(order.begin(), order.end(), [&values](uint32_t a, uint32_t b) { return values[a]<values[b]; });
+      std::vector<double> result(values.size());
+      for(uint32_t begin=0; begin<order.size();) {
+         uint32_t end=begin+1;
+         while(end<order.size() && values[order[end]]==values[order[begin]]) {
+            end++;
+         }
+         for(uint32_t i=begin; i<end; i++) {
+            result[order[i]]=(begin+end-1)/2.0;
+         }
+         begin=end;
+      }
+      return result;
+   }
+
+   double correlation(const std::vector<double>& a, const std::vector<double>& b) {
+      const double n=a.size();
+      double sumA=0, sumB=0;
+      for(size_t i=0; i<a.size(); i++) {
+         sumA+=a[i];
+         sumB+=b[i];
+      }
+      double cov=0, varA=0, varB=0;
+      for(size_t i=0; i<a.size(); i++) {
+         const double dA=a[i]-sumA/n;
+         const double dB=b[i]-sumB/n;
+         cov+=dA*dB;
+         varA+=dA*dA;
+         varB+=dB*dB;
+      }
+      return varA==0 || varB==0 ? 0 : cov/std::sqrt(varA*varB);
+   }
+}
+
+QueryCostModel::QueryCostModel(const FileIndexes& indexes) : indexes(indexes), active(false), averageFriends(0), placesGeneration(0) {
+}
+
+void QueryCostModel::enable(const std::string& samplesPath) {
+   active=true;
+   this->samplesPath=samplesPath;
+}
+
+uint64_t QueryCostModel::placePopulation(const char* place) {
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      if(personPlaces.empty() || placesGeneration!=indexes.generation) {
+         // Updates replace the place index
+         personPlaces.clear();
+         placesGeneration=indexes.generation;
+         // Places are nested intervals, a person place lies in a query place iff its lower bound does
+         const auto& placeIndex=*indexes.personPlaceIndex;
+         for(PersonId person=0; person<indexes.personMapper.count(); person++) {
+            for(const PlaceBounds* personPlace=placeIndex.places[person];
+                  *reinterpret_cast<const uint64_t*>(personPlace)!=*reinterpret_cast<const uint64_t*>(&placeSeparator); personPlace++) {
+               personPlaces.push_back(personPlace->lower());
+            }
+         }
+         std::sort(personPlaces.begin(), personPlaces.end());
+
+         uint64_t friends=0;
+         for(PersonId person=0; person<indexes.personMapper.count(); person++) {
+            const auto list=indexes.personGraph->retrieve(person);
+            friends+=list==nullptr ? 0 : list->size();
+         }
+         averageFriends=personPlaces.empty() ? 0 : static_cast<double>(friends)/indexes.personMapper.count();
+      }
+   }
+
+   // Persons located at several matching places are counted once per place
+   uint64_t population=0;
+   auto placeIds=indexes.namePlaceIndex->equal_range(awfy::StringRef(place, strlen(place)));
+   for(auto placeIter=placeIds.first; placeIter!=placeIds.second; placeIter++) {
+      const PlaceBounds bounds=indexes.placeBoundsIndex->at(placeIter->second);
+      population+=std::upper_bound(personPlaces.begin(), personPlaces.end(), bounds.upper())
+         -std::lower_bound(personPlaces.begin(), personPlaces.end(), bounds.lower());
+   }
+   return population;
+}
+
+uint64_t QueryCostModel::estimateQuery1(PersonId p1, PersonId p2) {
+   const auto& personGraph=*indexes.personGraph;
+   uint64_t friends=1; // Even isolated persons cost a lookup
+   for(const PersonId person : { p1, p2 }) {
+      const auto list=personGraph.retrieve(indexes.personMapper.map(person));
+      friends+=list==nullptr ? 0 : list->size();
+   }
+   return friends;
+}
+
+uint64_t QueryCostModel::estimateQuery3(uint32_t hops, const char* place) {
+   const uint64_t population=placePopulation(place);
+   const double reachable=std::min(static_cast<double>(population), std::pow(averageFriends, hops));
+   return population*static_cast<uint64_t>(std::max(1.0, reachable));
+}
+
+uint64_t QueryCostModel::estimateQuery4(const char* tag) {
+   const auto tagId=indexes.tagIndex->strToId.retrieve(awfy::StringRef(tag, strlen(tag)));
+   if(tagId==indexes.tagIndex->strToId.end()) {
+      return 0;
+   }
+   const auto& forumIndex=*indexes.tagInForumsIndex.index;
+   const auto& memberIndex=*indexes.hasMemberIndex;
+   uint64_t members=0;
+   const auto forumLists=forumIndex.retrieve(tagId);
+   if(forumLists!=forumIndex.end()) {
+      auto forums=forumLists->firstList();
+      do {
+         auto forumBounds=forums->bounds();
+         for(; forumBounds.first!=forumBounds.second; forumBounds.first++) {
+            const auto memberLists=memberIndex.retrieve(*forumBounds.first);
+            if(memberLists==memberIndex.end()) { continue; }
+            auto memberList=memberLists->firstList();
+            do {
+               members+=memberList->size();
+            } while((memberList=memberLists->nextList(memberList))!=nullptr);
+         }
+      } while((forums=forumLists->nextList(forums))!=nullptr);
+   }
+   return members*members;
+}
+
+void QueryCostModel::record(uint32_t queryType, uint64_t predicted, awfy::chrono::Time actual) {
+   std::lock_guard<std::mutex> lock(mutex);
+   samples.push_back(Sample { queryType, predicted, actual });
+}
+
+void QueryCostModel::print(std::ostream& out) {
+   std::lock_guard<std::mutex> lock(mutex);
+   for(uint32_t queryType=0; queryType<4; queryType++) {
+      std::vector<double> predicted, actual;
+      awfy::chrono::Time totalTime=0;
+      for(const auto& sample : samples) {
+         if(sample.queryType!=queryType) { continue; }
+         predicted.push_back(sample.predicted);
+         actual.push_back(sample.actual);
+         totalTime+=sample.actual;
+      }
+      if(predicted.empty()) { continue; }
+      out<<"[QueryCost] "<<queryNames[queryType]<<": "<<predicted.size()<<" queries in "<<totalTime/1000<<" ms, rank correlation of predicted and actual cost "
+         <<correlation(ranks(predicted), ranks(actual))<<std::endl;
+   }
+
+   if(!samplesPath.empty()) {
+      std::ofstream samplesFile(samplesPath);
+      samplesFile<<"query,predicted,actual_us"<<std::endl;
+      for(const auto& sample : samples) {
+         samplesFile<<queryNames[sample.queryType]<<","<<sample.predicted<<","<<sample.actual<<std::endl;
+      }
+   }
+}
+
+}
@@ -0,0 +1,188 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "include/reorder.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include "include/util/log.hpp"
+
+namespace awfy {
+namespace reorder {
+
+/// Label propagation stops once less than this share of the persons changes its label in a round
+static const double communityConvergence=0.001;
+static const unsigned maxCommunityRounds=10;
+
+Order parseOrder(const char* name) {
+   if(name==nullptr || strcmp(name, "none")==0) {
+      return Order::None;
+   } else if(strcmp(name, "degree")==0) {
+      return Order::Degree;
+   } else if(strcmp(name, "rcm")==0) {
+      return Order::RCM;
+   } else if(strcmp(name, "community")==0) {
+      return Order::Community;
+   }
+   FATAL_ERROR("Unknown person order "<<name<<", expected none, degree, rcm or community");
+}
+
+const char* orderName(Order order) {
+   switch(order) {
+      case Order::None: return "none";
+      case Order::Degree: return "degree";
+      case Order::RCM: return "rcm";
+      case Order::Community: return "community";
+   }
+   return "unknown";
+}
+
+static inline uint32_t degree(const PersonGraph& graph, PersonId person) {
+   const auto friends=graph.retrieve(person);
+   return friends!=nullptr ? friends->size() : 0;
+}
+
+static std::vector<PersonId> identityOrder(uint32_t numPersons) {
+   std::vector<PersonId> order(numPersons);
+   for(PersonId person=0; person<numPersons; person++) {
+      order[person]=person;
+   }
+   return order;
+}
+
+static std::vector<PersonId> degreeOrder(const PersonGraph& graph, uint32_t numPersons) {
+   auto order=identityOrder(numPersons);
+   std::stable_sort(order.begin(), order.end(), [&graph](PersonId a, PersonId b) {
+      return degree(graph, a)>degree(graph, b);
+   });
+   return order;
+}
+
+static std::vector<PersonId> rcmOrder(const PersonGraph& graph, uint32_t numPersons) {
+   std::vector<uint32_t> degrees(numPersons);
+   for(PersonId person=0; person<numPersons; person++) {
+      degrees[person]=degree(graph, person);
+   }
+   const auto byDegree=[&degrees](PersonId a, PersonId b) {
+      return degrees[a]<degrees[b] || (degrees[a]==degrees[b] && a<b);
+   };
+
+   // Every component starts at its unvisited person with the lowest degree
+   auto starts=identityOrder(numPersons);
+   std::sort(starts.begin(), starts.end(), byDegree);
+
+   std::vector<PersonId> order;
+   order.reserve(numPersons);
+   std::vector<bool> visited(numPersons);
+   std::vector<PersonId> neighbours;
+   for(auto startIter=starts.cbegin(); startIter!=starts.cend(); startIter++) {
+      if(visited[*startIter]) { continue; }
+      visited[*startIter]=true;
+      size_t head=order.size();
+      order.push_back(*startIter);
+      // The order vector doubles as BFS queue
+      while(head<order.size()) {
+         const auto friends=graph.retrieve(order[head++]);
+         if(friends==nullptr) { continue; }
+         neighbours.clear();
+         auto bounds=friends->bounds();
+         while(bounds.first!=bounds.second) {
+            const PersonId curFriend=*bounds.first;
+            ++bounds.first;
+            if(!visited[curFriend]) {
+               visited[curFriend]=true;
+               neighbours.push_back(curFriend);
+            }
+         }
+         std::sort(neighbours.begin(), neighbours.end(), byDegree);
+         order.insert(order.end(), neighbours.begin(), neighbours.end());
+      }
+   }
+   std::reverse(order.begin(), order.end());
+   return order;
+}
+
+static inline uint32_t labelHash(PersonId label) {
+   return label*2654435761u;
+}
+
+static std::vector<PersonId> communityOrder(const PersonGraph& graph, uint32_t numPersons) {
+   auto labels=identityOrder(numPersons);
+   std::vector<PersonId> neighbourLabels;
+   for(unsigned round=0; round<maxCommunityRounds; round++) {
+      uint32_t changed=0;
+      for(PersonId person=0; person<numPersons; person++) {
+         const auto friends=graph.retrieve(person);
+         if(friends==nullptr || friends->size()==0) { continue; }
+         neighbourLabels.clear();
+         auto bounds=friends->bounds();
+         while(bounds.first!=bounds.second) {
+            neighbourLabels.push_back(labels[*bounds.first]);
+            ++bounds.first;
+         }
+         std::sort(neighbourLabels.begin(), neighbourLabels.end());
+
+         // Most frequent label of the friends. A person keeps its label on ties, other ties are broken
+         // by a hash of the label, preferring the smallest label would flood the graph in the first round.
+         PersonId bestLabel=labels[person];
+         uint32_t bestCount=0;
+         for(size_t i=0; i<neighbourLabels.size();) {
+            size_t j=i+1;
+            while(j<neighbourLabels.size() && neighbourLabels[j]==neighbourLabels[i]) { j++; }
+            if(j-i>bestCount || (j-i==bestCount && bestLabel!=labels[person]
+                  && (neighbourLabels[i]==labels[person] || labelHash(neighbourLabels[i])>labelHash(bestLabel)))) {
+               bestCount=j-i;
+               bestLabel=neighbourLabels[i];
+            }
+            i=j;
+         }
+         if(bestLabel!=labels[person]) {
+            labels[person]=bestLabel;
+            changed++;
+         }
+      }
+      LOG_PRINT("[Reorder] Label propagation round "<<round<<" changed "<<changed<<" labels");
+      if(changed<numPersons*communityConvergence) { break; }
+   }
+
+   // Communities are numbered in the order of their first member, members keep their relative order
+   std::vector<PersonId> communityRank(numPersons, numPersons);
+   PersonId nextRank=0;
+   for(PersonId person=0; person<numPersons; person++) {
+      if(communityRank[labels[person]]==numPersons) {
+         communityRank[labels[person]]=nextRank++;
+      }
+   }
+   LOG_PRINT("[Reorder] Found "<<nextRank<<" communities");
+   auto order=identityOrder(numPersons);
+   std::stable_sort(order.begin(), order.end(), [&](PersonId a, PersonId b) {
+      return communityRank[labels[a]]<communityRank[labels[b]];
+   });
+   return order;
+}
+
+std::vector<PersonId> computeOrder(const PersonGraph& graph, uint32_t numPersons, Order order) {
+   switch(order) {
+      case Order::None: return identityOrder(numPersons);
+      case Order::Degree: return degreeOrder(graph, numPersons);
+      case Order::RCM: return rcmOrder(graph, numPersons);
+      case Order::Community: return communityOrder(graph, numPersons);
+   }
+   FATAL_ERROR("Unknown person order");
+}
+
+}
+}
@@ -0,0 +1,211 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <sys/wait.h>
+#include "query1.hpp"
+#include "query2.hpp"
+#include "query3.hpp"
+#include "include/indexes.hpp"
+#include "include/reorder.hpp"
+#include "include/queryfiles.hpp"
+#include "include/concurrent/scheduler.hpp"
+#include "include/concurrent/thread.hpp"
+#include "include/runtime.hpp"
+#include "include/schedulegraph.hpp"
+#include "include/executioncommons.hpp"
+#include "include/util/chrono.hpp"
+#include "include/util/perfevents.hpp"
+
+// Query time and last level cache misses of query 1, 2 and 3 for every person order. Every order
+// is loaded in its own child process because the relabeling rewrites the indexes in place. The queries
+// run one after another on a single thread so the misses of one query type can be attributed to it.
+// Answers are compared to the file order through a hash of all results of a query type.
+
+const uint32_t hardwareThreads=std::thread::hardware_concurrency();
+const awfy::reorder::Order orders[] = { awfy::reorder::Order::None, awfy::reorder::Order::Degree,
+   awfy::reorder::Order::RCM, awfy::reorder::Order::Community };
+const unsigned numOrders=sizeof(orders)/sizeof(orders[0]);
+const unsigned numQueryTypes=3;
+
+/// Parses the queries but keeps the query tasks from running them
+struct ParseBatchesIgnored {
+   queryfiles::QueryBatcher& batches;
+
+   ParseBatchesIgnored(queryfiles::QueryBatcher& batches, bool* /*excludes*/)
+      : batches(batches)
+   { }
+
+   void operator()() {
+      batches.parse();
+      auto queryList=batches.getQueryList();
+      for(auto queryIter=queryList.begin(); queryIter!=queryList.end(); queryIter++) {
+         (*queryIter)->ignore=true;
+      }
+   }
+};
+
+/// Written by the child of an order to the pipe of the parent
+struct QueryStats {
+   uint64_t queries;
+   awfy::chrono::Time duration;
+   uint64_t llcMisses;
+   uint64_t resultHash;
+
+   QueryStats() : queries(0), duration(0), llcMisses(0), resultHash(14695981039346656037ull) {
+   }
+
+   void addResult(const string& result) {
+      for(auto c : result) {
+         resultHash=(resultHash^static_cast<uint8_t>(c))*1099511628211ull;
+      }
+      resultHash=(resultHash^'\n')*1099511628211ull;
+   }
+};
+
+struct RunQueries {
+   queryfiles::QueryBatcher& batches;
+   FileIndexes& fileIndexes;
+   QueryStats* stats;
+
+   RunQueries(queryfiles::QueryBatcher& batches, FileIndexes& fileIndexes, QueryStats* stats)
+      : batches(batches), fileIndexes(fileIndexes), stats(stats)
+   { }
+
+   void operator()() {
+      Query1::QueryRunner runner1(fileIndexes);
+      Query2::QueryRunner runner2(fileIndexes);
+      Query3::QueryRunner runner3(fileIndexes);
+      awfy::perf::Counter misses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+      if(!misses.valid()) {
+         std::cerr<<"Cache misses are not available, perf_event_open failed"<<std::endl;
+      }
+
+      auto& personMapper=fileIndexes.personMapper;
+      auto queryList=batches.getQueryList();
+      for(auto queryIter=queryList.begin(); queryIter!=queryList.end(); queryIter++) {
+         const auto queryPtr=(*queryIter)->getQuery();
+         const auto queryType=reinterpret_cast<queryfiles::QueryParser::BaseQuery*>(queryPtr)->id;
+
+         string result;
+         unsigned type;
+         misses.start();
+         const auto start=awfy::chrono::now();
+         if(queryType==queryfiles::QueryParser::Query1::QueryId) {
+            auto query=reinterpret_cast<queryfiles::QueryParser::Query1*>(queryPtr);
+            result=to_string(runner1.query(personMapper.map(query->p1), personMapper.map(query->p2), query->x));
+            type=0;
+         } else if(queryType==queryfiles::QueryParser::Query2::QueryId) {
+            auto query=reinterpret_cast<queryfiles::QueryParser::Query2*>(queryPtr);
+            result=runner2.query(query->k, query->year, query->month, query->day);
+            type=1;
+         } else if(queryType==queryfiles::QueryParser::Query3::QueryId) {
+            auto query=reinterpret_cast<queryfiles::QueryParser::Query3*>(queryPtr);
+            result=runner3.query(query->k, query->hops, query->getPlace());
+            type=2;
+         } else {
+            misses.stop();
+            continue;
+         }
+         const auto duration=awfy::chrono::now()-start;
+         misses.stop();
+
+         stats[type].queries++;
+         stats[type].duration+=duration;
+         stats[type].llcMisses+=misses.read();
+         stats[type].addResult(result);
+      }
+   }
+};
+
+/// Loads the indexes in the given order and runs all queries, returns the stats of every query type
+void runOrder(const std::string& dataPath, const char* queryPath, awfy::reorder::Order order, QueryStats* stats) {
+   io::MmapedFile queryFile(queryPath, O_RDONLY);
+   bool excludes[4] = {false, false, false, true};
+
+   awfy::counters::ProgramCounters counters(hardwareThreads);
+   auto& threadCounts=counters.getThreadCounters();
+   threadCounts.initThread();
+   threadCounts.startTask(TaskGraph::Initialize);
+
+   Scheduler scheduler(counters, SchedulerKinds::GLOBAL_QUEUE, hardwareThreads);
+   ScheduleGraph taskGraph(scheduler);
+   queryfiles::QueryFileParser queries(queryFile);
+   queryfiles::QueryBatcher batches(queries);
+   FileIndexes fileIndexes;
+   fileIndexes.personOrder=order;
+   runtime::QueryState queryState(taskGraph, scheduler, fileIndexes);
+
+   initScheduleGraph<RunQueries, ParseBatchesIgnored>(scheduler, taskGraph, fileIndexes, dataPath, batches, queryState, excludes,
+      RunQueries(batches, fileIndexes, stats));
+   taskGraph.eraseNotUsedEdges();
+
+   executeTaskGraph(hardwareThreads, scheduler, counters, threadCounts);
+}
+
+double delta(uint64_t value, uint64_t base) {
+   return base>0 ? 100.0*(double(value)-double(base))/double(base) : 0;
+}
+
+int main(int argc, char** argv) {
+   if(argc != 3) {
+      std::cerr<<"Usage: "<<argv[0]<<" <dataFolder> <queryFile>"<<std::endl;
+      return -1;
+   }
+   const std::string dataPath(argv[1]);
+
+   QueryStats stats[numOrders][numQueryTypes];
+   for(unsigned o=0; o<numOrders; o++) {
+      int fds[2];
+      if(pipe(fds)!=0) {
+         FATAL_ERROR("Could not create pipe");
+      }
+      const pid_t child=fork();
+      if(child<0) {
+         FATAL_ERROR("Could not fork");
+      }
+      if(child==0) {
+         close(fds[0]);
+         QueryStats childStats[numQueryTypes];
+         runOrder(dataPath, argv[2], orders[o], childStats);
+         const auto written=write(fds[1], childStats, sizeof(childStats));
+         _exit(written==sizeof(childStats) ? 0 : 1);
+      }
+
+      close(fds[1]);
+      const auto bytesRead=read(fds[0], stats[o], sizeof(stats[o]));
+      close(fds[0]);
+      int status;
+      waitpid(child, &status, 0);
+      if(bytesRead!=sizeof(stats[o]) || !WIFEXITED(status) || WEXITSTATUS(status)!=0) {
+         FATAL_ERROR("Run with person order "<<awfy::reorder::orderName(orders[o])<<" failed");
+      }
+   }
+
+   std::cout<<"order,query,queries,us,us_per_query,us_delta_percent,llc_misses,llc_misses_delta_percent,same_results"<<std::endl;
+   for(unsigned o=0; o<numOrders; o++) {
+      for(unsigned q=0; q<numQueryTypes; q++) {
+         const QueryStats& s=stats[o][q];
+         const QueryStats& base=stats[0][q];
+         std::cout<<awfy::reorder::orderName(orders[o])<<",q"<<(q+1)<<","<<s.queries<<","<<s.duration<<","<<(s.queries>0?s.duration/s.queries:0)
+            <<","<<delta(s.duration, base.duration)<<","<<s.llcMisses<<","<<delta(s.llcMisses, base.llcMisses)
+            <<","<<(s.resultHash==base.resultHash?"yes":"no")<<std::endl;
+      }
+   }
+   return 0;
+}
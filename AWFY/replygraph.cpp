@@ -0,0 +1,79 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "include/replygraph.hpp"
+
+namespace awfy {
+
+ReplySortedGraph::ReplySortedGraph(const PersonGraph& personGraph, PersonCommentedGraph commentedGraph, uint32_t numPersons)
+   : offsets(numPersons+1), prefixes(static_cast<size_t>(numPersons)*numBounds)
+{
+   typedef std::remove_pointer<PersonGraph::Content>::type Content;
+   const auto basePersonPtr=reinterpret_cast<const uint8_t*>(personGraph.buffer.data);
+   const auto baseCommentedPtr=reinterpret_cast<const uint8_t*>(commentedGraph);
+
+   uint64_t numEdges=0;
+   for(PersonId person=0; person<numPersons; person++) {
+      const auto list=personGraph.retrieve(person);
+      numEdges+=list==nullptr ? 0 : list->size();
+   }
+   friends.reserve(numEdges);
+   replies.reserve(numEdges);
+
+   std::vector<std::pair<uint32_t,PersonId>> entries; // (replies, friend) of the current person
+   for(PersonId person=0; person<numPersons; person++) {
+      offsets[person]=friends.size();
+      const auto list=personGraph.retrieve(person);
+      if(list==nullptr) { continue; }
+      const auto listOffset=reinterpret_cast<const uint8_t*>(list)-basePersonPtr;
+      const auto commentedCounts=reinterpret_cast<const Content*>(baseCommentedPtr+listOffset);
+
+      entries.clear();
+      for(uint32_t i=0; i<list->size(); i++) {
+         const PersonId friendId=*list->getPtr(i);
+         uint32_t count=*commentedCounts->getPtr(i);
+         if(count>0) {
+            const auto otherList=personGraph.retrieve(friendId);
+            assert(otherList!=nullptr);
+            const auto reverse=otherList->find(person);
+            assert(reverse!=nullptr);
+            const auto reverseOffset=reinterpret_cast<const uint8_t*>(reverse)-basePersonPtr;
+            count=std::min(count, *reinterpret_cast<const PersonGraph::Id*>(baseCommentedPtr+reverseOffset));
+         }
+         entries.push_back(std::make_pair(count, friendId));
+      }
+      // Most replies first, friends with the same count keep their id order
+      std::sort(entries.begin(), entries.end(), [](const std::pair<uint32_t,PersonId>& a, const std::pair<uint32_t,PersonId>& b) {
+         return a.first>b.first || (a.first==b.first && a.second<b.second);
+      });
+
+      uint32_t* personPrefixes=prefixes.data()+static_cast<size_t>(person)*numBounds;
+      uint32_t pos=0;
+      for(uint32_t bound=numBounds; bound-->0; ) {
+         while(pos<entries.size() && entries[pos].first>bound) {
+            pos++;
+         }
+         personPrefixes[bound]=pos;
+      }
+      for(const auto& entry : entries) {
+         friends.push_back(entry.second);
+         replies.push_back(entry.first);
+      }
+   }
+   offsets[numPersons]=friends.size();
+}
+
+}
@@ -0,0 +1,157 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include "query1.hpp"
+#include "include/indexes.hpp"
+#include "include/replygraph.hpp"
+#include "include/queryfiles.hpp"
+#include "include/concurrent/scheduler.hpp"
+#include "include/concurrent/thread.hpp"
+#include "include/runtime.hpp"
+#include "include/schedulegraph.hpp"
+#include "include/executioncommons.hpp"
+#include "include/util/chrono.hpp"
+#include "include/util/log.hpp"
+
+// Edge checks and latency of the query 1 search on the raw friend lists and on the reply sorted
+// friend lists. The persons of every query 1 entry of a query file are searched once per comment
+// bound of the given range, differing answers are reported as mismatches.
+
+const uint32_t hardwareThreads=std::thread::hardware_concurrency();
+
+/// Parses the queries but keeps the query tasks from running them
+struct ParseBatchesIgnored {
+   queryfiles::QueryBatcher& batches;
+
+   ParseBatchesIgnored(queryfiles::QueryBatcher& batches, bool* /*excludes*/)
+      : batches(batches)
+   { }
+
+   void operator()() {
+      batches.parse();
+      auto queryList=batches.getQueryList();
+      for(auto queryIter=queryList.begin(); queryIter!=queryList.end(); queryIter++) {
+         (*queryIter)->ignore=true;
+      }
+   }
+};
+
+struct SearchStats {
+   uint64_t queries;
+   uint64_t edgeChecks;
+   awfy::chrono::Time duration;
+   uint64_t mismatches;
+
+   SearchStats() : queries(0), edgeChecks(0), duration(0), mismatches(0) {
+   }
+
+   void print(int32_t num, const char* layout) const {
+      std::cout<<num<<","<<layout<<","<<queries<<","<<edgeChecks<<","<<duration<<","<<(queries>0?duration/queries:0)<<","<<mismatches<<std::endl;
+   }
+};
+
+struct CompareLayouts {
+   queryfiles::QueryBatcher& batches;
+   FileIndexes& fileIndexes;
+   const int32_t minNum;
+   const int32_t maxNum;
+
+   CompareLayouts(queryfiles::QueryBatcher& batches, FileIndexes& fileIndexes, int32_t minNum, int32_t maxNum)
+      : batches(batches), fileIndexes(fileIndexes), minNum(minNum), maxNum(maxNum)
+   { }
+
+   void operator()() {
+      LOG_PRINT("[ReplyGraphBench] "<<fileIndexes.replyGraph->edges()<<" edges in "<<fileIndexes.replyGraph->memorySize()/1024<<" kb");
+      fileIndexes.replySortedGraph=false;
+      Query1::QueryRunner raw(fileIndexes);
+      fileIndexes.replySortedGraph=true;
+      Query1::QueryRunner sorted(fileIndexes);
+
+      // Persons of all query 1 entries, the bound of the entry is replaced by the benchmarked ones
+      vector<pair<PersonId,PersonId>> pairs;
+      auto& personMapper=fileIndexes.personMapper;
+      auto queryList=batches.getQueryList();
+      for(auto queryIter=queryList.begin(); queryIter!=queryList.end(); queryIter++) {
+         const auto queryPtr=(*queryIter)->getQuery();
+         if(reinterpret_cast<queryfiles::QueryParser::BaseQuery*>(queryPtr)->id==queryfiles::QueryParser::Query1::QueryId) {
+            auto query=reinterpret_cast<queryfiles::QueryParser::Query1*>(queryPtr);
+            pairs.push_back(make_pair(personMapper.map(query->p1), personMapper.map(query->p2)));
+         }
+      }
+
+      std::cout<<"x,layout,queries,edge_checks,us,us_per_query,mismatches"<<std::endl;
+      for(int32_t num=minNum; num<=maxNum; num++) {
+         SearchStats stats[2]; // [sorted]
+         const uint64_t rawChecks=raw.getEdgeChecks();
+         const uint64_t sortedChecks=sorted.getEdgeChecks();
+         for(const auto& persons : pairs) {
+            auto start=awfy::chrono::now();
+            const int rawResult=raw.query(persons.first, persons.second, num);
+            stats[0].duration+=awfy::chrono::now()-start;
+            start=awfy::chrono::now();
+            const int sortedResult=sorted.query(persons.first, persons.second, num);
+            stats[1].duration+=awfy::chrono::now()-start;
+
+            stats[0].queries++;
+            stats[1].queries++;
+            if(rawResult!=sortedResult) {
+               stats[1].mismatches++;
+               LOG_PRINT("[ReplyGraphBench] Query1 "<<persons.first<<" "<<persons.second<<" "<<num<<": "<<rawResult<<" vs "<<sortedResult);
+            }
+         }
+         stats[0].edgeChecks=raw.getEdgeChecks()-rawChecks;
+         stats[1].edgeChecks=sorted.getEdgeChecks()-sortedChecks;
+         stats[0].print(num, "raw");
+         stats[1].print(num, "sorted");
+      }
+   }
+};
+
+int main(int argc, char** argv) {
+   if(argc != 3 && argc != 5) {
+      std::cerr<<"Usage: "<<argv[0]<<" <dataFolder> <queryFile> (<minX> <maxX>)"<<std::endl;
+      return -1;
+   }
+   const std::string dataPath(argv[1]);
+   io::MmapedFile queryFile(argv[2], O_RDONLY);
+   const int32_t minNum=argc==5 ? std::stoi(argv[3]) : -1;
+   const int32_t maxNum=argc==5 ? std::stoi(argv[4]) : 5;
+   bool excludes[4] = {false, true, true, true};
+
+   awfy::counters::ProgramCounters counters(hardwareThreads);
+   auto& threadCounts=counters.getThreadCounters();
+   threadCounts.initThread();
+   threadCounts.startTask(TaskGraph::Initialize);
+
+   Scheduler scheduler(counters, SchedulerKinds::GLOBAL_QUEUE, hardwareThreads);
+   ScheduleGraph taskGraph(scheduler);
+   queryfiles::QueryFileParser queries(queryFile);
+   queryfiles::QueryBatcher batches(queries);
+   FileIndexes fileIndexes;
+   fileIndexes.replySortedGraph=true;
+   runtime::QueryState queryState(taskGraph, scheduler, fileIndexes);
+
+   // The comparison runs once the indexes of query 1 are complete
+   initScheduleGraph<CompareLayouts, ParseBatchesIgnored>(scheduler, taskGraph, fileIndexes, dataPath, batches, queryState, excludes,
+      CompareLayouts(batches, fileIndexes, minNum, maxNum));
+   taskGraph.eraseNotUsedEdges();
+
+   executeTaskGraph(hardwareThreads, scheduler, counters, threadCounts);
+   return 0;
+}
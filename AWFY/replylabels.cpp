@@ -0,0 +1,92 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "include/replylabels.hpp"
+
+#include <algorithm>
+
+namespace awfy {
+
+ReplyComponentLabels::ReplyComponentLabels(const PersonGraph& personGraph, PersonCommentedGraph commentedGraph, uint32_t numPersons, int32_t maxNum)
+   : maxNum(maxNum), numPersons(numPersons), labels(static_cast<size_t>(numLevels())*numPersons)
+{
+   typedef std::remove_pointer<PersonGraph::Content>::type Content;
+   const auto basePersonPtr=reinterpret_cast<const uint8_t*>(personGraph.buffer.data);
+   const auto baseCommentedPtr=reinterpret_cast<const uint8_t*>(commentedGraph);
+
+   for(PersonId person=0; person<numPersons; person++) {
+      const auto friends=personGraph.retrieve(person);
+      if(friends==nullptr) { continue; }
+      const auto friendsOffset=reinterpret_cast<const uint8_t*>(friends)-basePersonPtr;
+      const auto commentedCounts=reinterpret_cast<const Content*>(baseCommentedPtr+friendsOffset);
+
+      for(uint32_t i=0; i<friends->size(); i++) {
+         const PersonId friendId=*friends->getPtr(i);
+         // Every friendship is stored in both lists, keep it once
+         if(friendId<=person) { continue; }
+         uint32_t replies=*commentedCounts->getPtr(i);
+         if(replies>0) {
+            const auto otherFriends=personGraph.retrieve(friendId);
+            assert(otherFriends!=nullptr);
+            const auto reverse=otherFriends->find(person);
+            assert(reverse!=nullptr);
+            const auto reverseOffset=reinterpret_cast<const uint8_t*>(reverse)-basePersonPtr;
+            replies=std::min(replies, *reinterpret_cast<const PersonGraph::Id*>(baseCommentedPtr+reverseOffset));
+         }
+         edges.push_back(Edge { person, friendId, replies });
+      }
+   }
+}
+
+void ReplyComponentLabels::buildLevel(uint32_t level) {
+   assert(level<numLevels());
+   const int64_t num=static_cast<int64_t>(level)-1;
+   PersonId* parent=labels.data()+static_cast<size_t>(level)*numPersons;
+   for(PersonId person=0; person<numPersons; person++) {
+      parent[person]=person;
+   }
+
+   auto find=[parent](PersonId person) {
+      while(parent[person]!=person) {
+         parent[person]=parent[parent[person]];
+         person=parent[person];
+      }
+      return person;
+   };
+
+   for(const auto& edge : edges) {
+      if(static_cast<int64_t>(edge.replies)<=num) { continue; }
+      const PersonId a=find(edge.a);
+      const PersonId b=find(edge.b);
+      // Smaller id becomes the root, labels do not depend on the edge order
+      if(a<b) {
+         parent[b]=a;
+      } else if(b<a) {
+         parent[a]=b;
+      }
+   }
+
+   // Parents always have smaller ids, so one pass in id order points every person to its root
+   for(PersonId person=0; person<numPersons; person++) {
+      parent[person]=parent[parent[person]];
+   }
+}
+
+void ReplyComponentLabels::finish() {
+   std::vector<Edge>().swap(edges);
+}
+
+}
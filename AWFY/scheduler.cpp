@@ -17,15 +17,99 @@ limitations under the License.
 #include "include/concurrent/scheduler.hpp"
 
 #include <iostream>
+#include <string.h>
 #include "include/concurrent/atomic.hpp"
 #include <chrono>
 #include <pthread.h>
 #include <sched.h>
 #include "include/util/log.hpp"
+#include "include/util/numa.hpp"
+
+///--- Scheduler kind related methods
+SchedulerKinds::Kind SchedulerKinds::parse(const char* name) {
+   if(name==nullptr || strcmp(name, "global")==0) {
+      return GLOBAL_QUEUE;
+   } else if(strcmp(name, "stealing")==0) {
+      return WORK_STEALING;
+   }
+   FATAL_ERROR("Unknown scheduler "<<name<<", expected global or stealing");
+}
+
+unsigned SchedulerKinds::priorityLevel(Priorities::Priority priority) {
+   switch(priority) {
+      case Priorities::LOW: return 0;
+      case Priorities::DEFAULT: return 1;
+      case Priorities::NORMAL: return 2;
+      case Priorities::URGENT: return 3;
+      case Priorities::CRITICAL: return 4;
+      case Priorities::HYPER_CRITICAL: return 5;
+   }
+   FATAL_ERROR("Unknown priority "<<priority);
+}
+
+///--- Worker queue related methods
+void WorkerQueue::push(const Task* newTasks, size_t count, unsigned level, bool isIO) {
+   assert(level<SchedulerKinds::numPriorityLevels);
+   awfy::lock_guard<awfy::Mutex> lock(mutex);
+   tasks[level][isIO].insert(tasks[level][isIO].end(), newTasks, newTasks+count);
+   size.fetch_add(count);
+}
+
+bool WorkerQueue::pop(Task& task, bool preferIO, bool steal) {
+   if(steal && size.load()==0) {
+      return false;
+   }
+   awfy::lock_guard<awfy::Mutex> lock(mutex);
+   // Most urgent non empty queue for work and io tasks
+   std::deque<Task>* urgent[2] = {nullptr, nullptr};
+   for(int level=SchedulerKinds::numPriorityLevels-1; level>=0; level--) {
+      for(unsigned isIO=0; isIO<2; isIO++) {
+         if(urgent[isIO]==nullptr && !tasks[level][isIO].empty()) {
+            urgent[isIO]=&tasks[level][isIO];
+         }
+      }
+   }
+   // Same choice as the global queue
+   std::deque<Task>* queue=((preferIO && urgent[1]!=nullptr) || urgent[0]==nullptr) ? urgent[1] : urgent[0];
+   if(queue==nullptr) {
+      return false;
+   }
+   if(steal) {
+      task=queue->back();
+      queue->pop_back();
+   } else {
+      task=queue->front();
+      queue->pop_front();
+   }
+   size.fetch_add(-1);
+   return true;
+}
+
+bool WorkerQueue::empty() {
+   awfy::lock_guard<awfy::Mutex> lock(mutex);
+   for(unsigned level=0; level<SchedulerKinds::numPriorityLevels; level++) {
+      if(!tasks[level][0].empty() || !tasks[level][1].empty()) {
+         return false;
+      }
+   }
+   return true;
+}
 
 ///--- Scheduler related methods
-Scheduler::Scheduler(awfy::counters::ProgramCounters& counters) 
-   : ioTasks(), workTasks(), closeOnEmpty(false), currentlyEmpty(false), nextTaskId(0), counters(counters) {
+namespace {
+   __thread Scheduler* workerScheduler;
+   __thread unsigned workerId;
+}
+
+Scheduler::Scheduler(awfy::counters::ProgramCounters& counters, SchedulerKinds::Kind kind, unsigned numWorkers)
+   : ioTasks(), workTasks(), closeOnEmpty(false), currentlyEmpty(false), nextTaskId(0), kind(kind), counters(counters) {
+   if(kind==SchedulerKinds::WORK_STEALING) {
+      assert(numWorkers>0);
+      for(unsigned i=0; i<numWorkers; i++) {
+         workerQueues.push_back(new WorkerQueue());
+         workerNodes.push_back(awfy::numa::enabled() ? awfy::numa::executorNode(i) : 0);
+      }
+   }
 }
 
 Scheduler::~Scheduler() {
@@ -34,9 +118,126 @@ Scheduler::~Scheduler() {
    }
    assert(ioTasks.size()==0);
    assert(workTasks.size()==0);
+   for(auto queueIter=workerQueues.begin(); queueIter!=workerQueues.end(); queueIter++) {
+      assert((*queueIter)->empty());
+      delete *queueIter;
+   }
+}
+
+void Scheduler::registerWorker(unsigned id) {
+   if(kind==SchedulerKinds::WORK_STEALING) {
+      assert(id<workerQueues.size());
+      workerScheduler=this;
+      workerId=id;
+   }
+}
+
+void Scheduler::unregisterWorker() {
+   if(workerScheduler==this) {
+      workerScheduler=nullptr;
+   }
+}
+
+unsigned Scheduler::currentWorker() {
+   return workerScheduler==this ? workerId : workerQueues.size();
+}
+
+void Scheduler::pushGlobal(const Task* tasks, size_t count, Priorities::Priority priority, bool isIO) {
+   awfy::lock_guard<awfy::Mutex> lock(taskMutex);
+   for (unsigned i = 0; i < count; ++i) {
+      Task* task = new Task(tasks[i]);
+      if(isIO) {
+         ioTasks.push(std::make_pair(TaskOrder(priority, nextTaskId++), task));
+      } else {
+         workTasks.push(std::make_pair(TaskOrder(priority, nextTaskId++), task));
+      }
+   }
+   numGlobalTasks.fetch_add(count);
+}
+
+bool Scheduler::popGlobal(Task& task, bool preferIO) {
+   awfy::lock_guard<awfy::Mutex> lock(taskMutex);
+   if(ioTasks.empty() && workTasks.empty()) {
+      return false;
+   }
+   Task* globalTask;
+   if((preferIO && !ioTasks.empty()) || workTasks.empty()) {
+      globalTask = ioTasks.top().second;
+      ioTasks.pop();
+   } else {
+      globalTask = workTasks.top().second;
+      workTasks.pop();
+   }
+   task=*globalTask;
+   delete globalTask;
+   numGlobalTasks.fetch_add(-1);
+   numTasks.fetch_add(-1);
+   return true;
+}
+
+bool Scheduler::getStolenTask(Task& task, bool preferIO) {
+   const unsigned numWorkers=workerQueues.size();
+   const unsigned self=currentWorker();
+   const unsigned selfNode=self<numWorkers ? workerNodes[self] : 0;
+   // Steal from executors on the same numa node first, their tasks work on local memory
+   for(unsigned pass=0; pass<2; pass++) {
+      const bool sameNode=pass==0;
+      for(unsigned i=1; i<numWorkers; i++) {
+         const unsigned victim=(self+i)%numWorkers;
+         if((workerNodes[victim]==selfNode)!=sameNode) {
+            continue;
+         }
+         if(workerQueues[victim]->pop(task, preferIO, true)) {
+            numTasks.fetch_add(-1);
+            return true;
+         }
+      }
+   }
+   return false;
+}
+
+/// Wakes idle executors, has to be called after numTasks was increased
+void Scheduler::notifyWorkers(size_t count) {
+   if(numSleeping.load()>0) {
+      awfy::lock_guard<awfy::Mutex> lock(idleMutex);
+      if(currentlyEmpty) {
+         currentlyEmpty=false;
+         counters.endStalledScheduler();
+      }
+      if(count>1) {
+         idleCondition.broadcast();
+      } else {
+         idleCondition.signal();
+      }
+   }
+}
+
+void Scheduler::pushTasks(const Task* tasks, size_t count, Priorities::Priority priority, bool isIO) {
+   if(count==0) {
+      return;
+   }
+   const auto worker=currentWorker();
+   if(worker<workerQueues.size()) {
+      workerQueues[worker]->push(tasks, count, SchedulerKinds::priorityLevel(priority), isIO);
+   } else {
+      pushGlobal(tasks, count, priority, isIO);
+   }
+   #ifdef DEBUG
+   __sync_fetch_and_add(&counters.scheduledTasks, count);
+   for (unsigned i = 0; i < count; ++i) {
+      counters.countScheduledTask();
+   }
+   #endif
+   numTasks.fetch_add(count);
+   notifyWorkers(count);
 }
 
 void Scheduler::schedule(const std::vector<Task>& funcs, Priorities::Priority priority, bool isIO) {
+   if(kind==SchedulerKinds::WORK_STEALING) {
+      pushTasks(funcs.data(), funcs.size(), priority, isIO);
+      return;
+   }
+
    awfy::lock_guard<awfy::Mutex> lock(taskMutex);
    for (unsigned i = 0; i < funcs.size(); ++i) {
       Task* task = new Task(funcs[i]);
@@ -57,7 +258,40 @@ void Scheduler::schedule(const std::vector<Task>& funcs, Priorities::Priority pr
    taskCondition.signal();
 }
 
+void Scheduler::scheduleOnNode(const std::vector<Task>& funcs, unsigned node, Priorities::Priority priority, bool isIO) {
+   const unsigned numWorkers=workerQueues.size();
+   const unsigned self=currentWorker();
+   if(kind!=SchedulerKinds::WORK_STEALING || funcs.empty() || (self<numWorkers && workerNodes[self]==node)) {
+      schedule(funcs, priority, isIO);
+      return;
+   }
+
+   // Queue of the first executor on the node, executors of other nodes only get the tasks by stealing
+   unsigned target=0;
+   while(target<numWorkers && workerNodes[target]!=node) {
+      target++;
+   }
+   if(target==numWorkers) {
+      schedule(funcs, priority, isIO);
+      return;
+   }
+   workerQueues[target]->push(funcs.data(), funcs.size(), SchedulerKinds::priorityLevel(priority), isIO);
+   #ifdef DEBUG
+   __sync_fetch_and_add(&counters.scheduledTasks, funcs.size());
+   for (unsigned i = 0; i < funcs.size(); ++i) {
+      counters.countScheduledTask();
+   }
+   #endif
+   numTasks.fetch_add(funcs.size());
+   notifyWorkers(funcs.size());
+}
+
 void Scheduler::schedule(const Task& scheduleTask, Priorities::Priority priority, bool isIO) {
+   if(kind==SchedulerKinds::WORK_STEALING) {
+      pushTasks(&scheduleTask, 1, priority, isIO);
+      return;
+   }
+
    awfy::lock_guard<awfy::Mutex> lock(taskMutex);
    Task* task = new Task(scheduleTask);
    #ifdef DEBUG
@@ -76,7 +310,41 @@ void Scheduler::schedule(const Task& scheduleTask, Priorities::Priority priority
    taskCondition.signal();
 }
 
-Task* Scheduler::getTask(bool preferIO) {
+bool Scheduler::getTask(Task& result, bool preferIO) {
+   if(kind==SchedulerKinds::WORK_STEALING) {
+      const auto worker=currentWorker();
+      assert(worker<workerQueues.size());
+      while(true) {
+         if(workerQueues[worker]->pop(result, preferIO, false)) {
+            numTasks.fetch_add(-1);
+            return true;
+         }
+         // Tasks scheduled by threads that are no executor
+         if(numGlobalTasks.load()>0 && popGlobal(result, preferIO)) {
+            return true;
+         }
+         if(getStolenTask(result, preferIO)) {
+            return true;
+         }
+
+         // Wait if no task is available
+         awfy::lock_guard<awfy::Mutex> lock(idleMutex);
+         numSleeping.fetch_add(1);
+         while(numTasks.load()==0 && !closeOnEmpty) {
+            if(!currentlyEmpty) {
+               currentlyEmpty=true;
+               counters.startStalledScheduler();
+            }
+            idleCondition.wait(idleMutex.get());
+         }
+         numSleeping.fetch_add(-1);
+         if(numTasks.load()==0 && closeOnEmpty) {
+            idleCondition.signal();
+            return false;
+         }
+      }
+   }
+
    taskMutex.lock();
    while(true) {
       // Try to acquire task
@@ -97,7 +365,9 @@ Task* Scheduler::getTask(bool preferIO) {
          }
          taskMutex.unlock();
          if(numTasks>0) { taskCondition.signal(); }
-         return task;
+         result=*task;
+         delete task;
+         return true;
       } else {
          // Wait if no task is available
          if(closeOnEmpty) {
@@ -110,15 +380,22 @@ Task* Scheduler::getTask(bool preferIO) {
       }
    }
 
-   return nullptr;
+   return false;
 }
 
 void Scheduler::setCloseOnEmpty() {
    closeOnEmpty=true;
    taskCondition.broadcast();
+   if(kind==SchedulerKinds::WORK_STEALING) {
+      awfy::lock_guard<awfy::Mutex> lock(idleMutex);
+      idleCondition.broadcast();
+   }
 }
 
 size_t Scheduler::size() {
+   if(kind==SchedulerKinds::WORK_STEALING) {
+      return numTasks.load();
+   }
    return ioTasks.size()+workTasks.size();
 }
 
@@ -126,17 +403,22 @@ size_t Scheduler::size() {
 void Executor::run() {
    // set thread affinity to specific core (core pinning)
    counters.initThread();
+   if(awfy::numa::enabled()) {
+      awfy::numa::pinExecutor(coreId);
+   }
+   scheduler.registerWorker(coreId);
+   Task task(nullptr, nullptr);
    while(true) {
       counters.startStalled();
-      auto task = scheduler.getTask(preferIO);
+      const bool found = scheduler.getTask(task, preferIO);
       counters.endStalled();
-      if(task==nullptr) { break; }
+      if(!found) { break; }
 
-      counters.startTask(task->groupId);
-      task->execute();
+      counters.startTask(task.groupId);
+      task.execute();
       counters.endTask();
-      delete task;
    }
+   scheduler.unregisterWorker();
 }
 
 void* Executor::start(void* argument) {
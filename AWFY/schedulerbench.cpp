@@ -0,0 +1,113 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "include/concurrent/scheduler.hpp"
+#include "include/concurrent/thread.hpp"
+#include "include/util/chrono.hpp"
+#include "include/util/counters.hpp"
+
+// Task throughput of the schedulers. Every round schedules a task group of small
+// morsel tasks whose join task schedules the next round, like the Q4 morsels do.
+
+struct BenchmarkState {
+   Scheduler& scheduler;
+   unsigned remainingRounds;
+   const unsigned tasksPerRound;
+   const unsigned workPerTask;
+
+   BenchmarkState(Scheduler& scheduler, unsigned rounds, unsigned tasksPerRound, unsigned workPerTask)
+      : scheduler(scheduler), remainingRounds(rounds), tasksPerRound(tasksPerRound), workPerTask(workPerTask)
+   { }
+};
+
+void scheduleRound(BenchmarkState& state);
+
+void runMorsel(void* argument) {
+   auto state=static_cast<BenchmarkState*>(argument);
+   volatile uint64_t sum=0;
+   for(unsigned i=0; i<state->workPerTask; i++) {
+      sum+=i;
+   }
+}
+
+void finishRound(void* argument) {
+   auto state=static_cast<BenchmarkState*>(argument);
+   if(--state->remainingRounds==0) {
+      state->scheduler.setCloseOnEmpty();
+   } else {
+      scheduleRound(*state);
+   }
+}
+
+void scheduleRound(BenchmarkState& state) {
+   TaskGroup morsels;
+   for(unsigned i=0; i<state.tasksPerRound; i++) {
+      morsels.schedule(Task(runMorsel, &state));
+   }
+   morsels.join(Task(finishRound, &state));
+   state.scheduler.schedule(morsels.close(), Priorities::NORMAL, false);
+}
+
+/// Returns the runtime in microseconds
+awfy::chrono::Time runBenchmark(SchedulerKinds::Kind kind, unsigned numThreads, unsigned rounds, unsigned tasksPerRound, unsigned workPerTask) {
+   awfy::counters::ProgramCounters counters(numThreads);
+   auto& threadCounts=counters.getThreadCounters();
+   threadCounts.initThread();
+   Scheduler scheduler(counters, kind, numThreads);
+   BenchmarkState state(scheduler, rounds, tasksPerRound, workPerTask);
+
+   const auto start=awfy::chrono::now();
+   scheduleRound(state);
+   std::vector<awfy::Thread<Executor>> threads;
+   for(unsigned i=0; i<numThreads-1; i++) {
+      Executor* executor=new Executor(counters.getThreadCounters(), scheduler, i, false);
+      threads.emplace_back(&Executor::start, executor);
+   }
+   Executor executor(threadCounts, scheduler, numThreads-1, false);
+   executor.run();
+   for(auto threadIter=threads.begin(); threadIter!=threads.end(); threadIter++) {
+      (*threadIter).join();
+   }
+   return awfy::chrono::now()-start;
+}
+
+int main(int argc, char** argv) {
+   if(argc > 5) {
+      std::cerr<<"Usage: "<<argv[0]<<" (<maxThreads>) (<rounds>) (<tasksPerRound>) (<workPerTask>)"<<std::endl;
+      return -1;
+   }
+   const unsigned maxThreads=argc>1?std::stoul(argv[1]):std::thread::hardware_concurrency();
+   const unsigned rounds=argc>2?std::stoul(argv[2]):100;
+   const unsigned tasksPerRound=argc>3?std::stoul(argv[3]):10000;
+   const unsigned workPerTask=argc>4?std::stoul(argv[4]):100;
+   const uint64_t numTasks=static_cast<uint64_t>(rounds)*(tasksPerRound+1);
+
+   const SchedulerKinds::Kind kinds[] = {SchedulerKinds::GLOBAL_QUEUE, SchedulerKinds::WORK_STEALING};
+   const char* names[] = {"global", "stealing"};
+
+   std::cout<<"scheduler,threads,tasks,ms,tasks_per_ms"<<std::endl;
+   for(unsigned numThreads=1; numThreads<=maxThreads; numThreads++) {
+      for(unsigned k=0; k<2; k++) {
+         const auto duration=runBenchmark(kinds[k], numThreads, rounds, tasksPerRound, workPerTask);
+         std::cout<<names[k]<<","<<numThreads<<","<<numTasks<<","<<duration/1000<<","<<(numTasks*1000/(duration>0?duration:1))<<std::endl;
+      }
+   }
+   return 0;
+}
@@ -0,0 +1,397 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "include/snapshot.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "include/metrics.hpp"
+#include "include/tokenize.hpp"
+#include "include/util/log.hpp"
+
+namespace snapshot {
+
+/// Header of PersonGraph like list indexes, the list buffer follows it
+struct ListIndexHeader {
+   uint64_t maxKey;
+   uint64_t bufferSize;
+   uint64_t padding[6];
+};
+static_assert(sizeof(ListIndexHeader)==sectionAlignment, "List buffer must stay aligned");
+
+struct StringEntry {
+   uint32_t id;
+   uint32_t length;
+   uint64_t offset; // Relative to the file start
+};
+
+struct PlaceBoundsEntry {
+   PlaceId place;
+   uint32_t padding;
+   PlaceBounds bounds;
+};
+
+static uint32_t layoutFingerprint() {
+   return (sizeof(PersonId)<<24)|(sizeof(Birthday)<<16)|(sizeof(InterestStat)<<8)|sizeof(PlaceBounds);
+}
+
+static uint64_t sourceSize(const std::string& path) {
+   struct stat info;
+   if(::stat(path.c_str(), &info)!=0) {
+      return 0;
+   }
+   return info.st_size;
+}
+
+//--- Writing
+class SnapshotWriter {
+   std::ofstream out;
+   uint64_t pos;
+
+public:
+   Header header;
+
+   SnapshotWriter(const std::string& path) : out(path, std::ios::binary|std::ios::trunc), pos(0) {
+      memset(&header, 0, sizeof(Header));
+      // Reserve space for the header, it is written once all sections are known
+      append(&header, sizeof(Header));
+   }
+
+   bool good() const {
+      return out.good();
+   }
+
+   void append(const void* data, size_t size) {
+      out.write(reinterpret_cast<const char*>(data), size);
+      pos+=size;
+   }
+
+   template<class T>
+   void append(const T& value) {
+      append(&value, sizeof(T));
+   }
+
+   void beginSection(Section section) {
+      static const char zeros[sectionAlignment] = {};
+      const auto misalignment=pos%sectionAlignment;
+      if(misalignment!=0) {
+         append(zeros, sectionAlignment-misalignment);
+      }
+      header.sections[static_cast<size_t>(section)].offset=pos;
+   }
+
+   void endSection(Section section) {
+      auto& entry=header.sections[static_cast<size_t>(section)];
+      entry.size=pos-entry.offset;
+   }
+
+   uint64_t position() const {
+      return pos;
+   }
+
+   void finish() {
+      out.seekp(0);
+      out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+      out.close();
+   }
+};
+
+template<class Index>
+static void writeListIndex(SnapshotWriter& writer, Section section, const Index& index) {
+   writer.beginSection(section);
+   ListIndexHeader listHeader;
+   memset(&listHeader, 0, sizeof(ListIndexHeader));
+   listHeader.maxKey=index.maxKey();
+   listHeader.bufferSize=index.buffer.size;
+   writer.append(listHeader);
+   writer.append(index.buffer.data, index.buffer.size);
+   writer.endSection(section);
+}
+
+/// Writes a table of (id, string) pairs followed by the zero terminated strings
+static void writeStrings(SnapshotWriter& writer, Section section, const vector<pair<uint32_t,awfy::StringRef>>& strings) {
+   writer.beginSection(section);
+   const uint64_t count=strings.size();
+   writer.append(count);
+
+   uint64_t strOffset=writer.position()+count*sizeof(StringEntry);
+   for(auto iter=strings.cbegin(); iter!=strings.cend(); iter++) {
+      StringEntry entry { iter->first, iter->second.strLen, strOffset };
+      writer.append(entry);
+      strOffset+=iter->second.strLen+1;
+   }
+   for(auto iter=strings.cbegin(); iter!=strings.cend(); iter++) {
+      writer.append(iter->second.str, iter->second.strLen);
+      writer.append('\0');
+   }
+   writer.endSection(section);
+}
+
+static vector<pair<uint32_t,awfy::StringRef>> readTags(io::MmapedFile& file) {
+   vector<pair<uint32_t,awfy::StringRef>> tags;
+   tokenize::Tokenizer tokenizer(file);
+   tokenizer.skipAfter('\n'); // Skip header
+   do {
+      InterestId id=tokenizer.consumeLong('|');
+      auto tagStart=tokenizer.getPositionPtr();
+      auto tagLength=tokenizer.skipAfterAndCount('|')-1;
+      tags.push_back(make_pair(id, awfy::StringRef(tagStart, tagLength)));
+      tokenizer.skipAfter('\n');
+   } while (!tokenizer.finished());
+   return tags;
+}
+
+void write(const std::string& snapshotPath, const std::string& dataPath, const FileIndexes& indexes) {
+   metrics::BlockStats<>::LogSensor sensor("snapshotWrite");
+   const uint64_t numPersons=indexes.personMapper.count();
+
+   // Write to a temporary file first so a crash never leaves a truncated snapshot behind
+   const std::string tmpPath=snapshotPath+".tmp";
+   SnapshotWriter writer(tmpPath);
+   if(!writer.good()) {
+      std::cerr<<"WARNING: Could not create snapshot "<<tmpPath<<std::endl;
+      return;
+   }
+
+   writer.header.magic=magic;
+   writer.header.version=formatVersion;
+   writer.header.layout=layoutFingerprint();
+   writer.header.numPersons=numPersons;
+   for(unsigned i=0; i<numSourceFiles; i++) {
+      writer.header.sourceSizes[i]=sourceSize(dataPath+sourceFiles[i]);
+   }
+
+   // Person graph and the comment counts which share its layout
+   writeListIndex(writer, Section::PersonGraph, *indexes.personGraph);
+   writer.beginSection(Section::PersonCommented);
+   writer.append(indexes.personCommentedGraph, indexes.personGraph->buffer.size);
+   writer.endSection(Section::PersonCommented);
+
+   writer.beginSection(Section::Birthday);
+   writer.append(indexes.birthdayIndex, numPersons*sizeof(Birthday));
+   writer.endSection(Section::Birthday);
+
+   writeListIndex(writer, Section::HasInterest, *indexes.hasInterestIndex);
+
+   writer.beginSection(Section::InterestStatistics);
+   const auto& interestStats=*indexes.interestStatistics;
+   writer.append<uint64_t>(interestStats.size());
+   writer.append(interestStats.data(), interestStats.size()*sizeof(InterestStat));
+   writer.endSection(Section::InterestStatistics);
+
+   // The tag index depends on the tags used by the queries, so store the raw tags
+   {
+      io::MmapedFile file(dataPath+"tag.csv", O_RDONLY);
+      writeStrings(writer, Section::Tags, readTags(file));
+   }
+
+   {
+      vector<pair<uint32_t,awfy::StringRef>> places;
+      places.reserve(indexes.namePlaceIndex->size());
+      for(auto iter=indexes.namePlaceIndex->cbegin(); iter!=indexes.namePlaceIndex->cend(); iter++) {
+         places.push_back(make_pair(iter->second, iter->first));
+      }
+      writeStrings(writer, Section::NamePlaces, places);
+   }
+
+   writer.beginSection(Section::PlaceBounds);
+   writer.append<uint64_t>(indexes.placeBoundsIndex->size());
+   for(auto iter=indexes.placeBoundsIndex->cbegin(); iter!=indexes.placeBoundsIndex->cend(); iter++) {
+      PlaceBoundsEntry entry;
+      entry.place=iter->first;
+      entry.padding=0;
+      entry.bounds=iter->second;
+      writer.append(entry);
+   }
+   writer.endSection(Section::PlaceBounds);
+
+   // Person places are stored as offsets into the separator terminated bounds data
+   {
+      const PersonPlaceIndex& placeIndex=*indexes.personPlaceIndex;
+      const uint64_t numPlaces=placeIndex.places.size();
+      const PlaceBounds* dataEnd=placeIndex.dataStart;
+      if(numPlaces>0) {
+         dataEnd=placeIndex.places[numPlaces-1];
+         while(*reinterpret_cast<const uint64_t*>(dataEnd)!=*reinterpret_cast<const uint64_t*>(&placeSeparator)) {
+            dataEnd++;
+         }
+         dataEnd++;
+      }
+      const uint64_t dataLen=dataEnd-placeIndex.dataStart;
+
+      writer.beginSection(Section::PersonPlaces);
+      writer.append(numPlaces);
+      writer.append(dataLen);
+      for(uint64_t p=0; p<numPlaces; p++) {
+         writer.append<uint64_t>(placeIndex.places[p]-placeIndex.dataStart);
+      }
+      writer.append(placeIndex.dataStart, dataLen*sizeof(PlaceBounds));
+      writer.endSection(Section::PersonPlaces);
+   }
+
+   writer.finish();
+   if(!writer.good() || ::rename(tmpPath.c_str(), snapshotPath.c_str())!=0) {
+      std::cerr<<"WARNING: Could not write snapshot "<<snapshotPath<<std::endl;
+      ::unlink(tmpPath.c_str());
+      return;
+   }
+   LOG_PRINT("[Snapshot] Wrote "<<snapshotPath);
+}
+
+//--- Loading
+template<class T>
+static const T* sectionPtr(const io::MmapedFile& file, Section section) {
+   const Header& header=*reinterpret_cast<const Header*>(file.mapping);
+   return reinterpret_cast<const T*>(reinterpret_cast<const uint8_t*>(file.mapping)+header.sections[static_cast<size_t>(section)].offset);
+}
+
+template<class Index>
+static Index* restoreListIndex(const io::MmapedFile& file, Section section, size_t numKeys) {
+   typedef typename std::remove_pointer<typename Index::Content>::type List;
+   const ListIndexHeader& listHeader=*sectionPtr<ListIndexHeader>(file, section);
+   uint8_t* const data=const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(&listHeader+1));
+
+   Index* index=new Index(numKeys);
+   index->buffer.data=data;
+   index->buffer.size=listHeader.bufferSize;
+
+   // Only the list pointers have to be recreated, the lists are used in place
+   uint8_t* pos=data;
+   for(typename Index::Id k=0; k<=listHeader.maxKey; k++) {
+      List* list=reinterpret_cast<List*>(pos);
+      index->insert(k, list);
+      pos+=sizeof(typename List::Size)+list->size()*sizeof(typename List::Entry);
+   }
+   assert(pos<=data+listHeader.bufferSize);
+   return index;
+}
+
+static bool validate(const io::MmapedFile& file, const std::string& dataPath) {
+   const Header& header=*reinterpret_cast<const Header*>(file.mapping);
+   if(header.magic!=magic || header.version!=formatVersion || header.layout!=layoutFingerprint()) {
+      LOG_PRINT("[Snapshot] Incompatible snapshot format");
+      return false;
+   }
+   for(unsigned i=0; i<numSourceFiles; i++) {
+      if(header.sourceSizes[i]!=sourceSize(dataPath+sourceFiles[i])) {
+         LOG_PRINT("[Snapshot] Snapshot is stale, "<<sourceFiles[i]<<" changed");
+         return false;
+      }
+   }
+   for(unsigned s=0; s<numSections; s++) {
+      const auto& entry=header.sections[s];
+      if(entry.offset<sizeof(Header) || entry.offset+entry.size>file.size) {
+         LOG_PRINT("[Snapshot] Snapshot is truncated");
+         return false;
+      }
+   }
+   return true;
+}
+
+bool load(const std::string& snapshotPath, const std::string& dataPath, FileIndexes& indexes) {
+   metrics::BlockStats<>::LogSensor sensor("snapshotLoad");
+   if(sourceSize(snapshotPath)<sizeof(Header) || ::access(snapshotPath.c_str(), R_OK)!=0) {
+      return false;
+   }
+
+   io::MmapedFile* file=new io::MmapedFile(snapshotPath, O_RDONLY);
+   if(!validate(*file, dataPath)) {
+      delete file;
+      return false;
+   }
+   madvise(file->mapping, file->size, MADV_WILLNEED);
+
+   const Header& header=*reinterpret_cast<const Header*>(file->mapping);
+   const size_t numPersons=header.numPersons;
+   indexes.personMapper=PersonMapper(numPersons);
+   #ifdef DEBUG
+   indexes.personMapper.closed=true;
+   #endif
+
+   indexes.personGraph=restoreListIndex<PersonGraph>(*file, Section::PersonGraph, numPersons);
+   indexes.personCommentedGraph=sectionPtr<void>(*file, Section::PersonCommented);
+   indexes.birthdayIndex=sectionPtr<Birthday>(*file, Section::Birthday);
+   indexes.hasInterestIndex=restoreListIndex<HasInterestIndex>(*file, Section::HasInterest, numPersons);
+
+   {
+      const uint64_t* count=sectionPtr<uint64_t>(*file, Section::InterestStatistics);
+      const InterestStat* stats=reinterpret_cast<const InterestStat*>(count+1);
+      indexes.interestStatistics=new InterestStatistics(stats, stats+*count);
+   }
+
+   {
+      const uint64_t* count=sectionPtr<uint64_t>(*file, Section::NamePlaces);
+      const StringEntry* entries=reinterpret_cast<const StringEntry*>(count+1);
+      const char* base=reinterpret_cast<const char*>(file->mapping);
+      NamePlaceIndex* namePlaces=new NamePlaceIndex();
+      namePlaces->reserve(*count);
+      for(uint64_t i=0; i<*count; i++) {
+         namePlaces->emplace(make_pair(awfy::StringRef(base+entries[i].offset, entries[i].length), entries[i].id));
+      }
+      indexes.namePlaceIndex=namePlaces;
+   }
+
+   {
+      const uint64_t* count=sectionPtr<uint64_t>(*file, Section::PlaceBounds);
+      const PlaceBoundsEntry* entries=reinterpret_cast<const PlaceBoundsEntry*>(count+1);
+      PlaceBoundsIndex* placeBounds=new PlaceBoundsIndex();
+      placeBounds->reserve(*count);
+      for(uint64_t i=0; i<*count; i++) {
+         placeBounds->emplace(entries[i].place, entries[i].bounds);
+      }
+      indexes.placeBoundsIndex=placeBounds;
+   }
+
+   {
+      const uint64_t* numPlaces=sectionPtr<uint64_t>(*file, Section::PersonPlaces);
+      const uint64_t* offsets=numPlaces+2;
+      PersonPlaceIndex* personPlaces=new PersonPlaceIndex();
+      personPlaces->dataStart=reinterpret_cast<const PlaceBounds*>(offsets+*numPlaces);
+      personPlaces->places.resize(*numPlaces);
+      for(uint64_t p=0; p<*numPlaces; p++) {
+         personPlaces->places[p]=personPlaces->dataStart+offsets[p];
+      }
+      indexes.personPlaceIndex=personPlaces;
+   }
+
+   indexes.snapshotFile=file;
+   LOG_PRINT("[Snapshot] Restored indexes of "<<numPersons<<" persons from "<<snapshotPath);
+   return true;
+}
+
+TagIndex* buildTagIndex(const io::MmapedFile& file, const unordered_set<awfy::StringRef>& usedTags, const bool allTags) {
+   const uint64_t* count=sectionPtr<uint64_t>(file, Section::Tags);
+   const StringEntry* entries=reinterpret_cast<const StringEntry*>(count+1);
+   const char* base=reinterpret_cast<const char*>(file.mapping);
+
+   TagIndex* index=new TagIndex(*count);
+   for(uint64_t i=0; i<*count; i++) {
+      const InterestId id=entries[i].id;
+      awfy::StringRef tagStr(base+entries[i].offset, entries[i].length);
+      if(allTags || usedTags.find(tagStr)!=usedTags.end()) {
+         index->usedTags.insert(id);
+      }
+      index->strToId.insert(tagStr,id);
+      index->idToStr.insert(id,move(tagStr));
+   }
+   return index;
+}
+
+}
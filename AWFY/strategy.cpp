@@ -0,0 +1,116 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "include/strategy.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "include/indexes.hpp"
+#include "include/io.hpp"
+#include "include/util/log.hpp"
+
+namespace awfy {
+namespace strategy {
+
+/// Building the birthday component index costs about as much as two or three BFS based Query2 runs
+static const uint64_t sweepMinQueries=3;
+/// From this size on a single BFS based Query2 run takes longer than building the index
+static const uint64_t sweepMinPersons=100000;
+/// Bytes of person.csv that are read to estimate the length of a line
+static const size_t personSampleBytes=64*1024;
+
+Query3Mode parseQuery3Mode(const char* name) {
+   if(strcmp(name, "bfs")==0) {
+      return Query3Mode::Bfs;
+   } else if(strcmp(name, "inverted")==0) {
+      return Query3Mode::Inverted;
+   } else if(strcmp(name, "auto")==0) {
+      return Query3Mode::Auto;
+   }
+   FATAL_ERROR("Unknown query 3 strategy "<<name<<", expected bfs, inverted or auto");
+}
+
+const char* query3ModeName(Query3Mode mode) {
+   switch(mode) {
+      case Query3Mode::Bfs: return "bfs";
+      case Query3Mode::Inverted: return "inverted";
+      case Query3Mode::Auto: return "auto";
+   }
+   return "unknown";
+}
+
+Workload::Workload() : persons(0) {
+   std::fill(queries, queries+4, unknownCount);
+}
+
+void Workload::countQueries(const io::MmapedFile& queryFile, const bool* excludes) {
+   std::fill(queries, queries+4, 0);
+   const char* iter=reinterpret_cast<const char*>(queryFile.mapping);
+   const char* end=iter+queryFile.size;
+   while(iter<end) {
+      const char* lineEnd=reinterpret_cast<const char*>(memchr(iter, '\n', end-iter));
+      if(lineEnd==nullptr) {
+         lineEnd=end;
+      }
+      // Query lines start with "query" followed by the type
+      if(lineEnd-iter>6 && memcmp(iter, "query", 5)==0 && iter[5]>='1' && iter[5]<='4') {
+         const unsigned type=iter[5]-'1';
+         if(!excludes[type]) {
+            queries[type]++;
+         }
+      }
+      iter=lineEnd+1;
+   }
+}
+
+void Workload::estimatePersons(const std::string& dataPath) {
+   const std::string path=dataPath+"person.csv";
+   const size_t size=io::fileSize(path);
+   // Lines of the first bytes give the average length, the file is parsed in full by the loader anyway
+   std::ifstream file(path, std::ios::binary);
+   std::string sample(std::min(size, personSampleBytes), '\0');
+   file.read(&sample[0], sample.size());
+   const size_t sampleLines=std::count(sample.begin(), sample.end(), '\n');
+   persons=sampleLines>1 ? size*(sampleLines-1)/sample.size() : 0;
+}
+
+void select(const Workload& workload, const Fixed& fixed, FileIndexes& indexes) {
+   const uint64_t numQuery2=workload.queries[1];
+   if(!fixed.query2) {
+      // A server has to expect many queries
+      indexes.birthdaySweep = numQuery2>=sweepMinQueries || (numQuery2>0 && workload.persons>=sweepMinPersons);
+   }
+   if(!fixed.query3) {
+      indexes.query3Mode = Query3Mode::Auto;
+   }
+
+   std::cerr<<"[Strategy] ~"<<workload.persons<<" persons";
+   for(unsigned type=0; type<4; type++) {
+      std::cerr<<", q"<<type+1<<" ";
+      if(workload.queries[type]==unknownCount) {
+         std::cerr<<"?";
+      } else {
+         std::cerr<<workload.queries[type];
+      }
+   }
+   std::cerr<<" queries: q1 "<<(indexes.hybridBFS ? "hybrid" : "bidirectional")<<" bfs, q2 "<<(indexes.birthdaySweep ? "sweep" : "bfs")
+      <<", q3 "<<query3ModeName(indexes.query3Mode)<<", q4 pruned bfs"<<std::endl;
+}
+
+}
+}
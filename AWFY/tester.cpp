@@ -20,7 +20,11 @@ limitations under the License.
 #include "query2.hpp"
 #include "query3.hpp"
 #include "query4.hpp"
+#include "include/arena.hpp"
 #include "include/indexes.hpp"
+#include "include/snapshot.hpp"
+#include "include/reorder.hpp"
+#include "include/strategy.hpp"
 #include "include/env.hpp"
 #include "include/metrics.hpp"
 #include "include/queryfiles.hpp"
@@ -112,7 +116,7 @@ struct ValidateAnswers {
 
 int main(int argc, char **argv) {
    if(argc < 4) {
-      cerr<<"Usage [runTester] (-factor X) (-exclude q1,q2...) -F <dataFolder> <queryFile> <answerFile>"<<endl;
+      cerr<<"Usage [runTester] (-factor X) (-exclude q1,q2...) (-snapshot <file>) (-scheduler global|stealing) (-bfs queue|hybrid) (-graph raw|compressed) (-q2 bfs|sweep) (-q3 bfs|inverted|auto) (-q1labels <maxNum>) (-q1graph raw|sorted) (-q1pll <maxMB>) (-q4cache <maxMB>) (-arena default|huge) (-admission fifo|lpt) (-trace <traceFile>) (-perf) (-reorder none|degree|rcm|community) -F <dataFolder> <queryFile> <answerFile>"<<endl;
       return -1;
    }
 
@@ -128,6 +132,20 @@ int main(int argc, char **argv) {
       if(excludesStr.find("4")!=std::string::npos) excludes[3] = true;
    }
    const auto workFactor = argsParser.getOptionAsUint32("-factor",1);
+   const auto snapshotArgs = argsParser.getOption("-snapshot");
+   const auto schedulerKind = SchedulerKinds::parse(argsParser.getOption("-scheduler"));
+   const auto bfsArgs = argsParser.getOption("-bfs");
+   const auto graphArgs = argsParser.getOption("-graph");
+   const auto q2Args = argsParser.getOption("-q2");
+   const auto q3Args = argsParser.getOption("-q3");
+   const auto q1LabelsArgs = argsParser.getOption("-q1labels");
+   const auto q1GraphArgs = argsParser.getOption("-q1graph");
+   const auto q1PllArgs = argsParser.getOption("-q1pll");
+   const auto q4CacheArgs = argsParser.getOption("-q4cache");
+   const auto reorderArgs = argsParser.getOption("-reorder");
+   const auto arenaArgs = argsParser.getOption("-arena");
+   const auto admissionArgs = argsParser.getOption("-admission");
+   const auto traceArgs = argsParser.getOption("-trace");
 
    const string dataPath(argv[argc-3]);
    const string queryPath(argv[argc-2]);
@@ -135,6 +153,31 @@ int main(int argc, char **argv) {
 
    io::MmapedFile queryFile(queryPath, O_RDONLY);
    FileIndexes fileIndexes;
+   fileIndexes.hybridBFS = bfsArgs != nullptr && string(bfsArgs) == "hybrid";
+   fileIndexes.compressedGraph = graphArgs != nullptr && string(graphArgs) == "compressed";
+   fileIndexes.birthdaySweep = q2Args != nullptr && string(q2Args) == "sweep";
+   if(q3Args != nullptr) {
+      fileIndexes.query3Mode = awfy::strategy::parseQuery3Mode(q3Args);
+   }
+   fileIndexes.replySortedGraph = q1GraphArgs != nullptr && string(q1GraphArgs) == "sorted";
+   if(q1LabelsArgs != nullptr) {
+      fileIndexes.replyLabelMaxNum = std::stoi(q1LabelsArgs);
+   }
+   if(q1PllArgs != nullptr) {
+      fileIndexes.landmarkLabelBytes = std::stoull(q1PllArgs)<<20;
+   }
+   if(q4CacheArgs != nullptr) {
+      fileIndexes.query4CacheBytes = std::stoull(q4CacheArgs)<<20;
+   }
+   fileIndexes.personOrder = awfy::reorder::parseOrder(reorderArgs);
+   awfy::QueryArena::useHugePages(arenaArgs != nullptr && string(arenaArgs) == "huge");
+   awfy::counters::Trace::enabled = traceArgs != nullptr;
+   awfy::counters::HardwareCounters::enabled = argsParser.existsOption("-perf");
+   if(snapshotArgs != nullptr && fileIndexes.personOrder != awfy::reorder::Order::None) {
+      LOG_PRINT("[Snapshot] Ignoring " << snapshotArgs << ", snapshots hold the file order of the persons");
+   } else if(snapshotArgs != nullptr && !snapshot::load(snapshotArgs, dataPath, fileIndexes)) {
+      fileIndexes.snapshotPath = snapshotArgs;
+   }
 
    size_t failureCnt=0;
    size_t successCnt=0;
@@ -150,17 +193,30 @@ int main(int argc, char **argv) {
       threadCounts.initThread();
       threadCounts.startTask(TaskGraph::Initialize);
 
-      Scheduler scheduler(counters);
+      Scheduler scheduler(counters, schedulerKind, hardwareThreads);
       ScheduleGraph taskGraph(scheduler);
 
       queryfiles::QueryFileParser queries(queryFile);
       queryfiles::QueryBatcher batches(queries);
       runtime::QueryState queryState(taskGraph, scheduler, fileIndexes);
+      if(admissionArgs != nullptr && string(admissionArgs) == "lpt") {
+         queryState.costs.enable("");
+      }
 
       initScheduleGraph<ValidateAnswers, ParseBatchesFiletered>(scheduler, taskGraph, fileIndexes, dataPath, batches, queryState, excludes,
          ValidateAnswers(taskGraph, answerPath, batches, quickFail, failureCnt, successCnt, queryCnt, end));
 
       executeTaskGraph(hardwareThreads, scheduler, counters, threadCounts);
+      if(queryState.costs.enabled()) {
+         queryState.costs.print(cout);
+      }
+      if(traceArgs != nullptr) {
+         // Every run overwrites the trace, it shows the last one
+         counters.writeTrace(traceArgs);
+      }
+      if(awfy::counters::HardwareCounters::enabled) {
+         counters.printHardwareStats(cout);
+      }
    }
 
    auto endMemory = metrics::MemorySensor::measure();
@@ -170,6 +226,9 @@ int main(int argc, char **argv) {
    cout<<"Tested "<<queryCnt<<" queries with "<<hardwareThreads<<" threads"<<endl;
    cout<<"(#Queries\tSuccess\t\tFailure\t\tIndex Time(ms)\tQuery Time(ms)\tTotal Time(ms))\tIndex Memory(kb)\tTotal Memory(kb)"<<endl;
    cout<<queryCnt<<"\t\t"<<successCnt<<"\t\t"<<failureCnt<<"\t\t"<<totalDuration/workFactor<<"\t\t"<<totalDuration<<"\t\t"<<totalDuration<<"\t\t"<<totalMemory<<"\t\t"<<totalMemory<<endl;
+   if(Query4::TagCache::get().enabled()) {
+      Query4::TagCache::get().print(cout);
+   }
 
    if(failureCnt==0) {
       return 0;
@@ -0,0 +1,700 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "include/updates.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <sys/stat.h>
+#include "include/indexers.hpp"
+#include "include/tokenize.hpp"
+#include "include/util/log.hpp"
+
+namespace awfy {
+namespace updates {
+
+static const uint32_t minSlack=4; // Free slots of every list, new persons start with this capacity
+static const uint32_t slackDivisor=4; // Lists get a quarter of their size as free slots
+static const size_t deltaDivisor=4; // The delta segment gets a quarter of the size of all lists
+static const uint32_t interestPadding=4; // The interest intersection may load 16 bytes at once
+static const PersonId unknownPerson=std::numeric_limits<PersonId>::max();
+
+/// Interest list of persons without interests
+static const uint32_t emptyInterests[1+interestPadding] = {0, UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX};
+
+UpdateStats::UpdateStats()
+   : persons(0), knows(0), replies(0), interests(0), places(0), members(0), skipped(0), compactions(0), duration(0)
+{ }
+
+std::string UpdateStats::toString() const {
+   std::ostringstream output;
+   output<<"persons="<<persons<<" knows="<<knows<<" replies="<<replies<<" interests="<<interests<<" places="<<places
+      <<" members="<<members<<" skipped="<<skipped<<" compactions="<<compactions<<" ms="<<duration/1000;
+   return output.str();
+}
+
+/// Missing and empty files are not part of the batch
+static bool batchFileExists(const std::string& path) {
+   struct stat fileStat;
+   return stat(path.c_str(), &fileStat)==0 && fileStat.st_size>0;
+}
+
+template<class T>
+static T* allocBuffer(size_t size) {
+   T* buffer;
+   auto ret=posix_memalign(reinterpret_cast<void**>(&buffer),64,size);
+   if(unlikely(ret!=0)) {
+      throw -1;
+   }
+   return buffer;
+}
+
+static inline bool isSeparator(const PlaceBounds* bounds) {
+   return *reinterpret_cast<const uint64_t*>(bounds)==*reinterpret_cast<const uint64_t*>(&placeSeparator);
+}
+
+static inline uint64_t replyKey(PersonId parentCreator, PersonId replier) {
+   return (static_cast<uint64_t>(parentCreator)<<32)|replier;
+}
+
+IndexUpdater::IndexUpdater(FileIndexes& indexes, const std::string& dataPath)
+   : indexes(indexes), dataPath(dataPath), graph(nullptr), graphBuffer(nullptr), commentedBuffer(nullptr), bufferSize(0), bufferUsed(0),
+     personCapacity(0), interests(nullptr), interestStats(nullptr), places(nullptr), baseCreators(nullptr)
+{
+   assert(indexes.personGraph!=nullptr);
+   const PersonId numPersons=indexes.personMapper.count();
+
+   // Restored and relabeled indexes may be read only, everything that is patched gets copied
+   rebuildGraph(numPersons+numPersons/8+minSlack);
+
+   if(indexes.birthdayIndex!=nullptr) {
+      birthdays.assign(indexes.birthdayIndex, indexes.birthdayIndex+numPersons);
+      indexes.birthdayIndex=birthdays.data();
+   }
+   if(indexes.hasInterestIndex!=nullptr) {
+      interests=new HasInterestIndex(personCapacity);
+      for(PersonId person=0; person<numPersons; person++) {
+         const auto list=indexes.hasInterestIndex->retrieve(person);
+         if(list!=nullptr) {
+            interests->insert(person, list);
+         }
+      }
+      indexes.hasInterestIndex=interests;
+   }
+   if(indexes.interestStatistics!=nullptr) {
+      interestStats=new InterestStatistics(*indexes.interestStatistics);
+      indexes.interestStatistics=interestStats;
+   }
+   if(indexes.personPlaceIndex!=nullptr) {
+      places=new PersonPlaceIndex(*indexes.personPlaceIndex);
+      // Persons without any place may be missing at the end
+      places->places.resize(numPersons, &placeSeparator);
+      indexes.personPlaceIndex=places;
+   }
+   indexes.refreshGraphCopies();
+   indexes.generation++;
+}
+
+IndexUpdater::~IndexUpdater() {
+   free(graphBuffer);
+   free(commentedBuffer);
+   delete graph;
+   delete interests;
+   delete interestStats;
+   delete places;
+   for(auto block : memberBlocks) {
+      free(block);
+   }
+   delete baseCreators;
+}
+
+/// Copies the current person graph into a new buffer with free slots behind every list and an empty delta segment
+void IndexUpdater::rebuildGraph(size_t newPersonCapacity) {
+   const PersonGraph& oldGraph=*indexes.personGraph;
+   const uint8_t* oldBase=reinterpret_cast<const uint8_t*>(oldGraph.buffer.data);
+   const uint8_t* oldCommented=reinterpret_cast<const uint8_t*>(indexes.personCommentedGraph);
+   const PersonId numPersons=indexes.personMapper.count();
+   assert(numPersons<=newPersonCapacity);
+
+   std::vector<uint32_t> newCapacities(numPersons);
+   size_t listsSize=0;
+   for(PersonId person=0; person<numPersons; person++) {
+      const auto friends=oldGraph.retrieve(person);
+      const uint32_t size=friends!=nullptr ? friends->size() : 0;
+      newCapacities[person]=size+size/slackDivisor+minSlack;
+      listsSize+=sizeof(FriendList::Size)+newCapacities[person]*sizeof(PersonId);
+   }
+   const size_t newSize=listsSize+listsSize/deltaDivisor;
+
+   uint8_t* newBase=allocBuffer<uint8_t>(newSize);
+   uint8_t* newCommented=oldCommented!=nullptr ? allocBuffer<uint8_t>(newSize) : nullptr;
+   memset(newBase, 0, newSize);
+   if(newCommented!=nullptr) {
+      memset(newCommented, 0, newSize);
+   }
+
+   PersonGraph* newGraph=new PersonGraph(newPersonCapacity);
+   newGraph->buffer.data=newBase;
+   newGraph->buffer.size=newSize;
+   size_t offset=0;
+   for(PersonId person=0; person<numPersons; person++) {
+      FriendList* list=reinterpret_cast<FriendList*>(newBase+offset);
+      const auto friends=oldGraph.retrieve(person);
+      if(friends!=nullptr) {
+         const uint32_t size=friends->size();
+         memcpy(list->getPtr(0), friends->getPtr(0), size*sizeof(PersonId));
+         list->setSize(size);
+         if(newCommented!=nullptr) {
+            const size_t oldOffset=reinterpret_cast<const uint8_t*>(friends->getPtr(0))-oldBase;
+            memcpy(newCommented+(reinterpret_cast<uint8_t*>(list->getPtr(0))-newBase), oldCommented+oldOffset, size*sizeof(PersonId));
+         }
+      } else {
+         list->setSize(0);
+      }
+      newGraph->insert(person, list);
+      offset+=sizeof(FriendList::Size)+newCapacities[person]*sizeof(PersonId);
+   }
+   assert(offset==listsSize);
+
+   // The first copy leaves the buffers of the index builders alone
+   if(graph!=nullptr) {
+      free(graphBuffer);
+      free(commentedBuffer);
+      delete graph;
+   }
+   graph=newGraph;
+   graphBuffer=newBase;
+   commentedBuffer=newCommented;
+   bufferSize=newSize;
+   bufferUsed=listsSize;
+   capacities=move(newCapacities);
+   personCapacity=newPersonCapacity;
+
+   indexes.personGraph=graph;
+   if(commentedBuffer!=nullptr) {
+      indexes.personCommentedGraph=commentedBuffer;
+   }
+}
+
+/// Takes an empty list from the delta segment, returns null if the segment is exhausted
+IndexUpdater::FriendList* IndexUpdater::allocateList(PersonId person, uint32_t capacity) {
+   const size_t listSize=sizeof(FriendList::Size)+capacity*sizeof(PersonId);
+   if(bufferUsed+listSize>bufferSize) {
+      return nullptr;
+   }
+   FriendList* list=reinterpret_cast<FriendList*>(graphBuffer+bufferUsed);
+   bufferUsed+=listSize;
+   capacities[person]=capacity;
+   return list;
+}
+
+/// Adds the directed edge, returns false if it exists already
+bool IndexUpdater::addFriend(PersonId person, PersonId friendId, UpdateStats& stats) {
+   FriendList* friends=graph->retrieve(person);
+   if(friends->find(friendId)!=nullptr) {
+      return false;
+   }
+
+   const uint32_t size=friends->size();
+   if(size==capacities[person]) {
+      FriendList* moved=allocateList(person, 2*size+minSlack);
+      if(moved==nullptr) {
+         rebuildGraph(personCapacity);
+         stats.compactions++;
+         friends=graph->retrieve(person);
+      } else {
+         memcpy(moved, friends, sizeof(FriendList::Size)+size*sizeof(PersonId));
+         if(commentedBuffer!=nullptr) {
+            const size_t oldOffset=reinterpret_cast<uint8_t*>(friends)-graphBuffer;
+            const size_t newOffset=reinterpret_cast<uint8_t*>(moved)-graphBuffer;
+            memcpy(commentedBuffer+newOffset, commentedBuffer+oldOffset, sizeof(FriendList::Size)+size*sizeof(PersonId));
+         }
+         graph->insert(person, moved);
+         friends=moved;
+      }
+   }
+   assert(friends->size()<capacities[person]);
+
+   PersonId* entry=friends->getPtr(size);
+   *entry=friendId;
+   friends->setSize(size+1);
+   if(commentedBuffer!=nullptr) {
+      // Replies of earlier batches that waited for the friendship
+      uint32_t replies=0;
+      auto pending=pendingReplies.find(replyKey(person, friendId));
+      if(pending!=pendingReplies.end()) {
+         replies=pending->second;
+         pendingReplies.erase(pending);
+         stats.replies+=replies;
+      }
+      *reinterpret_cast<uint32_t*>(commentedBuffer+(reinterpret_cast<uint8_t*>(entry)-graphBuffer))=replies;
+   }
+   return true;
+}
+
+/// Extends all person indexes to the new number of persons, new persons have no friends, interests and places
+void IndexUpdater::growPersons(PersonId numPersons, UpdateStats& stats) {
+   const PersonId oldCount=indexes.personMapper.count();
+   if(numPersons<=oldCount) {
+      return;
+   }
+
+   indexes.personMapper.grow(numPersons);
+   if(indexes.personMapper.relabeled()) {
+      // New persons keep their ids
+      for(PersonId person=oldCount; person<numPersons; person++) {
+         indexes.relabeledPersonIds.push_back(person);
+         indexes.originalPersonIds.push_back(person);
+      }
+      indexes.personMapper.relabel(indexes.relabeledPersonIds.data(), indexes.originalPersonIds.data());
+   }
+
+   if(numPersons>personCapacity) {
+      const size_t newCapacity=numPersons+numPersons/8+minSlack;
+      if(interests!=nullptr) {
+         HasInterestIndex* grown=new HasInterestIndex(newCapacity);
+         for(PersonId person=0; person<oldCount; person++) {
+            const auto list=interests->retrieve(person);
+            if(list!=nullptr) {
+               grown->insert(person, list);
+            }
+         }
+         delete interests;
+         interests=grown;
+         indexes.hasInterestIndex=interests;
+      }
+      // Creates the empty lists of the new persons
+      rebuildGraph(newCapacity);
+      stats.compactions++;
+   } else {
+      capacities.resize(numPersons);
+      for(PersonId person=oldCount; person<numPersons; person++) {
+         FriendList* list=allocateList(person, minSlack);
+         if(list==nullptr) {
+            rebuildGraph(personCapacity);
+            stats.compactions++;
+            break;
+         }
+         list->setSize(0);
+         graph->insert(person, list);
+      }
+   }
+
+   if(interests!=nullptr) {
+      for(PersonId person=oldCount; person<numPersons; person++) {
+         interests->insert(person, reinterpret_cast<HasInterestIndex::Content>(const_cast<uint32_t*>(emptyInterests)));
+      }
+   }
+   if(indexes.birthdayIndex!=nullptr) {
+      birthdays.resize(numPersons, 0);
+      indexes.birthdayIndex=birthdays.data();
+   }
+   if(places!=nullptr) {
+      places->places.resize(numPersons, &placeSeparator);
+   }
+}
+
+/// Creator of a comment of the base data or of an earlier batch
+PersonId IndexUpdater::creatorOf(uint64_t comment) {
+   auto creator=commentCreators.find(comment);
+   if(creator!=commentCreators.end()) {
+      return creator->second;
+   }
+
+   if(baseCreators==nullptr) {
+      const std::string path=dataPath+"comment_hasCreator_person.csv";
+      if(!batchFileExists(path)) {
+         return unknownPerson;
+      }
+      baseCreators=new io::MmapedFile(path, O_RDONLY);
+   }
+
+   // Binary search over the lines, the file is sorted by comment id
+   const char* data=reinterpret_cast<const char*>(baseCreators->mapping);
+   const char* begin=static_cast<const char*>(memchr(data, '\n', baseCreators->size));
+   const char* end=data+baseCreators->size;
+   if(begin==nullptr) {
+      return unknownPerson;
+   }
+   begin++;
+   while(begin<end) {
+      const char* line=begin+(end-begin)/2;
+      while(line>begin && line[-1]!='\n') {
+         line--;
+      }
+      const char* pos=line;
+      uint64_t id=0;
+      while(pos<end && *pos>='0' && *pos<='9') {
+         id=id*10+(*pos-'0');
+         pos++;
+      }
+      uint64_t person=0;
+      for(pos++; pos<end && *pos>='0' && *pos<='9'; pos++) {
+         person=person*10+(*pos-'0');
+      }
+      if(id==comment) {
+         return person<indexes.personMapper.count() ? indexes.personMapper.map(person) : unknownPerson;
+      }
+      if(id<comment) {
+         const char* next=static_cast<const char*>(memchr(pos, '\n', end-pos));
+         begin=next!=nullptr ? next+1 : end;
+      } else {
+         end=line;
+      }
+   }
+   return unknownPerson;
+}
+
+void IndexUpdater::applyPersons(const std::string& batchPath, UpdateStats& stats) {
+   const std::string path=batchPath+"person.csv";
+   if(!batchFileExists(path)) {
+      return;
+   }
+   io::MmapedFile file(path, O_RDONLY);
+   tokenize::Tokenizer tokenizer(file);
+
+   std::vector<std::pair<PersonId,Birthday>> newPersons;
+   PersonId numPersons=indexes.personMapper.count();
+   tokenizer.skipAfter('\n'); // Skip header
+   while(!tokenizer.finished()) {
+      const PersonId person=tokenizer.consumeLong('|');
+      tokenizer.skipAfter('|'); //firstName
+      tokenizer.skipAfter('|'); //lastName
+      tokenizer.skipAfter('|'); //gender
+      const Birthday birthday=tokenizer.consumeBirthday();
+      tokenizer.skipAfter('\n');
+
+      // Persons are never changed
+      if(person<indexes.personMapper.count()) {
+         stats.skipped++;
+         continue;
+      }
+      newPersons.push_back(std::make_pair(person, birthday));
+      numPersons=std::max(numPersons, person+1);
+   }
+
+   growPersons(numPersons, stats);
+   for(auto iter=newPersons.cbegin(); iter!=newPersons.cend(); iter++) {
+      if(indexes.birthdayIndex!=nullptr) {
+         birthdays[indexes.personMapper.map(iter->first)]=iter->second;
+      }
+      stats.persons++;
+   }
+}
+
+void IndexUpdater::applyPlaces(const std::string& batchPath, UpdateStats& stats) {
+   if(places==nullptr) {
+      return;
+   }
+   const PlaceBoundsIndex& boundsIndex=*indexes.placeBoundsIndex;
+   auto addPlace=[&](uint64_t original, PlaceId place) {
+      const auto bounds=boundsIndex.find(place);
+      if(original>=indexes.personMapper.count() || bounds==boundsIndex.end()) {
+         stats.skipped++;
+         return;
+      }
+      const PersonId person=indexes.personMapper.map(original);
+      auto& list=placeLists[person];
+      if(list.empty()) {
+         for(const PlaceBounds* current=places->places[person]; current!=nullptr && !isSeparator(current); current++) {
+            list.push_back(*current);
+         }
+      } else {
+         list.pop_back(); // Separator
+      }
+      list.push_back(bounds->second);
+      list.push_back(placeSeparator);
+      places->places[person]=list.data();
+      stats.places++;
+   };
+
+   const std::string locatedPath=batchPath+"person_isLocatedIn_place.csv";
+   if(batchFileExists(locatedPath)) {
+      io::MmapedFile file(locatedPath, O_RDONLY);
+      tokenize::Tokenizer tokenizer(file);
+      tokenizer.skipAfter('\n'); // Skip header
+      while(!tokenizer.finished()) {
+         auto result=tokenizer.consumeLongLongDistinctDelimiter('|','\n');
+         addPlace(result.first, result.second);
+      }
+   }
+
+   const std::string organizationFiles[] = { "person_studyAt_organisation.csv", "person_workAt_organisation.csv" };
+   for(auto& fileName : organizationFiles) {
+      const std::string path=batchPath+fileName;
+      if(!batchFileExists(path)) {
+         continue;
+      }
+      if(organizationPlaces.empty()) {
+         organizationPlaces=buildOrganizationPlaceIndex(dataPath);
+      }
+      io::MmapedFile file(path, O_RDONLY);
+      tokenize::Tokenizer tokenizer(file);
+      tokenizer.skipAfter('\n'); // Skip header
+      while(!tokenizer.finished()) {
+         auto result=tokenizer.consumeLongLongSingleDelimiter('|');
+         tokenizer.skipAfter('\n');
+         const uint64_t organization=result.second/10;
+         if(organization>=organizationPlaces.size()) {
+            stats.skipped++;
+            continue;
+         }
+         addPlace(result.first, organizationPlaces[organization]);
+      }
+   }
+}
+
+void IndexUpdater::applyInterests(const std::string& batchPath, UpdateStats& stats) {
+   const std::string path=batchPath+"person_hasInterest_tag.csv";
+   if(interests==nullptr || !batchFileExists(path)) {
+      return;
+   }
+
+   std::unordered_map<InterestId,size_t> statPositions;
+   if(interestStats!=nullptr) {
+      for(size_t i=0; i<interestStats->size(); i++) {
+         statPositions[(*interestStats)[i].interest]=i;
+      }
+   }
+
+   io::MmapedFile file(path, O_RDONLY);
+   tokenize::Tokenizer tokenizer(file);
+   tokenizer.skipAfter('\n'); // Skip header
+   while(!tokenizer.finished()) {
+      auto result=tokenizer.consumeLongLongDistinctDelimiter('|','\n');
+      const InterestId interest=result.second;
+      if(result.first>=indexes.personMapper.count() || (indexes.tagIndex!=nullptr && indexes.tagIndex->idToStr.retrieve(interest).str==nullptr)) {
+         stats.skipped++;
+         continue;
+      }
+      const PersonId person=indexes.personMapper.map(result.first);
+
+      // Lists stay sorted for the intersection of Q3
+      auto& list=interestLists[person];
+      if(list.empty()) {
+         const auto current=interests->retrieve(person);
+         const uint32_t size=current!=nullptr ? current->size() : 0;
+         list.push_back(size);
+         for(uint32_t i=0; i<size; i++) {
+            list.push_back(*current->getPtr(i));
+         }
+         list.insert(list.end(), interestPadding, UINT32_MAX);
+      }
+      const auto entriesEnd=list.begin()+1+list[0];
+      const auto position=std::lower_bound(list.begin()+1, entriesEnd, interest);
+      if(position!=entriesEnd && *position==interest) {
+         stats.skipped++;
+         continue;
+      }
+      list.insert(position, interest);
+      list[0]++;
+      interests->insert(person, reinterpret_cast<HasInterestIndex::Content>(list.data()));
+      stats.interests++;
+
+      if(interestStats!=nullptr) {
+         auto statPosition=statPositions.find(interest);
+         if(statPosition==statPositions.end()) {
+            statPosition=statPositions.insert(std::make_pair(interest, interestStats->size())).first;
+            interestStats->push_back(InterestStat(interest));
+         }
+         InterestStat& stat=(*interestStats)[statPosition->second];
+         stat.numPersons++;
+         if(indexes.birthdayIndex!=nullptr) {
+            stat.maxBirthday=std::max(stat.maxBirthday, indexes.birthdayIndex[person]);
+         }
+      }
+   }
+
+   if(interestStats!=nullptr) {
+      std::sort(interestStats->begin(), interestStats->end(), [](const InterestStat& a, const InterestStat& b) {
+         return a.numPersons>b.numPersons;
+      });
+   }
+}
+
+void IndexUpdater::applyKnows(const std::string& batchPath, UpdateStats& stats) {
+   const std::string path=batchPath+"person_knows_person.csv";
+   if(!batchFileExists(path)) {
+      return;
+   }
+   io::MmapedFile file(path, O_RDONLY);
+   tokenize::Tokenizer tokenizer(file);
+   tokenizer.skipAfter('\n'); // Skip header
+   while(!tokenizer.finished()) {
+      auto result=tokenizer.consumeLongLongDistinctDelimiter('|','\n');
+      const auto numPersons=indexes.personMapper.count();
+      if(result.first>=numPersons || result.second>=numPersons || result.first==result.second) {
+         stats.skipped++;
+         continue;
+      }
+      // The data lists both directions, a single direction is enough for an update
+      const PersonId person=indexes.personMapper.map(result.first);
+      const PersonId friendId=indexes.personMapper.map(result.second);
+      const bool added=addFriend(person, friendId, stats);
+      if(addFriend(friendId, person, stats) || added) {
+         stats.knows++;
+      } else {
+         stats.skipped++;
+      }
+   }
+}
+
+void IndexUpdater::applyComments(const std::string& batchPath, UpdateStats& stats) {
+   const std::string creatorPath=batchPath+"comment_hasCreator_person.csv";
+   if(batchFileExists(creatorPath)) {
+      io::MmapedFile file(creatorPath, O_RDONLY);
+      tokenize::Tokenizer tokenizer(file);
+      tokenizer.skipAfter('\n'); // Skip header
+      while(!tokenizer.finished()) {
+         auto result=tokenizer.consumeLongLongDistinctDelimiter('|','\n');
+         if(result.second>=indexes.personMapper.count()) {
+            stats.skipped++;
+            continue;
+         }
+         commentCreators[result.first]=indexes.personMapper.map(result.second);
+      }
+   }
+
+   const std::string replyPath=batchPath+"comment_replyOf_comment.csv";
+   if(commentedBuffer==nullptr || !batchFileExists(replyPath)) {
+      return;
+   }
+   io::MmapedFile file(replyPath, O_RDONLY);
+   tokenize::Tokenizer tokenizer(file);
+   tokenizer.skipAfter('\n'); // Skip header
+   while(!tokenizer.finished()) {
+      auto result=tokenizer.consumeLongLongDistinctDelimiter('|','\n');
+      const PersonId replier=creatorOf(result.first);
+      const PersonId parentCreator=creatorOf(result.second);
+      if(replier==unknownPerson || parentCreator==unknownPerson) {
+         stats.skipped++;
+         continue;
+      }
+      // Self references are not counted, see the commented graph builder
+      if(replier==parentCreator) {
+         continue;
+      }
+
+      // The count is stored in the list of the parent creator at the entry of the replier
+      const auto friends=graph->retrieve(parentCreator);
+      const PersonId* entry=friends->find(replier);
+      if(entry==nullptr) {
+         pendingReplies[replyKey(parentCreator, replier)]++;
+         continue;
+      }
+      (*reinterpret_cast<uint32_t*>(commentedBuffer+(reinterpret_cast<const uint8_t*>(entry)-graphBuffer)))++;
+      stats.replies++;
+   }
+}
+
+void IndexUpdater::applyMembers(const std::string& batchPath, UpdateStats& stats) {
+   typedef std::remove_pointer<HasMemberIndex::Content>::type MemberList;
+   const std::string path=batchPath+"forum_hasMember_person.csv";
+   if(indexes.hasMemberIndex==nullptr || !batchFileExists(path)) {
+      return;
+   }
+
+   // Member lists only exist for the forums of used tags
+   const auto& forums=indexes.tagInForumsIndex.forums;
+   std::unordered_map<ForumId,std::vector<PersonId>> newMembers;
+   io::MmapedFile file(path, O_RDONLY);
+   tokenize::Tokenizer tokenizer(file);
+   tokenizer.skipAfter('\n'); // Skip header
+   while(!tokenizer.finished()) {
+      auto result=tokenizer.consumeLongLongSingleDelimiter('|');
+      tokenizer.skipAfter('\n'); //joinDate
+      if(result.second>=indexes.personMapper.count() || forums.find(result.first)==forums.end()) {
+         stats.skipped++;
+         continue;
+      }
+      newMembers[result.first].push_back(indexes.personMapper.map(result.second));
+   }
+
+   HasMemberIndex& members=const_cast<HasMemberIndex&>(*indexes.hasMemberIndex);
+   for(auto forumIter=newMembers.begin(); forumIter!=newMembers.end(); forumIter++) {
+      auto& forumMembers=forumIter->second;
+      std::sort(forumMembers.begin(), forumMembers.end());
+      forumMembers.erase(std::unique(forumMembers.begin(), forumMembers.end()), forumMembers.end());
+
+      MemberList* memberList=members.retrieve(forumIter->first);
+      if(memberList!=members.end()) {
+         auto list=memberList->firstList();
+         do {
+            for(uint32_t i=0; i<list->size(); i++) {
+               const auto existing=std::lower_bound(forumMembers.begin(), forumMembers.end(), *list->getPtr(i));
+               if(existing!=forumMembers.end() && *existing==*list->getPtr(i)) {
+                  forumMembers.erase(existing);
+                  stats.skipped++;
+               }
+            }
+         } while((list=memberList->nextList(list))!=nullptr);
+      }
+      const uint32_t numMembers=forumMembers.size();
+      if(numMembers==0) {
+         continue;
+      }
+
+      const size_t chunkSize=sizeof(MemberList::Size)+numMembers*sizeof(PersonId)+sizeof(MemberList::ListType*);
+      MemberList::ListType* chunk;
+      if(memberList==members.end()) {
+         uint8_t* block=allocBuffer<uint8_t>(sizeof(MemberList)+chunkSize);
+         MemberList::create(numMembers, reinterpret_cast<char*>(block));
+         memberList=reinterpret_cast<MemberList*>(block);
+         members.insert(forumIter->first, memberList);
+         chunk=memberList->firstList();
+         memberBlocks.push_back(block);
+      } else {
+         uint8_t* block=allocBuffer<uint8_t>(chunkSize);
+         memberList->appendList(numMembers, reinterpret_cast<char*>(block));
+         chunk=reinterpret_cast<MemberList::ListType*>(block);
+         memberBlocks.push_back(block);
+      }
+      std::copy(forumMembers.begin(), forumMembers.end(), chunk->getPtr(0));
+      stats.members+=numMembers;
+   }
+}
+
+UpdateStats IndexUpdater::apply(const std::string& batchPath) {
+   UpdateStats stats;
+   const auto start=awfy::chrono::now();
+   std::string path=batchPath;
+   if(!path.empty() && path.back()!='/') {
+      path+='/';
+   }
+
+   // Persons first, all other rows may refer to them
+   applyPersons(path, stats);
+   applyPlaces(path, stats);
+   applyInterests(path, stats);
+   applyKnows(path, stats);
+   applyComments(path, stats);
+   applyMembers(path, stats);
+
+   indexes.refreshGraphCopies();
+   indexes.generation++;
+   stats.duration=awfy::chrono::now()-start;
+   LOG_PRINT("[Updates] Applied "<<path<<": "<<stats.toString());
+   return stats;
+}
+
+void IndexUpdater::compact() {
+   rebuildGraph(personCapacity);
+   indexes.refreshGraphCopies();
+   indexes.generation++;
+}
+
+}
+}
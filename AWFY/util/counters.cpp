@@ -17,9 +17,13 @@ limitations under the License.
 #include "../include/util/log.hpp"
 #include <sys/types.h>
 #include <assert.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
 
 #include "../include/util/counters.hpp"
 #include "../include/util/memoryhooks.hpp"
+#include "../include/util/numa.hpp"
 #include "../include/schedulegraph.hpp"
 #include "../include/compatibility.hpp"
 
@@ -27,6 +31,10 @@ namespace awfy {
    namespace counters {
 
 __thread uint64_t CurrentThread::id=0;
+bool Trace::enabled=false;
+__thread const char* Trace::label=nullptr;
+bool HardwareCounters::enabled=false;
+const char* HardwareCounters::names[HardwareCounters::numEvents]={ "cycles", "instructions", "LLC misses", "dTLB misses", "branch misses" };
 
 //--- Memory hook functions
 static volatile __thread TaskCounters* currentTask;
@@ -37,6 +45,12 @@ void countMemory(size_t size) {
    currentTask->allocatedMemory+=size;
 }
 
+static __thread TraceEvent* currentEvent;
+void countTraceMemory(size_t size) {
+   currentEvent->numAllocations++;
+   currentEvent->allocatedMemory+=size;
+}
+
 AllocationStats::AllocationStats() : totalBytes(0), totalAllocations(0) {
 
 }
@@ -62,7 +76,7 @@ void TaskCounters::end() {
 }
 
 //--- ThreadCounters methods
-ThreadCounters::ThreadCounters(const unsigned threadId) : threadId(threadId) {
+ThreadCounters::ThreadCounters(const unsigned threadId) : threadId(threadId), currentGroupId(0) {
 }
 
 ThreadCounters::~ThreadCounters() {
@@ -117,21 +131,54 @@ void ThreadCounters::endStalled() {
    #endif
 }
 
-#ifdef DEBUG
 void ThreadCounters::startTask(unsigned groupId) {
+   #ifdef DEBUG
    TaskCounters* counters = new TaskCounters();
    counters->groupId=groupId;
    counters->start();
    taskCounters.push_back(counters);
+   #endif
+   if(hardwareEvents!=nullptr) {
+      currentGroupId=groupId;
+      hardwareEvents->read(hardwareStart);
+   }
+   if(Trace::enabled) {
+      Trace::label=nullptr;
+      traceEvents.push_back(TraceEvent { awfy::chrono::now(), 0, groupId, nullptr, 0, 0 });
+      #ifndef DEBUG
+      // Debug builds count the allocations in the task counters
+      currentEvent=&traceEvents.back();
+      awfy::memoryhooks::CurrentThread::report_fn=countTraceMemory;
+      #endif
+   }
 }
-#else
-void ThreadCounters::startTask(unsigned) { }
-#endif
 
 void ThreadCounters::endTask() {
    #ifdef DEBUG
    taskCounters[taskCounters.size()-1]->end();
    #endif
+   if(hardwareEvents!=nullptr) {
+      uint64_t hardwareEnd[HardwareCounters::numEvents];
+      hardwareEvents->read(hardwareEnd);
+      if(currentGroupId>=hardwareStats.size()) { hardwareStats.resize(currentGroupId+1, HardwareStats()); }
+      auto& stats=hardwareStats[currentGroupId];
+      stats.numTasks++;
+      for(unsigned i=0; i<HardwareCounters::numEvents; i++) {
+         stats.events[i]+=hardwareEnd[i]-hardwareStart[i];
+      }
+   }
+   if(Trace::enabled && !traceEvents.empty()) {
+      auto& event=traceEvents.back();
+      #ifdef DEBUG
+      event.numAllocations=taskCounters.back()->numAllocations;
+      event.allocatedMemory=taskCounters.back()->allocatedMemory;
+      #else
+      awfy::memoryhooks::CurrentThread::report_fn=nullptr;
+      currentEvent=nullptr;
+      #endif
+      event.end=awfy::chrono::now();
+      event.label=Trace::label;
+   }
 }
 
 TaskCounters& ThreadCounters::currentTaskCounters() {
@@ -152,6 +199,18 @@ AllocationStats ThreadCounters::getAllocationStats() {
 
 void ThreadCounters::initThread() {
    CurrentThread::id=threadId;
+   if(HardwareCounters::enabled) {
+      // Same order as HardwareCounters::names
+      hardwareEvents.reset(new awfy::perf::CounterGroup());
+      hardwareEvents->add(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+      hardwareEvents->add(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+      hardwareEvents->add(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+      hardwareEvents->add(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB|(PERF_COUNT_HW_CACHE_OP_READ<<8)|(PERF_COUNT_HW_CACHE_RESULT_MISS<<16));
+      hardwareEvents->add(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+      if(!hardwareEvents->valid()) {
+         hardwareEvents.reset();
+      }
+   }
 }
 
 //--- ProgramCounters methods
@@ -161,8 +220,19 @@ ProgramCounters::ProgramCounters(unsigned numThreads) : nextThreadId(0), schedul
 
 ProgramCounters::~ProgramCounters() {
    #ifdef DEBUG
-   threadCounters.clear(); // Force destructor call of TaskCounters
    auto stats=getAllocationStats();
+   // The query groups count the allocations of their batches and sub tasks
+   std::vector<AllocationStats> groupStats;
+   for (unsigned i = 0; i < threadCounters.size(); ++i) {
+      auto& taskCounters=threadCounters[i].taskCounters;
+      for (unsigned j = 0; j < taskCounters.size(); ++j) {
+         auto& taskCount=*taskCounters[j];
+         if(taskCount.groupId>=groupStats.size()) { groupStats.resize(taskCount.groupId+1); }
+         groupStats[taskCount.groupId].totalBytes+=taskCount.allocatedMemory;
+         groupStats[taskCount.groupId].totalAllocations+=taskCount.numAllocations;
+      }
+   }
+   threadCounters.clear(); // Force destructor call of TaskCounters
    uint64_t noWorkTime=0;
    for (unsigned i = 0; i < emptyScheduler.size(); ++i) {
       awfy::chrono::TimeFrame& timeFrame=emptyScheduler[i];
@@ -173,6 +243,10 @@ ProgramCounters::~ProgramCounters() {
    }
    LOG_PRINT("[ProgramCounters] Total scheduled tasks: "<<scheduledTasks);
    LOG_PRINT("[ProgramCounters] Total allocated memory: "<<stats.totalBytes<<" in "<<stats.totalAllocations<<" allocations");
+   for (unsigned i = 0; i < groupStats.size(); ++i) {
+      if(groupStats[i].totalAllocations==0) { continue; }
+      LOG_PRINT("[ProgramCounters] "<<TaskGraph::getName((TaskGraph::Node)i)<<" allocated memory: "<<groupStats[i].totalBytes<<" in "<<groupStats[i].totalAllocations<<" allocations");
+   }
    #endif
 }
 
@@ -201,6 +275,111 @@ void ProgramCounters::printStats() {
    #endif
 }
 
+namespace {
+   void writeTraceEvent(std::ostream& out, bool& first, const std::string& name, const char* category, char phase, unsigned threadId, awfy::chrono::Time time) {
+      out<<(first ? "\n" : ",\n")<<"{\"name\":\""<<name<<"\",\"cat\":\""<<category<<"\",\"ph\":\""<<phase<<"\",\"pid\":1,\"tid\":"<<threadId<<",\"ts\":"<<time;
+      first=false;
+   }
+}
+
+void ProgramCounters::writeTrace(const std::string& path) {
+   std::ofstream out(path);
+   if(!out) {
+      std::cerr<<"[Trace] Could not open "<<path<<std::endl;
+      return;
+   }
+
+   awfy::chrono::Time origin=~awfy::chrono::Time(0);
+   for(const auto& thread : threadCounters) {
+      for(const auto& event : thread.traceEvents) {
+         origin=std::min(origin, event.start);
+      }
+   }
+
+   // Tasks are complete events on the track of their executor, the allocations are counted per executor
+   std::vector<std::pair<awfy::chrono::Time,awfy::chrono::Time>> nodeTimes;
+   uint64_t numEvents=0;
+   bool first=true;
+   out<<"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+   for(const auto& thread : threadCounters) {
+      out<<(first ? "\n" : ",\n")<<"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"<<thread.threadId<<",\"args\":{\"name\":\"Executor "<<thread.threadId<<"\"}}";
+      first=false;
+      size_t allocations=0, allocatedMemory=0;
+      for(const auto& event : thread.traceEvents) {
+         if(event.end==0) { continue; } // Still running when the trace was written
+         const auto groupName=TaskGraph::getName((TaskGraph::Node)event.groupId);
+         const auto name=event.label!=nullptr ? groupName+" "+event.label : groupName;
+         writeTraceEvent(out, first, name, event.label!=nullptr ? event.label : "task", 'X', thread.threadId, event.start-origin);
+         out<<",\"dur\":"<<event.end-event.start<<",\"args\":{\"allocations\":"<<event.numAllocations<<",\"bytes\":"<<event.allocatedMemory<<"}}";
+
+         allocations+=event.numAllocations;
+         allocatedMemory+=event.allocatedMemory;
+         writeTraceEvent(out, first, "Executor "+std::to_string(thread.threadId)+" allocations", "memory", 'C', thread.threadId, event.end-origin);
+         out<<",\"args\":{\"allocations\":"<<allocations<<",\"kb\":"<<allocatedMemory/1024<<"}}";
+
+         if(event.groupId>=nodeTimes.size()) { nodeTimes.resize(event.groupId+1, std::make_pair(~awfy::chrono::Time(0), 0)); }
+         nodeTimes[event.groupId].first=std::min(nodeTimes[event.groupId].first, event.start);
+         nodeTimes[event.groupId].second=std::max(nodeTimes[event.groupId].second, event.end);
+         numEvents++;
+      }
+   }
+
+   // Task graph nodes span from their first to the end of their last task, async events get a row each
+   for(unsigned node=0; node<nodeTimes.size(); node++) {
+      if(nodeTimes[node].second==0) { continue; }
+      const auto name=TaskGraph::getName((TaskGraph::Node)node);
+      writeTraceEvent(out, first, name, "graph", 'b', 0, nodeTimes[node].first-origin);
+      out<<",\"id\":"<<node<<"}";
+      writeTraceEvent(out, first, name, "graph", 'e', 0, nodeTimes[node].second-origin);
+      out<<",\"id\":"<<node<<"}";
+   }
+   out<<"\n]}"<<std::endl;
+   std::cerr<<"[Trace] Wrote "<<numEvents<<" tasks to "<<path<<std::endl;
+}
+
+void ProgramCounters::printHardwareStats(std::ostream& out) {
+   std::vector<HardwareStats> groupStats;
+   bool counted[HardwareCounters::numEvents]={ false, false, false, false, false };
+   for(const auto& thread : threadCounters) {
+      if(thread.hardwareEvents==nullptr) { continue; }
+      for(unsigned i=0; i<HardwareCounters::numEvents; i++) {
+         counted[i]|=thread.hardwareEvents->valid(i);
+      }
+      if(thread.hardwareStats.size()>groupStats.size()) { groupStats.resize(thread.hardwareStats.size(), HardwareStats()); }
+      for(unsigned group=0; group<thread.hardwareStats.size(); group++) {
+         groupStats[group].numTasks+=thread.hardwareStats[group].numTasks;
+         for(unsigned i=0; i<HardwareCounters::numEvents; i++) {
+            groupStats[group].events[i]+=thread.hardwareStats[group].events[i];
+         }
+      }
+   }
+   if(groupStats.empty()) {
+      std::ifstream paranoid("/proc/sys/kernel/perf_event_paranoid");
+      std::string level="unknown";
+      paranoid>>level;
+      out<<"[Perf] Hardware counters are not available, perf_event_paranoid is "<<level<<std::endl;
+      return;
+   }
+
+   for(unsigned group=0; group<groupStats.size(); group++) {
+      const auto& stats=groupStats[group];
+      if(stats.numTasks==0) { continue; }
+      out<<"[Perf] "<<TaskGraph::getName((TaskGraph::Node)group)<<": "<<stats.numTasks<<" tasks";
+      for(unsigned i=0; i<HardwareCounters::numEvents; i++) {
+         out<<", "<<HardwareCounters::names[i]<<" ";
+         if(counted[i]) { out<<stats.events[i]; } else { out<<"n/a"; }
+      }
+      // Instructions per cycle and LLC misses per thousand instructions tell compute from memory bound phases
+      if(counted[0] && counted[1] && stats.events[0]>0) {
+         out<<", IPC "<<static_cast<double>(stats.events[1])/stats.events[0];
+      }
+      if(counted[1] && counted[2] && stats.events[1]>0) {
+         out<<", LLC MPKI "<<1000.0*stats.events[2]/stats.events[1];
+      }
+      out<<std::endl;
+   }
+}
+
 ThreadCounters& ProgramCounters::getThreadCounters() {
    threadCounters.emplace_back(nextThreadId++);
    return threadCounters[threadCounters.size()-1];
@@ -241,5 +420,66 @@ AllocationStats ProgramCounters::getAllocationStats() {
    return stats;
 }
 
+//--- NumaCounters methods
+awfy::atomic<uint64_t> NumaCounters::localTasks[NumaCounters::maxNodes];
+awfy::atomic<uint64_t> NumaCounters::remoteTasks[NumaCounters::maxNodes];
+awfy::atomic<uint64_t> NumaCounters::placedBytes[NumaCounters::maxNodes];
+awfy::atomic<uint64_t> NumaCounters::placementTime[NumaCounters::maxNodes];
+std::vector<std::pair<uint64_t,uint64_t>> NumaCounters::startPages;
+
+/// Reads the local_node and other_node page counts of the node
+static std::pair<uint64_t,uint64_t> readNumastat(unsigned nodeId) {
+   std::pair<uint64_t,uint64_t> pages(0, 0);
+   std::ifstream numastat("/sys/devices/system/node/node"+std::to_string(nodeId)+"/numastat");
+   std::string name;
+   uint64_t value;
+   while(numastat>>name>>value) {
+      if(name=="local_node") {
+         pages.first=value;
+      } else if(name=="other_node") {
+         pages.second=value;
+      }
+   }
+   return pages;
+}
+
+void NumaCounters::start() {
+   const auto& topology=awfy::numa::Topology::get();
+   startPages.clear();
+   for(unsigned node=0; node<topology.numNodes(); node++) {
+      startPages.push_back(readNumastat(topology.nodeIds[node]));
+   }
+}
+
+void NumaCounters::countTask(unsigned executorNode, unsigned homeNode) {
+   assert(executorNode<maxNodes);
+   if(executorNode==homeNode) {
+      localTasks[executorNode].fetch_add(1);
+   } else {
+      remoteTasks[executorNode].fetch_add(1);
+   }
+}
+
+void NumaCounters::countPlacement(unsigned node, uint64_t bytes, awfy::chrono::Time duration) {
+   assert(node<maxNodes);
+   placedBytes[node].fetch_add(bytes);
+   placementTime[node].fetch_add(duration);
+}
+
+void NumaCounters::print(std::ostream& out) {
+   const auto& topology=awfy::numa::Topology::get();
+   for(unsigned node=0; node<topology.numNodes() && node<maxNodes; node++) {
+      const auto pages=readNumastat(topology.nodeIds[node]);
+      const auto start=node<startPages.size() ? startPages[node] : std::make_pair<uint64_t,uint64_t>(0, 0);
+      const uint64_t time=placementTime[node].load();
+      // Bytes per microsecond are MB/s
+      const uint64_t bandwidth=time>0 ? placedBytes[node].load()/time : 0;
+      out<<"[NUMA] Node "<<topology.nodeIds[node]
+         <<" tasks local: "<<localTasks[node].load()<<", remote: "<<remoteTasks[node].load()
+         <<", placed: "<<placedBytes[node].load()/1024<<" kb in "<<time/1000<<" ms ("<<bandwidth<<" MB/s)"
+         <<", pages local: "<<pages.first-start.first<<", remote: "<<pages.second-start.second<<std::endl;
+   }
+}
+
+}
 }
-}
\ No newline at end of file
@@ -0,0 +1,182 @@
+/*
+Copyright 2014 Moritz Kaufmann, Manuel Then, Tobias Muehlbauer, Andrey Gubichev
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "../include/util/numa.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "../include/util/log.hpp"
+#include "../include/concurrent/thread.hpp"
+
+namespace awfy {
+namespace numa {
+
+// From linux/mempolicy.h
+static const int MPOL_INTERLEAVE_POLICY=3;
+static const unsigned MPOL_MF_MOVE_FLAG=1<<1;
+
+static Mode currentMode=Mode::Off;
+static __thread unsigned threadNode;
+
+Mode parseMode(const char* name) {
+   if(name==nullptr || strcmp(name, "off")==0) {
+      return Mode::Off;
+   } else if(strcmp(name, "replicate")==0) {
+      return Mode::Replicate;
+   } else if(strcmp(name, "interleave")==0) {
+      return Mode::Interleave;
+   }
+   FATAL_ERROR("Unknown numa mode "<<name<<", expected off, replicate or interleave");
+}
+
+void setMode(Mode mode) {
+   currentMode=mode;
+}
+
+Mode mode() {
+   return currentMode;
+}
+
+/// Parses cpu lists like "0-3,8-11"
+static std::vector<unsigned> parseCpuList(const std::string& list) {
+   std::vector<unsigned> cpus;
+   std::istringstream ranges(list);
+   std::string range;
+   while(std::getline(ranges, range, ',')) {
+      if(range.empty() || range[0]=='\n') {
+         continue;
+      }
+      const auto dash=range.find('-');
+      const unsigned first=std::stoul(range.substr(0, dash));
+      const unsigned last=dash==std::string::npos ? first : std::stoul(range.substr(dash+1));
+      for(unsigned cpu=first; cpu<=last; cpu++) {
+         cpus.push_back(cpu);
+      }
+   }
+   return cpus;
+}
+
+static Topology detectTopology() {
+   Topology topology;
+   const unsigned maxNodes=1024;
+   for(unsigned node=0; node<maxNodes; node++) {
+      std::ifstream cpuList("/sys/devices/system/node/node"+std::to_string(node)+"/cpulist");
+      if(!cpuList) {
+         continue;
+      }
+      std::string list;
+      std::getline(cpuList, list);
+      auto cpus=parseCpuList(list);
+      if(!cpus.empty()) { // Memory only nodes have no cpus
+         topology.nodeIds.push_back(node);
+         topology.nodeCpus.push_back(move(cpus));
+      }
+   }
+
+   if(topology.nodeCpus.empty()) {
+      std::vector<unsigned> cpus;
+      for(unsigned cpu=0; cpu<std::thread::hardware_concurrency(); cpu++) {
+         cpus.push_back(cpu);
+      }
+      topology.nodeIds.push_back(0);
+      topology.nodeCpus.push_back(move(cpus));
+   }
+   return topology;
+}
+
+const Topology& Topology::get() {
+   static const Topology topology=detectTopology();
+   return topology;
+}
+
+unsigned executorNode(unsigned executorId) {
+   return executorId%Topology::get().numNodes();
+}
+
+unsigned executorCpu(unsigned executorId) {
+   const auto& cpus=Topology::get().nodeCpus[executorNode(executorId)];
+   return cpus[(executorId/Topology::get().numNodes())%cpus.size()];
+}
+
+static void pinThread(unsigned cpu, unsigned node) {
+   cpu_set_t cpuSet;
+   CPU_ZERO(&cpuSet);
+   CPU_SET(cpu, &cpuSet);
+   if(pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet)!=0) {
+      LOG_PRINT("[NUMA] Could not pin thread to cpu "<<cpu);
+   }
+   threadNode=node;
+}
+
+void pinExecutor(unsigned executorId) {
+   pinThread(executorCpu(executorId), executorNode(executorId));
+}
+
+unsigned currentNode() {
+   return threadNode;
+}
+
+struct NodeRunner {
+   unsigned node;
+   const std::function<void(unsigned)>& fn;
+
+   NodeRunner(unsigned node, const std::function<void(unsigned)>& fn) : node(node), fn(fn) {
+   }
+
+   static void* run(void* argument) {
+      auto runner=static_cast<NodeRunner*>(argument);
+      pinThread(Topology::get().nodeCpus[runner->node][0], runner->node);
+      runner->fn(runner->node);
+      return nullptr;
+   }
+};
+
+void runOnNodes(const std::function<void(unsigned node)>& fn) {
+   std::vector<awfy::Thread<NodeRunner>> threads;
+   threads.reserve(Topology::get().numNodes());
+   for(unsigned node=0; node<Topology::get().numNodes(); node++) {
+      threads.emplace_back(&NodeRunner::run, new NodeRunner(node, fn));
+   }
+   for(auto threadIter=threads.begin(); threadIter!=threads.end(); threadIter++) {
+      (*threadIter).join();
+   }
+}
+
+bool interleave(const void* data, size_t size) {
+   const auto& topology=Topology::get();
+   const size_t bitsPerWord=8*sizeof(unsigned long);
+   std::vector<unsigned long> nodeMask(topology.nodeIds.back()/bitsPerWord+1, 0);
+   for(auto nodeId : topology.nodeIds) {
+      nodeMask[nodeId/bitsPerWord]|=1ul<<(nodeId%bitsPerWord);
+   }
+
+   // The range has to start at a page boundary
+   const uintptr_t pageSize=sysconf(_SC_PAGESIZE);
+   const uintptr_t begin=reinterpret_cast<uintptr_t>(data)&~(pageSize-1);
+   const uintptr_t end=reinterpret_cast<uintptr_t>(data)+size;
+   const long result=syscall(SYS_mbind, begin, end-begin, MPOL_INTERLEAVE_POLICY, nodeMask.data(), nodeMask.size()*bitsPerWord+1, MPOL_MF_MOVE_FLAG);
+   return result==0;
+}
+
+}
+}
@@ -21,7 +21,6 @@ vector<vector<int> > Data::person_in_tags;
 vector<string> Data::tag_name;
 unordered_map<string, vector<int>, StringHashFunc> Data::placeid;
 vector<PlaceNode> Data::places;
-vector<unordered_set<int>> Data::friends_hash;
 
 #ifdef DEBUG
 vector<int> Data::real_tag_id;
@@ -29,11 +28,6 @@ vector<int> Data::real_tag_id;
 
 void Data::allocate() {
 	m_assert(nperson != 0);
-	friends_hash.resize(nperson);
-#ifdef GOOGLE_HASH
-	FOR_ITR(itr, friends_hash) itr->set_empty_key(-1);
-#endif
-
 	birthday = new int[nperson];
 	friends.resize(nperson);
 	tags.resize(nperson);
@@ -73,8 +73,6 @@ public:
 
 	static std::vector<std::vector<ConnectedPerson> > friends;
 	// friends[i] is a vector(sorted by 'id') of friends of the person with id=i
-	static std::vector<unordered_set<int>> friends_hash;
-	// destroyed after read_comments
 
 	static int *birthday;	// birthday[i] for the person with id=i
 	// destroyed after q2 finished
@@ -14,7 +14,7 @@ using namespace std;
 
 // global variables
 DEFINE_SIGNAL(tag_read)
-DEFINE_SIGNAL(friends_hash_built)
+DEFINE_SIGNAL(friends_sorted)
 DEFINE_SIGNAL(q2_finished)
 DEFINE_SIGNAL(can_start_queries)
 #undef DEFINE_SIGNAL
@@ -23,6 +23,20 @@ Timer globaltimer;
 
 ThreadPool* threadpool;
 
+static mutex cleanup_mt;
+static vector<thread> cleanup_threads;
+
+void start_cleanup(function<void()> fn) {
+	lock_guard<mutex> lk(cleanup_mt);
+	cleanup_threads.emplace_back(fn);
+}
+
+void join_cleanups() {
+	lock_guard<mutex> lk(cleanup_mt);
+	FOR_ITR(th, cleanup_threads) th->join();
+	cleanup_threads.clear();
+}
+
 vector<double> tot_time(5, 0.0);
 
 int q1_cmt_vst = 0;
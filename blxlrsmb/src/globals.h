@@ -5,6 +5,7 @@
 #pragma once
 
 #include <condition_variable>
+#include <functional>
 #include <thread>
 #include <mutex>
 #include "lib/hash_lib.h"
@@ -26,7 +27,7 @@ extern Timer globaltimer;
 	extern bool s;
 
 DECLARE_SIGNAL(tag_read)
-DECLARE_SIGNAL(friends_hash_built)
+DECLARE_SIGNAL(friends_sorted)
 DECLARE_SIGNAL(q2_finished)
 DECLARE_SIGNAL(can_start_queries)
 
@@ -34,6 +35,10 @@ DECLARE_SIGNAL(can_start_queries)
 
 extern ThreadPool* threadpool;
 
+// threads freeing data that is no longer needed, main joins them before the globals are destroyed
+void start_cleanup(std::function<void()> fn);
+void join_cleanups();
+
 extern std::vector<double> tot_time;
 
 extern int q1_cmt_vst;
@@ -8,8 +8,11 @@
 
 
 
+#include <algorithm>
+#include <functional>
 #include <string>
 #include <mutex>
+#include <vector>
 #include "read.h"
 #include "lib/Timer.h"
 #include "lib/common.h"
@@ -93,9 +96,15 @@ inline void start_4() {
 	 *        q4_sched->work();
 	 *} else {
 	 */
-			REP(i, s) {
+			// longest first: the pool only orders by priority, so spread the jobs over 10..19 by the persons of their tag
+			std::vector<std::pair<int, size_t>> order;
+			REP(i, s)
+					order.emplace_back(cnt_tag_persons_hash(q4_set[i].tag), i);
+			std::sort(order.begin(), order.end(), std::greater<std::pair<int, size_t>>());
+			REP(r, s) {
+					size_t i = order[r].second;
 					threadpool->enqueue(bind(&Query4Handler::add_query,
-											&q4, q4_set[i].k, q4_set[i].tag, i), 10);
+											&q4, q4_set[i].k, q4_set[i].tag, i), 10 + (int)((s - 1 - r) * 10 / s));
 			}
 	/*
 	 *}
@@ -0,0 +1,232 @@
+//File: kernel_bench.cc
+//Date: Fri Oct 16 10:12:40 2026 +0000
+
+// Latency of the SSE bitset kernels and the dense hash map next to plain scalar / std variants.
+// Output is csv with the columns of the AWFY kernel benchmark:
+// cpu,kernel,variant,input,size,ops,ns_per_op,checksum
+// ns_per_op is the fastest of at least 3 runs (and 100ms), checksums of the variants of a row group must agree.
+
+#include <google/dense_hash_map>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "lib/bitset.h"
+#include "lib/common.h"
+
+using namespace std;
+
+namespace {
+	const uint64_t MIN_RUN_NS = 100ULL * 1000 * 1000;
+	const int MIN_RUNS = 3;
+
+	string cpu_name;
+
+	string read_cpu_name() {
+		ifstream cpuinfo("/proc/cpuinfo");
+		string line;
+		while (getline(cpuinfo, line)) {
+			if (line.compare(0, 10, "model name") != 0) continue;
+			string value = line.substr(line.find(':') + 1);
+			value.erase(0, value.find_first_not_of(' '));
+			value.erase(remove(value.begin(), value.end(), ','), value.end());
+			return value;
+		}
+		return "unknown";
+	}
+
+	template <typename Fn>
+	void measure(const char* kernel, const char* variant, const string& input,
+			uint64_t size, uint64_t ops, Fn fn) {
+		uint64_t best = UINT64_MAX, total = 0, checksum = 0;
+		for (int run = 0; run < MIN_RUNS || total < MIN_RUN_NS; run ++) {
+			auto start = chrono::steady_clock::now();
+			checksum = fn();
+			uint64_t ns = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+					chrono::steady_clock::now() - start).count();
+			best = min(best, ns);
+			total += ns;
+		}
+		cout << cpu_name << "," << kernel << "," << variant << "," << input << ","
+			<< size << "," << ops << "," << (double)best / (double)max<uint64_t>(ops, 1)
+			<< "," << checksum << endl;
+	}
+
+	// popcount of bitsets of len 16 byte chunks, len is a multiple of 4 like get_len_from_bit() returns
+	void bench_popcount(mt19937_64& rng) {
+		for (int len : {4, 64, 1024}) {
+			int nset = (1 << 16) / len;
+			vector<Bitset> sets;
+			sets.reserve(nset);
+			REP(i, nset) {
+				sets.emplace_back(len);
+				uint64_t* words = (uint64_t*)sets[i].data;
+				REP(w, len * 2) words[w] = rng();
+			}
+			string input = "synthetic_" + to_string(len * 128);
+			measure("popcount", "ssse3", input, len * 128, nset, [&]() {
+				uint64_t sum = 0;
+				FOR_ITR(s, sets) sum += s->count(len);
+				return sum;
+			});
+			measure("popcount", "builtin", input, len * 128, nset, [&]() {
+				uint64_t sum = 0;
+				FOR_ITR(s, sets) {
+					const uint64_t* words = (const uint64_t*)s->data;
+					REP(w, len * 2) sum += (uint64_t)__builtin_popcountll(words[w]);
+				}
+				return sum;
+			});
+			FOR_ITR(s, sets) s->free();
+		}
+	}
+
+	vector<vector<int>> random_graph(int np, int degree, mt19937_64& rng) {
+		vector<vector<int>> graph(np);
+		REP(i, np) REP(j, degree / 2) {
+			int other = (int)(rng() % (uint64_t)np);
+			if (other == i) continue;
+			graph[i].push_back(other);
+			graph[other].push_back(i);
+		}
+		FOR_ITR(fr, graph) {
+			sort(fr->begin(), fr->end());
+			fr->erase(unique(fr->begin(), fr->end()), fr->end());
+		}
+		return graph;
+	}
+
+	// friends in person_knows_person.csv, persons are numbered in order of appearance
+	vector<vector<int>> read_graph(const string& dir) {
+		vector<vector<int>> graph;
+		std::unordered_map<unsigned long long, int> id_map;
+		auto map_id = [&](unsigned long long id) {
+			auto ins = id_map.insert(make_pair(id, (int)id_map.size()));
+			if (ins.second) graph.emplace_back();
+			return ins.first->second;
+		};
+		ifstream fin(dir + "/person_knows_person.csv");
+		string line;
+		getline(fin, line);
+		while (getline(fin, line)) {
+			size_t sep = line.find('|');
+			if (sep == string::npos) continue;
+			int a = map_id(stoull(line.substr(0, sep))),
+				b = map_id(stoull(line.substr(sep + 1)));
+			graph[a].push_back(b);
+		}
+		return graph;
+	}
+
+	// one level of the bitset union in HybridEstimator: s = (OR of s_prev of friends) & ~s_prev[i]
+	void bench_reach_step(const string& input, const vector<vector<int>>& graph) {
+		int np = (int)graph.size();
+		if (np == 0) return;
+		int len = get_len_from_bit(np);
+		uint64_t nedge = 0;
+		FOR_ITR(fr, graph) nedge += fr->size();
+
+		// persons within one hop
+		BitBoard board(np);
+		vector<Bitset>& s_prev = board.bitsets;
+		vector<uint64_t> plain((size_t)np * (size_t)len * 2);
+		REP(i, np) {
+			s_prev[i].set(i);
+			FOR_ITR(fr, graph[i]) s_prev[i].set(*fr);
+			memcpy(&plain[(size_t)i * (size_t)len * 2], s_prev[i].data, (size_t)len * sizeof(__m128i));
+		}
+
+		measure("reach_step", "sse", input, nedge, np, [&]() {
+			uint64_t sum = 0;
+			Bitset s(len);
+			REP(i, np) {
+				s.reset(len);
+				FOR_ITR(fr, graph[i]) s.or_arr(s_prev[*fr], len);
+				s.and_not_arr(s_prev[i], len);
+				sum += (uint64_t)s.count(len);
+			}
+			s.free();
+			return sum;
+		});
+
+		size_t nword = (size_t)len * 2;
+		measure("reach_step", "scalar", input, nedge, np, [&]() {
+			uint64_t sum = 0;
+			vector<uint64_t> s(nword);
+			REP(i, np) {
+				fill(s.begin(), s.end(), 0);
+				FOR_ITR(fr, graph[i]) {
+					const uint64_t* src = &plain[(size_t)*fr * nword];
+					REP(w, nword) s[w] |= src[w];
+				}
+				const uint64_t* self = &plain[(size_t)i * nword];
+				REP(w, nword) sum += (uint64_t)__builtin_popcountll(s[w] & ~self[w]);
+			}
+			return sum;
+		});
+	}
+
+	// int -> int id maps as built while reading, every key is inserted and looked up along with a missing key
+	// keys are positive and below 2^30, -1 stays free as the empty key
+	template <typename Map>
+	void bench_hash_map(const char* variant, const string& input, const vector<int>& keys, const Map& empty) {
+		measure("hash_insert", variant, input, keys.size(), keys.size(), [&]() {
+			Map map = empty;
+			REP(i, keys.size()) map[keys[i]] = (int)i;
+			return (uint64_t)map.size();
+		});
+		Map map = empty;
+		REP(i, keys.size()) map[keys[i]] = (int)i;
+		measure("hash_find", variant, input, keys.size(), keys.size() * 2, [&]() {
+			uint64_t sum = 0;
+			FOR_ITR(k, keys) {
+				auto itr = map.find(*k);
+				if (itr != map.end()) sum += (uint64_t)itr->second + 1;
+				itr = map.find(*k | (1 << 30));
+				if (itr != map.end()) sum += (uint64_t)itr->second + 1;
+			}
+			return sum;
+		});
+	}
+
+	void bench_hash_maps(mt19937_64& rng) {
+		for (int size : {1 << 10, 1 << 16, 1 << 20}) {
+			vector<int> keys;
+			REP(i, size) keys.push_back(1 + (int)(rng() % ((1U << 30) - 1)));
+			string input = "synthetic_" + to_string(size);
+			google::dense_hash_map<int, int> dense;
+			dense.set_empty_key(-1);
+			bench_hash_map("dense_hash_map", input, keys, dense);
+			bench_hash_map("std", input, keys, std::unordered_map<int, int>());
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	if (argc > 2) {
+		fprintf(stderr, "Usage: %s [<data dir>]\n", argv[0]);
+		return 1;
+	}
+	cpu_name = read_cpu_name();
+	mt19937_64 rng(42);
+	cout << fixed << setprecision(3);
+	cout << "cpu,kernel,variant,input,size,ops,ns_per_op,checksum" << endl;
+
+	bench_popcount(rng);
+	bench_reach_step("synthetic", random_graph(1 << 12, 32, rng));
+	bench_hash_maps(rng);
+	if (argc == 2)
+		bench_reach_step("person_knows_person", read_graph(argv[1]));
+	return 0;
+}
+
+/**
+ * vim: syntax=cpp11 foldmethod=marker
+ */
@@ -0,0 +1,115 @@
+//File: arena.h
+//Date: Fri Oct 16 10:12:44 2026 +0000
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// bump allocator for the temporary data of one thread's queries.
+// chunks are kept, so once they cover a query nothing more is requested from the system;
+// an ArenaScope gives back everything allocated during its lifetime.
+class Arena {
+	public:
+		static const size_t CHUNK_SIZE = 2 * 1024 * 1024;
+
+		struct Mark {
+			size_t chunk, used;
+		};
+
+		Arena(): cur(0), used(0) {}
+
+		~Arena() {
+			for (auto& c : chunks)
+				free(c.data);
+		}
+
+		Arena(const Arena&) = delete;
+		Arena& operator=(const Arena&) = delete;
+
+		static Arena& local() {
+			static thread_local Arena arena;
+			return arena;
+		}
+
+		void* allocate(size_t size, size_t align) {
+			if (cur < chunks.size()) {
+				size_t off = (used + align - 1) & ~(align - 1);
+				if (off + size <= chunks[cur].size) {
+					used = off + size;
+					return chunks[cur].data + off;
+				}
+			}
+			// continue in the next chunk that fits
+			size_t next = cur < chunks.size() ? cur + 1 : 0;
+			while (next < chunks.size() && chunks[next].size < size)
+				next ++;
+			if (next == chunks.size()) {
+				size_t csize = size <= CHUNK_SIZE ? CHUNK_SIZE : (size + CHUNK_SIZE - 1) & ~(CHUNK_SIZE - 1);
+				void* data;
+				// tcmalloc replaces posix_memalign but not aligned_alloc
+				if (posix_memalign(&data, 64, csize) != 0)
+					throw std::bad_alloc();
+				chunks.push_back(Chunk{static_cast<char*>(data), csize});
+			}
+			cur = next;
+			used = size;
+			return chunks[cur].data;
+		}
+
+		Mark mark() const { return Mark{cur, used}; }
+
+		void rewind(Mark m) {
+			cur = m.chunk;
+			used = m.used;
+		}
+
+	private:
+		struct Chunk {
+			char* data;
+			size_t size;
+		};
+
+		std::vector<Chunk> chunks;
+		size_t cur, used;
+};
+
+class ArenaScope {
+	public:
+		ArenaScope(): arena(Arena::local()), start(arena.mark()) {}
+		~ArenaScope() { arena.rewind(start); }
+
+		ArenaScope(const ArenaScope&) = delete;
+		ArenaScope& operator=(const ArenaScope&) = delete;
+
+	private:
+		Arena& arena;
+		const Arena::Mark start;
+};
+
+// allocates from the arena of the constructing thread, deallocate is a no-op
+template <typename T>
+class ArenaAllocator {
+	public:
+		typedef T value_type;
+
+		ArenaAllocator(): arena(&Arena::local()) {}
+		template <typename U>
+		ArenaAllocator(const ArenaAllocator<U>& r): arena(r.arena) {}
+
+		T* allocate(size_t n) {
+			return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+		}
+		void deallocate(T*, size_t) {}
+
+		template <typename U>
+		bool operator==(const ArenaAllocator<U>& r) const { return arena == r.arena; }
+		template <typename U>
+		bool operator!=(const ArenaAllocator<U>& r) const { return arena != r.arena; }
+
+	private:
+		template <typename U> friend class ArenaAllocator;
+		Arena* arena;
+};
@@ -68,7 +68,8 @@ void parse_query(int argc, char **argv) {
 	}
 }
 
-void read_query(const string& fname) {
+// only_type > 0 keeps the queries of that type
+void read_query(const string& fname, int only_type) {
 	FILE* fin = fopen(fname.c_str(), "r");
 	m_assert(fin != NULL);
 	int type;
@@ -79,6 +80,7 @@ void read_query(const string& fname) {
 				{
 					int p1, p2, x;
 					fscanf(fin, "%d, %d, %d)", &p1, &p2, &x);
+					if (only_type && only_type != type) break;
 					q1_set.emplace_back(p1, p2, x);
 					break;
 				}
@@ -87,6 +89,7 @@ void read_query(const string& fname) {
 					int k, y, m, d;
 					fscanf(fin, "%d, %d-%d-%d)", &k, &y, &m, &d);
 					d = 10000 * y + 100 * m + d;
+					if (only_type && only_type != type) break;
 					q2_set.emplace_back(k, d, (int)q2_set.size());
 					break;
 				}
@@ -95,6 +98,7 @@ void read_query(const string& fname) {
 					int k, h;
 					fscanf(fin, "%d, %d, %s", &k, &h, buf);
 					string place(buf, strlen(buf) - 1);
+					if (only_type && only_type != type) break;
 					q3_set.emplace_back(k, h, place);
 					break;
 				}
@@ -103,6 +107,7 @@ void read_query(const string& fname) {
 					int k;
 					fscanf(fin, "%d, %s", &k, buf);
 					string tag_name(buf, strlen(buf) - 1);
+					if (only_type && only_type != type) break;
 					q4_set.emplace_back(k, tag_name);
 					q4_tag_set.insert(tag_name);
 					break;
@@ -154,13 +159,13 @@ int main(int argc, char* argv[]) {
 	bool printQueryNumber = false;
 	size_t queryId{0U};
 	if (argv[2] == FILE_FLAG) {
-		read_query(string(argv[3]));		// read query first, so we can read data optionally later
 		if (argc > 4) {
 			if (argv[4][0] < '1' || argv[4][0] > '4') {
 				throw std::runtime_error("Invalid query id");				
 			}
 			queryId = argv[4][0] - '0';
 		}
+		read_query(string(argv[3]), (int)queryId);		// read query first, so we can read data optionally later
 	} else if (argv[2] == PARAM_FLAG) {
 		parse_query(argc, argv);
 		printQueryNumber = true;
@@ -200,6 +205,7 @@ int main(int argc, char* argv[]) {
 	PP("deleting...");
 	threadpool->condition.notify_all();
 	delete threadpool;		// will wait to join all thread
+	join_cleanups();		// they free globals, so they must not race with exit
 
 	#ifdef MEASURE
 	measurement::finished();
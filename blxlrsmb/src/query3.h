@@ -10,6 +10,7 @@
 #include <unordered_set>
 #include <queue>
 #include "data.h"
+#include "lib/arena.h"
 #include "lib/finish_time_continuation.h"
 
 struct Query3 {
@@ -58,11 +59,12 @@ class Query3Calculator {
 		int sum;
 		int heapSize, qk;
 		PersonSet pset;
-		std::set<int> pinplace;
+		// per query containers live in the arena of the thread, see Query3Handler::add_query
+		std::set<int, std::less<int>, ArenaAllocator<int> > pinplace;
 		std::vector<int> people;
 		std::vector<Answer3> first;
-		std::map<int, int> invPeople;
-		std::set<Answer3> answerHeap;
+		std::map<int, int, std::less<int>, ArenaAllocator<std::pair<const int, int> > > invPeople;
+		std::set<Answer3, std::less<Answer3>, ArenaAllocator<Answer3> > answerHeap;
 		std::vector<Answer3> answers;
 		std::vector<std::vector<std::vector<int> > > invList;
 		std::vector<std::vector<int>::iterator> map_itr;
@@ -16,9 +16,10 @@ int sumbfs = 0;
 int bfs3(int p1, int p2, int x, int h) {
 	sumbfs ++;
 	if (p1 == p2) return 0;
-	vector<bool> vst1(Data::nperson, false);
-	vector<bool> vst2(Data::nperson, false);
-	deque<int> q1, q2;
+	ArenaScope scope;
+	vector<bool, ArenaAllocator<bool> > vst1(Data::nperson, false);
+	vector<bool, ArenaAllocator<bool> > vst2(Data::nperson, false);
+	deque<int, ArenaAllocator<int> > q1, q2;
 	q1.push_back(p1); vst1[p1] = true;
 	q2.push_back(p2); vst2[p2] = true;
 	int depth1 = 0, depth2 = 0;
@@ -70,6 +71,8 @@ void destroy_q3_data();
 void Query3Handler::add_query(int k, int h, const string& p, int index) {
 	TotalTimer timer("Q3");
 
+	// frees the containers of calc, it must be destroyed first
+	ArenaScope scope;
 	Query3Calculator calc;
 	calc.work(k, h, p, global_answer[index]);
 
@@ -78,8 +81,7 @@ void Query3Handler::add_query(int k, int h, const string& p, int index) {
 
 	int task_count = continuation->get_count();
 	if (!task_count) {
-		thread th(destroy_q3_data);		// clear useless data
-		th.detach();
+		start_cleanup(destroy_q3_data);		// clear useless data
 	}
 	return;
 }
@@ -216,7 +218,7 @@ void Query3Calculator::moveOneStep(int g, int h, int f)
 		//prune
 		if (heapSize == qk)
 		{
-			set<Answer3>::iterator it = answerHeap.end();
+			auto it = answerHeap.end();
 			it --;
 			if (it->com_interest > curLen) return ;
 		}
@@ -299,7 +301,7 @@ void Query3Calculator::insHeap(Answer3 cur, int g, int f)
 			answerHeap.insert(cur), heapSize ++;
 		else
 		{
-			set<Answer3>::iterator it = answerHeap.end();
+			auto it = answerHeap.end();
 			it --;
 			if ((*it) < cur) return ;
 			answerHeap.erase(it);
@@ -344,14 +346,14 @@ void Query3Calculator::work(int k, int h, const string &p, std::vector<Answer3>
 //		if (first[i].p1 != first[i].p2)
 //			answerHeap.insert(first[i]);
 //
-	set<pair<int, int> > dup;
+	set<pair<int, int>, less<pair<int, int> >, ArenaAllocator<pair<int, int> > > dup;
 	dup.clear();
 	vector<Answer3> tmp; tmp.clear();
 
 	for (int lp = 1; lp <= k; lp ++)
 	{
 		if (answerHeap.empty()) break;
-		set<Answer3>::iterator i = answerHeap.begin();
+		auto i = answerHeap.begin();
 		tmp.push_back(*i);
 		dup.insert(make_pair(i->p1, i->p2));
 		moveOneStep(invPeople[i->p1], h, 0);
@@ -65,17 +65,6 @@ void read_person_file(const string& dir) {
 	fclose(fin);
 }
 
-void build_friends_hash() {
-	REP(i, Data::nperson) {
-		auto &f = Data::friends[i];
-		FOR_ITR(ff, f)
-			Data::friends_hash[i].insert(ff->pid);
-	}
-	friends_hash_built = true;
-	friends_hash_built_cv.notify_all();
-	print_debug("Friends hash built\n");
-}
-
 void read_person_knows_person(const string& dir) {
 	static char buffer[BUFFER_LEN];
 	char *ptr, *buf_end;
@@ -94,8 +83,8 @@ void read_person_knows_person(const string& dir) {
 	}
 	REP(i, Data::nperson)
 		sort(Data::friends[i].begin(), Data::friends[i].end());		// sort by id!
-	thread t(build_friends_hash);
-	t.detach();
+	friends_sorted = true;
+	friends_sorted_cv.notify_all();
 	fclose(fin);
 }
 
@@ -390,8 +379,7 @@ void read_forum(const string& dir, unordered_map<int, int>& id_map, const unorde
 		close(fd);
 	}
 
-	thread th(destroy_tag_name);
-	th.detach();
+	start_cleanup(destroy_tag_name);
 
 	print_debug("Read forum spent %lf secs\n", timer.get_time());
 }
@@ -590,156 +578,151 @@ void read_data(const string& dir) {		// may need to be implemented synchronously
  */
 
 
-int find_count(const std::vector<std::pair<std::pair<int, int>, int>> &count, const std::pair<int, int> &pivot) {
-	// lower bound
-	int left = 0, right = (int)count.size();
-	while (left + 1 < right) {
-		int mid = (left + right) >> 1;
-		if (count[mid].first <= pivot) {
-			left = mid;
-		} else {
-			right = mid;
-		}
-	}
+namespace {
 
-	if (count[left].first == pivot)
-		return count[left].second;
-	return 0;
+// split [begin, end) into n chunks, every chunk starts at the beginning of a line
+vector<pair<const char*, const char*>> split_lines(const char* begin, const char* end, int n) {
+	vector<pair<const char*, const char*>> chunks;
+	size_t len = end - begin;
+	const char* last = begin;
+	REPL(i, 1, n + 1) {
+		const char* p = i == n ? end : begin + len * i / n;
+		if (p < last) p = last;
+		while (p != end && p != last && *(p - 1) != '\n') p ++;
+		chunks.emplace_back(last, p);
+		last = p;
+	}
+	return chunks;
 }
 
-void read_comments_tim(const std::string &dir) {
-	char *ptr, *buf_end;
+struct MappedFile {
+	int fd;
+	size_t size;
+	void* mapped;
+	const char *begin, *end;		// lines after the header
 
-	vector<int> owner;
-	Timer timer;
-	{
-		GuardedTimer guarded_timer("read comment_hasCreator_person.csv%d", 1);
-		int fd = open((dir + "/comment_hasCreator_person.csv").c_str(), O_RDONLY);
+	MappedFile(const string& fname) {
+		fd = open(fname.c_str(), O_RDONLY);
 		struct stat s; fstat(fd, &s);
-		size_t size = s.st_size;
-		void* mapped = mmap(0, size, PROT_READ, MAP_FILE|MAP_PRIVATE, fd, 0);
-//		madvise(mapped, size, MADV_WILLNEED);
-
-//		ptr = (char*) mapped;
-//		buf_end = (char*) mapped + size;
-
-//		MMAP_READ_TILL_EOL();
-//		if (Data::nperson > 9000) owner.reserve(20100000);
-
-
-		ptr = (char*) mapped;
-		buf_end = (char*) mapped + size;
-
-		char* seek = buf_end - 1024;
-		while (*seek++ != '\n');
-		ULL cid = 0;
-		while (*seek != '|') cid = cid * 10 + (*(seek++) - '0');
-		//fprintf(stderr, "ncmt<%llu\n", cid); fflush(stderr);
+		size = s.st_size;
+		mapped = mmap(0, size, PROT_READ, MAP_FILE|MAP_PRIVATE, fd, 0);
 		madvise(mapped, size, MADV_SEQUENTIAL);
-		MMAP_READ_TILL_EOL();
-		owner.reserve(cid / 10 + 1000);
+		begin = (char*)mapped;
+		end = begin + size;
+		while (*begin++ != '\n');
+	}
 
-		do {
-			do { ptr ++; } while (*ptr != '|');
-			ptr ++;
-			int pid = 0;
-			do {
-				pid = pid * 10 + *ptr - '0';
-				ptr ++;
-			} while (*ptr != '\n');
-			owner.emplace_back(pid);
-			ptr ++;
-		} while (ptr != buf_end);
+	~MappedFile() {
 		munmap(mapped, size);
 		close(fd);
 	}
+};
 
-	WAIT_FOR(friends_hash_built);
-
-	vector<PII> comments;
-	{
-		GuardedTimer guarded_timer("read comment_replyOf_comment.csv");
+inline ULL parse_until(const char*& ptr, char delim) {
+	ULL ret = 0;
+	do {
+		ret = ret * 10 + *ptr - '0';
+		ptr ++;
+	} while (*ptr != delim);
+	ptr ++;
+	return ret;
+}
 
-		// using mmap
-		int fd = open((dir + "/comment_replyOf_comment.csv").c_str(), O_RDONLY);
-		struct stat s; fstat(fd, &s);
-		size_t size = s.st_size;
-		void* mapped = mmap(0, size, PROT_READ, MAP_FILE|MAP_PRIVATE, fd, 0);
-//		madvise(mapped, size, MADV_WILLNEED);
-		madvise(mapped, size, MADV_SEQUENTIAL);
+}
 
-		ptr = (char*)mapped;
-		buf_end = (char*)mapped + size;
+void read_comments_tim(const std::string &dir) {
+	// Reply pairs between friends are bucketed by their smaller person id into
+	// partitions, so that both directions of a pair end up in the same
+	// partition and every partition can be counted on its own.
+	// A pair is stored as (min << 32 | max << 1 | (replier > parent)).
+	int nthreads = NUM_THREADS;
+	int nparts = nthreads * 8;
 
-		MMAP_READ_TILL_EOL();
-		do {
-			unsigned long long cid1 = 0;
-			do {
-				cid1 = cid1 * 10 + *ptr - '0';
-				ptr ++;
-			} while (*ptr != '|');
-			ptr ++;
-			unsigned long long cid2 = 0;
-			do {
-				cid2 = cid2 * 10 + *ptr - '0';
-				ptr ++;
-			} while (*ptr != '\n');
+	vector<int> owner;
+	Timer timer;
+	{
+		GuardedTimer guarded_timer("read comment_hasCreator_person.csv");
+		MappedFile file(dir + "/comment_hasCreator_person.csv");
 
-			int p1 = owner[cid1 / 10], p2 = owner[cid2 / 10];
-			if (p1 != p2) {
-				auto &h = Data::friends_hash[p1];
-				if (h.find(p2) != h.end())
-					comments.emplace_back(p1, p2);
+		// the last comment has the largest id
+		const char* seek = file.end - 1;
+		while (seek != file.begin and *(seek - 1) != '\n') seek --;
+		ULL cid = 0;
+		while (*seek != '|') cid = cid * 10 + (*(seek++) - '0');
+		owner.resize(cid / 10 + 1);
+
+		auto chunks = split_lines(file.begin, file.end, nthreads);
+#pragma omp parallel for schedule(static) num_threads(nthreads)
+		REP(t, nthreads) {
+			const char* ptr = chunks[t].first;
+			const char* end = chunks[t].second;
+			while (ptr < end) {
+				ULL cid = parse_until(ptr, '|');
+				owner[cid / 10] = (int)parse_until(ptr, '\n');
 			}
-
-			ptr ++;
-		} while (ptr != buf_end);
-		munmap(mapped, size);
-		close(fd);
+		}
 	}
-	Data::friends_hash = vector<unordered_set<int>>();
 
-	print_debug("number of valid comment pair: %lu\n", comments.size());
-	{
-		//	GuardedTimer guarded_timer("sort");		// very fast
-		std::sort(comments.begin(), comments.end());
-		//	quick_sort(comments);		// lambda cannot compile!
-	}
+	WAIT_FOR(friends_sorted);
 
-	// aggregate, very fast
-	std::vector<pair<PII, int>> count;
-	count.emplace_back(comments[0], 1);
-	for (size_t i = 1, d = comments.size(); i < d; i ++) {
-		auto &cur = comments[i];
-		if (cur != comments[i - 1])
-			count.emplace_back(cur, 1);
-		else
-			count.back().second ++;
+	vector<vector<vector<ULL>>> buckets(nthreads, vector<vector<ULL>>(nparts));
+	{
+		GuardedTimer guarded_timer("read comment_replyOf_comment.csv");
+		MappedFile file(dir + "/comment_replyOf_comment.csv");
+
+		auto chunks = split_lines(file.begin, file.end, nthreads);
+#pragma omp parallel for schedule(static) num_threads(nthreads)
+		REP(t, nthreads) {
+			auto& bucket = buckets[t];
+			const char* ptr = chunks[t].first;
+			const char* end = chunks[t].second;
+			while (ptr < end) {
+				ULL cid1 = parse_until(ptr, '|');
+				ULL cid2 = parse_until(ptr, '\n');
+				int p1 = owner[cid1 / 10], p2 = owner[cid2 / 10];
+				if (p1 == p2)
+					continue;
+				auto& fs = Data::friends[p1];
+				auto f = lower_bound(fs.begin(), fs.end(), ConnectedPerson(p2, 0));
+				if (f == fs.end() or f->pid != p2)
+					continue;
+				ULL lo = min(p1, p2), hi = max(p1, p2);
+				bucket[lo * nparts / Data::nperson].emplace_back(lo << 32 | hi << 1 | (p1 > p2));
+			}
+		}
 	}
-
+	owner = vector<int>();
 
 	{
-		GuardedTimer timer("build graph");		// very fast (0.05s/300k)
-		int index = 0;
-		REP(i, Data::nperson) {
-			auto& fs = Data::friends[i];
-			FOR_ITR(itr, fs) {
-				int j = itr->pid;
-				PII now_pair = make_pair(i, j);
-				while (count[index].first < now_pair) {
-					index ++;
-					if (index == (int)count.size()) break;
-				}
-				if (index == (int)count.size()) break;
-
-				if (count[index].first == now_pair)
-					itr->ncmts = min(count[index].second, find_count(count, make_pair(j, i)));
-				else
-					itr->ncmts = 0;
+		GuardedTimer guarded_timer("build graph");
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+		REP(part, nparts) {
+			vector<ULL> pairs;
+			size_t tot = 0;
+			REP(t, nthreads) tot += buckets[t][part].size();
+			pairs.reserve(tot);
+			REP(t, nthreads) {
+				auto& b = buckets[t][part];
+				pairs.insert(pairs.end(), b.begin(), b.end());
+				vector<ULL>().swap(b);
+			}
+			sort(pairs.begin(), pairs.end());
+
+			for (size_t i = 0; i < pairs.size(); ) {
+				ULL key = pairs[i] >> 1;
+				int cnt[2] = {0, 0};
+				for (; i < pairs.size() and (pairs[i] >> 1) == key; i ++)
+					cnt[pairs[i] & 1] ++;
+				int n = min(cnt[0], cnt[1]);
+				if (not n)
+					continue;
+				int lo = (int)(key >> 31), hi = (int)(key & 0x7fffffff);
+				auto& flo = Data::friends[lo];
+				lower_bound(flo.begin(), flo.end(), ConnectedPerson(hi, 0))->ncmts = n;
+				auto& fhi = Data::friends[hi];
+				lower_bound(fhi.begin(), fhi.end(), ConnectedPerson(lo, 0))->ncmts = n;
 			}
-			if (index == (int)count.size()) break;
 		}
 	}
 	print_debug("Read comment spent %lf secs\n", timer.get_time());
 }
-
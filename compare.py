@@ -0,0 +1,230 @@
+#!/usr/bin/env python3
+"""Runs the AWFY and blxlrsmb solutions on the same data and query file and compares them.
+
+Every query type of the query file is run separately in `FILE <queryFile> <type>` mode, so each run
+loads only the indexes of one type. The answers of both solutions are compared query by query, and the
+load time, query time, throughput and peak resident memory of every run are reported as a table and
+optionally as JSON. Both binaries must be Release builds with -DPRINT_RESULTS=1, see their READMEs.
+"""
+
+import argparse
+import json
+import os
+import re
+import resource
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.abspath(__file__))
+ENGINES = {
+    'awfy': os.path.join(ROOT, 'AWFY', 'cmake-build-release', 'runGraphQueries'),
+    'blxlrsmb': os.path.join(ROOT, 'blxlrsmb', 'cmake-build-release', 'main'),
+}
+# q<type>,<loading time in us>,<query time in us>,<first answer>
+MEASURE_RE = re.compile(r'^q(\d),(\d+),(\d+),?(.*)$')
+QUERY_RE = re.compile(r'^query(\d)\(')
+
+
+def get_args():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('data', help='data folder')
+    parser.add_argument('queries', help='query file')
+    parser.add_argument('--awfy', default=ENGINES['awfy'], help='runGraphQueries binary, default %(default)s')
+    parser.add_argument('--blxlrsmb', default=ENGINES['blxlrsmb'], help='main binary, default %(default)s')
+    parser.add_argument('--types', default='',
+                        help='comma separated query types to run, default all types in the query file')
+    parser.add_argument('--runs', type=int, default=1,
+                        help='runs per engine and type, the fastest is reported, default %(default)s')
+    parser.add_argument('--timeout', type=float, default=3600, help='seconds per run, default %(default)s')
+    parser.add_argument('--env', action='append', default=[], metavar='ENGINE:KEY=VALUE',
+                        help='environment variable for one engine, e.g. awfy:AWFY_Q2=sweep')
+    parser.add_argument('--json', help='write the results as JSON to this file, - for stdout')
+    parser.add_argument('--show', type=int, default=5, help='mismatches printed per type, default %(default)s')
+    return parser.parse_args()
+
+
+def read_queries(path):
+    """Query lines of the file by type, in file order."""
+    queries = {}
+    with open(path) as f:
+        for line in f:
+            match = QUERY_RE.match(line)
+            if match:
+                queries.setdefault(int(match.group(1)), []).append(line.strip())
+    return queries
+
+
+def read_hwm_kb(pid):
+    try:
+        with open('/proc/%d/status' % pid) as f:
+            for line in f:
+                if line.startswith('VmHWM:'):
+                    return int(line.split()[1])
+    except (IOError, ValueError):
+        pass
+    return 0
+
+
+def run_once(binary, data, queries, qtype, env, timeout):
+    """Runs one engine on one query type and returns its measurements and answers."""
+    # The answers go to a file, a pipe would block the engine while this process waits
+    out = tempfile.TemporaryFile()
+    start = time.time()
+    proc = subprocess.Popen([binary, os.path.join(data, ''), 'FILE', queries, str(qtype)],
+                            stdout=out, stderr=subprocess.DEVNULL, env=env)
+    # Peak resident memory like memusg measures it. wait4 reports it exactly, but the child inherits the peak
+    # of this process through fork, so below that the high water mark of /proc is sampled instead.
+    own_peak_kb = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    sampled_peak_kb = 0
+    deadline = start + timeout
+    while True:
+        pid, status, usage = os.wait4(proc.pid, os.WNOHANG)
+        if pid != 0:
+            break
+        sampled_peak_kb = max(sampled_peak_kb, read_hwm_kb(proc.pid))
+        if time.time() > deadline:
+            proc.kill()
+            pid, status, usage = os.wait4(proc.pid, 0)
+            break
+        # Short runs are sampled more often
+        time.sleep(min(0.01, 0.001 + (time.time() - start) / 100))
+    wall = time.time() - start
+    out.seek(0)
+    output = out.read().decode('utf-8', 'replace')
+    out.close()
+
+    result = {
+        'exit_code': -os.WTERMSIG(status) if os.WIFSIGNALED(status) else os.WEXITSTATUS(status),
+        'timeout': wall > timeout,
+        'wall_s': wall,
+        'peak_rss_kb': usage.ru_maxrss if usage.ru_maxrss > own_peak_kb else (sampled_peak_kb or None),
+        'load_us': None,
+        'query_us': None,
+    }
+    lines = output.split('\n')
+    if lines and lines[-1] == '':
+        lines.pop()
+    if lines:
+        match = MEASURE_RE.match(lines[0])
+        if match:
+            result['load_us'] = int(match.group(2))
+            result['query_us'] = int(match.group(3))
+            lines[0] = match.group(4)
+    result['answers'] = lines
+    return result
+
+
+def run_engine(name, binary, args, qtype, count):
+    env = dict(os.environ)
+    for entry in args.env:
+        engine, _, assignment = entry.partition(':')
+        if engine == name:
+            key, _, value = assignment.partition('=')
+            env[key] = value
+    best = None
+    for _ in range(args.runs):
+        result = run_once(binary, args.data, args.queries, qtype, env, args.timeout)
+        result['ok'] = result['exit_code'] == 0 and not result['timeout'] and len(result['answers']) == count
+        if best is None or (result['ok'], -(result['query_us'] or 0)) > (best['ok'], -(best['query_us'] or 0)):
+            best = result
+    if best['ok'] and best['query_us']:
+        best['queries_per_s'] = count / (best['query_us'] / 1e6)
+    else:
+        best['queries_per_s'] = None
+    return best
+
+
+def status_of(result, count):
+    if result['timeout']:
+        return 'timeout'
+    if result['exit_code'] != 0:
+        return 'exit %d' % result['exit_code']
+    if len(result['answers']) != count:
+        return '%d/%d answers' % (len(result['answers']), count)
+    if result['query_us'] is None:
+        return 'no timing'
+    return 'ok'
+
+
+def fmt(value, scale=1.0, digits=1):
+    return '-' if value is None else '%.*f' % (digits, value / scale)
+
+
+def main():
+    args = get_args()
+    binaries = {'awfy': args.awfy, 'blxlrsmb': args.blxlrsmb}
+    for name, binary in binaries.items():
+        if not os.access(binary, os.X_OK):
+            sys.exit('%s binary not found: %s' % (name, binary))
+    queries = read_queries(args.queries)
+    types = [int(t) for t in args.types.split(',')] if args.types else sorted(queries)
+
+    report = {'data': os.path.abspath(args.data), 'queries': os.path.abspath(args.queries),
+              'binaries': binaries, 'types': []}
+    rows = []
+    for qtype in types:
+        count = len(queries.get(qtype, []))
+        if count == 0:
+            continue
+        results = {}
+        for name in ('awfy', 'blxlrsmb'):
+            print('running %s on %d query%d entries...' % (name, count, qtype), file=sys.stderr)
+            results[name] = run_engine(name, binaries[name], args, qtype, count)
+
+        # Answers are compared by position, both solutions print them in file order
+        mismatches = []
+        a, b = results['awfy']['answers'], results['blxlrsmb']['answers']
+        for i in range(min(len(a), len(b), count)):
+            if a[i].strip() != b[i].strip():
+                mismatches.append({'index': i, 'query': queries[qtype][i], 'awfy': a[i], 'blxlrsmb': b[i]})
+
+        entry = {'type': qtype, 'queries': count, 'compared': min(len(a), len(b), count),
+                 'mismatches': len(mismatches), 'mismatch_details': mismatches, 'engines': {}}
+        for name, result in results.items():
+            entry['engines'][name] = {key: result[key] for key in
+                                      ('exit_code', 'timeout', 'wall_s', 'peak_rss_kb', 'load_us', 'query_us',
+                                       'queries_per_s')}
+            entry['engines'][name]['status'] = status_of(result, count)
+            entry['engines'][name]['answers'] = len(result['answers'])
+        timed = [n for n in results if entry['engines'][n]['status'] == 'ok']
+        entry['faster'] = min(timed, key=lambda n: results[n]['query_us']) if len(timed) == 2 else None
+        report['types'].append(entry)
+
+        for name in ('awfy', 'blxlrsmb'):
+            e = entry['engines'][name]
+            rows.append(['q%d' % qtype, str(count), name, fmt(e['load_us'], 1e3), fmt(e['query_us'], 1e3),
+                         fmt(e['queries_per_s']), fmt(e['peak_rss_kb'], 1024), fmt(e['wall_s'], 1, 2), e['status'],
+                         '%d/%d' % (entry['mismatches'], entry['compared'])])
+        if mismatches:
+            print('q%d: %d of %d answers differ' % (qtype, len(mismatches), entry['compared']))
+            for m in mismatches[:args.show]:
+                print('  %s\n    awfy:     %s\n    blxlrsmb: %s' % (m['query'], m['awfy'], m['blxlrsmb']))
+
+    header = ['type', 'queries', 'engine', 'load ms', 'query ms', 'queries/s', 'peak MB', 'wall s', 'status',
+              'mismatch']
+    widths = [max(len(r[i]) for r in rows + [header]) for i in range(len(header))]
+    print()
+    for row in [header] + rows:
+        print('  '.join(cell.rjust(width) if i in (1, 3, 4, 5, 6, 7) else cell.ljust(width)
+                        for i, (cell, width) in enumerate(zip(row, widths))).rstrip())
+    for entry in report['types']:
+        if entry['faster']:
+            times = sorted(e['query_us'] for e in entry['engines'].values())
+            print('q%d: %s is faster (%.2fx)' % (entry['type'], entry['faster'], times[1] / max(times[0], 1)))
+
+    if args.json:
+        if args.json == '-':
+            json.dump(report, sys.stdout, indent=2)
+            print()
+        else:
+            with open(args.json, 'w') as f:
+                json.dump(report, f, indent=2)
+    failed = any(entry['mismatches'] or any(e['status'] != 'ok' for e in entry['engines'].values())
+                 for entry in report['types'])
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())